@@ -0,0 +1,68 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "../src/scene/bvh/bvh_builder.hpp"
+
+// Deterministic pseudo random generator so every run uses the same data
+struct BenchRng {
+    uint32_t state;
+
+    explicit BenchRng(uint32_t seed = 1): state(seed) {}
+
+    uint32_t next() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+    float uniform() { return (next() >> 8) * (1.0f / 16777216.0f); }
+};
+
+// Bounds of `count` small triangles scattered over a few clusters, similar to a detailed scanned mesh
+inline std::vector<BvhPrimitiveBounds> makeTriangleBounds(size_t count, uint32_t seed = 1) {
+    BenchRng rng(seed);
+    std::vector<glm::vec3> clusters(16);
+    for (glm::vec3 &c : clusters) {
+        c = glm::vec3(rng.uniform(), rng.uniform(), rng.uniform()) * 20.0f - 10.0f;
+    }
+
+    std::vector<BvhPrimitiveBounds> bounds(count);
+    for (size_t i = 0; i < count; i++) {
+        const glm::vec3 center = clusters[rng.next() % clusters.size()];
+        const glm::vec3 v0 = center + (glm::vec3(rng.uniform(), rng.uniform(), rng.uniform()) - 0.5f) * 4.0f;
+        const glm::vec3 v1 = v0 + (glm::vec3(rng.uniform(), rng.uniform(), rng.uniform()) - 0.5f) * 0.05f;
+        const glm::vec3 v2 = v0 + (glm::vec3(rng.uniform(), rng.uniform(), rng.uniform()) - 0.5f) * 0.05f;
+        const glm::vec3 mn = glm::min(v0, glm::min(v1, v2));
+        const glm::vec3 mx = glm::max(v0, glm::max(v1, v2));
+        bounds[i] = { mn, mx, (mn + mx) * 0.5f };
+    }
+    return bounds;
+}
+
+// Runs `fn` `iterations` times and returns the duration of each run in milliseconds, sorted
+inline std::vector<double> timeRuns(int iterations, const std::function<void()> &fn) {
+    std::vector<double> times;
+    times.reserve(iterations);
+    for (int i = 0; i < iterations; i++) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        auto end = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    return times;
+}
+
+inline double percentile(const std::vector<double> &sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    size_t index = static_cast<size_t>(std::round(p * (sorted.size() - 1)));
+    return sorted[std::min(index, sorted.size() - 1)];
+}
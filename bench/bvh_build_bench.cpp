@@ -0,0 +1,63 @@
+// Mesh BVH build time against the number of threads
+// usage: bvh_build_bench [triangle count] [iterations]
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+#include "bench_utils.hpp"
+
+static bool sameBvh(const std::vector<GpuBvhNode> &a, const std::vector<GpuBvhNode> &b) {
+    if (a.size() != b.size()) return false;
+    // Compared field by field, the padding of the nodes is left uninitialized
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].aabbMin != b[i].aabbMin || a[i].aabbMax != b[i].aabbMax ||
+            a[i].data0 != b[i].data0 || a[i].data1 != b[i].data1 || a[i].isLeaf != b[i].isLeaf)
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const size_t triangleCount = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    const int iterations = argc > 2 ? std::atoi(argv[2]) : 5;
+    const std::vector<BvhPrimitiveBounds> bounds = makeTriangleBounds(triangleCount);
+
+    std::cout << "[INFO] " << triangleCount << " triangles, " << iterations << " iterations, "
+              << std::thread::hardware_concurrency() << " hardware threads" << std::endl;
+
+    for (BvhBuilderType builder : { BvhBuilderType::Median, BvhBuilderType::BinnedSah }) {
+        std::cout << (builder == BvhBuilderType::Median ? "Median" : "Binned SAH") << std::endl;
+        std::cout << "  threads    median ms       min ms    speedup" << std::endl;
+
+        std::vector<GpuBvhNode> reference;
+        std::vector<uint32_t> referenceOrder;
+        double serialMedian = 0.0;
+
+        for (int threads : { 1, 2, 4, 8, 16 }) {
+            BvhBuildSettings settings;
+            settings.builder = builder;
+            settings.threadCount = threads;
+
+            std::vector<GpuBvhNode> nodes;
+            std::vector<uint32_t> order;
+            std::vector<double> times = timeRuns(iterations, [&]() {
+                buildBvh(bounds, settings, nodes, order);
+            });
+
+            if (threads == 1) {
+                reference = nodes;
+                referenceOrder = order;
+                serialMedian = percentile(times, 0.5);
+            } else if (!sameBvh(nodes, reference) || order != referenceOrder) {
+                std::cerr << "[ERROR] The BVH built with " << threads << " threads differs from the serial one" << std::endl;
+                return 1;
+            }
+
+            std::printf("  %7d %12.2f %12.2f %9.2fx\n", threads, percentile(times, 0.5), times.front(), serialMedian / percentile(times, 0.5));
+        }
+    }
+
+    return 0;
+}
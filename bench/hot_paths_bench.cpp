@@ -0,0 +1,289 @@
+// CPU paths run from the interactive loop, each in isolation on synthetic inputs of increasing size:
+// `Scene::fillBuffers`, the mesh BVH build, `Scene::pushMeshFromObj`, `Scene::raycast` and the PNG encoding
+// of `Application::saveScreenshotBuffer`. Reports the time, the measured allocations and an estimate of the bytes touched.
+// usage: hot_paths_bench [iterations] [max triangle count]
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+
+#include "bench_utils.hpp"
+#include "../src/camera.hpp"
+#include "../src/scene/scene.hpp"
+#include "../src/utils/image.hpp"
+
+// ================ ALLOCATION COUNTING ================
+// Every allocation of the process goes through these, counted from every thread
+static std::atomic<uint64_t> allocationCount = 0;
+static std::atomic<uint64_t> allocatedBytes = 0;
+
+static void *countedAlloc(size_t size, size_t alignment) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    size = std::max<size_t>(size, 1);
+    void *p = alignment <= alignof(std::max_align_t) ? std::malloc(size) : std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void *operator new(size_t size) { return countedAlloc(size, 0); }
+void *operator new[](size_t size) { return countedAlloc(size, 0); }
+void *operator new(size_t size, std::align_val_t alignment) { return countedAlloc(size, static_cast<size_t>(alignment)); }
+void *operator new[](size_t size, std::align_val_t alignment) { return countedAlloc(size, static_cast<size_t>(alignment)); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t, std::align_val_t) noexcept { std::free(p); }
+
+// ================ MEASURE ================
+struct CaseResult {
+    double medianMs;
+    double minMs;
+    double allocations;     // Per run
+    double allocatedBytes;  // Per run
+};
+
+// `setup` runs before each measured call of `fn` and isn't counted
+template<typename SetupFn, typename Fn>
+static CaseResult measure(int iterations, SetupFn &&setup, Fn &&fn) {
+    std::vector<double> times;
+    uint64_t allocations = 0, bytes = 0;
+    for (int i = 0; i < iterations; i++) {
+        setup();
+        const uint64_t countBefore = allocationCount.load(), bytesBefore = allocatedBytes.load();
+        times.push_back(timeRuns(1, fn).front());
+        allocations += allocationCount.load() - countBefore;
+        bytes += allocatedBytes.load() - bytesBefore;
+    }
+    std::sort(times.begin(), times.end());
+    return { percentile(times, 0.5), times.front(), static_cast<double>(allocations) / iterations, static_cast<double>(bytes) / iterations };
+}
+
+// `touchedBytes` is an estimate of the data read and written by one run, not a measure: each case adds the sizes of
+// the arrays it knows the path reads to the bytes it allocated, which are taken as written once
+static void printCase(const std::string &name, const CaseResult &result, double touchedBytes) {
+    std::printf("  %-22s %10.3f %10.3f %12.1f %12.2f %12.2f\n", name.c_str(), result.medianMs, result.minMs,
+                result.allocations, result.allocatedBytes / (1024.0 * 1024.0), touchedBytes / (1024.0 * 1024.0));
+}
+
+static void printHeader(const char *title) {
+    std::printf("%s\n  %-22s %10s %10s %12s %12s %12s\n", title, "input", "median ms", "min ms", "allocs", "alloc MiB", "est. MiB");
+}
+
+// ================ INPUTS ================
+// Wavy grid of about `triangleCount` triangles
+static void makeGridMesh(size_t triangleCount, std::vector<Vertex> &vertices, std::vector<unsigned int> &indices) {
+    const uint32_t side = std::max<uint32_t>(1, static_cast<uint32_t>(std::sqrt(triangleCount / 2.0)));
+    vertices.clear();
+    indices.clear();
+    vertices.reserve(static_cast<size_t>(side + 1) * (side + 1));
+    indices.reserve(static_cast<size_t>(side) * side * 6);
+    for (uint32_t y = 0; y <= side; y++) {
+        for (uint32_t x = 0; x <= side; x++) {
+            const float u = static_cast<float>(x) / side, v = static_cast<float>(y) / side;
+            vertices.push_back({ glm::vec3(u * 10.0f - 5.0f, 0.3f * std::sin(u * 40.0f) * std::cos(v * 40.0f), v * 10.0f - 5.0f) });
+        }
+    }
+    for (uint32_t y = 0; y < side; y++) {
+        for (uint32_t x = 0; x < side; x++) {
+            const unsigned int i0 = y * (side + 1) + x;
+            const unsigned int i1 = i0 + side + 1;
+            indices.insert(indices.end(), { i0, i1, i0 + 1, i0 + 1, i1, i1 + 1 });
+        }
+    }
+}
+
+static size_t geometryBytes(const MeshGeometry &geometry) {
+    return geometry.getVertices().size() * sizeof(Vertex) + geometry.getIndices().size() * sizeof(uint32_t)
+         + geometry.getBvhNodes().size() * sizeof(GpuBvhNode);
+}
+
+// Top-level BVH nodes and object indices, built by `fillBuffers` then copied to the staging arrays
+static size_t tlasBytes(const Scene &scene) {
+    return scene.getTlasNodes().size() * sizeof(GpuBvhNode) + scene.getTlasObjectIds().size() * sizeof(uint32_t);
+}
+
+static const Material BENCH_MATERIAL = { .type=MaterialType::Lambertian, .albedo={ 0.8f, 0.8f, 0.8f }, .payload={ 0.0f, 0.0f } };
+
+static void pushSpheres(VkSmol &engine, Scene &scene, size_t count) {
+    BenchRng rng;
+    for (size_t i = 0; i < count; i++) {
+        const glm::vec3 center = (glm::vec3(rng.uniform(), rng.uniform(), rng.uniform()) - 0.5f) * 40.0f;
+        scene.pushSphere(engine, "Sphere" + std::to_string(i), center, 0.2f + rng.uniform() * 0.5f, BENCH_MATERIAL);
+    }
+}
+
+static std::string formatCount(size_t count, const char *unit) {
+    if (count >= 1000000) return std::to_string(count / 1000000) + "M " + unit;
+    if (count >= 1000) return std::to_string(count / 1000) + "k " + unit;
+    return std::to_string(count) + " " + unit;
+}
+
+// ================ CASES ================
+static void benchFillBuffers(VkSmol &engine, int iterations, const std::vector<size_t> &triangleCounts) {
+    printHeader("Scene::fillBuffers (headless, without the upload)");
+    for (size_t sphereCount : { 100, 1000, 10000 }) {
+        Scene scene;
+        scene.init(engine, true);
+        pushSpheres(engine, scene, sphereCount);
+        scene.fillBuffers(engine);     // Grows the buffers once, like the first frame
+        const CaseResult result = measure(iterations, []() {}, [&]() { scene.fillBuffers(engine); });
+        // Every object is read, then the staging arrays and the TLAS are written
+        printCase(formatCount(sphereCount, "spheres"), result,
+                  sphereCount * sizeof(Sphere) + result.allocatedBytes + 2.0 * tlasBytes(scene));
+        scene.destroy(engine);
+    }
+    for (size_t triangleCount : triangleCounts) {
+        Scene scene;
+        scene.init(engine, true);
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> indices;
+        makeGridMesh(triangleCount, vertices, indices);
+        scene.pushMesh(engine, "Grid", std::move(vertices), std::move(indices), glm::mat4(1.0f), BENCH_MATERIAL);
+        scene.fillBuffers(engine);
+        const CaseResult result = measure(iterations, []() {}, [&]() { scene.fillBuffers(engine); });
+        const Mesh *mesh = static_cast<const Mesh*>(scene.getObjects().front());
+        printCase(formatCount(triangleCount, "triangles"), result,
+                  geometryBytes(*mesh->getGeometry()) + result.allocatedBytes + 2.0 * tlasBytes(scene));
+        scene.destroy(engine);
+    }
+}
+
+static void benchBuildBvh(int iterations, const std::vector<size_t> &triangleCounts) {
+    printHeader("Mesh BVH build (MeshGeometry construction)");
+    for (size_t triangleCount : triangleCounts) {
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> indices;
+        makeGridMesh(triangleCount, vertices, indices);
+
+        std::vector<Vertex> vertexCopy;
+        std::vector<unsigned int> indexCopy;
+        std::unique_ptr<MeshGeometry> geometry;
+        const CaseResult result = measure(iterations, [&]() {
+            geometry.reset();
+            vertexCopy = vertices;
+            indexCopy = indices;
+        }, [&]() {
+            geometry = std::make_unique<MeshGeometry>(std::move(vertexCopy), std::move(indexCopy));
+        });
+        // Vertices and indices read, the reordered indices, the nodes and the build arrays written
+        printCase(formatCount(triangleCount, "triangles"), result,
+                  (vertices.size() * sizeof(Vertex) + indices.size() * sizeof(uint32_t)) + result.allocatedBytes);
+    }
+}
+
+static void benchPushMeshFromObj(VkSmol &engine, int iterations, const std::vector<size_t> &triangleCounts) {
+    printHeader("Scene::pushMeshFromObj (mesh cache off, BVH build included)");
+    const std::filesystem::path directory = std::filesystem::temp_directory_path();
+    for (size_t triangleCount : triangleCounts) {
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> indices;
+        makeGridMesh(triangleCount, vertices, indices);
+
+        const std::string path = (directory / ("hot_paths_bench_" + std::to_string(triangleCount) + ".obj")).string();
+        {
+            std::ofstream file(path);
+            for (const Vertex &v : vertices) file << "v " << v.position.x << " " << v.position.y << " " << v.position.z << "\n";
+            for (size_t i = 0; i + 2 < indices.size(); i += 3)
+                file << "f " << indices[i] + 1 << " " << indices[i + 1] + 1 << " " << indices[i + 2] + 1 << "\n";
+        }
+        const size_t fileBytes = std::filesystem::file_size(path);
+
+        Scene scene;
+        scene.init(engine, true);
+        scene.setMeshCacheEnabled(false);
+        bool loaded = true;
+        const CaseResult result = measure(iterations, [&]() { scene.clear(engine); }, [&]() {
+            loaded = loaded && scene.pushMeshFromObj(engine, "Grid", path, BENCH_MATERIAL);
+        });
+        if (!loaded) {
+            std::cerr << "[ERROR] Failed to load " << path << std::endl;
+        } else {
+            // The file is read, the parsed arrays, the geometry and the TLAS written
+            printCase(formatCount(triangleCount, "triangles"), result, fileBytes + result.allocatedBytes + 2.0 * tlasBytes(scene));
+        }
+        scene.destroy(engine);
+        std::filesystem::remove(path);
+    }
+}
+
+static void benchRaycast(VkSmol &engine, int iterations) {
+    printHeader("Scene::raycast (1000 clicks per run)");
+    const glm::vec2 screenSize(1280.0f, 720.0f);
+    const Camera camera(glm::vec3(0.0f, 0.0f, -60.0f));
+    for (size_t sphereCount : { 100, 1000, 10000 }) {
+        Scene scene;
+        scene.init(engine, true);
+        pushSpheres(engine, scene, sphereCount);
+
+        BenchRng rng;
+        std::vector<glm::vec2> clicks(1000);
+        for (glm::vec2 &click : clicks) click = glm::vec2(rng.uniform(), rng.uniform()) * screenSize;
+
+        size_t hits = 0;
+        const CaseResult result = measure(iterations, []() {}, [&]() {
+            for (const glm::vec2 &click : clicks) {
+                float dist;
+                glm::vec3 p;
+                hits += scene.raycast(click, screenSize, camera, dist, p) ? 1 : 0;
+            }
+        });
+        // Every object is tested by every click, the picking loop doesn't go through the TLAS
+        printCase(formatCount(sphereCount, "spheres"), result, static_cast<double>(clicks.size() * sphereCount * sizeof(Sphere)));
+        if (hits == 0) std::cerr << "[WARN] No click hit an object" << std::endl;
+        scene.destroy(engine);
+    }
+}
+
+static void benchScreenshot(int iterations) {
+    printHeader("saveScreenshotBuffer PNG encoding (without the GPU readback)");
+    const std::string path = (std::filesystem::temp_directory_path() / "hot_paths_bench.png").string();
+    const uint32_t sizes[][2] = { { 640, 360 }, { 1280, 720 }, { 1920, 1080 }, { 3840, 2160 } };
+    for (const auto &size : sizes) {
+        // Smooth gradient with noise, closer to a render than a flat image for the compressor
+        BenchRng rng;
+        std::vector<float> pixels(static_cast<size_t>(size[0]) * size[1] * 4);
+        for (size_t i = 0; i < pixels.size(); i++) pixels[i] = static_cast<float>(i % 4096) / 4096.0f * 0.8f + rng.uniform() * 0.2f;
+
+        bool written = true;
+        const CaseResult result = measure(iterations, []() {}, [&]() {
+            written = written && writePngFromFloats(path, size[0], size[1], pixels.data());
+        });
+        if (!written) {
+            std::cerr << "[ERROR] Failed to write " << path << std::endl;
+            continue;
+        }
+        // The floats are read, the 8 bit rows, the compressed data and the file written
+        printCase(std::to_string(size[0]) + "x" + std::to_string(size[1]), result,
+                  pixels.size() * sizeof(float) + result.allocatedBytes + static_cast<double>(std::filesystem::file_size(path)));
+    }
+    std::filesystem::remove(path);
+}
+
+int main(int argc, char **argv) {
+    const int iterations = argc > 1 ? std::max(1, std::atoi(argv[1])) : 5;
+    const size_t maxTriangles = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000000;
+
+    std::vector<size_t> triangleCounts;
+    for (size_t count = 10000; count <= maxTriangles; count *= 10) triangleCounts.push_back(count);
+
+    std::cout << "[INFO] " << iterations << " iterations, meshes up to " << maxTriangles << " triangles" << std::endl;
+
+    // The engine is never initialized, every scene is headless
+    VkSmol engine;
+    benchFillBuffers(engine, iterations, triangleCounts);
+    benchBuildBvh(iterations, triangleCounts);
+    benchPushMeshFromObj(engine, iterations, triangleCounts);
+    benchRaycast(engine, iterations);
+    benchScreenshot(iterations);
+    return 0;
+}
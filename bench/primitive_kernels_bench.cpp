@@ -0,0 +1,195 @@
+// One ray against many primitives: scalar object queries against the SoA kernels of every available width
+// usage: primitive_kernels_bench [primitive count] [ray count] [iterations]
+
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "bench_utils.hpp"
+#include "../src/cpu/primitive_kernels.hpp"
+#include "../src/scene/object/mesh_geometry.hpp"
+#include "../src/scene/object/sphere.hpp"
+
+// Closest hit of a ray, as the distance and the index of the primitive
+typedef std::function<float(const Ray&, uint32_t&)> ClosestHitFn;
+
+struct KernelResult {
+    double mraysPerSecond;
+    size_t mismatches;
+};
+
+static KernelResult runKernel(const std::vector<Ray> &rays, int iterations, const ClosestHitFn &fn, const std::vector<float> *reference, std::vector<float> *hits) {
+    std::vector<float> results(rays.size());
+    std::vector<double> times = timeRuns(iterations, [&]() {
+        for (size_t i = 0; i < rays.size(); i++) {
+            uint32_t index = 0;
+            results[i] = fn(rays[i], index);
+        }
+    });
+
+    size_t mismatches = 0;
+    if (reference) {
+        for (size_t i = 0; i < rays.size(); i++) {
+            const float expected = (*reference)[i];
+            if ((expected < 0.0f) != (results[i] < 0.0f) || std::abs(expected - results[i]) > 1e-3f * std::max(1.0f, expected))
+                mismatches++;
+        }
+    }
+    if (hits) *hits = results;
+    return { rays.size() / (percentile(times, 0.5) * 1e3), mismatches };
+}
+
+static void printResult(const char *name, const KernelResult &result, double scalarRate) {
+    std::printf("  %-10s %10.2f Mrays/s %8.2fx   %zu mismatches\n", name, result.mraysPerSecond, result.mraysPerSecond / scalarRate, result.mismatches);
+}
+
+// `Box::rayIntersection` with the inverse transform computed once, like the boxes of the SoA
+static float rayUnitBoxIntersection(const glm::mat4 &invTransform, const Ray &ray) {
+    const glm::vec3 localOrigin = glm::vec3(invTransform * glm::vec4(ray.origin, 1.0f));
+    const glm::vec3 localDir = glm::vec3(invTransform * glm::vec4(ray.dir, 0.0f));
+
+    float tmin = -std::numeric_limits<float>::infinity();
+    float tmax = std::numeric_limits<float>::infinity();
+    for (int i = 0; i < 3; ++i) {
+        if (std::abs(localDir[i]) < 1e-8f) {
+            if (localOrigin[i] < -1.0f || localOrigin[i] > 1.0f) return -1.0f;
+            continue;
+        }
+
+        const float invD = 1.0f / localDir[i];
+        float t0 = (-1.0f - localOrigin[i]) * invD;
+        float t1 = ( 1.0f - localOrigin[i]) * invD;
+        if (invD < 0.0f) std::swap(t0, t1);
+
+        if (t0 > tmin) tmin = t0;
+        if (t1 < tmax) tmax = t1;
+        if (tmax < tmin) return -1.0f;
+    }
+
+    if (tmax < 0.0f) return -1.0f;
+    return tmin >= 0.0f ? tmin : tmax;
+}
+
+template<typename Soa>
+using KernelFn = float (*)(const Soa&, const Ray&, float, uint32_t&);
+
+// Grazing rays may flip between hit and miss with the evaluation order of the floating point operations
+static bool acceptable(const KernelResult &result, size_t rayCount) {
+    return result.mismatches <= rayCount / 10000;
+}
+
+template<typename Soa>
+static bool benchKernel(const char *title, const std::vector<Ray> &rays, int iterations, const ClosestHitFn &scalar, const Soa &soa,
+                        std::type_identity_t<KernelFn<Soa>> kernel4, std::type_identity_t<KernelFn<Soa>> kernel8) {
+    const float tMax = std::numeric_limits<float>::infinity();
+    std::cout << title << std::endl;
+
+    std::vector<float> reference;
+    KernelResult scalarResult = runKernel(rays, iterations, scalar, nullptr, &reference);
+    printResult("scalar", scalarResult, scalarResult.mraysPerSecond);
+
+    KernelResult result4 = runKernel(rays, iterations, [&](const Ray &ray, uint32_t &index) { return kernel4(soa, ray, tMax, index); }, &reference, nullptr);
+    printResult("4 wide", result4, scalarResult.mraysPerSecond);
+    bool valid = acceptable(result4, rays.size());
+
+    if (kernel8) {
+        KernelResult result8 = runKernel(rays, iterations, [&](const Ray &ray, uint32_t &index) { return kernel8(soa, ray, tMax, index); }, &reference, nullptr);
+        printResult("8 wide", result8, scalarResult.mraysPerSecond);
+        valid = valid && acceptable(result8, rays.size());
+    }
+    return valid;
+}
+
+int main(int argc, char **argv) {
+    const size_t primitiveCount = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 64;
+    const size_t rayCount = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100000;
+    const int iterations = argc > 3 ? std::atoi(argv[3]) : 5;
+
+    std::cout << "[INFO] " << primitiveCount << " primitives, " << rayCount << " rays, " << iterations << " iterations, "
+              << simdInstructionSet() << std::endl;
+
+    // Primitives in a 20 units cube, rays from the outside towards it so about half of them hit something
+    BenchRng rng;
+    auto randomPoint = [&](float extent) {
+        return (glm::vec3(rng.uniform(), rng.uniform(), rng.uniform()) - 0.5f) * extent;
+    };
+
+    std::vector<Ray> rays(rayCount);
+    for (Ray &ray : rays) {
+        ray.origin = glm::normalize(randomPoint(2.0f)) * 40.0f;
+        ray.dir = glm::normalize(randomPoint(20.0f) - ray.origin);
+    }
+
+    std::vector<std::unique_ptr<Sphere>> sphereObjects;
+    std::vector<glm::mat4> boxInverses;
+    std::vector<GpuTriangle> triangleRecords;
+    SphereSoA spheres;
+    BoxSoA boxes;
+    TriangleSoA triangles;
+    for (size_t i = 0; i < primitiveCount; i++) {
+        const glm::vec3 center = randomPoint(20.0f);
+        const float radius = 0.2f + rng.uniform() * 0.8f;
+        sphereObjects.push_back(std::make_unique<Sphere>("Sphere", center, radius, 0));
+        spheres.push(center, radius);
+
+        glm::mat4 transform = glm::translate(glm::mat4(1.0f), randomPoint(20.0f));
+        transform = glm::rotate(transform, rng.uniform() * 6.28f, glm::normalize(randomPoint(2.0f) + glm::vec3(0.0f, 0.01f, 0.0f)));
+        transform = glm::scale(transform, glm::vec3(0.2f) + glm::vec3(rng.uniform(), rng.uniform(), rng.uniform()));
+        boxInverses.push_back(glm::inverse(transform));
+        boxes.push(boxInverses.back());
+
+        const glm::vec3 v0 = randomPoint(20.0f);
+        const glm::vec3 v1 = v0 + randomPoint(4.0f);
+        const glm::vec3 v2 = v0 + randomPoint(4.0f);
+        triangleRecords.push_back({ v0, v1 - v0, v2 - v0 });
+        triangles.push(v0, v1, v2);
+    }
+
+    // Scalar references: the sphere query used for picking, the box slab test on the same inverses as the SoA
+    // and the triangle test of the mesh traversal
+    auto closestOf = [primitiveCount](uint32_t &index, auto &&intersect) {
+        float tClosest = -1.0f;
+        for (size_t i = 0; i < primitiveCount; i++) {
+            const float t = intersect(i);
+            if (t >= 0.0f && (tClosest < 0.0f || t < tClosest)) {
+                tClosest = t;
+                index = static_cast<uint32_t>(i);
+            }
+        }
+        return tClosest;
+    };
+    ClosestHitFn scalarSpheres = [&](const Ray &ray, uint32_t &index) {
+        return closestOf(index, [&](size_t i) { return sphereObjects[i]->rayIntersection(ray); });
+    };
+    ClosestHitFn scalarBoxes = [&](const Ray &ray, uint32_t &index) {
+        return closestOf(index, [&](size_t i) { return rayUnitBoxIntersection(boxInverses[i], ray); });
+    };
+    ClosestHitFn scalarTriangles = [&](const Ray &ray, uint32_t &index) {
+        return closestOf(index, [&](size_t i) {
+            return rayTriangleEdgeIntersection(ray, triangleRecords[i].v0, triangleRecords[i].e1, triangleRecords[i].e2);
+        });
+    };
+
+#if defined(SIMD_AVX2)
+    #define KERNEL8(kernel) kernel<Float8>
+#else
+    #define KERNEL8(kernel) nullptr
+#endif
+    bool valid = true;
+    valid &= benchKernel("Spheres", rays, iterations, scalarSpheres, spheres, raySpheresIntersection<Float4>, KERNEL8(raySpheresIntersection));
+    valid &= benchKernel("Oriented boxes", rays, iterations, scalarBoxes, boxes, rayBoxesIntersection<Float4>, KERNEL8(rayBoxesIntersection));
+    valid &= benchKernel("Triangles", rays, iterations, scalarTriangles, triangles, rayTrianglesIntersection<Float4>, KERNEL8(rayTrianglesIntersection));
+
+    if (!valid) {
+        std::cerr << "[ERROR] A kernel disagrees with the scalar intersection" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+// First hit of the primary rays of a preset, traced one by one and in packets of 4x4 pixels
+// usage: ray_packet_bench [empty|cornell|spheres] [obj path or -] [aperture] [iterations]
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "bench_utils.hpp"
+#include "../src/cpu/cpu_random.hpp"
+#include "../src/cpu/cpu_scene.hpp"
+#include "../src/scene/scene_preset.hpp"
+
+#define WIDTH 1280
+#define HEIGHT 720
+#define PACKET_SIDE 4
+
+// Rays of the default camera of `CpuRenderParams`, pixels in packet order
+static std::vector<Ray> makePrimaryRays(float aperture) {
+    const glm::vec3 origin = glm::vec3(0.0f, 0.0f, -10.0f);
+    const float tanHFov = 0.8390996f;
+    const float focusDepth = 10.0f;
+    const float aspect = static_cast<float>(WIDTH) / static_cast<float>(HEIGHT);
+
+    std::vector<Ray> rays;
+    rays.reserve(WIDTH * HEIGHT);
+    for (uint32_t blockY = 0; blockY < HEIGHT; blockY += PACKET_SIDE) {
+        for (uint32_t blockX = 0; blockX < WIDTH; blockX += PACKET_SIDE) {
+            for (uint32_t y = blockY; y < blockY + PACKET_SIDE; y++) {
+                for (uint32_t x = blockX; x < blockX + PACKET_SIDE; x++) {
+                    uint32_t seed = initSeed(x, y, 1);
+                    const float camX = ((x + 0.5f) / WIDTH * 2.0f - 1.0f) * aspect * tanHFov;
+                    const float camY = (1.0f - (y + 0.5f) / HEIGHT * 2.0f) * tanHFov;
+                    const glm::vec2 lens = randomInDisk(seed) * aperture * 0.5f;
+                    const glm::vec3 rayOrigin = origin + glm::vec3(-lens.x, lens.y, 0.0f);
+                    const glm::vec3 target = origin + glm::vec3(-camX, camY, 1.0f) * focusDepth;
+                    rays.push_back({ rayOrigin, glm::normalize(target - rayOrigin) });
+                }
+            }
+        }
+    }
+    return rays;
+}
+
+int main(int argc, char **argv) {
+    const std::string preset = argc > 1 ? argv[1] : "spheres";
+    const std::string objPath = argc > 2 && std::string(argv[2]) != "-" ? argv[2] : "";
+    const float aperture = argc > 3 ? std::strtof(argv[3], nullptr) : 0.0f;
+    const int iterations = argc > 4 ? std::atoi(argv[4]) : 5;
+
+    // The engine is never initialized, the scene is headless
+    VkSmol engine;
+    Scene scene;
+    scene.init(engine, true);
+    LightMode lightMode;
+    if (preset == "empty")        initEmpty(engine, scene, lightMode);
+    else if (preset == "cornell") initCornellBox(engine, scene, lightMode);
+    else if (preset == "spheres") initRandomSpheres(engine, scene, lightMode);
+    else {
+        std::cerr << "[ERROR] Unknown scene " << preset << std::endl;
+        return 1;
+    }
+    if (!objPath.empty()) {
+        const Material material = { .type=MaterialType::Lambertian, .albedo={ 1.0f, 1.0f, 1.0f }, .payload={ 0.0f, 0.0f } };
+        if (!scene.pushMeshFromObj(engine, objPath, objPath, material)) {
+            std::cerr << "[ERROR] Failed to load " << objPath << std::endl;
+            return 1;
+        }
+    }
+
+    CpuScene cpuScene;
+    cpuScene.pack(scene);
+    const std::vector<Ray> rays = makePrimaryRays(aperture);
+    std::cout << "[INFO] " << preset << (objPath.empty() ? "" : " + " + objPath) << ", " << rays.size() << " rays, aperture "
+              << aperture << ", " << iterations << " iterations" << std::endl;
+
+    std::vector<CpuHit> singleHits(rays.size()), packetHits(rays.size());
+    std::vector<double> singleTimes = timeRuns(iterations, [&]() {
+        for (size_t i = 0; i < rays.size(); i++) singleHits[i] = cpuScene.intersection(rays[i]);
+    });
+    std::vector<double> packetTimes = timeRuns(iterations, [&]() {
+        const uint32_t packetSize = PACKET_SIDE * PACKET_SIDE;
+        for (size_t i = 0; i < rays.size(); i += packetSize)
+            cpuScene.intersectionPacket(&rays[i], packetSize, &packetHits[i]);
+    });
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < rays.size(); i++) {
+        const CpuHit &a = singleHits[i], &b = packetHits[i];
+        if (a.object.type != b.object.type || a.object.id != b.object.id || (a.found() && a.t != b.t)) mismatches++;
+    }
+
+    const double singleRate = rays.size() / (percentile(singleTimes, 0.5) * 1e3);
+    const double packetRate = rays.size() / (percentile(packetTimes, 0.5) * 1e3);
+    std::printf("  %-8s %10.2f Mrays/s\n", "single", singleRate);
+    std::printf("  %-8s %10.2f Mrays/s %8.2fx   %zu mismatches\n", "packets", packetRate, packetRate / singleRate, mismatches);
+
+    scene.destroy(engine);
+    if (mismatches != 0) {
+        std::cerr << "[ERROR] Packets and single rays disagree" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,404 @@
+// Throughput of the CPU path tracer on fixed scenes, cameras, seeds and bounce counts.
+// Every scene renders a few warmup frames then the measured ones, the results are written as JSON.
+// With --wavefront every scene is also rendered by the wavefront GPU pipeline with the hits sorted by material and
+// unsorted, reporting the material branches per shading workgroup that the sorting removes.
+// usage: render_bench [--scenes a,b,...] [--size WxH] [--warmup N] [--frames N] [--bounces N] [--threads N]
+//                     [--no-packets] [--wavefront] [--device N] [--output PATH]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "bench_utils.hpp"
+#include "../src/cpu/cpu_renderer.hpp"
+#include "../src/gpu/headless_renderer.hpp"
+#include "../src/scene/scene_preset.hpp"
+#include "../src/utils/parallel.hpp"
+#include "../src/utils/simd.hpp"
+
+struct BenchScene {
+    const char *name;
+    void (*load)(VkSmol &engine, Scene &scene, LightMode &lightMode);
+    glm::vec3 cameraPos;
+    glm::vec3 cameraTarget;
+};
+
+struct BenchOptions {
+    std::vector<std::string> scenes;    // Empty runs every scene
+    uint32_t width = 640;
+    uint32_t height = 360;
+    int warmupFrames = 2;
+    int frames = 16;
+    int maxBounces = 8;
+    int threadCount = 0;
+    bool rayPackets = true;
+    bool wavefront = false;
+    int deviceIndex = -1;
+    std::string output = "render_bench.json";
+};
+
+// One run of the wavefront pipeline
+struct WavefrontResult {
+    bool sortHits;
+    double samplesPerSecond;
+    double p50Ms;
+    double gpuP50Ms;                // Negative when the queue has no timestamps
+    double shadeBranchesPerGroup;   // 1 when no shading workgroup diverges
+};
+
+struct BenchResult {
+    std::string scene;
+    size_t objectCount;
+    double loadMs;
+    double samplesPerSecond;
+    double raysPerSecond;
+    double msPerFrame;
+    double p50Ms;
+    double p99Ms;
+    std::vector<WavefrontResult> wavefront;     // Sorted then unsorted, empty without --wavefront
+};
+
+// ================ SCENES ================
+static Material randomMaterial(BenchRng &rng) {
+    Material mat = {};
+    mat.albedo = { rng.uniform(), rng.uniform(), rng.uniform() };
+    const float r = rng.uniform();
+    if (r <= 0.25f) {
+        mat.type = MaterialType::Lambertian;
+    } else if (r <= 0.50f) {
+        mat.type = MaterialType::Dielectric;
+        dielectricIoR(mat) = 1.5f;
+    } else if (r <= 0.75f) {
+        mat.type = MaterialType::Metal;
+        metalFuzz(mat) = rng.uniform();
+    } else {
+        mat.type = MaterialType::Glossy;
+        glossyIoR(mat) = 1.5f;
+        glossyFuzz(mat) = 0.0f;
+    }
+    return mat;
+}
+
+// Floor and area light shared by the generated scenes
+static void pushStage(VkSmol &engine, Scene &scene, float lightHeight, float lightRadius) {
+    Material floorMat = {};
+    floorMat.type = MaterialType::Checkerboard;
+    checkerboardScale(floorMat) = 2.0f;
+    scene.pushPlane(engine, "Floor", glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), floorMat);
+
+    Material lightMat = {};
+    lightMat.type = MaterialType::Emissive;
+    lightMat.albedo = { 1.0f, 1.0f, 1.0f };
+    emissiveIntensity(lightMat) = 15.0f;
+    scene.pushSphere(engine, "Light", glm::vec3(0.0f, lightHeight, 0.0f), lightRadius, lightMat);
+}
+
+// `count` spheres jittered on a square grid of the same density whatever the count
+static void loadSphereField(VkSmol &engine, Scene &scene, LightMode &lightMode, uint32_t count) {
+    scene.clear(engine);
+    lightMode = LightMode::Sunset;
+
+    const uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(count))));
+    const float spacing = 2.5f;
+    const float extent = side * spacing;
+    pushStage(engine, scene, extent * 0.5f, extent * 0.1f);
+
+    BenchRng rng(count);
+    for (uint32_t i = 0; i < count; i++) {
+        const float x = (static_cast<float>(i % side) + 0.5f) * spacing - extent * 0.5f;
+        const float z = (static_cast<float>(i / side) + 0.5f) * spacing - extent * 0.5f;
+        const float radius = 0.4f + rng.uniform() * 0.6f;
+        const glm::vec3 center(x + (rng.uniform() - 0.5f) * 0.5f, radius - 1.0f, z + (rng.uniform() - 0.5f) * 0.5f);
+        scene.pushSphere(engine, "Sphere" + std::to_string(i), center, radius, randomMaterial(rng));
+    }
+}
+
+// Bumpy sphere of `rings * segments * 2` triangles
+static void loadLargeMesh(VkSmol &engine, Scene &scene, LightMode &lightMode, uint32_t rings, uint32_t segments) {
+    scene.clear(engine);
+    lightMode = LightMode::Day;
+    pushStage(engine, scene, 12.0f, 2.0f);
+
+    std::vector<Vertex> vertices;
+    vertices.reserve(static_cast<size_t>(rings + 1) * (segments + 1));
+    for (uint32_t r = 0; r <= rings; r++) {
+        const float theta = static_cast<float>(r) / rings * 3.14159265f;
+        for (uint32_t s = 0; s <= segments; s++) {
+            const float phi = static_cast<float>(s) / segments * 6.28318531f;
+            const float radius = 1.0f + 0.05f * std::sin(theta * 24.0f) * std::sin(phi * 24.0f);
+            vertices.push_back({ radius * glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)) });
+        }
+    }
+
+    std::vector<unsigned int> indices;
+    indices.reserve(static_cast<size_t>(rings) * segments * 6);
+    for (uint32_t r = 0; r < rings; r++) {
+        for (uint32_t s = 0; s < segments; s++) {
+            const unsigned int i0 = r * (segments + 1) + s;
+            const unsigned int i1 = i0 + segments + 1;
+            indices.insert(indices.end(), { i0, i1, i0 + 1, i0 + 1, i1, i1 + 1 });
+        }
+    }
+
+    Material mat = {};
+    mat.type = MaterialType::Glossy;
+    mat.albedo = { 0.8f, 0.3f, 0.2f };
+    glossyIoR(mat) = 1.5f;
+    glossyFuzz(mat) = 0.1f;
+    const glm::mat4 transform = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 2.0f, 0.0f)), glm::vec3(3.0f));
+    scene.pushMesh(engine, "Mesh", std::move(vertices), std::move(indices), transform, mat);
+}
+
+static const BenchScene BENCH_SCENES[] = {
+    { "cornell", initCornellBox, glm::vec3(0.0f, 0.0f, -10.0f), glm::vec3(0.0f) },
+    { "spheres", [](VkSmol &engine, Scene &scene, LightMode &lightMode) { initRandomSpheres(engine, scene, lightMode, 1); },
+      glm::vec3(0.0f, 6.0f, -22.0f), glm::vec3(0.0f) },
+    { "spheres-1k", [](VkSmol &engine, Scene &scene, LightMode &lightMode) { loadSphereField(engine, scene, lightMode, 1000); },
+      glm::vec3(0.0f, 25.0f, -60.0f), glm::vec3(0.0f) },
+    { "spheres-10k", [](VkSmol &engine, Scene &scene, LightMode &lightMode) { loadSphereField(engine, scene, lightMode, 10000); },
+      glm::vec3(0.0f, 50.0f, -130.0f), glm::vec3(0.0f) },
+    { "spheres-100k", [](VkSmol &engine, Scene &scene, LightMode &lightMode) { loadSphereField(engine, scene, lightMode, 100000); },
+      glm::vec3(0.0f, 160.0f, -420.0f), glm::vec3(0.0f) },
+    { "mesh-1m", [](VkSmol &engine, Scene &scene, LightMode &lightMode) { loadLargeMesh(engine, scene, lightMode, 500, 1000); },
+      glm::vec3(0.0f, 4.0f, -12.0f), glm::vec3(0.0f, 2.0f, 0.0f) },
+};
+
+// ================ RUN ================
+static double elapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Same frames as the CPU, the counters and timings restart after the warmup
+static bool runWavefront(VkSmol &engine, Scene &scene, const CpuRenderParams &params, const BenchOptions &options, bool sortHits,
+                         WavefrontResult &result) {
+    HeadlessGpuRenderer renderer;
+    const HeadlessGpuOptions gpuOptions = { .deviceIndex=options.deviceIndex, .pipeline=HeadlessPipeline::Wavefront, .sortHits=sortHits };
+    if (!renderer.init(gpuOptions) || !renderer.setScene(engine, scene) || !renderer.setParams(params)) return false;
+    for (int i = 0; i < options.warmupFrames; i++) {
+        if (!renderer.renderFrame()) return false;
+    }
+    if (!renderer.setParams(params)) return false;
+    for (int i = 0; i < options.frames; i++) {
+        if (!renderer.renderFrame()) return false;
+    }
+
+    std::vector<double> wallMs, gpuMs;
+    double totalMs = 0.0;
+    for (const HeadlessFrameTiming &timing : renderer.getFrameTimings()) {
+        wallMs.push_back(timing.wallMs);
+        if (timing.gpuMs >= 0.0) gpuMs.push_back(timing.gpuMs);
+        totalMs += timing.wallMs;
+    }
+    std::sort(wallMs.begin(), wallMs.end());
+    std::sort(gpuMs.begin(), gpuMs.end());
+
+    result.sortHits = sortHits;
+    result.samplesPerSecond = static_cast<double>(options.width) * options.height * options.frames / (totalMs * 1e-3);
+    result.p50Ms = percentile(wallMs, 0.5);
+    result.gpuP50Ms = gpuMs.empty() ? -1.0 : percentile(gpuMs, 0.5);
+    result.shadeBranchesPerGroup = renderer.getShadeBranchesPerGroup();
+    return true;
+}
+
+static BenchResult runScene(VkSmol &engine, const BenchScene &benchScene, const BenchOptions &options) {
+    Scene scene;
+    scene.init(engine, true);
+    auto start = std::chrono::steady_clock::now();
+    LightMode lightMode = LightMode::Empty;
+    benchScene.load(engine, scene, lightMode);
+
+    CpuRenderParams params;
+    params.cameraPos = benchScene.cameraPos;
+    params.cameraDir = glm::normalize(benchScene.cameraTarget - benchScene.cameraPos);
+    params.width = options.width;
+    params.height = options.height;
+    params.lightMode = lightMode;
+    params.maxBounces = options.maxBounces;
+    params.samplesPerPixel = 1;
+    params.rayPackets = options.rayPackets;
+
+    CpuRenderer renderer;
+    renderer.setThreadCount(options.threadCount);
+    renderer.setParams(params);
+    renderer.setScene(scene);
+    const double loadMs = elapsedMs(start);
+
+    for (int i = 0; i < options.warmupFrames; i++) renderer.renderFrame();
+
+    // The seeds only depend on the pixel and the frame index, the same frames are measured on every run
+    std::vector<double> frameMs;
+    uint64_t rays = 0;
+    for (int i = 0; i < options.frames; i++) {
+        start = std::chrono::steady_clock::now();
+        renderer.renderFrame();
+        frameMs.push_back(elapsedMs(start));
+        rays += renderer.getRayCount();
+    }
+
+    double totalMs = 0.0;
+    for (double ms : frameMs) totalMs += ms;
+    std::sort(frameMs.begin(), frameMs.end());
+
+    BenchResult result;
+    result.scene = benchScene.name;
+    result.objectCount = scene.getObjects().size();
+    result.loadMs = loadMs;
+    result.samplesPerSecond = static_cast<double>(options.width) * options.height * options.frames / (totalMs * 1e-3);
+    result.raysPerSecond = static_cast<double>(rays) / (totalMs * 1e-3);
+    result.msPerFrame = totalMs / options.frames;
+    result.p50Ms = percentile(frameMs, 0.5);
+    result.p99Ms = percentile(frameMs, 0.99);
+
+    if (options.wavefront) {
+        for (bool sortHits : { true, false }) {
+            WavefrontResult wavefront;
+            if (runWavefront(engine, scene, params, options, sortHits, wavefront)) {
+                result.wavefront.push_back(wavefront);
+            } else {
+                std::cerr << "[WARN] The wavefront pipeline failed on " << benchScene.name << std::endl;
+            }
+        }
+    }
+
+    scene.destroy(engine);
+    return result;
+}
+
+static std::string toJson(const BenchOptions &options, const std::vector<BenchResult> &results) {
+    std::ostringstream out;
+    out.precision(6);
+    out << "{\n"
+        << "  \"width\": " << options.width << ",\n"
+        << "  \"height\": " << options.height << ",\n"
+        << "  \"warmupFrames\": " << options.warmupFrames << ",\n"
+        << "  \"frames\": " << options.frames << ",\n"
+        << "  \"samplesPerFrame\": 1,\n"
+        << "  \"maxBounces\": " << options.maxBounces << ",\n"
+        << "  \"threads\": " << resolveThreadCount(options.threadCount) << ",\n"
+        << "  \"rayPackets\": " << (options.rayPackets ? "true" : "false") << ",\n"
+        << "  \"simd\": \"" << simdInstructionSet() << "\",\n"
+        << "  \"scenes\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult &r = results[i];
+        out << (i == 0 ? "\n" : ",\n")
+            << "    { \"name\": \"" << r.scene << "\", \"objects\": " << r.objectCount << ", \"loadMs\": " << r.loadMs
+            << ", \"samplesPerSecond\": " << r.samplesPerSecond << ", \"raysPerSecond\": " << r.raysPerSecond
+            << ", \"msPerFrame\": " << r.msPerFrame << ", \"p50Ms\": " << r.p50Ms << ", \"p99Ms\": " << r.p99Ms;
+        if (options.wavefront) {
+            out << ", \"wavefront\": [";
+            for (size_t j = 0; j < r.wavefront.size(); j++) {
+                const WavefrontResult &w = r.wavefront[j];
+                out << (j == 0 ? "" : ", ") << "{ \"sortHits\": " << (w.sortHits ? "true" : "false")
+                    << ", \"samplesPerSecond\": " << w.samplesPerSecond << ", \"p50Ms\": " << w.p50Ms
+                    << ", \"gpuP50Ms\": " << w.gpuP50Ms << ", \"shadeBranchesPerGroup\": " << w.shadeBranchesPerGroup << " }";
+            }
+            out << "]";
+        }
+        out << " }";
+    }
+    out << "\n  ]\n}\n";
+    return out.str();
+}
+
+static bool parseOptions(int argc, char **argv, BenchOptions &options) {
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--no-packets") {
+            options.rayPackets = false;
+            continue;
+        }
+        if (arg == "--wavefront") {
+            options.wavefront = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "[ERROR] Missing value for " << arg << std::endl;
+            return false;
+        }
+
+        const char *value = argv[++i];
+        if (arg == "--scenes") {
+            std::stringstream list(value);
+            std::string name;
+            while (std::getline(list, name, ',')) options.scenes.push_back(name);
+        }
+        else if (arg == "--size" && std::sscanf(value, "%ux%u", &options.width, &options.height) == 2) {}
+        else if (arg == "--warmup")  options.warmupFrames = std::atoi(value);
+        else if (arg == "--frames")  options.frames = std::atoi(value);
+        else if (arg == "--bounces") options.maxBounces = std::atoi(value);
+        else if (arg == "--threads") options.threadCount = std::atoi(value);
+        else if (arg == "--device")  options.deviceIndex = std::atoi(value);
+        else if (arg == "--output")  options.output = value;
+        else {
+            std::cerr << "[ERROR] Invalid option " << arg << " " << value << std::endl;
+            return false;
+        }
+    }
+
+    if (options.width == 0 || options.height == 0 || options.frames <= 0 || options.warmupFrames < 0 || options.maxBounces <= 0) {
+        std::cerr << "[ERROR] The size, frame and bounce counts must be positive" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options)) return 1;
+
+    std::vector<const BenchScene*> scenes;
+    for (const BenchScene &scene : BENCH_SCENES) {
+        bool selected = options.scenes.empty();
+        for (const std::string &name : options.scenes) selected = selected || name == scene.name;
+        if (selected) scenes.push_back(&scene);
+    }
+    if (scenes.size() < std::max<size_t>(options.scenes.size(), 1)) {
+        std::cerr << "[ERROR] Unknown scene in the list, the scenes are:";
+        for (const BenchScene &scene : BENCH_SCENES) std::cerr << " " << scene.name;
+        std::cerr << std::endl;
+        return 1;
+    }
+
+    std::printf("[INFO] %ux%u, %d warmup + %d frames, %d bounces, %u threads, %s\n", options.width, options.height,
+                options.warmupFrames, options.frames, options.maxBounces, resolveThreadCount(options.threadCount), simdInstructionSet());
+    std::printf("  %-14s %12s %12s %10s %10s %10s\n", "scene", "Msamples/s", "Mrays/s", "ms/frame", "p50 ms", "p99 ms");
+
+    // The engine is never initialized, the scenes are headless
+    VkSmol engine;
+    std::vector<BenchResult> results;
+    for (const BenchScene *scene : scenes) {
+        const BenchResult result = runScene(engine, *scene, options);
+        std::printf("  %-14s %12.3f %12.3f %10.2f %10.2f %10.2f\n", result.scene.c_str(), result.samplesPerSecond * 1e-6,
+                    result.raysPerSecond * 1e-6, result.msPerFrame, result.p50Ms, result.p99Ms);
+        results.push_back(result);
+    }
+
+    if (options.wavefront) {
+        std::printf("Wavefront GPU pipeline, hits sorted by material or not\n");
+        std::printf("  %-14s %-8s %12s %10s %10s %16s\n", "scene", "hits", "Msamples/s", "p50 ms", "GPU p50 ms", "branches/group");
+        for (const BenchResult &result : results) {
+            for (const WavefrontResult &w : result.wavefront) {
+                std::printf("  %-14s %-8s %12.3f %10.2f %10.2f %16.2f\n", result.scene.c_str(), w.sortHits ? "sorted" : "unsorted",
+                            w.samplesPerSecond * 1e-6, w.p50Ms, w.gpuP50Ms, w.shadeBranchesPerGroup);
+            }
+        }
+    }
+
+    std::ofstream file(options.output);
+    file << toJson(options, results);
+    if (!file) {
+        std::cerr << "[ERROR] Failed to write " << options.output << std::endl;
+        return 1;
+    }
+    std::printf("[INFO] Saved %s\n", options.output.c_str());
+    return 0;
+}
@@ -16,6 +16,16 @@ Hit rayObjectIntersection(in Ray ray, in Object obj) {
     }
 }
 
+bool rayObjectOcclusion(in Ray ray, in Object obj, in float tMax) {
+    switch (obj.type) {
+        case obj_Sphere: return raySphereOcclusion(ray, sphereBuffer.spheres[obj.id], tMax);
+        case obj_Plane:  return rayPlaneOcclusion(ray, planeBuffer.planes[obj.id], tMax);
+        case obj_Box:    return rayBoxOcclusion(ray, boxBuffer.boxes[obj.id], tMax);
+        case obj_Mesh:   return rayMeshOcclusion(ray, meshBuffer.meshes[obj.id], tMax);
+        default:         return false;
+    }
+}
+
 Material getMaterial(in Object obj) {
     switch (obj.type) {
         case obj_Sphere: return materialBuffer.materials[sphereBuffer.spheres[obj.id].materialHandle];
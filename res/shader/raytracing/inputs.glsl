@@ -4,8 +4,10 @@
 #include "utils.glsl"
 #include "materials.glsl"
 
+#ifndef RAYTRACING_COMPUTE
 layout(location = 0) in vec2 fragPos;
 layout(location = 0) out vec4 outColor;
+#endif
 
 layout(std140, set = 0, binding = 0) uniform UBO {
     vec3 cameraPos;
@@ -27,9 +29,38 @@ layout(std140, set = 0, binding = 0) uniform UBO {
     int samplesPerPixel;
     int importanceSampling;
     int debugView;
+    int cpuSampleCount;     // Samples of `cpuSampleBuffer` merged by this frame, 0 for none
 } ubo;
 
+// Settings compiled into the pipeline variants of `Application`, read from the UBO otherwise. As constants, the
+// unused debug views and sky modes are dropped and the bounce loop has a fixed bound
+#ifdef VARIANT_MAX_BOUNCES
+#define MAX_BOUNCES VARIANT_MAX_BOUNCES
+#else
+#define MAX_BOUNCES ubo.maxBounces
+#endif
+#ifdef VARIANT_IMPORTANCE_SAMPLING
+#define IMPORTANCE_SAMPLING VARIANT_IMPORTANCE_SAMPLING
+#else
+#define IMPORTANCE_SAMPLING ubo.importanceSampling
+#endif
+#ifdef VARIANT_DEBUG_VIEW
+#define DEBUG_VIEW VARIANT_DEBUG_VIEW
+#else
+#define DEBUG_VIEW ubo.debugView
+#endif
+#ifdef VARIANT_LIGHT_MODE
+#define LIGHT_MODE VARIANT_LIGHT_MODE
+#else
+#define LIGHT_MODE ubo.lightMode
+#endif
+
+#ifdef RAYTRACING_COMPUTE
+// Accumulation read and written in place by the compute pipeline
+layout(set = 0, binding = 1, rgba32f) uniform image2D accumImage;
+#else
 layout(set = 0, binding = 1) uniform sampler2D prevTex;
+#endif
 
 // Vertices
 // Indices
@@ -64,7 +95,30 @@ layout(set = 0, binding = 10) buffer readonly ObjectBuffer {
 } objectBuffer;
 layout(set = 0, binding = 11) buffer readonly LightBuffer {
     float totalArea;
+    int lightCount;
     Light lights[];
 } lightBuffer;
+layout(set = 0, binding = 12) buffer readonly TlasBuffer {
+    BvhNode nodes[];
+} tlasBuffer;
+layout(set = 0, binding = 13) buffer readonly TlasIndexBuffer {
+    uint nodeCount;
+    uint boundedCount;      // Objects referenced by the TLAS leaves, in leaf order
+    uint unboundedCount;    // Planes, stored after the bounded objects
+    uint objectIds[];
+} tlasIndexBuffer;
+layout(set = 0, binding = 14) buffer readonly Bvh4Buffer {
+    BvhNode4 nodes[];
+} bvh4Buffer;
+layout(set = 0, binding = 15) buffer readonly QuantizedBvhBuffer {
+    uint words[];
+} quantizedBvhBuffer;
+layout(set = 0, binding = 16) buffer readonly TriangleBuffer {
+    TriangleRecord triangles[];
+} triangleBuffer;
+// Mean of samples rendered by the CPU, merged into the accumulation when `ubo.cpuSampleCount` > 0
+layout(set = 0, binding = 17) buffer readonly CpuSampleBuffer {
+    vec4 colors[];
+} cpuSampleBuffer;
 
 #endif
@@ -8,20 +8,26 @@
 int getLightId(inout uint seed) {
     if (lightBuffer.totalArea == 0) return -1;
 
+    // A draw of exactly 0 picks the first light, same as `getLightId` in `cpu_integrator.cpp`
+    // Bounded by the light count, rounding can leave the cumulated share just below 1
     float r = rand(seed);
-    float t = 0.0;
+    float t = lightBuffer.lights[0].area / lightBuffer.totalArea;
     int i = 0;
-    while (r > t) {
-        t += lightBuffer.lights[i].area / lightBuffer.totalArea;
+    while (r > t && i + 1 < lightBuffer.lightCount) {
         i++;
+        t += lightBuffer.lights[i].area / lightBuffer.totalArea;
     }
-    return i-1;
+    return i;
 }
 
-Hit intersection(in Ray ray); // Forward declaration
+bool occluded(in Ray ray, in float tMax); // Forward declaration
 
-vec3 importanceSampleLight(in Material surfaceMat, in Hit hit, in ScatterResult scatterResult, inout uint seed) {
-    if (ubo.importanceSampling != 1 || !scatterResult.isDiffuse) return vec3(0.0);
+// Unoccluded contribution of a light sample, the visibility is tested separately along `shadowRay` up to `shadowDist`
+vec3 sampleLightContribution(in Material surfaceMat, in Hit hit, in ScatterResult scatterResult, inout uint seed,
+                             out Ray shadowRay, out float shadowDist) {
+    shadowRay = Ray(vec3(0.0), vec3(0.0));
+    shadowDist = 0.0;
+    if (IMPORTANCE_SAMPLING != 1 || !scatterResult.isDiffuse) return vec3(0.0);
 
     int lightId = getLightId(seed);
     if (lightId < 0) return vec3(0.0);
@@ -39,10 +45,8 @@ vec3 importanceSampleLight(in Material surfaceMat, in Hit hit, in ScatterResult
     float cosLight = max(dot(-toLightDir, surfaceSample.normal), 0.0);
     if (cosSurface <= 0.0 || cosLight <= 0.0) return vec3(0.0);
 
-    Ray shadowRay = Ray(scatterResult.scattered.origin, toLightDir);
-    Hit shadowHit = intersection(shadowRay);
-    bool visible = foundIntersection(shadowHit) && shadowHit.t >= dist - EPS;
-    if (!visible) return vec3(0.0);
+    shadowRay = Ray(scatterResult.scattered.origin, toLightDir);
+    shadowDist = dist - EPS;
 
     float pdfW = lightBuffer.lights[lightId].pdfA * dist2 / max(cosLight, EPS);
 
@@ -51,4 +55,12 @@ vec3 importanceSampleLight(in Material surfaceMat, in Hit hit, in ScatterResult
     return (surfaceMat.albedo / PI) * Le * cosSurface / max(pdfW, EPS);
 }
 
+vec3 importanceSampleLight(in Material surfaceMat, in Hit hit, in ScatterResult scatterResult, inout uint seed) {
+    Ray shadowRay;
+    float shadowDist;
+    vec3 contribution = sampleLightContribution(surfaceMat, hit, scatterResult, seed, shadowRay, shadowDist);
+    if (contribution == vec3(0.0) || occluded(shadowRay, shadowDist)) return vec3(0.0);
+    return contribution;
+}
+
 #endif
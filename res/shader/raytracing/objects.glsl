@@ -144,6 +144,37 @@ Hit rayAabbIntersection(in Ray ray, in vec3 aabbMin, in vec3 aabbMax) {
     return makeHit(ray, OBJECT_AABB, tNear, normal);
 }
 
+// Returns the entry distance of the ray in the box, or INFINITY if the box is missed or further than tMax
+float rayAabbDistance(in vec3 origin, in vec3 invDir, in vec3 aabbMin, in vec3 aabbMax, in float tMax) {
+    vec3 t0 = (aabbMin - origin) * invDir;
+    vec3 t1 = (aabbMax - origin) * invDir;
+    vec3 tmin = min(t0, t1);
+    vec3 tmax = max(t0, t1);
+    float tNear = max(max(tmin.x, tmin.y), max(tmin.z, 0.0));
+    float tFar = min(min(tmax.x, tmax.y), min(tmax.z, tMax));
+    return tNear <= tFar ? tNear : INFINITY;
+}
+
+vec3 safeInverseDir(in vec3 dir) {
+    vec3 safeDir = sign(dir) * max(abs(dir), vec3(EPS));
+    return 1.0 / safeDir;
+}
+
+// Entry distances of the ray in the 4 children of a wide node, INFINITY for the children missed, further than tMax or unused
+vec4 rayAabbDistance4(in vec3 origin, in vec3 invDir, in BvhNode4 node, in float tMax) {
+    vec4 t0x = (node.minX - origin.x) * invDir.x;
+    vec4 t1x = (node.maxX - origin.x) * invDir.x;
+    vec4 t0y = (node.minY - origin.y) * invDir.y;
+    vec4 t1y = (node.maxY - origin.y) * invDir.y;
+    vec4 t0z = (node.minZ - origin.z) * invDir.z;
+    vec4 t1z = (node.maxZ - origin.z) * invDir.z;
+    vec4 tNear = max(max(min(t0x, t1x), min(t0y, t1y)), max(min(t0z, t1z), vec4(0.0)));
+    vec4 tFar = min(min(max(t0x, t1x), max(t0y, t1y)), min(max(t0z, t1z), vec4(tMax)));
+
+    uvec4 hit = uvec4(lessThanEqual(tNear, tFar)) & uvec4(notEqual(node.child, uvec4(BVH4_INVALID)));
+    return mix(vec4(INFINITY), tNear, bvec4(hit));
+}
+
 Hit rayBoxIntersection(in Ray ray, in Object obj, in Box box) {
     vec3 localOrigin = (box.invModelMatrix * vec4(ray.origin, 1.0)).xyz;
     vec3 localDir = (box.invModelMatrix * vec4(ray.dir, 0.0)).xyz;
@@ -157,9 +188,7 @@ Hit rayBoxIntersection(in Ray ray, in Object obj, in Box box) {
     return makeHit(ray, obj, hit.t, worldNormal);
 }
 
-float rayTriangleIntersection(in Ray ray, vec3 v0, vec3 v1, vec3 v2) {
-    vec3 edge1 = v1 - v0;
-    vec3 edge2 = v2 - v0;
+float rayTriangleEdgeIntersection(in Ray ray, vec3 v0, vec3 edge1, vec3 edge2) {
     vec3 pvec = cross(ray.dir, edge2);
     float det = dot(edge1, pvec);
     if (abs(det) < TRI_EPS) return -1.0;
@@ -177,40 +206,444 @@ float rayTriangleIntersection(in Ray ray, vec3 v0, vec3 v1, vec3 v2) {
     return (t >= TRI_EPS) ? t : -1.0;
 }
 
+float rayTriangleIntersection(in Ray ray, vec3 v0, vec3 v1, vec3 v2) {
+    return rayTriangleEdgeIntersection(ray, v0, v1 - v0, v2 - v0);
+}
+
+// Triangle `i` of the scene index buffer, read from the triangle records when the mesh has them
+float rayMeshTriangleIntersection(in Ray localRay, in Mesh mesh, uint i) {
+    if (mesh.triangleRecordOffset != NO_TRIANGLE_RECORDS) {
+        TriangleRecord tri = triangleBuffer.triangles[mesh.triangleRecordOffset + i - mesh.indexOffset / 3u];
+        return rayTriangleEdgeIntersection(localRay, tri.v0, tri.e1, tri.e2);
+    }
+
+    uint base = i * 3u;
+    vec3 v0 = vertexBuffer.vertices[indexBuffer.indices[base + 0u]].position;
+    vec3 v1 = vertexBuffer.vertices[indexBuffer.indices[base + 1u]].position;
+    vec3 v2 = vertexBuffer.vertices[indexBuffer.indices[base + 2u]].position;
+    return rayTriangleIntersection(localRay, v0, v1, v2);
+}
+
+// Closest hit in a 4-wide BVH, `tClosest` and `bestTriangle` are only updated when a closer triangle is found
+bool rayMeshIntersection4(in Ray localRay, in vec3 invDir, in Mesh mesh, inout float tClosest, inout uint bestTriangle) {
+    bool foundHit = false;
+
+    uint stackNode[BVH4_STACK_SIZE];
+    float stackNear[BVH4_STACK_SIZE];
+    int stackSize = 0;
+    uint nodeIndex = mesh.bvhOffset;
+    while (true) {
+        BvhNode4 node = bvh4Buffer.nodes[nodeIndex];
+        vec4 tNear = rayAabbDistance4(localRay.origin, invDir, node, tClosest);
+
+        // Leaves are intersected right away, inner children are sorted from the farthest to the nearest
+        uint innerNode[4];
+        float innerNear[4];
+        int innerCount = 0;
+        for (int c = 0; c < 4; c++) {
+            if (tNear[c] == INFINITY) continue;
+
+            if (node.count[c] == 0u) {
+                int j = innerCount;
+                while (j > 0 && innerNear[j - 1] < tNear[c]) {
+                    innerNode[j] = innerNode[j - 1];
+                    innerNear[j] = innerNear[j - 1];
+                    j--;
+                }
+                innerNode[j] = node.child[c];
+                innerNear[j] = tNear[c];
+                innerCount++;
+                continue;
+            }
+
+            if (tNear[c] >= tClosest) continue;
+            for (uint i = node.child[c]; i < node.child[c] + node.count[c]; i++) {
+                float tLocal = rayMeshTriangleIntersection(localRay, mesh, i);
+                if (tLocal > 0.0 && tLocal < tClosest) {
+                    tClosest = tLocal;
+                    bestTriangle = i;
+                    foundHit = true;
+                }
+            }
+        }
+
+        // Push the far children, continue with the nearest one
+        bool next = false;
+        for (int k = 0; k < innerCount; k++) {
+            if (innerNear[k] >= tClosest) continue;
+            if (k == innerCount - 1) {
+                nodeIndex = innerNode[k];
+                next = true;
+            } else if (stackSize < BVH4_STACK_SIZE) {
+                stackNode[stackSize] = innerNode[k];
+                stackNear[stackSize] = innerNear[k];
+                stackSize++;
+            }
+        }
+        if (next) continue;
+
+        while (stackSize > 0) {
+            stackSize--;
+            if (stackNear[stackSize] < tClosest) {
+                nodeIndex = stackNode[stackSize];
+                next = true;
+                break;
+            }
+        }
+        if (!next) break;
+    }
+
+    return foundHit;
+}
+
+// ================ QUANTIZED BVH ================
+// Same operations as `dequantize` in `bvh_quantized.hpp`, `precise` keeps them from being fused so both sides decode the same boxes
+float dequantize(in uint q, in uint qMax, in float invMax, in float parentMin, in float parentMax) {
+    if (q == qMax) return parentMax;
+    precise float scale = (parentMax - parentMin) * invMax;
+    precise float offset = float(q) * scale;
+    precise float value = parentMin + offset;
+    return value;
+}
+
+// Box of one of the two children of the quantized node starting at the word `node`
+void decodeQuantizedChild(in uint node, in uint child, in uint bits, in vec3 parentMin, in vec3 parentMax, out vec3 childMin, out vec3 childMax) {
+    uint perWord = 32u / bits;
+    uint qMax = (1u << bits) - 1u;
+    float invMax = uintBitsToFloat(bits == 8u ? QBVH_INV_MAX8 : QBVH_INV_MAX16);
+    for (uint axis = 0u; axis < 3u; axis++) {
+        uint iMin = child * 6u + axis;
+        uint iMax = iMin + 3u;
+        uint qLow = (quantizedBvhBuffer.words[node + iMin / perWord] >> ((iMin % perWord) * bits)) & qMax;
+        uint qHigh = (quantizedBvhBuffer.words[node + iMax / perWord] >> ((iMax % perWord) * bits)) & qMax;
+        childMin[axis] = dequantize(qLow, qMax, invMax, parentMin[axis], parentMax[axis]);
+        childMax[axis] = dequantize(qHigh, qMax, invMax, parentMin[axis], parentMax[axis]);
+    }
+}
+
+// Closest hit in a quantized BVH, the stack keeps the decoded box of each node since its children are relative to it
+bool rayMeshIntersectionQuantized(in Ray localRay, in vec3 invDir, in Mesh mesh, inout float tClosest, inout uint bestTriangle) {
+    uint bits = mesh.bvhLayout == bvh_Quantized8 ? 8u : 16u;
+    uint nodeWords = 12u / (32u / bits) + 2u;
+    uint base = mesh.bvhOffset;
+    uint triangleOffset = mesh.indexOffset / 3u;
+
+    vec3 boxMin = vec3(
+        uintBitsToFloat(quantizedBvhBuffer.words[base + 0u]),
+        uintBitsToFloat(quantizedBvhBuffer.words[base + 1u]),
+        uintBitsToFloat(quantizedBvhBuffer.words[base + 2u])
+    );
+    vec3 boxMax = vec3(
+        uintBitsToFloat(quantizedBvhBuffer.words[base + 3u]),
+        uintBitsToFloat(quantizedBvhBuffer.words[base + 4u]),
+        uintBitsToFloat(quantizedBvhBuffer.words[base + 5u])
+    );
+    uint child = quantizedBvhBuffer.words[base + 6u];
+    if (rayAabbDistance(localRay.origin, invDir, boxMin, boxMax, tClosest) == INFINITY) return false;
+
+    bool foundHit = false;
+    uint stackChild[BVH_STACK_SIZE];
+    float stackNear[BVH_STACK_SIZE];
+    vec3 stackMin[BVH_STACK_SIZE];
+    vec3 stackMax[BVH_STACK_SIZE];
+    int stackSize = 0;
+    while (true) {
+        if ((child & QBVH_LEAF_BIT) != 0u) {
+            uint first = triangleOffset + (child & QBVH_FIRST_MASK);
+            uint count = ((child & ~QBVH_LEAF_BIT) >> QBVH_COUNT_SHIFT) + 1u;
+            for (uint i = first; i < first + count; i++) {
+                float tLocal = rayMeshTriangleIntersection(localRay, mesh, i);
+                if (tLocal > 0.0 && tLocal < tClosest) {
+                    tClosest = tLocal;
+                    bestTriangle = i;
+                    foundHit = true;
+                }
+            }
+        } else {
+            uint node = base + QBVH_HEADER_WORDS + child * nodeWords;
+            vec3 leftMin, leftMax, rightMin, rightMax;
+            decodeQuantizedChild(node, 0u, bits, boxMin, boxMax, leftMin, leftMax);
+            decodeQuantizedChild(node, 1u, bits, boxMin, boxMax, rightMin, rightMax);
+            uint left = quantizedBvhBuffer.words[node + nodeWords - 2u];
+            uint right = quantizedBvhBuffer.words[node + nodeWords - 1u];
+
+            float tLeft = rayAabbDistance(localRay.origin, invDir, leftMin, leftMax, tClosest);
+            float tRight = rayAabbDistance(localRay.origin, invDir, rightMin, rightMax, tClosest);
+            bool hitLeft = tLeft != INFINITY;
+            bool hitRight = tRight != INFINITY;
+
+            if (hitLeft && hitRight) {
+                bool leftFirst = tLeft <= tRight;
+                if (stackSize < BVH_STACK_SIZE) {
+                    stackChild[stackSize] = leftFirst ? right : left;
+                    stackNear[stackSize] = leftFirst ? tRight : tLeft;
+                    stackMin[stackSize] = leftFirst ? rightMin : leftMin;
+                    stackMax[stackSize] = leftFirst ? rightMax : leftMax;
+                    stackSize++;
+                }
+                child = leftFirst ? left : right;
+                boxMin = leftFirst ? leftMin : rightMin;
+                boxMax = leftFirst ? leftMax : rightMax;
+                continue;
+            }
+            if (hitLeft)  { child = left;  boxMin = leftMin;  boxMax = leftMax;  continue; }
+            if (hitRight) { child = right; boxMin = rightMin; boxMax = rightMax; continue; }
+        }
+
+        bool next = false;
+        while (stackSize > 0) {
+            stackSize--;
+            if (stackNear[stackSize] < tClosest) {
+                child = stackChild[stackSize];
+                boxMin = stackMin[stackSize];
+                boxMax = stackMax[stackSize];
+                next = true;
+                break;
+            }
+        }
+        if (!next) break;
+    }
+
+    return foundHit;
+}
+
+Hit makeMeshHit(in Ray ray, in Object obj, in Mesh mesh, in float t, in uint triangle) {
+    uint base = triangle * 3u;
+    vec3 v0 = vertexBuffer.vertices[indexBuffer.indices[base + 0u]].position;
+    vec3 v1 = vertexBuffer.vertices[indexBuffer.indices[base + 1u]].position;
+    vec3 v2 = vertexBuffer.vertices[indexBuffer.indices[base + 2u]].position;
+
+    mat3 normalMat = mat3(transpose(mesh.invModelMatrix));
+    vec3 normal = normalize(normalMat * normalize(cross(v1 - v0, v2 - v0)));
+    return makeHit(ray, obj, t, normal);
+}
+
 Hit rayMeshIntersection(in Ray ray, in Object obj, in Mesh mesh) {
+    if (mesh.bvhNodeCount == 0u) return NO_HIT;
+
     vec3 localOrigin = (mesh.invModelMatrix * vec4(ray.origin, 1.0)).xyz;
     vec3 localDir = (mesh.invModelMatrix * vec4(ray.dir, 0.0)).xyz;
     Ray localRay = Ray(localOrigin, localDir);
-
-    BvhNode bvhNode = bvhBuffer.bvhNodes[mesh.bvhOffset];
-
-    Hit hit = rayAabbIntersection(localRay, bvhNode.aabbMin, bvhNode.aabbMax);
-    if (!foundIntersection(hit)) return hit;
+    vec3 invDir = safeInverseDir(localDir);
 
     float tClosest = INFINITY;
+    uint bestTriangle = 0u;
     bool foundHit = false;
-    vec3 bestNormal = vec3(0.0, 1.0, 0.0);
-    for (uint i = 0; i < mesh.triangleCount; i++) {
-        uint base = mesh.indexOffset + i * 3u;
-        uint i0 = indexBuffer.indices[base + 0u];
-        uint i1 = indexBuffer.indices[base + 1u];
-        uint i2 = indexBuffer.indices[base + 2u];
 
-        vec3 v0 = vertexBuffer.vertices[i0].position;
-        vec3 v1 = vertexBuffer.vertices[i1].position;
-        vec3 v2 = vertexBuffer.vertices[i2].position;
+    if (mesh.bvhLayout == bvh_Wide4) {
+        if (!rayMeshIntersection4(localRay, invDir, mesh, tClosest, bestTriangle)) return NO_HIT;
+        return makeMeshHit(ray, obj, mesh, tClosest, bestTriangle);
+    }
+    if (mesh.bvhLayout == bvh_Quantized16 || mesh.bvhLayout == bvh_Quantized8) {
+        if (!rayMeshIntersectionQuantized(localRay, invDir, mesh, tClosest, bestTriangle)) return NO_HIT;
+        return makeMeshHit(ray, obj, mesh, tClosest, bestTriangle);
+    }
 
-        float tLocal = rayTriangleIntersection(localRay, v0, v1, v2);
-        if (tLocal > 0.0 && tLocal < tClosest) {
-            tClosest = tLocal;
-            bestNormal = normalize(cross(v1 - v0, v2 - v0));
-            foundHit = true;
+    BvhNode root = bvhBuffer.bvhNodes[mesh.bvhOffset];
+    if (rayAabbDistance(localOrigin, invDir, root.aabbMin, root.aabbMax, tClosest) == INFINITY) return NO_HIT;
+
+    // Node indices and entry distances of the far children left to visit
+    uint stackNode[BVH_STACK_SIZE];
+    float stackNear[BVH_STACK_SIZE];
+    int stackSize = 0;
+    uint nodeIndex = mesh.bvhOffset;
+    while (true) {
+        BvhNode node = bvhBuffer.bvhNodes[nodeIndex];
+
+        if (node.isLeaf != 0u) {
+            uint first = BVH_firstTriangle(node);
+            uint count = BVH_triangleCount(node);
+            for (uint i = first; i < first + count; i++) {
+                float tLocal = rayMeshTriangleIntersection(localRay, mesh, i);
+                if (tLocal > 0.0 && tLocal < tClosest) {
+                    tClosest = tLocal;
+                    bestTriangle = i;
+                    foundHit = true;
+                }
+            }
+        } else {
+            uint left = BVH_childLeft(node);
+            uint right = BVH_childRight(node);
+            BvhNode leftNode = bvhBuffer.bvhNodes[left];
+            BvhNode rightNode = bvhBuffer.bvhNodes[right];
+            float tLeft = rayAabbDistance(localOrigin, invDir, leftNode.aabbMin, leftNode.aabbMax, tClosest);
+            float tRight = rayAabbDistance(localOrigin, invDir, rightNode.aabbMin, rightNode.aabbMax, tClosest);
+            bool hitLeft = tLeft != INFINITY;
+            bool hitRight = tRight != INFINITY;
+
+            if (hitLeft && hitRight) {
+                // Near child first, the far one is pruned when popped if a closer hit was found
+                bool leftFirst = tLeft <= tRight;
+                if (stackSize < BVH_STACK_SIZE) {
+                    stackNode[stackSize] = leftFirst ? right : left;
+                    stackNear[stackSize] = leftFirst ? tRight : tLeft;
+                    stackSize++;
+                }
+                nodeIndex = leftFirst ? left : right;
+                continue;
+            }
+            if (hitLeft)  { nodeIndex = left;  continue; }
+            if (hitRight) { nodeIndex = right; continue; }
+        }
+
+        bool next = false;
+        while (stackSize > 0) {
+            stackSize--;
+            if (stackNear[stackSize] < tClosest) {
+                nodeIndex = stackNode[stackSize];
+                next = true;
+                break;
+            }
         }
+        if (!next) break;
     }
 
-    mat3 normalMat = mat3(transpose(mesh.invModelMatrix));
-    vec3 normal = normalize(normalMat * bestNormal);
-    return foundHit ? makeHit(ray, obj, tClosest, normal) : NO_HIT;
+    if (!foundHit) return NO_HIT;
+    return makeMeshHit(ray, obj, mesh, tClosest, bestTriangle);
+}
+
+// ================ OCCLUSION ================
+// Any-hit versions of the intersections above: they only tell if a surface is crossed in [EPS, tMax]
+bool raySphereOcclusion(in Ray ray, in Sphere sphere, in float tMax) {
+    vec3 p = sphere.center - ray.origin;
+    float dp = dot(ray.dir, p);
+    float c = dot(p, p) - sphere.radius*sphere.radius;
+    float delta = dp*dp - c;
+    if (delta < 0) return false;
+
+    float sqrtDelta = sqrt(delta);
+    float t1 = dp - sqrtDelta;
+    float t2 = dp + sqrtDelta;
+    return (t1 >= EPS && t1 <= tMax) || (t1 < EPS && t2 >= EPS && t2 <= tMax);
+}
+
+bool rayPlaneOcclusion(in Ray ray, in Plane plane, in float tMax) {
+    float denom = dot(plane.normal, ray.dir);
+    if (abs(denom) <= EPS) return false;
+
+    float t = dot(plane.point - ray.origin, plane.normal) / denom;
+    return t >= EPS && t <= tMax;
+}
+
+bool rayBoxOcclusion(in Ray ray, in Box box, in float tMax) {
+    vec3 localOrigin = (box.invModelMatrix * vec4(ray.origin, 1.0)).xyz;
+    vec3 localDir = (box.invModelMatrix * vec4(ray.dir, 0.0)).xyz;
+    vec3 invDir = safeInverseDir(localDir);
+
+    vec3 t0 = (vec3(-1.0) - localOrigin) * invDir;
+    vec3 t1 = (vec3( 1.0) - localOrigin) * invDir;
+    vec3 tmin = min(t0, t1);
+    vec3 tmax = max(t0, t1);
+    float tNear = max(max(tmin.x, tmin.y), tmin.z);
+    float tFar = min(min(tmax.x, tmax.y), tmax.z);
+    if (tFar < tNear) return false;
+
+    // Entering the box, or leaving it when the ray starts inside
+    return (tNear >= EPS && tNear <= tMax) || (tNear < EPS && tFar >= EPS && tFar <= tMax);
+}
+
+bool rayMeshOcclusion4(in Ray localRay, in vec3 invDir, in Mesh mesh, in float tMax) {
+    uint stack[BVH4_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = mesh.bvhOffset;
+    while (stackSize > 0) {
+        BvhNode4 node = bvh4Buffer.nodes[stack[--stackSize]];
+        vec4 tNear = rayAabbDistance4(localRay.origin, invDir, node, tMax);
+
+        for (int c = 0; c < 4; c++) {
+            if (tNear[c] == INFINITY) continue;
+
+            if (node.count[c] == 0u) {
+                if (stackSize < BVH4_STACK_SIZE) stack[stackSize++] = node.child[c];
+                continue;
+            }
+            for (uint i = node.child[c]; i < node.child[c] + node.count[c]; i++) {
+                float tLocal = rayMeshTriangleIntersection(localRay, mesh, i);
+                if (tLocal >= EPS && tLocal <= tMax) return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool rayMeshOcclusionQuantized(in Ray localRay, in vec3 invDir, in Mesh mesh, in float tMax) {
+    uint bits = mesh.bvhLayout == bvh_Quantized8 ? 8u : 16u;
+    uint nodeWords = 12u / (32u / bits) + 2u;
+    uint base = mesh.bvhOffset;
+    uint triangleOffset = mesh.indexOffset / 3u;
+
+    uint stackChild[BVH_STACK_SIZE];
+    vec3 stackMin[BVH_STACK_SIZE];
+    vec3 stackMax[BVH_STACK_SIZE];
+    int stackSize = 0;
+    stackChild[0] = quantizedBvhBuffer.words[base + 6u];
+    stackMin[0] = vec3(
+        uintBitsToFloat(quantizedBvhBuffer.words[base + 0u]),
+        uintBitsToFloat(quantizedBvhBuffer.words[base + 1u]),
+        uintBitsToFloat(quantizedBvhBuffer.words[base + 2u])
+    );
+    stackMax[0] = vec3(
+        uintBitsToFloat(quantizedBvhBuffer.words[base + 3u]),
+        uintBitsToFloat(quantizedBvhBuffer.words[base + 4u]),
+        uintBitsToFloat(quantizedBvhBuffer.words[base + 5u])
+    );
+    stackSize++;
+
+    while (stackSize > 0) {
+        stackSize--;
+        uint child = stackChild[stackSize];
+        vec3 boxMin = stackMin[stackSize];
+        vec3 boxMax = stackMax[stackSize];
+        if (rayAabbDistance(localRay.origin, invDir, boxMin, boxMax, tMax) == INFINITY) continue;
+
+        if ((child & QBVH_LEAF_BIT) != 0u) {
+            uint first = triangleOffset + (child & QBVH_FIRST_MASK);
+            uint count = ((child & ~QBVH_LEAF_BIT) >> QBVH_COUNT_SHIFT) + 1u;
+            for (uint i = first; i < first + count; i++) {
+                float tLocal = rayMeshTriangleIntersection(localRay, mesh, i);
+                if (tLocal >= EPS && tLocal <= tMax) return true;
+            }
+        } else if (stackSize + 2 <= BVH_STACK_SIZE) {
+            uint node = base + QBVH_HEADER_WORDS + child * nodeWords;
+            decodeQuantizedChild(node, 1u, bits, boxMin, boxMax, stackMin[stackSize], stackMax[stackSize]);
+            stackChild[stackSize++] = quantizedBvhBuffer.words[node + nodeWords - 1u];
+            decodeQuantizedChild(node, 0u, bits, boxMin, boxMax, stackMin[stackSize], stackMax[stackSize]);
+            stackChild[stackSize++] = quantizedBvhBuffer.words[node + nodeWords - 2u];
+        }
+    }
+    return false;
+}
+
+bool rayMeshOcclusion(in Ray ray, in Mesh mesh, in float tMax) {
+    if (mesh.bvhNodeCount == 0u) return false;
+
+    vec3 localOrigin = (mesh.invModelMatrix * vec4(ray.origin, 1.0)).xyz;
+    vec3 localDir = (mesh.invModelMatrix * vec4(ray.dir, 0.0)).xyz;
+    Ray localRay = Ray(localOrigin, localDir);
+    vec3 invDir = safeInverseDir(localDir);
+    if (mesh.bvhLayout == bvh_Wide4) return rayMeshOcclusion4(localRay, invDir, mesh, tMax);
+    if (mesh.bvhLayout == bvh_Quantized16 || mesh.bvhLayout == bvh_Quantized8) return rayMeshOcclusionQuantized(localRay, invDir, mesh, tMax);
+
+    uint stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = mesh.bvhOffset;
+    while (stackSize > 0) {
+        BvhNode node = bvhBuffer.bvhNodes[stack[--stackSize]];
+        if (rayAabbDistance(localOrigin, invDir, node.aabbMin, node.aabbMax, tMax) == INFINITY) continue;
+
+        if (node.isLeaf != 0u) {
+            uint first = BVH_firstTriangle(node);
+            uint count = BVH_triangleCount(node);
+            for (uint i = first; i < first + count; i++) {
+                float tLocal = rayMeshTriangleIntersection(localRay, mesh, i);
+                if (tLocal >= EPS && tLocal <= tMax) return true;
+            }
+        } else if (stackSize + 2 <= BVH_STACK_SIZE) {
+            stack[stackSize++] = BVH_childRight(node);
+            stack[stackSize++] = BVH_childLeft(node);
+        }
+    }
+    return false;
 }
 
 // ================ SURFACE SAMPLING ================
@@ -0,0 +1,278 @@
+#ifndef PATHTRACER_GLSL
+#define PATHTRACER_GLSL
+
+// Shared by the fragment (`raytracing.glsl`) and the compute (`raytracing_compute.glsl`) entry points
+
+#include "inputs.glsl"
+#include "utils.glsl"
+#include "materials.glsl"
+#include "objects.glsl"
+#include "lights.glsl"
+#include "global.glsl"
+#include "random.glsl"
+
+
+Ray getRay(Camera camera, vec2 ndc_pos, in bool enableFocus, inout uint seed) {
+    vec3 forward = normalize(camera.dir);
+    vec3 right   = normalize(cross(forward, camera.up));
+    vec3 up      = cross(right, forward);
+
+    // ndc_pos is in [-1, 1]; convert to [0, 1] UV space
+    float scr_x = ndc_pos.x * 0.5f + 0.5f;
+    float scr_y = ndc_pos.y * 0.5f + 0.5f;
+    
+    float cam_x = (2.f * scr_x - 1.f) * ubo.aspect * ubo.tanHFov;
+    float cam_y = (1.f - 2.f * scr_y) * ubo.tanHFov;
+
+    vec3 offset = vec3(0.0);
+    if (enableFocus) {
+        vec2 p = randomInDisk(seed);
+        float lens_r = ubo.aperture * 0.5;
+        offset = lens_r * (right * p.x + up * p.y);
+    }
+
+    vec3 origin = camera.pos + offset;
+
+    vec3 target = camera.pos + (cam_x * right + cam_y * up + forward) * ubo.focusDepth;
+    vec3 dir = normalize(target - origin);
+
+    return Ray(origin, dir);
+}
+
+Hit intersection(in Ray ray) {
+    Hit bestHit = Hit(vec3(0), vec3(0), INFINITY, true, OBJECT_NONE);
+
+    // Unbounded objects can't be part of the TLAS
+    uint unboundedEnd = tlasIndexBuffer.boundedCount + tlasIndexBuffer.unboundedCount;
+    for (uint i = tlasIndexBuffer.boundedCount; i < unboundedEnd; i++) {
+        Hit hit = rayObjectIntersection(ray, objectBuffer.objects[tlasIndexBuffer.objectIds[i]]);
+        if (foundIntersection(hit) && hit.t < bestHit.t) {
+            bestHit = hit;
+        }
+    }
+
+    if (tlasIndexBuffer.nodeCount == 0u) return bestHit;
+
+    vec3 invDir = safeInverseDir(ray.dir);
+    if (rayAabbDistance(ray.origin, invDir, tlasBuffer.nodes[0].aabbMin, tlasBuffer.nodes[0].aabbMax, bestHit.t) == INFINITY)
+        return bestHit;
+
+    uint stackNode[BVH_STACK_SIZE];
+    float stackNear[BVH_STACK_SIZE];
+    int stackSize = 0;
+    uint nodeIndex = 0u;
+    while (true) {
+        BvhNode node = tlasBuffer.nodes[nodeIndex];
+
+        if (node.isLeaf != 0u) {
+            uint first = BVH_firstTriangle(node);
+            uint count = BVH_triangleCount(node);
+            for (uint i = first; i < first + count; i++) {
+                Hit hit = rayObjectIntersection(ray, objectBuffer.objects[tlasIndexBuffer.objectIds[i]]);
+                if (foundIntersection(hit) && hit.t < bestHit.t) {
+                    bestHit = hit;
+                }
+            }
+        } else {
+            uint left = BVH_childLeft(node);
+            uint right = BVH_childRight(node);
+            float tLeft = rayAabbDistance(ray.origin, invDir, tlasBuffer.nodes[left].aabbMin, tlasBuffer.nodes[left].aabbMax, bestHit.t);
+            float tRight = rayAabbDistance(ray.origin, invDir, tlasBuffer.nodes[right].aabbMin, tlasBuffer.nodes[right].aabbMax, bestHit.t);
+            bool hitLeft = tLeft != INFINITY;
+            bool hitRight = tRight != INFINITY;
+
+            if (hitLeft && hitRight) {
+                bool leftFirst = tLeft <= tRight;
+                if (stackSize < BVH_STACK_SIZE) {
+                    stackNode[stackSize] = leftFirst ? right : left;
+                    stackNear[stackSize] = leftFirst ? tRight : tLeft;
+                    stackSize++;
+                }
+                nodeIndex = leftFirst ? left : right;
+                continue;
+            }
+            if (hitLeft)  { nodeIndex = left;  continue; }
+            if (hitRight) { nodeIndex = right; continue; }
+        }
+
+        bool next = false;
+        while (stackSize > 0) {
+            stackSize--;
+            if (stackNear[stackSize] < bestHit.t) {
+                nodeIndex = stackNode[stackSize];
+                next = true;
+                break;
+            }
+        }
+        if (!next) break;
+    }
+
+    return bestHit;
+}
+
+// Returns true as soon as any surface is found in [EPS, tMax], no hit record is built
+bool occluded(in Ray ray, in float tMax) {
+    uint unboundedEnd = tlasIndexBuffer.boundedCount + tlasIndexBuffer.unboundedCount;
+    for (uint i = tlasIndexBuffer.boundedCount; i < unboundedEnd; i++) {
+        if (rayObjectOcclusion(ray, objectBuffer.objects[tlasIndexBuffer.objectIds[i]], tMax)) return true;
+    }
+
+    if (tlasIndexBuffer.nodeCount == 0u) return false;
+
+    vec3 invDir = safeInverseDir(ray.dir);
+    uint stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = 0u;
+    while (stackSize > 0) {
+        BvhNode node = tlasBuffer.nodes[stack[--stackSize]];
+        if (rayAabbDistance(ray.origin, invDir, node.aabbMin, node.aabbMax, tMax) == INFINITY) continue;
+
+        if (node.isLeaf != 0u) {
+            uint first = BVH_firstTriangle(node);
+            uint count = BVH_triangleCount(node);
+            for (uint i = first; i < first + count; i++) {
+                if (rayObjectOcclusion(ray, objectBuffer.objects[tlasIndexBuffer.objectIds[i]], tMax)) return true;
+            }
+        } else if (stackSize + 2 <= BVH_STACK_SIZE) {
+            stack[stackSize++] = BVH_childRight(node);
+            stack[stackSize++] = BVH_childLeft(node);
+        }
+    }
+    return false;
+}
+
+vec3 skyColor(vec3 dir) {
+    float t = clamp(0.5*(dir.y + 1.0), 0.0, 1.0);
+    vec3 zenith, horizon;
+
+    switch (LIGHT_MODE) {
+        case lightMode_Day:
+            zenith = vec3(0.5, 0.7, 1.0);
+            horizon = vec3(1.0, 1.0, 1.0);
+            break;
+        case lightMode_Sunset:
+            zenith = vec3(0.2, 0.1, 0.4);
+            horizon = vec3(1.0, 0.4, 0.2);
+            break;
+        case lightMode_Night:
+            zenith  = vec3(0.01, 0.01, 0.03);
+            horizon = vec3(0.05, 0.05, 0.1);
+            break;
+        case lightMode_Empty:
+            return vec3(0.0);
+            break;
+        default:
+            return vec3(1.0, 0.0, 1.0);
+            break;
+    }
+    
+    vec3 color = mix(horizon, zenith, t);
+    color += vec3(0.05, 0.02, 0.0) * pow(1.0 - t, 3.0);
+    return color;
+}
+
+vec3 traceRay(in Camera camera, in Ray ray, inout uint seed) {
+    Ray primaryRay = ray;
+    Hit hit = intersection(ray);
+    vec3 throughput = vec3(1.0);
+    vec3 radiance = vec3(0.0);
+
+    int i = 0;
+    ScatterResult result;
+    Material mat;
+    for (; i < MAX_BOUNCES; i++) {
+        if (DEBUG_VIEW == debug_Normal || DEBUG_VIEW == debug_SelectionMask) break;
+        
+        if (foundIntersection(hit)) {
+            mat = getMaterial(hit.object);
+
+            if (mat.type == mat_Emissive) {
+                radiance += throughput * mat.albedo * emissiveIntensity(mat);
+                break;
+            }
+
+            scatter(
+                mat,
+                ray,
+                hit,
+                result,
+                seed
+            );
+            throughput *= result.attenuation;
+            if (!result.isScattered) break;
+
+            vec3 direct = importanceSampleLight(mat, hit, result, seed);
+            radiance += throughput * direct;
+
+            ray = result.scattered;
+            hit = intersection(ray);
+        } else {
+            radiance += throughput * skyColor(ray.dir);
+            break;
+        }
+    }
+    if (i == MAX_BOUNCES)
+        radiance = vec3(0.0);
+
+    // Debug visualisations
+    if (DEBUG_VIEW == debug_Bounces) {
+        return vec3(i / float(MAX_BOUNCES));
+    }
+    if (DEBUG_VIEW == debug_Normal) {
+        return foundIntersection(hit) ? (hit.normal * 0.5 + 0.5) : vec3(0.0);
+    }
+    if (DEBUG_VIEW == debug_SelectionMask) {
+        if (objectBuffer.selectedObjectId < 0) return vec3(0.0);
+        Object sel = objectBuffer.objects[objectBuffer.selectedObjectId];
+        Hit selHit = rayObjectIntersection(primaryRay, sel);
+        return foundIntersection(selHit) ? vec3(1.0) : vec3(0.0);
+    }
+    
+    return radiance;
+}
+
+vec3 computePixelColor(in Camera camera, in vec2 ndcPos, inout uint seed) {
+    vec3 color = vec3(0);
+    for (int i = 0; i < ubo.samplesPerPixel; i++) {
+        uint sampleState = pcg_hash(seed + uint(i));
+        vec2 offset = vec2(rand(sampleState), rand(sampleState)) / ubo.screenSize;
+        Ray ray = getRay(camera, ndcPos + offset, true, sampleState);
+        vec3 rayColor = traceRay(camera, ray, sampleState);
+        color.rgb += rayColor.rgb;
+    }
+    color.rgb /= float(ubo.samplesPerPixel);
+
+    return color;
+}
+
+// Color of this frame, only one pixel per block is traced on the low resolution first frame
+vec3 computeFrameColor(in Camera camera, in vec2 ndcPos, in vec2 screenCoord, inout uint seed) {
+    if (ubo.frameCount <= 1 && ubo.lowResolutionScale != 1.0f) {
+        ivec2 blockCoord = ivec2(round(screenCoord / ubo.lowResolutionScale) * ubo.lowResolutionScale);
+        if (ivec2(screenCoord) != blockCoord) return vec3(0);
+    }
+    return computePixelColor(camera, ndcPos, seed);
+}
+
+// Merges the frame into the accumulated color, the alpha holds the selection mask read by the screen shader
+vec4 accumulate(in Camera camera, in vec3 prevColor, in vec3 currColor, in ivec2 pixelCoord, in vec2 ndcPos, inout uint seed) {
+    if (ubo.frameCount <= 2) {
+        prevColor = currColor;
+    } else if (ubo.cpuSampleCount > 0) {
+        // The host already counts the CPU samples in `frameCount`, the previous image holds the others
+        float prevSampleCount = float(ubo.frameCount - 1) * float(ubo.samplesPerPixel);
+        vec3 cpuColor = cpuSampleBuffer.colors[pixelCoord.y * int(ubo.screenSize.x) + pixelCoord.x].rgb;
+        prevColor = mix(prevColor, cpuColor, float(ubo.cpuSampleCount) / prevSampleCount);
+    }
+
+    float intersection = 0;
+    if (objectBuffer.selectedObjectId >= 0) {
+        Hit hit = rayObjectIntersection(getRay(camera, ndcPos, false, seed), objectBuffer.objects[objectBuffer.selectedObjectId]);
+        if (foundIntersection(hit)) intersection = 1;
+    }
+
+    float frame = float(max(ubo.frameCount, 1));
+    return vec4(mix(prevColor, currColor, 1.0 / frame), intersection);
+}
+
+#endif
@@ -0,0 +1,26 @@
+#version 450
+
+#define RAYTRACING_COMPUTE
+#include "pathtracer.glsl"
+
+// Must match `COMPUTE_WORKGROUP_SIZE` on the host
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+void main() {
+    ivec2 size = imageSize(accumImage);
+    ivec2 pixelCoord = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(pixelCoord, size))) return;
+
+    // Center of the pixel, where the fragment shader is evaluated
+    vec2 screenCoord = vec2(pixelCoord) + 0.5;
+    vec2 ndcPos = screenCoord / vec2(size) * 2.0 - 1.0;
+
+    // Each invocation owns its pixel, the accumulation is updated in place
+    vec3 prevColor = imageLoad(accumImage, pixelCoord).rgb;
+
+    Camera camera = Camera(ubo.cameraPos, ubo.cameraDir, vec3(0, 1, 0));
+    uint seed = initSeed(uvec2(pixelCoord), uint(ubo.frameCount));
+
+    vec3 currColor = computeFrameColor(camera, ndcPos, screenCoord, seed);
+    imageStore(accumImage, pixelCoord, accumulate(camera, prevColor, currColor, pixelCoord, ndcPos, seed));
+}
@@ -0,0 +1,25 @@
+#ifndef RAYTRACING_FRAGMENT_GLSL
+#define RAYTRACING_FRAGMENT_GLSL
+
+// Fragment shader of the raytracing pipeline, without `#version` so the pipeline variants can define their settings
+// before including it
+
+#include "pathtracer.glsl"
+
+void main() {
+    vec2 uv = fragPos * 0.5 + 0.5;
+
+    vec2 texSize = vec2(textureSize(prevTex, 0));
+    vec2 screenCoord = uv * texSize;
+    ivec2 pixelCoord = ivec2(screenCoord);
+
+    vec3 prevColor = texelFetch(prevTex, pixelCoord, 0).rgb;
+
+    Camera camera = Camera(ubo.cameraPos, ubo.cameraDir, vec3(0, 1, 0));
+    uint seed = initSeed(uvec2(pixelCoord), uint(ubo.frameCount));
+
+    vec3 currColor = computeFrameColor(camera, fragPos, screenCoord, seed);
+    outColor = accumulate(camera, prevColor, currColor, pixelCoord, fragPos, seed);
+}
+
+#endif
@@ -67,6 +67,14 @@ struct Vertex {
     vec3 position;
 };
 
+// First vertex and edges of a triangle, stored in BVH leaf order
+#define NO_TRIANGLE_RECORDS 0xFFFFFFFFu
+struct TriangleRecord {
+    vec3 v0;
+    vec3 e1;
+    vec3 e2;
+};
+
 struct BvhNode {
     vec3 aabbMin;
     vec3 aabbMax;
@@ -75,11 +83,42 @@ struct BvhNode {
     uint isLeaf;
 };
 
+#define BVH_STACK_SIZE 32   // Must match `BVH_STACK_SIZE` in `src/scene/bvh/bvh.hpp`
+#define BVH4_STACK_SIZE (3 * (BVH_STACK_SIZE - 1) + 1)  // Must match `BVH4_STACK_SIZE` in `src/scene/bvh/bvh.hpp`
+#define BVH4_INVALID 0xFFFFFFFFu
+
 #define BVH_childLeft(node)   (node.data0)
 #define BVH_childRight(node)  (node.data1)
 #define BVH_firstTriangle(node) (node.data0)
 #define BVH_triangleCount(node) (node.data1)
 
+// ============== BVH LAYOUTS ==============
+#define bvh_Binary      Enum(0)
+#define bvh_Wide4       Enum(1)
+#define bvh_Quantized16 Enum(2)
+#define bvh_Quantized8  Enum(3)
+
+// Bounds of the 4 children in SoA, inner children have count == 0, unused slots have child == BVH4_INVALID
+struct BvhNode4 {
+    vec4 minX;
+    vec4 maxX;
+    vec4 minY;
+    vec4 maxY;
+    vec4 minZ;
+    vec4 maxZ;
+    uvec4 child;    // node, or first triangle for leaves
+    uvec4 count;
+};
+
+// Quantized binary BVH stored in a word buffer, must match `src/scene/bvh/bvh_quantized.hpp`:
+// root box (6 floats), root child word, then per inner node the 12 packed child bounds and the 2 child words
+#define QBVH_HEADER_WORDS 7u
+#define QBVH_LEAF_BIT 0x80000000u
+#define QBVH_COUNT_SHIFT 27
+#define QBVH_FIRST_MASK 0x07FFFFFFu
+#define QBVH_INV_MAX8 0x3B808081u
+#define QBVH_INV_MAX16 0x37800080u
+
 struct Mesh {
     mat4 modelMatrix;
     mat4 invModelMatrix;
@@ -87,6 +126,8 @@ struct Mesh {
     uint triangleCount;
     uint bvhOffset;
     uint bvhNodeCount;
+    Enum bvhLayout;
+    uint triangleRecordOffset;  // NO_TRIANGLE_RECORDS when the triangles are read through the index buffer
     MaterialHandle materialHandle;
 };
 
@@ -0,0 +1,34 @@
+#version 450
+
+#include "wavefront.glsl"
+
+layout(local_size_x = WAVEFRONT_WORKGROUP_SIZE) in;
+
+vec3 pathColor(in PathState path) {
+    if (DEBUG_VIEW == debug_Bounces) return vec3(path.bounce / float(MAX_BOUNCES));
+    // Still running after the last bounce, see `traceRay`
+    if (path.bounce >= MAX_BOUNCES) return vec3(0.0);
+    return path.radiance;
+}
+
+// Mean of the paths of each pixel, merged into the accumulation image like the compute pipeline
+void main() {
+    uint pixelIndex = gl_GlobalInvocationID.x;
+    uint samplesPerPixel = uint(ubo.samplesPerPixel);
+    if (pixelIndex >= pc.pathCount / samplesPerPixel) return;
+
+    ivec2 pixelCoord = pathPixel(pixelIndex * samplesPerPixel);
+    vec2 screenCoord = vec2(pixelCoord) + 0.5;
+    vec2 ndcPos = screenCoord / ubo.screenSize * 2.0 - 1.0;
+
+    vec3 currColor = vec3(0.0);
+    for (uint i = 0u; i < samplesPerPixel; i++) {
+        currColor += pathColor(pathBuffer.paths[pixelIndex * samplesPerPixel + i]);
+    }
+    currColor /= float(samplesPerPixel);
+
+    vec3 prevColor = imageLoad(accumImage, pixelCoord).rgb;
+    Camera camera = Camera(ubo.cameraPos, ubo.cameraDir, vec3(0, 1, 0));
+    uint seed = initSeed(uvec2(pixelCoord), uint(ubo.frameCount));
+    imageStore(accumImage, pixelCoord, accumulate(camera, prevColor, currColor, pixelCoord, ndcPos, seed));
+}
@@ -0,0 +1,14 @@
+#version 450
+
+#include "wavefront.glsl"
+
+layout(local_size_x = QUEUE_COUNT) in;
+
+// Workgroup counts of the indirect dispatches, one invocation per queue
+void main() {
+    uint queue = gl_LocalInvocationID.x;
+    uint groupSize = uint(WAVEFRONT_WORKGROUP_SIZE);
+    queueCountBuffer.dispatchArgs[3u * queue + 0u] = (queueCountBuffer.counts[queue] + groupSize - 1u) / groupSize;
+    queueCountBuffer.dispatchArgs[3u * queue + 1u] = 1u;
+    queueCountBuffer.dispatchArgs[3u * queue + 2u] = 1u;
+}
@@ -0,0 +1,50 @@
+#version 450
+
+#include "wavefront.glsl"
+
+layout(local_size_x = WAVEFRONT_WORKGROUP_SIZE) in;
+
+// Bins the hits by material type. Without it every hit goes to the first material queue, in the order of the rays
+layout(constant_id = 0) const bool SORT_HITS = true;
+
+// Intersects the rays of the queue: misses and emitters end their path, the other hits go to the queue of their material
+void main() {
+    uint pathIndex;
+    if (!popQueue(queue_Ray + int(pc.rayQueue), pathIndex)) return;
+
+    PathState path = pathBuffer.paths[pathIndex];
+    Ray ray = Ray(path.origin, path.dir);
+    Hit hit = intersection(ray);
+
+    // The debug views stop at the primary hit, like in `traceRay`
+    if (DEBUG_VIEW == debug_Normal) {
+        pathBuffer.paths[pathIndex].radiance = foundIntersection(hit) ? (hit.normal * 0.5 + 0.5) : vec3(0.0);
+        return;
+    }
+    if (DEBUG_VIEW == debug_SelectionMask) {
+        bool selected = false;
+        if (objectBuffer.selectedObjectId >= 0) {
+            Hit selHit = rayObjectIntersection(ray, objectBuffer.objects[objectBuffer.selectedObjectId]);
+            selected = foundIntersection(selHit);
+        }
+        pathBuffer.paths[pathIndex].radiance = selected ? vec3(1.0) : vec3(0.0);
+        return;
+    }
+
+    if (!foundIntersection(hit)) {
+        pathBuffer.paths[pathIndex].radiance = path.radiance + path.throughput * skyColor(ray.dir);
+        return;
+    }
+
+    Material mat = getMaterial(hit.object);
+    if (mat.type == mat_Emissive) {
+        pathBuffer.paths[pathIndex].radiance = path.radiance + path.throughput * mat.albedo * emissiveIntensity(mat);
+        return;
+    }
+
+    storeHit(pathIndex, hit);
+    // Unknown types are shaded with the default material of `scatter`, by the Lambertian pass
+    int materialQueue = (mat.type >= 0 && mat.type < MATERIAL_QUEUE_COUNT) ? mat.type : mat_Lambertian;
+    if (!SORT_HITS) materialQueue = 0;
+    pushQueue(queue_Material + materialQueue, pathIndex);
+}
@@ -0,0 +1,50 @@
+#version 450
+
+#include "wavefront.glsl"
+
+layout(local_size_x = WAVEFRONT_WORKGROUP_SIZE) in;
+
+// One path per sample of every pixel, with the camera rays and random sequences of `computePixelColor`
+void main() {
+    uint pathIndex = gl_GlobalInvocationID.x;
+    if (pathIndex >= pc.pathCount) return;
+
+    ivec2 pixelCoord = pathPixel(pathIndex);
+    vec2 screenCoord = vec2(pixelCoord) + 0.5;
+    vec2 ndcPos = screenCoord / ubo.screenSize * 2.0 - 1.0;
+
+    PathState path;
+    path.origin = vec3(0.0);
+    path.seed = 0u;
+    path.dir = vec3(0.0);
+    path.bounce = 0;
+    path.throughput = vec3(1.0);
+    path.objectType = obj_None;
+    path.radiance = vec3(0.0);
+    path.objectId = 0u;
+    path.hitPoint = vec3(0.0);
+    path.frontFace = 1u;
+    path.hitNormal = vec3(0.0);
+    path.hitT = INFINITY;
+
+    // Only one pixel per block is traced on the low resolution first frame
+    if (ubo.frameCount <= 1 && ubo.lowResolutionScale != 1.0f) {
+        ivec2 blockCoord = ivec2(round(screenCoord / ubo.lowResolutionScale) * ubo.lowResolutionScale);
+        if (pixelCoord != blockCoord) {
+            pathBuffer.paths[pathIndex] = path;
+            return;
+        }
+    }
+
+    Camera camera = Camera(ubo.cameraPos, ubo.cameraDir, vec3(0, 1, 0));
+    uint seed = initSeed(uvec2(pixelCoord), uint(ubo.frameCount));
+    uint sampleState = pcg_hash(seed + pathIndex % uint(ubo.samplesPerPixel));
+    vec2 offset = vec2(rand(sampleState), rand(sampleState)) / ubo.screenSize;
+    Ray ray = getRay(camera, ndcPos + offset, true, sampleState);
+
+    path.origin = ray.origin;
+    path.dir = ray.dir;
+    path.seed = sampleState;
+    pathBuffer.paths[pathIndex] = path;
+    pushQueue(queue_Ray, pathIndex);
+}
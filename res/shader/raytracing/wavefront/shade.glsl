@@ -0,0 +1,72 @@
+#version 450
+
+#include "wavefront.glsl"
+
+layout(local_size_x = WAVEFRONT_WORKGROUP_SIZE) in;
+
+// One pipeline per material type, every invocation of a pass runs the same scattering code. `MATERIAL_ANY` shades the
+// unsorted hits of the first material queue and branches on their type like `scatter`
+#define MATERIAL_ANY -1
+layout(constant_id = 0) const int MATERIAL_TYPE = 0;
+
+// Scattering branches taken by the workgroup, one bit per material type
+shared uint groupMaterials;
+
+// Scatters the hits of the material queue, queues the shadow ray of the light sample and the next ray of the path
+void main() {
+    if (gl_LocalInvocationIndex == 0u) groupMaterials = 0u;
+    barrier();
+
+    uint pathIndex;
+    bool active = popQueue(queue_Material + max(MATERIAL_TYPE, 0), pathIndex);
+    PathState path;
+    Hit hit;
+    Material mat;
+    int type = mat_Lambertian;
+    if (active) {
+        path = pathBuffer.paths[pathIndex];
+        hit = loadHit(path);
+        mat = getMaterial(hit.object);
+        if (MATERIAL_TYPE != MATERIAL_ANY) type = MATERIAL_TYPE;
+        else if (mat.type >= 0 && mat.type < MATERIAL_QUEUE_COUNT) type = mat.type;
+        atomicOr(groupMaterials, 1u << uint(type));
+    }
+
+    // The divergence of the shading, 1 branch per workgroup when the hits are sorted
+    barrier();
+    if (gl_LocalInvocationIndex == 0u && groupMaterials != 0u) {
+        atomicAdd(queueCountBuffer.shadeGroups, 1u);
+        atomicAdd(queueCountBuffer.shadeBranches, uint(bitCount(groupMaterials)));
+    }
+    if (!active) return;
+
+    Ray ray = Ray(path.origin, path.dir);
+    uint seed = path.seed;
+
+    ScatterResult result;
+    switch (type) {
+        case mat_Metal:        scatterMetal(mat, ray, hit, result, seed); break;
+        case mat_Dielectric:   scatterDielectric(mat, ray, hit, result, seed); break;
+        case mat_Glossy:       scatterGlossy(mat, ray, hit, result, seed); break;
+        case mat_Checkerboard: scatterCheckerboard(mat, ray, hit, result, seed); break;
+        default:               scatterLambertian(mat.type == mat_Lambertian ? mat : DEFAULT_MATERIAL, ray, hit, result, seed); break;
+    }
+    if (!result.isScattered) return;
+
+    // Out of bounces, `accumulate.glsl` discards the path like `traceRay` does: its light sample would be wasted
+    pathBuffer.paths[pathIndex].bounce = path.bounce + 1;
+    if (path.bounce + 1 >= MAX_BOUNCES) return;
+
+    path.throughput *= result.attenuation;
+
+    Ray shadowRay;
+    float shadowDist;
+    vec3 direct = sampleLightContribution(mat, hit, result, seed, shadowRay, shadowDist);
+    if (direct != vec3(0.0)) pushShadowRay(shadowRay, shadowDist, path.throughput * direct, pathIndex);
+
+    pathBuffer.paths[pathIndex].origin = result.scattered.origin;
+    pathBuffer.paths[pathIndex].dir = result.scattered.dir;
+    pathBuffer.paths[pathIndex].seed = seed;
+    pathBuffer.paths[pathIndex].throughput = path.throughput;
+    pushQueue(queue_Ray + int(1u - pc.rayQueue), pathIndex);
+}
@@ -0,0 +1,16 @@
+#version 450
+
+#include "wavefront.glsl"
+
+layout(local_size_x = WAVEFRONT_WORKGROUP_SIZE) in;
+
+// Visibility of the light samples, each path has at most one shadow ray per bounce
+void main() {
+    uint slot = gl_GlobalInvocationID.x;
+    if (slot >= queueCountBuffer.counts[queue_Shadow]) return;
+
+    ShadowRay shadowRay = shadowBuffer.rays[slot];
+    if (!occluded(Ray(shadowRay.origin, shadowRay.dir), shadowRay.tMax)) {
+        pathBuffer.paths[shadowRay.pathIndex].radiance += shadowRay.contribution;
+    }
+}
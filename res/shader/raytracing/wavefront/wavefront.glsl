@@ -0,0 +1,104 @@
+#ifndef WAVEFRONT_GLSL
+#define WAVEFRONT_GLSL
+
+// Wavefront path tracing: instead of the `traceRay` loop, every bounce runs as separate passes (extension, shading per
+// material type, shadow rays) which hand the paths to each other through queues
+
+#define RAYTRACING_COMPUTE
+#include "../pathtracer.glsl"
+
+#define WAVEFRONT_WORKGROUP_SIZE 64     // Must match `WAVEFRONT_WORKGROUP_SIZE` on the host
+
+// Queues, must match the host. The extension pass reads one ray queue while the shading passes fill the other one,
+// there is one shading queue per material type (the emissive one stays empty)
+#define queue_Ray       0
+#define queue_Material  2
+#define queue_Shadow    8
+#define QUEUE_COUNT     9
+#define MATERIAL_QUEUE_COUNT 6
+
+struct PathState {
+    vec3 origin;
+    uint seed;
+    vec3 dir;
+    int bounce;         // Scattering events so far, `MAX_BOUNCES` when the path ran out of bounces
+    vec3 throughput;
+    Enum objectType;    // Hit of the last extension, read by the shading passes
+    vec3 radiance;
+    uint objectId;
+    vec3 hitPoint;
+    uint frontFace;
+    vec3 hitNormal;
+    float hitT;
+};
+
+struct ShadowRay {
+    vec3 origin;
+    float tMax;
+    vec3 dir;
+    uint pathIndex;
+    vec3 contribution;  // Added to the radiance of the path when the light is visible
+    float padding;
+};
+
+layout(push_constant) uniform WavefrontConstants {
+    uint pathCount;     // Pixels times samples per pixel
+    uint rayQueue;      // Ray queue read by this bounce
+} pc;
+
+layout(std430, set = 0, binding = 18) buffer PathBuffer {
+    PathState paths[];
+} pathBuffer;
+layout(std430, set = 0, binding = 19) buffer QueueCountBuffer {
+    uint counts[QUEUE_COUNT];
+    uint dispatchArgs[QUEUE_COUNT * 3];     // `VkDispatchIndirectCommand` per queue, written by `args.glsl`
+    uint shadeGroups;       // Workgroups of the shading passes this frame
+    uint shadeBranches;     // Sum of the material types shaded by each of them, read back by the host
+} queueCountBuffer;
+layout(std430, set = 0, binding = 20) buffer QueueBuffer {
+    uint entries[];     // Path indices, queue `q` starts at `q * pc.pathCount`
+} queueBuffer;
+layout(std430, set = 0, binding = 21) buffer ShadowBuffer {
+    ShadowRay rays[];
+} shadowBuffer;
+
+void pushQueue(int queue, uint pathIndex) {
+    uint slot = atomicAdd(queueCountBuffer.counts[queue], 1u);
+    queueBuffer.entries[uint(queue) * pc.pathCount + slot] = pathIndex;
+}
+
+// Path handled by this invocation, false past the end of the queue
+bool popQueue(int queue, out uint pathIndex) {
+    uint slot = gl_GlobalInvocationID.x;
+    pathIndex = 0u;
+    if (slot >= queueCountBuffer.counts[queue]) return false;
+    pathIndex = queueBuffer.entries[uint(queue) * pc.pathCount + slot];
+    return true;
+}
+
+void pushShadowRay(in Ray ray, in float tMax, in vec3 contribution, uint pathIndex) {
+    uint slot = atomicAdd(queueCountBuffer.counts[queue_Shadow], 1u);
+    shadowBuffer.rays[slot] = ShadowRay(ray.origin, tMax, ray.dir, pathIndex, contribution, 0.0);
+}
+
+void storeHit(uint pathIndex, in Hit hit) {
+    pathBuffer.paths[pathIndex].hitPoint = hit.p;
+    pathBuffer.paths[pathIndex].hitNormal = hit.normal;
+    pathBuffer.paths[pathIndex].hitT = hit.t;
+    pathBuffer.paths[pathIndex].frontFace = hit.front_face ? 1u : 0u;
+    pathBuffer.paths[pathIndex].objectType = hit.object.type;
+    pathBuffer.paths[pathIndex].objectId = hit.object.id;
+}
+
+Hit loadHit(in PathState path) {
+    return Hit(path.hitPoint, path.hitNormal, path.hitT, path.frontFace != 0u, Object(path.objectType, path.objectId));
+}
+
+// Samples of a pixel are consecutive paths
+ivec2 pathPixel(uint pathIndex) {
+    uint pixelIndex = pathIndex / uint(ubo.samplesPerPixel);
+    uint width = uint(ubo.screenSize.x);
+    return ivec2(pixelIndex % width, pixelIndex / width);
+}
+
+#endif
@@ -2,9 +2,13 @@
 
 #include <algorithm>
 #include <cmath>
+#include <filesystem>
+#include <fstream>
 
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include <stb_image_write.h>
+#include "./utils/image.hpp"
+#include "./utils/parallel.hpp"
+
+#define SHADER_VARIANT_DIR "cache/shader"
 
 const std::vector<ScreenVertex> vertices = {
     { .position={ 1.0f, 1.0f} },
@@ -87,6 +91,7 @@ Application::Application() {
         screenshotWidth = extent.width;
         screenshotHeight = extent.height;
         screenshotBuffer = engine.initReadbackBuffer(static_cast<size_t>(screenshotWidth) * screenshotHeight * 4 * sizeof(float));
+        cpuSampleBuffers = engine.initBufferList(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, static_cast<size_t>(extent.width) * extent.height * 4 * sizeof(float));
     }
     
     initScene();
@@ -96,6 +101,7 @@ Application::Application() {
     for (size_t i = 0; i < scene.getBufferLists().size(); i++) {
         setLayout.addBinding(VK_SHADER_STAGE_FRAGMENT_BIT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
     }
+    setLayout.addBinding(VK_SHADER_STAGE_FRAGMENT_BIT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);     // CPU samples
     engine.initDescriptorSetLayout(setLayout);
     
     screenSetLayout.addBinding(VK_SHADER_STAGE_FRAGMENT_BIT, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
@@ -132,6 +138,7 @@ Application::Application() {
             for (bufferList_t &buffers : storageBuffers) {
                 descriptors.push_back(&buffers);
             }
+            descriptors.push_back(&cpuSampleBuffers);
 
             descriptorSets[i] = engine.initDescriptorSetList(setLayout, descriptors);
 
@@ -145,6 +152,7 @@ Application::Application() {
 
 
 Application::~Application() {
+    hybridWorker.stop();
     engine.waitIdle();
 
     engine.destroyDescriptorSetLayout(setLayout);
@@ -161,8 +169,11 @@ Application::~Application() {
     engine.destroyBufferList(raytracingUniformBuffers);
     engine.destroyBufferList(screenUniformBuffers);
     engine.destroyBuffer(screenshotBuffer);
+    engine.destroyBufferList(cpuSampleBuffers);
     scene.destroy(engine);
     
+    stopVariantBuilder();
+    destroyPipelineVariants();
     engine.destroyGraphicsPipeline(pipeline);
     engine.destroyGraphicsPipeline(screenPipeline);
     
@@ -234,16 +245,16 @@ void Application::run() {
                 );
                 
                 // Bind current descriptor set
-                engine.getDescriptorSet(descriptorSets[frame]).bind(commandBuffer, pipeline.getLayout());
+                engine.getDescriptorSet(descriptorSets[frame]).bind(commandBuffer, activePipeline.getLayout());
                 
-                pipeline.bind(commandBuffer);
+                activePipeline.bind(commandBuffer);
 
                 vertexBuffer.bindVertex(commandBuffer);
                 indexBuffer.bindIndex(commandBuffer, VK_INDEX_TYPE_UINT16);
                 
-                pipeline.setViewport(commandBuffer, viewport);
-                pipeline.setScissor(commandBuffer, scissor);
-                pipeline.drawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()));
+                activePipeline.setViewport(commandBuffer, viewport);
+                activePipeline.setScissor(commandBuffer, scissor);
+                activePipeline.drawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()));
 
                 engine.endDynamicRenderer(commandBuffer);
                 engine.barrier(
@@ -357,6 +368,7 @@ void Application::run() {
 
 
 void Application::onFrameStart(float dt) {
+    mergeCpuSamples();
     fillUBOs(raytracingUBO, screenUBO);
     engine.fillBuffer(engine.getBuffer(raytracingUniformBuffers), &raytracingUBO);
     scene.fillBuffers(engine);
@@ -374,6 +386,7 @@ void Application::onFrameStart(float dt) {
             for (bufferList_t &buffers : storageBuffers) {
                 descriptors.push_back(&buffers);
             }
+            descriptors.push_back(&cpuSampleBuffers);
             
             descriptorSets[i] = engine.initDescriptorSetList(setLayout, descriptors);
         }
@@ -496,6 +509,56 @@ void Application::onFrameStart(float dt) {
         sampleCount = 0;
         restartRender = false;
     }
+
+    selectPipelineVariant();
+    updateHybridWorker();
+}
+
+void Application::mergeCpuSamples() {
+    cpuSampleCount = 0;
+    // The shader ignores the previous image on the first two frames
+    if (!hybridWorker.isRunning() || frameCount < 3) return;
+
+    uint32_t count;
+    if (!hybridWorker.takeSamples(cpuSamples, count)) return;
+    engine.fillBuffer(engine.getBuffer(cpuSampleBuffers), cpuSamples.data());
+
+    // Counted as frames of the GPU so the `1 / frameCount` weight of the shader stays the one of a sample.
+    // The worker renders `samplesPerPixelRuntime` samples per frame, which can't change in render mode
+    cpuSampleCount = static_cast<int>(count);
+    frameCount += cpuSampleCount / samplesPerPixelRuntime;
+    sampleCount += count;
+    samplesPerSecAccumSamples += static_cast<double>(count);
+}
+
+// CPU samples only in render mode, where neither the camera nor the scene can change
+void Application::updateHybridWorker() {
+    const bool enabled = renderMode && hybridRendering && !renderModePendingExit;
+    if (!enabled && hybridWorker.isRunning()) {
+        hybridWorker.stop();
+    } else if (enabled && !hybridWorker.isRunning()) {
+        // One core is left to record and submit the GPU frames
+        const unsigned threads = std::max(resolveThreadCount(0), 2u) - 1;
+        hybridWorker.start(scene, getCpuRenderParams(), static_cast<int>(threads));
+    }
+}
+
+CpuRenderParams Application::getCpuRenderParams() {
+    const VkExtent2D extent = engine.getExtent();
+    CpuRenderParams params;
+    params.cameraPos = camera.getPosition();
+    params.cameraDir = camera.getDirection();
+    params.tanHFov = camera.getTanHFov();
+    params.aperture = camera.getAperture();
+    params.focusDepth = camera.getFocusDepth();
+    params.width = extent.width;
+    params.height = extent.height;
+    params.lightMode = lightMode;
+    params.maxBounces = maxBounces;
+    params.samplesPerPixel = samplesPerPixelRuntime;
+    params.importanceSampling = importanceSampling;
+    params.debugView = static_cast<int>(debugView);
+    return params;
 }
 
 void Application::drawUI(CommandBuffer commandBuffer) {
@@ -629,7 +692,8 @@ void Application::drawUI(CommandBuffer commandBuffer) {
         ImGui::PopItemWidth();
         
         ImGui::PushItemWidth(-FLT_MIN);
-        ImGui::DragInt("##Max bounces", &maxBounces, 1, 1, 20, "Bounces: %d");
+        // Clamped so typed values stay in the range the variants are compiled for
+        ImGui::DragInt("##Max bounces", &maxBounces, 1, 1, 20, "Bounces: %d", ImGuiSliderFlags_AlwaysClamp);
         ImGui::DragInt("##Samples", &samplesPerPixelRuntime, 1, 1, 10, "Runtime Samples: %d");
         ImGui::DragInt("##Samples Per Pixel", &samplesPerPixelRender, 1, 1, 4096, "Render Samples: %d");
         if (ImGui::DragFloat("##Low Resolution Scale", &lowResolutionScale, 1.0f, 1.0f, 50.0f, "Low Res: %.0f")) {
@@ -637,6 +701,7 @@ void Application::drawUI(CommandBuffer commandBuffer) {
         }
         ImGui::PopItemWidth();
         ImGui::Checkbox("Importance Sampling", &importanceSampling);
+        ImGui::Checkbox("CPU Samples in Render", &hybridRendering);
 
         const char *debugViews[] = { "None", "Bounces", "Normal", "Selection Mask" };
         ImGui::PushItemWidth(-FLT_MIN);
@@ -720,6 +785,7 @@ void Application::fillUBOs(RaytracingUBO &raytracingUBO, ScreenUBO &screenUBO) {
     raytracingUBO.samplesPerPixel = samplesPerPixelRuntime;
     raytracingUBO.importanceSampling = static_cast<int>(importanceSampling);
     raytracingUBO.debugView = static_cast<int>(debugView);
+    raytracingUBO.cpuSampleCount = cpuSampleCount;
 
     // Screen UBO
     screenUBO.frameCount = frameCount;
@@ -731,47 +797,66 @@ void Application::rebuildPipeline() {
     engine.waitIdle();
 
     std::string vertShaderPath = "./res/shader/vert.glsl";
+    std::string fragShaderPath = "./res/shader/raytracing/raytracing.glsl";
+    // Built from the previous shaders, the next frame queues them again
+    destroyPipelineVariants();
+    if (!buildRaytracingPipeline(vertShaderPath, fragShaderPath, pipeline)) return;
+
+    std::cout << "[INFO] Built the main pipeline by recompiling [" << vertShaderPath << "] and [" << fragShaderPath << "]" << std::endl;
+    notificationManager.pushMessage(
+        NotificationType::Info,
+        "(Re)Built the main pipeline"
+    );
+}
+
+// Replaces `target` when it already exists, leaves it untouched when a shader fails to compile.
+// Also called from `variantBuilder`, which passes `notify = false` since the notifications belong to the main thread
+bool Application::buildRaytracingPipeline(const std::string &vertShaderPath, const std::string &fragShaderPath, GraphicsPipeline &target,
+                                          bool notify) {
     Shader vertShader;
     try {
         vertShader = engine.initShader(VK_SHADER_STAGE_VERTEX_BIT, vertShaderPath);
     } catch (...) {
         std::cerr << "[ERROR] Failed to compile shader [" << vertShaderPath << "]: pipeline not built" << std::endl;
-        notificationManager.pushMessage(
-            NotificationType::Error,
-            "Failed to compile shader [" + vertShaderPath + "]: pipeline not built"
-        );
-        return;
+        if (notify) {
+            notificationManager.pushMessage(
+                NotificationType::Error,
+                "Failed to compile shader [" + vertShaderPath + "]: pipeline not built"
+            );
+        }
+        return false;
     }
     
-    std::string fragShaderPath = "./res/shader/raytracing/raytracing.glsl";
     Shader fragShader;
     try {
         fragShader = engine.initShader(VK_SHADER_STAGE_FRAGMENT_BIT, fragShaderPath);
     } catch (...) {
         engine.destroyShader(vertShader);
         std::cerr << "[ERROR] Failed to compile shader [" << fragShaderPath << "]: pipeline not built" << std::endl;
-        notificationManager.pushMessage(
-            NotificationType::Error,
-            "Failed to compile shader [" + fragShaderPath + "]: pipeline not built"
-        );
-        return;
+        if (notify) {
+            notificationManager.pushMessage(
+                NotificationType::Error,
+                "Failed to compile shader [" + fragShaderPath + "]: pipeline not built"
+            );
+        }
+        return false;
     }
 
     VertexInput<ScreenVertex> vertexInput;
     vertexInput.addAttributeDescription(VK_FORMAT_R32G32_SFLOAT, offsetof(ScreenVertex, position));
 
-    if (pipeline.get() != VK_NULL_HANDLE) {
+    if (target.get() != VK_NULL_HANDLE) {
         GraphicsPipeline newPipeline = engine.initGraphicsPipeline(
             vertexInput.get(),
             { vertShader, fragShader },
             { setLayout },
-            pipeline,
+            target,
             VK_FORMAT_R32G32B32A32_SFLOAT
         );
-        engine.destroyGraphicsPipeline(pipeline);
-        pipeline = newPipeline;
+        engine.destroyGraphicsPipeline(target);
+        target = newPipeline;
     } else {
-        pipeline = engine.initGraphicsPipeline(
+        target = engine.initGraphicsPipeline(
             vertexInput.get(),
             { vertShader, fragShader },
             { setLayout },
@@ -782,12 +867,164 @@ void Application::rebuildPipeline() {
 
     engine.destroyShader(vertShader);
     engine.destroyShader(fragShader);
+    return true;
+}
 
-    std::cout << "[INFO] Built the main pipeline by recompiling [" << vertShaderPath << "] and [" << fragShaderPath << "]" << std::endl;
-    notificationManager.pushMessage(
-        NotificationType::Info,
-        "(Re)Built the main pipeline"
-    );
+// Settings compiled into the variants, see `inputs.glsl`
+Application::PipelineVariantSettings Application::getPipelineVariantSettings() const {
+    return {
+        .maxBounces=std::clamp(maxBounces, 0, 0xFFFF),
+        .importanceSampling=importanceSampling,
+        .debugView=debugView,
+        .lightMode=lightMode
+    };
+}
+
+uint64_t Application::getPipelineVariantKey(const PipelineVariantSettings &settings) {
+    return static_cast<uint64_t>(settings.maxBounces)
+        | static_cast<uint64_t>(settings.importanceSampling) << 16
+        | static_cast<uint64_t>(static_cast<int>(settings.debugView)) << 24
+        | static_cast<uint64_t>(static_cast<int>(settings.lightMode)) << 32;
+}
+
+// The engine compiles files, so each variant is a file defining its settings before including the shader
+bool Application::writePipelineVariant(const PipelineVariantSettings &settings, std::string &path) {
+    const std::string name = "raytracing_b" + std::to_string(settings.maxBounces) + "_i" + std::to_string(settings.importanceSampling)
+        + "_d" + std::to_string(static_cast<int>(settings.debugView)) + "_l" + std::to_string(static_cast<int>(settings.lightMode));
+    path = std::string(SHADER_VARIANT_DIR) + "/" + name + ".glsl";
+    std::error_code error;
+    std::filesystem::create_directories(SHADER_VARIANT_DIR, error);
+    std::ofstream file(path);
+    file << "#version 450\n\n"
+         << "// Variant of `raytracing.glsl` written by `Application::writePipelineVariant`\n"
+         << "#define VARIANT_MAX_BOUNCES " << settings.maxBounces << "\n"
+         << "#define VARIANT_IMPORTANCE_SAMPLING " << static_cast<int>(settings.importanceSampling) << "\n"
+         << "#define VARIANT_DEBUG_VIEW " << static_cast<int>(settings.debugView) << "\n"
+         << "#define VARIANT_LIGHT_MODE " << static_cast<int>(settings.lightMode) << "\n\n"
+         << "#include \"../../res/shader/raytracing/raytracing_fragment.glsl\"\n";
+    file.close();
+    return static_cast<bool>(file);
+}
+
+// The variant of the current settings first, then every other combination of the discrete settings
+void Application::queuePipelineVariants(const PipelineVariantSettings &current) {
+    std::vector<PipelineVariantSettings> queue = { current };
+    for (int importance = 0; importance <= 1; importance++) {
+        for (int view = static_cast<int>(DebugView::None); view <= static_cast<int>(DebugView::SelectionMask); view++) {
+            for (int mode = LightMode::Day; mode <= LightMode::Empty; mode++) {
+                queue.push_back({
+                    .maxBounces=current.maxBounces,
+                    .importanceSampling=importance != 0,
+                    .debugView=static_cast<DebugView>(view),
+                    .lightMode=static_cast<LightMode>(mode)
+                });
+            }
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(variantMutex);
+        variantQueue.clear();
+        for (const PipelineVariantSettings &settings : queue) {
+            if (pipelineVariants.contains(getPipelineVariantKey(settings))) continue;
+            if (&settings != &queue.front() && getPipelineVariantKey(settings) == getPipelineVariantKey(current)) continue;
+            variantQueue.push_back(settings);
+        }
+    }
+    queuedVariantBounces = current.maxBounces;
+    if (!variantBuilder.joinable()) variantBuilder = std::thread(&Application::runVariantBuilder, this);
+    variantWake.notify_one();
+}
+
+// Background thread, only touches the engine to compile shaders and create pipelines
+void Application::runVariantBuilder() {
+    while (true) {
+        PipelineVariantSettings settings;
+        {
+            std::unique_lock<std::mutex> lock(variantMutex);
+            variantWake.wait(lock, [&] { return variantBuilderQuitting || !variantQueue.empty(); });
+            if (variantBuilderQuitting) return;
+            settings = variantQueue.front();
+            variantQueue.pop_front();
+            variantBuilderBusy = true;
+        }
+
+        BuiltPipelineVariant built = { .key=getPipelineVariantKey(settings), .path="", .pipeline=GraphicsPipeline() };
+        if (writePipelineVariant(settings, built.path)) {
+            buildRaytracingPipeline("./res/shader/vert.glsl", built.path, built.pipeline, false);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(variantMutex);
+            builtVariants.push_back(std::move(built));
+            variantBuilderBusy = false;
+        }
+        variantIdle.notify_all();
+    }
+}
+
+// Called by the main thread, which alone touches `pipelineVariants`
+void Application::collectBuiltVariants() {
+    std::vector<BuiltPipelineVariant> built;
+    {
+        std::lock_guard<std::mutex> lock(variantMutex);
+        built.swap(builtVariants);
+    }
+
+    for (BuiltPipelineVariant &variant : built) {
+        const bool valid = variant.pipeline.get() != VK_NULL_HANDLE;
+        if (!pipelineVariants.emplace(variant.key, variant.pipeline).second) {
+            // Queued again while it was building, never bound
+            if (valid) engine.destroyGraphicsPipeline(variant.pipeline);
+            continue;
+        }
+        if (valid) {
+            std::cout << "[INFO] Built the pipeline variant [" << variant.path << "]" << std::endl;
+        } else {
+            std::cerr << "[WARN] Failed to build the pipeline variant [" << variant.path << "], rendering with the generic pipeline" << std::endl;
+            notificationManager.pushMessage(NotificationType::Error, "Failed to build the pipeline variant [" + variant.path + "]");
+        }
+    }
+}
+
+void Application::stopVariantBuilder() {
+    if (!variantBuilder.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(variantMutex);
+        variantBuilderQuitting = true;
+    }
+    variantWake.notify_one();
+    variantBuilder.join();
+    variantBuilderQuitting = false;
+}
+
+void Application::selectPipelineVariant() {
+    if (pipeline.get() == VK_NULL_HANDLE) return;
+    const PipelineVariantSettings settings = getPipelineVariantSettings();
+
+    // Dragging the bounce count goes through many values, their variants are queued once the UI is released
+    if (settings.maxBounces != queuedVariantBounces && !ImGui::IsAnyItemActive()) queuePipelineVariants(settings);
+    collectBuiltVariants();
+
+    auto variant = pipelineVariants.find(getPipelineVariantKey(settings));
+    activePipeline = variant != pipelineVariants.end() && variant->second.get() != VK_NULL_HANDLE ? variant->second : pipeline;
+}
+
+// Waits for the variant being built, the ones still queued are dropped and queued again by the next frame
+void Application::destroyPipelineVariants() {
+    {
+        std::unique_lock<std::mutex> lock(variantMutex);
+        variantQueue.clear();
+        variantIdle.wait(lock, [&] { return !variantBuilderBusy; });
+    }
+    collectBuiltVariants();
+
+    for (auto &[key, variant] : pipelineVariants) {
+        if (variant.get() != VK_NULL_HANDLE) engine.destroyGraphicsPipeline(variant);
+    }
+    pipelineVariants.clear();
+    activePipeline = pipeline;
+    queuedVariantBounces = -1;
 }
 
 void Application::copyImageToScreenshotBuffer(CommandBuffer commandBuffer, Image image) {
@@ -814,20 +1051,7 @@ void Application::saveScreenshotBuffer(std::string path) {
     std::vector<float> floatPixels(floatCount);
     engine.readBuffer(screenshotBuffer, floatPixels.data(), byteCount);
 
-    std::vector<uint8_t> pixels(static_cast<size_t>(screenshotWidth) * screenshotHeight * 4);
-    auto toByte = [](float v) -> uint8_t {
-        v = std::clamp(v, 0.0f, 1.0f);
-        v = std::pow(v, 1.0f / 2.2f);
-        return static_cast<uint8_t>(v * 255.0f + 0.5f);
-    };
-    for (size_t i = 0; i < floatCount; i += 4) {
-        pixels[i + 0] = toByte(floatPixels[i + 0]);
-        pixels[i + 1] = toByte(floatPixels[i + 1]);
-        pixels[i + 2] = toByte(floatPixels[i + 2]);
-        pixels[i + 3] = 255;
-    }
-
-    if (stbi_write_png(path.c_str(), static_cast<int>(screenshotWidth), static_cast<int>(screenshotHeight), 4, pixels.data(), static_cast<int>(screenshotWidth) * 4) != 0) {
+    if (writePngFromFloats(path, screenshotWidth, screenshotHeight, floatPixels.data())) {
         notificationManager.pushMessage(NotificationType::Info, "Saved screenshot to " + path);
     } else {
         notificationManager.pushMessage(NotificationType::Error, "Failed to write screenshot");
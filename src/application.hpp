@@ -1,5 +1,11 @@
 #pragma once
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include <glm/glm.hpp>
@@ -7,6 +13,8 @@
 
 #include "./engine/engine.hpp"
 #include "./camera.hpp"
+#include "./cpu/hybrid_worker.hpp"
+#include "./gpu/raytracing_ubo.hpp"
 #include "./notification.hpp"
 #include "./scene/scene.hpp"
 #include "./scene/scene_preset.hpp"
@@ -18,35 +26,6 @@ struct ScreenVertex {
     glm::vec2 position;
 };
 
-struct RaytracingUBO {
-    alignas(16) glm::vec3 cameraPos;
-    alignas(16) glm::vec3 cameraDir;
-    float tanHFov;
-    float aperture;
-    float focusDepth;
-
-    alignas(8) glm::vec2 screenSize;
-    float aspect;
-    float lowResolutionScale;
-    
-    int frameCount;
-    float time;
-
-    LightMode lightMode;
-
-    int maxBounces;
-    int samplesPerPixel;
-    int importanceSampling;
-    int debugView;
-};
-
-enum class DebugView : int {
-    None = 0,
-    Bounces,
-    Normal,
-    SelectionMask
-};
-
 struct ScreenUBO {
     int frameCount;
     float lowResolutionScale;
@@ -68,11 +47,42 @@ private:
     
     DescriptorSetLayout setLayout, screenSetLayout;
     descriptorSetList_t descriptorSets[2], screenDescriptorSets[2];
+    // Always the fragment path tracer: the pinned engine only creates graphics pipelines, so the compute and wavefront
+    // pipelines are selected in `HeadlessGpuRenderer` (`gpu_render --pipeline`) instead
     GraphicsPipeline pipeline, screenPipeline;
+    // Raytracing pipelines with the settings of `getPipelineVariantKey` compiled in. `pipeline` reads them from the UBO
+    // and renders until the variant exists, an empty entry is a variant that failed to build
+    std::unordered_map<uint64_t, GraphicsPipeline> pipelineVariants;
+    GraphicsPipeline activePipeline;
+
+    // Settings compiled into a variant, the bounce count is clamped the same way in the key and the shader
+    struct PipelineVariantSettings {
+        int maxBounces;
+        bool importanceSampling;
+        DebugView debugView;
+        LightMode lightMode;
+    };
+    struct BuiltPipelineVariant {
+        uint64_t key;
+        std::string path;
+        GraphicsPipeline pipeline;  // Empty when the variant failed to build
+    };
+    // Every combination of the discrete settings for the current bounce count is compiled on `variantBuilder`,
+    // so switching a setting only selects a pipeline. The builds are handed over through `builtVariants`
+    std::thread variantBuilder;
+    std::mutex variantMutex;
+    std::condition_variable variantWake;
+    std::condition_variable variantIdle;
+    std::deque<PipelineVariantSettings> variantQueue;
+    std::vector<BuiltPipelineVariant> builtVariants;
+    bool variantBuilderBusy = false;
+    bool variantBuilderQuitting = false;
+    int queuedVariantBounces = -1;  // Bounce count of the variants queued, -1 when they must be queued again
     
     Buffer vertexBuffer, indexBuffer;
     bufferList_t raytracingUniformBuffers, screenUniformBuffers;
     Buffer screenshotBuffer;
+    bufferList_t cpuSampleBuffers;
 
     Scene scene;
 
@@ -94,6 +104,12 @@ private:
     bool importanceSampling = true;
     DebugView debugView = DebugView::None;
 
+    // CPU samples merged into the accumulation of the render mode
+    HybridCpuWorker hybridWorker;
+    bool hybridRendering = false;
+    std::vector<float> cpuSamples;
+    int cpuSampleCount = 0;     // Merged by the current frame
+
     bool uiCapturesMouse = false;
     bool uiCapturesKeyboard = false;
     bool uiToggled = true;
@@ -117,11 +133,25 @@ private:
     void initScene();
 
     void onFrameStart(float dt);
+    void mergeCpuSamples();
+    void updateHybridWorker();
+    CpuRenderParams getCpuRenderParams();
     void drawUI(CommandBuffer commandBuffer);
     void fillUBOs(RaytracingUBO &raytracingUBO, ScreenUBO &screenUBO);
     float lastTime = 0.0f;
 
     void rebuildPipeline();
+    bool buildRaytracingPipeline(const std::string &vertShaderPath, const std::string &fragShaderPath, GraphicsPipeline &target,
+                                 bool notify = true);
+    PipelineVariantSettings getPipelineVariantSettings() const;
+    static uint64_t getPipelineVariantKey(const PipelineVariantSettings &settings);
+    static bool writePipelineVariant(const PipelineVariantSettings &settings, std::string &path);
+    void queuePipelineVariants(const PipelineVariantSettings &current);
+    void runVariantBuilder();
+    void collectBuiltVariants();
+    void stopVariantBuilder();
+    void selectPipelineVariant();
+    void destroyPipelineVariants();
 
     void copyImageToScreenshotBuffer(CommandBuffer commandBuffer, Image image);
     void saveScreenshotBuffer(std::string path);
@@ -0,0 +1,321 @@
+#include "cpu_integrator.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "cpu_random.hpp"
+
+#define CPU_PI 3.14159265f
+
+// Same values as `DebugView`, kept here so the CPU renderer doesn't depend on the application
+#define DEBUG_BOUNCES 1
+#define DEBUG_NORMAL 2
+#define DEBUG_SELECTION_MASK 3
+
+// ================ CAMERA ================
+static Ray getRay(const CpuRenderParams &params, glm::vec2 ndcPos, bool enableFocus, uint32_t &seed) {
+    glm::vec3 forward = glm::normalize(params.cameraDir);
+    glm::vec3 right = glm::normalize(glm::cross(forward, glm::vec3(0.0f, 1.0f, 0.0f)));
+    glm::vec3 up = glm::cross(right, forward);
+
+    float scrX = ndcPos.x * 0.5f + 0.5f;
+    float scrY = ndcPos.y * 0.5f + 0.5f;
+    float aspect = static_cast<float>(params.width) / static_cast<float>(params.height);
+    float camX = (2.0f * scrX - 1.0f) * aspect * params.tanHFov;
+    float camY = (1.0f - 2.0f * scrY) * params.tanHFov;
+
+    glm::vec3 offset(0.0f);
+    if (enableFocus) {
+        glm::vec2 p = randomInDisk(seed);
+        float lensR = params.aperture * 0.5f;
+        offset = lensR * (right * p.x + up * p.y);
+    }
+
+    glm::vec3 origin = params.cameraPos + offset;
+    glm::vec3 target = params.cameraPos + (camX * right + camY * up + forward) * params.focusDepth;
+    return { origin, glm::normalize(target - origin) };
+}
+
+static glm::vec3 skyColor(const CpuRenderParams &params, const glm::vec3 &dir) {
+    float t = glm::clamp(0.5f * (dir.y + 1.0f), 0.0f, 1.0f);
+    glm::vec3 zenith, horizon;
+    switch (params.lightMode) {
+        case LightMode::Day:
+            zenith = glm::vec3(0.5f, 0.7f, 1.0f);
+            horizon = glm::vec3(1.0f, 1.0f, 1.0f);
+            break;
+        case LightMode::Sunset:
+            zenith = glm::vec3(0.2f, 0.1f, 0.4f);
+            horizon = glm::vec3(1.0f, 0.4f, 0.2f);
+            break;
+        case LightMode::Night:
+            zenith = glm::vec3(0.01f, 0.01f, 0.03f);
+            horizon = glm::vec3(0.05f, 0.05f, 0.1f);
+            break;
+        case LightMode::Empty:
+            return glm::vec3(0.0f);
+        default:
+            return glm::vec3(1.0f, 0.0f, 1.0f);
+    }
+
+    glm::vec3 color = glm::mix(horizon, zenith, t);
+    color += glm::vec3(0.05f, 0.02f, 0.0f) * std::pow(1.0f - t, 3.0f);
+    return color;
+}
+
+// ================ MATERIALS ================
+static float schlickApprox(float cosine, float ri) {
+    float r0 = (1.0f - ri) / (1.0f + ri);
+    r0 = r0*r0;
+    return r0 + (1.0f - r0) * std::pow(1.0f - cosine, 5.0f);
+}
+
+static void scatterLambertian(const glm::vec3 &albedo, const CpuHit &hit, ScatterResult &result, uint32_t &seed) {
+    glm::vec3 dir = hit.normal + randomInSphere(seed);
+    if (glm::length(dir) < CPU_EPS) dir = hit.normal;
+    dir = glm::normalize(dir);
+
+    result.scattered = { hit.p + hit.normal * CPU_EPS, dir };
+    result.attenuation = albedo / CPU_PI;
+    result.isScattered = true;
+    result.isDiffuse = true;
+}
+
+static void scatterMetal(const glm::vec3 &albedo, float fuzz, const Ray &ray, const CpuHit &hit, ScatterResult &result, uint32_t &seed) {
+    glm::vec3 dir = glm::reflect(ray.dir, hit.normal);
+    dir = glm::normalize(dir + randomInSphere(seed) * fuzz);
+
+    result.scattered = { hit.p + hit.normal * CPU_EPS, dir };
+    result.attenuation = albedo;
+    result.isScattered = true;
+    result.isDiffuse = false;
+}
+
+static void scatterDielectric(const Material &mat, const Ray &ray, const CpuHit &hit, ScatterResult &result, uint32_t &seed) {
+    const float ior = mat.payload[0];
+    const float fuzz = mat.payload[1];
+    float ri = hit.frontFace ? (1.0f / ior) : ior;
+
+    float cosTheta = std::min(glm::dot(-ray.dir, hit.normal), 1.0f);
+    float sinTheta = std::sqrt(1.0f - cosTheta*cosTheta);
+
+    glm::vec3 dir;
+    if (ri * sinTheta > 1.0f || schlickApprox(cosTheta, ri) > randFloat(seed)) {
+        dir = glm::reflect(ray.dir, hit.normal);
+        dir = glm::normalize(dir + randomInSphere(seed) * fuzz);
+    } else {
+        dir = glm::refract(ray.dir, hit.normal, ri);
+        dir = glm::normalize(dir + randomInSphere(seed) * fuzz);
+    }
+
+    float side = glm::dot(hit.normal, dir) > 0.0f ? 1.0f : -1.0f;
+    result.scattered = { hit.p + hit.normal * CPU_EPS * side, dir };
+    result.attenuation = mat.albedo;
+    result.isScattered = true;
+    result.isDiffuse = false;
+}
+
+static void scatterGlossy(const Material &mat, const Ray &ray, const CpuHit &hit, ScatterResult &result, uint32_t &seed) {
+    float ri = hit.frontFace ? (1.0f / mat.payload[0]) : mat.payload[0];
+    float cosTheta = std::min(glm::dot(-ray.dir, hit.normal), 1.0f);
+
+    if (schlickApprox(cosTheta, ri) > randFloat(seed))
+        scatterMetal(glm::vec3(1.0f), mat.payload[1], ray, hit, result, seed);
+    else
+        scatterLambertian(mat.albedo, hit, result, seed);
+}
+
+static void scatterCheckerboard(const Material &mat, const Ray &ray, CpuHit hit, ScatterResult &result, uint32_t &seed) {
+    const float scale = mat.payload[0];
+    glm::vec2 p = glm::vec2(hit.p.x, hit.p.z);
+    glm::vec2 ip = glm::round(p / scale);
+    glm::vec3 color = glm::vec3(0.2f, 0.3f, 0.5f);
+
+    // Gutters on the tile edges, same shape as the shader
+    float s = 6.0f;
+    glm::vec2 uv = p / scale;
+    glm::vec2 tileUv = glm::fract(uv - 0.5f);
+    glm::vec2 centered = tileUv - 0.5f;
+    glm::vec2 edgeDist = 0.5f - glm::abs(centered);
+    float gutterWidth = 0.25f / s;
+    glm::vec2 border = glm::step(edgeDist, glm::vec2(gutterWidth));
+    if (border.x > 0.0f || border.y > 0.0f) {
+        glm::vec2 falloff = glm::clamp((gutterWidth - edgeDist) * (1.0f / gutterWidth), 0.0f, 1.0f) * border;
+        glm::vec2 normalOffset = glm::sign(centered) * falloff;
+        float len2 = glm::dot(normalOffset, normalOffset);
+        if (len2 > 0.0f) {
+            normalOffset *= glm::inversesqrt(std::max(len2, CPU_EPS)) * 0.85f;
+            hit.normal = glm::normalize(hit.normal + glm::vec3(normalOffset.x, 0.0f, normalOffset.y));
+        }
+    }
+
+    if (border.x > 0.0f || border.y > 0.0f) {
+        scatterLambertian(color * 0.4f, hit, result, seed);
+    } else if (static_cast<int>(ip.x + ip.y + 1.0f) % 2 == 0) {
+        scatterMetal(color * 0.6f, 0.01f, ray, hit, result, seed);
+    } else {
+        scatterLambertian(color, hit, result, seed);
+    }
+}
+
+void scatter(const Material &mat, const Ray &ray, const CpuHit &hit, ScatterResult &result, uint32_t &seed) {
+    switch (mat.type) {
+        case MaterialType::Lambertian:   scatterLambertian(mat.albedo, hit, result, seed); break;
+        case MaterialType::Metal:        scatterMetal(mat.albedo, mat.payload[0], ray, hit, result, seed); break;
+        case MaterialType::Dielectric:   scatterDielectric(mat, ray, hit, result, seed); break;
+        case MaterialType::Emissive:
+            result.attenuation = mat.albedo * mat.payload[0];
+            result.isScattered = false;
+            break;
+        case MaterialType::Glossy:       scatterGlossy(mat, ray, hit, result, seed); break;
+        case MaterialType::Checkerboard: scatterCheckerboard(mat, ray, hit, result, seed); break;
+        default:                         scatterLambertian(glm::vec3(1.0f, 0.0f, 1.0f) * 0.7f, hit, result, seed); break;
+    }
+}
+
+// ================ LIGHTS ================
+int getLightId(const CpuScene &scene, uint32_t &seed) {
+    const float totalArea = scene.getTotalLightArea();
+    const std::vector<GpuLight> &lights = scene.getLights();
+    if (totalArea == 0.0f || lights.empty()) return -1;
+
+    // First light whose cumulated share reaches `r`, a draw of exactly 0 picks the first one.
+    // Bounded by the light count as rounding can leave the sum just below 1, same as the shader
+    float r = randFloat(seed);
+    float t = lights[0].area / totalArea;
+    size_t i = 0;
+    while (r > t && i + 1 < lights.size()) {
+        i++;
+        t += lights[i].area / totalArea;
+    }
+    return static_cast<int>(i);
+}
+
+static glm::vec3 importanceSampleLight(const CpuScene &scene, const CpuRenderParams &params, const Material &surfaceMat,
+                                       const CpuHit &hit, const ScatterResult &scatterResult, uint32_t &seed, uint64_t &rayCount) {
+    if (!params.importanceSampling || !scatterResult.isDiffuse) return glm::vec3(0.0f);
+
+    int lightId = getLightId(scene, seed);
+    if (lightId < 0) return glm::vec3(0.0f);
+
+    const GpuLight &light = scene.getLights()[lightId];
+    ObjectHandle lightObj = scene.getObjects()[light.objectId];
+    CpuSurfaceSample surfaceSample = scene.sampleSurface(lightObj, light.area, seed);
+
+    glm::vec3 toLight = surfaceSample.p - scatterResult.scattered.origin;
+    float dist2 = glm::dot(toLight, toLight);
+    float dist = std::sqrt(dist2);
+    glm::vec3 toLightDir = toLight / dist;
+
+    float cosSurface = std::max(glm::dot(hit.normal, toLightDir), 0.0f);
+    float cosLight = std::max(glm::dot(-toLightDir, surfaceSample.normal), 0.0f);
+    if (cosSurface <= 0.0f || cosLight <= 0.0f) return glm::vec3(0.0f);
+
+    Ray shadowRay = { scatterResult.scattered.origin, toLightDir };
+    rayCount++;
+    if (scene.occluded(shadowRay, dist - CPU_EPS)) return glm::vec3(0.0f);
+
+    float pdfW = light.pdfA * dist2 / std::max(cosLight, CPU_EPS);
+
+    const Material &lightMat = scene.getMaterial(lightObj);
+    glm::vec3 le = lightMat.albedo * lightMat.payload[0];
+    return (surfaceMat.albedo / CPU_PI) * le * cosSurface / std::max(pdfW, CPU_EPS);
+}
+
+// ================ INTEGRATOR ================
+// `hit` is the closest hit of the primary ray, found alone or in a packet. Counts the rays cast after it in `rayCount`
+static glm::vec3 traceRay(const CpuScene &scene, const CpuRenderParams &params, Ray ray, CpuHit hit, uint32_t &seed, uint64_t &rayCount) {
+    const Ray primaryRay = ray;
+    glm::vec3 throughput(1.0f);
+    glm::vec3 radiance(0.0f);
+
+    int i = 0;
+    ScatterResult result;
+    for (; i < params.maxBounces; i++) {
+        if (params.debugView == DEBUG_NORMAL || params.debugView == DEBUG_SELECTION_MASK) break;
+
+        if (hit.found()) {
+            const Material &mat = scene.getMaterial(hit.object);
+            if (mat.type == MaterialType::Emissive) {
+                radiance += throughput * mat.albedo * mat.payload[0];
+                break;
+            }
+
+            scatter(mat, ray, hit, result, seed);
+            throughput *= result.attenuation;
+            if (!result.isScattered) break;
+
+            radiance += throughput * importanceSampleLight(scene, params, mat, hit, result, seed, rayCount);
+
+            ray = result.scattered;
+            hit = scene.intersection(ray);
+            rayCount++;
+        } else {
+            radiance += throughput * skyColor(params, ray.dir);
+            break;
+        }
+    }
+    if (i == params.maxBounces)
+        radiance = glm::vec3(0.0f);
+
+    // Debug visualisations
+    if (params.debugView == DEBUG_BOUNCES) {
+        return glm::vec3(static_cast<float>(i) / static_cast<float>(params.maxBounces));
+    }
+    if (params.debugView == DEBUG_NORMAL) {
+        return hit.found() ? (hit.normal * 0.5f + 0.5f) : glm::vec3(0.0f);
+    }
+    if (params.debugView == DEBUG_SELECTION_MASK) {
+        const int selected = scene.getSelectedObjectId();
+        if (selected < 0) return glm::vec3(0.0f);
+        CpuHit selHit = scene.rayObjectIntersection(primaryRay, scene.getObjects()[selected]);
+        return selHit.found() ? glm::vec3(1.0f) : glm::vec3(0.0f);
+    }
+
+    return radiance;
+}
+
+// Consumes the random numbers of the pixel offset and of the lens
+static Ray samplePrimaryRay(const CpuRenderParams &params, glm::vec2 fragPos, uint32_t &sampleState) {
+    const glm::vec2 screenSize = glm::vec2(params.width, params.height);
+    float offsetX = randFloat(sampleState);
+    float offsetY = randFloat(sampleState);
+    glm::vec2 offset = glm::vec2(offsetX, offsetY) / screenSize;
+    return getRay(params, fragPos + offset, true, sampleState);
+}
+
+glm::vec3 computeFragmentColor(const CpuScene &scene, const CpuRenderParams &params, glm::vec2 fragPos, uint32_t &seed, uint64_t *rayCount) {
+    uint64_t rays = 0;
+    glm::vec3 color(0.0f);
+    for (int i = 0; i < params.samplesPerPixel; i++) {
+        uint32_t sampleState = pcgHash(seed + static_cast<uint32_t>(i));
+        Ray ray = samplePrimaryRay(params, fragPos, sampleState);
+        color += traceRay(scene, params, ray, scene.intersection(ray), sampleState, rays);
+        rays++;
+    }
+    if (rayCount) *rayCount += rays;
+    return color / static_cast<float>(params.samplesPerPixel);
+}
+
+void computePacketColors(const CpuScene &scene, const CpuRenderParams &params, const glm::vec2 *fragPos, uint32_t *seeds,
+                         uint32_t count, glm::vec3 *colors, uint64_t *rayCount) {
+    uint64_t rayTotal = 0;
+    count = std::min<uint32_t>(count, CPU_PACKET_SIZE);
+    for (uint32_t p = 0; p < count; p++) colors[p] = glm::vec3(0.0f);
+
+    uint32_t sampleStates[CPU_PACKET_SIZE];
+    Ray rays[CPU_PACKET_SIZE];
+    CpuHit hits[CPU_PACKET_SIZE];
+    for (int i = 0; i < params.samplesPerPixel; i++) {
+        for (uint32_t p = 0; p < count; p++) {
+            sampleStates[p] = pcgHash(seeds[p] + static_cast<uint32_t>(i));
+            rays[p] = samplePrimaryRay(params, fragPos[p], sampleStates[p]);
+        }
+        scene.intersectionPacket(rays, count, hits);
+        for (uint32_t p = 0; p < count; p++)
+            colors[p] += traceRay(scene, params, rays[p], hits[p], sampleStates[p], rayTotal);
+        rayTotal += count;
+    }
+    if (rayCount) *rayCount += rayTotal;
+    for (uint32_t p = 0; p < count; p++) colors[p] /= static_cast<float>(params.samplesPerPixel);
+}
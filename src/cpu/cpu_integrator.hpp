@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "cpu_scene.hpp"
+
+// Values of `RaytracingUBO` read by the integrator
+struct CpuRenderParams {
+    glm::vec3 cameraPos = glm::vec3(0.0f, 0.0f, -10.0f);
+    glm::vec3 cameraDir = glm::vec3(0.0f, 0.0f, 1.0f);
+    float tanHFov = 0.8390996f;     // 80 degrees, the default of `Camera`
+    float aperture = 0.0f;
+    float focusDepth = 10.0f;
+
+    uint32_t width = 1280;
+    uint32_t height = 720;
+
+    LightMode lightMode = LightMode::Empty;
+    int maxBounces = 8;
+    int samplesPerPixel = 1;
+    bool importanceSampling = true;
+    int debugView = 0;              // `DebugView` value
+    bool rayPackets = true;         // Primary rays traced in packets by `computePacketColors`, same image either way
+    uint32_t seedOffset = 0;        // Added to the frame of the random seeds, keeps extra samples apart from the GPU ones
+};
+
+// Port of `computeFragmentColor` in `raytracing.glsl`, `fragPos` is the NDC position of the pixel center.
+// The rays cast (camera, bounce and shadow rays) are added to `rayCount` if given
+glm::vec3 computeFragmentColor(const CpuScene &scene, const CpuRenderParams &params, glm::vec2 fragPos, uint32_t &seed, uint64_t *rayCount = nullptr);
+
+// `computeFragmentColor` of up to CPU_PACKET_SIZE neighbouring pixels: the primary rays of each sample are traversed
+// as a packet, the bounces as single rays since they scatter in every direction. The random sequence of each pixel
+// is the one of `computeFragmentColor`, so the colors are the same.
+void computePacketColors(const CpuScene &scene, const CpuRenderParams &params, const glm::vec2 *fragPos, uint32_t *seeds,
+                         uint32_t count, glm::vec3 *colors, uint64_t *rayCount = nullptr);
+
+// ================ INTERNALS ================
+// Exposed for the checks of `tests/cpu_integrator_test.cpp`
+
+struct ScatterResult {
+    glm::vec3 attenuation;
+    Ray scattered;
+    bool isScattered;
+    bool isDiffuse;
+};
+
+// Port of `scatter` in `materials.glsl`
+void scatter(const Material &mat, const Ray &ray, const CpuHit &hit, ScatterResult &result, uint32_t &seed);
+// Light picked with a probability proportional to its area (port of `getLightId` in `lights.glsl`), -1 without lights
+int getLightId(const CpuScene &scene, uint32_t &seed);
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+// Port of `random.glsl`, the CPU and the shader draw the same sequences from the same seed
+
+inline uint32_t pcgHash(uint32_t v) {
+    v = v * 747796405u + 2891336453u;
+    uint32_t word = ((v >> ((v >> 28u) + 4u)) ^ v) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+inline uint32_t initSeed(uint32_t x, uint32_t y, uint32_t frame) {
+    return pcgHash(x + y * 4096u + frame * 1315423911u);
+}
+
+inline float randFloat(uint32_t &seed) {
+    seed = pcgHash(seed);
+    return static_cast<float>(seed) * (1.0f / 4294967296.0f);
+}
+
+inline glm::vec3 randomInSphere(uint32_t &seed) {
+    float z = 1.0f - 2.0f * randFloat(seed);
+    float r = std::sqrt(std::max(0.0f, 1.0f - z*z));
+    float phi = 6.2831853f * randFloat(seed);
+    return glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+inline glm::vec2 randomInDisk(uint32_t &seed) {
+    float r = std::sqrt(randFloat(seed));
+    float theta = 6.2831853f * randFloat(seed);
+    return glm::vec2(r * std::cos(theta), r * std::sin(theta));
+}
@@ -0,0 +1,110 @@
+#include "cpu_renderer.hpp"
+
+#include <algorithm>
+
+#include "cpu_random.hpp"
+#include "../utils/parallel.hpp"
+
+#define CPU_PACKET_SIDE 4     // Packets of CPU_PACKET_SIDE^2 pixels
+
+static_assert(CPU_PACKET_SIDE * CPU_PACKET_SIDE <= CPU_PACKET_SIZE);
+
+void CpuRenderer::setScene(Scene &newScene) {
+    scene.pack(newScene);
+    scheduler.reset();
+    reset();
+}
+
+void CpuRenderer::setParams(const CpuRenderParams &newParams) {
+    params = newParams;
+    region = { 0, 0, params.width, params.height };
+    scheduler.reset();
+    reset();
+}
+
+void CpuRenderer::setRegion(const Tile &newRegion) {
+    region = newRegion;
+    region.width = std::min(region.width, params.width - std::min(region.x, params.width));
+    region.height = std::min(region.height, params.height - std::min(region.y, params.height));
+    reset();
+}
+
+void CpuRenderer::reset() {
+    pixels.assign(static_cast<size_t>(region.width) * region.height * 4, 0.0f);
+    frameCount = 0;
+    seedFrame = 0;
+}
+
+void CpuRenderer::startBatch() {
+    pixels.assign(static_cast<size_t>(region.width) * region.height * 4, 0.0f);
+    seedFrame += frameCount;
+    frameCount = 0;
+}
+
+bool CpuRenderer::renderFrame() {
+    if (region.width == 0 || region.height == 0) return true;
+
+    // The shader sees frame counts starting at 1
+    frameCount++;
+    const uint32_t frame = params.seedOffset + seedFrame + frameCount;
+    const float weight = 1.0f / static_cast<float>(frameCount);
+    const float invWidth = 1.0f / static_cast<float>(params.width);
+    const float invHeight = 1.0f / static_cast<float>(params.height);
+
+    auto storeColor = [&](uint32_t x, uint32_t y, const glm::vec3 &color) {
+        float *pixel = &pixels[(static_cast<size_t>(y - region.y) * region.width + (x - region.x)) * 4];
+        for (int c = 0; c < 3; c++) pixel[c] += (color[c] - pixel[c]) * weight;
+        pixel[3] = 1.0f;
+    };
+    auto getFragPos = [&](uint32_t x, uint32_t y) {
+        return glm::vec2(
+            (static_cast<float>(x) + 0.5f) * invWidth * 2.0f - 1.0f,
+            (static_cast<float>(y) + 0.5f) * invHeight * 2.0f - 1.0f
+        );
+    };
+
+    threadRayCounts.assign(resolveThreadCount(threadCount), ThreadRayCount());
+    const bool finished = scheduler.run(region.width, region.height, [&](const Tile &regionTile, unsigned thread) {
+        const Tile tile = { region.x + regionTile.x, region.y + regionTile.y, regionTile.width, regionTile.height };
+        uint64_t *rays = &threadRayCounts[thread].rays;
+        if (!params.rayPackets) {
+            for (uint32_t y = tile.y; y < tile.y + tile.height; y++) {
+                for (uint32_t x = tile.x; x < tile.x + tile.width; x++) {
+                    uint32_t seed = initSeed(x, y, frame);
+                    storeColor(x, y, computeFragmentColor(scene, params, getFragPos(x, y), seed, rays));
+                }
+            }
+            return;
+        }
+
+        // Square blocks of pixels, cut at the edges of the tile
+        for (uint32_t blockY = tile.y; blockY < tile.y + tile.height; blockY += CPU_PACKET_SIDE) {
+            for (uint32_t blockX = tile.x; blockX < tile.x + tile.width; blockX += CPU_PACKET_SIDE) {
+                const uint32_t endX = std::min(blockX + CPU_PACKET_SIDE, tile.x + tile.width);
+                const uint32_t endY = std::min(blockY + CPU_PACKET_SIDE, tile.y + tile.height);
+
+                glm::vec2 fragPos[CPU_PACKET_SIZE];
+                uint32_t seeds[CPU_PACKET_SIZE];
+                glm::vec3 colors[CPU_PACKET_SIZE];
+                uint32_t count = 0;
+                for (uint32_t y = blockY; y < endY; y++) {
+                    for (uint32_t x = blockX; x < endX; x++) {
+                        fragPos[count] = getFragPos(x, y);
+                        seeds[count] = initSeed(x, y, frame);
+                        count++;
+                    }
+                }
+
+                computePacketColors(scene, params, fragPos, seeds, count, colors, rays);
+                count = 0;
+                for (uint32_t y = blockY; y < endY; y++) {
+                    for (uint32_t x = blockX; x < endX; x++) storeColor(x, y, colors[count++]);
+                }
+            }
+        }
+    });
+
+    rayCount = 0;
+    for (const ThreadRayCount &count : threadRayCounts) rayCount += count.rays;
+    return finished;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "cpu_integrator.hpp"
+#include "cpu_scene.hpp"
+#include "tile_scheduler.hpp"
+
+// Headless path tracer running the shader integrator on every core.
+// Each call to `renderFrame` adds one frame of `samplesPerPixel` samples to a running mean, like the progressive GPU render.
+// Pixels are rendered in tiles shared by work stealing, their cost varies a lot with the number of bounces.
+class CpuRenderer {
+public:
+    // Packs a snapshot of the scene, later edits of the scene need another call
+    void setScene(Scene &scene);
+    void setParams(const CpuRenderParams &params);
+    // Only renders this rectangle of the image, e.g. a tile of a distributed render. Reset to the whole image by `setParams`
+    void setRegion(const Tile &region);
+    // 0 uses every core
+    void setThreadCount(int count) {
+        threadCount = count;
+        scheduler.setThreadCount(count);
+    }
+    // Stops the frame in progress at the next tile once set
+    void setCancelFlag(const std::atomic<bool> *flag) { scheduler.setCancelFlag(flag); }
+
+    // False when the frame was cancelled, its pixels are then partial until the next `reset` or `startBatch`
+    bool renderFrame();
+    void reset();
+    // Starts a new running mean, the next frames keep drawing new random sequences
+    void startBatch();
+
+    // RGBA floats of the region, rows from top to bottom
+    const std::vector<float>& getPixels() const { return pixels; }
+    const Tile& getRegion() const { return region; }
+    uint32_t getFrameCount() const { return frameCount; }
+    const CpuRenderParams& getParams() const { return params; }
+    const CpuScene& getScene() const { return scene; }
+    // Load balance of the last frame
+    const TileSchedulerStats& getSchedulerStats() const { return scheduler.getStats(); }
+    // Camera, bounce and shadow rays cast by the last frame
+    uint64_t getRayCount() const { return rayCount; }
+
+private:
+    CpuScene scene;
+    CpuRenderParams params;
+    Tile region = { 0, 0, 0, 0 };
+    TileScheduler scheduler;
+
+    // Rays counted by each thread, on their own cache line
+    struct alignas(64) ThreadRayCount {
+        uint64_t rays = 0;
+    };
+
+    int threadCount = 0;
+    std::vector<ThreadRayCount> threadRayCounts;
+    uint64_t rayCount = 0;
+
+    std::vector<float> pixels;
+    uint32_t frameCount = 0;        // Frames in `pixels`
+    uint32_t seedFrame = 0;         // Frames of the previous batches
+};
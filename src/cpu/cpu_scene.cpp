@@ -0,0 +1,421 @@
+#include "cpu_scene.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#include "cpu_random.hpp"
+
+static const Material DEFAULT_MATERIAL = { .type=Lambertian, .albedo=glm::vec3(1.0f, 0.0f, 1.0f) * 0.7f, .payload={ 0.0f, 0.0f } };
+
+void CpuScene::pack(Scene &scene) {
+    objects.clear();
+    spheres.clear();
+    planes.clear();
+    boxes.clear();
+    meshes.clear();
+    lights.clear();
+    totalLightArea = 0.0f;
+    materials = scene.getMaterials();
+    selectedObjectId = scene.getSelectedObjectId();
+
+    // Same order and light list as `Scene::fillBuffers`
+    for (Object *object : scene.getObjects()) {
+        ObjectHandle handle = { object->getType(), -1 };
+        MaterialHandle materialHandle = -1;
+        switch (handle.type) {
+            case ObjectType::Sphere:
+                handle.id = static_cast<int>(spheres.size());
+                spheres.push_back(static_cast<Sphere*>(object)->getStruct());
+                materialHandle = spheres.back().materialHandle;
+                break;
+            case ObjectType::Plane:
+                handle.id = static_cast<int>(planes.size());
+                planes.push_back(static_cast<Plane*>(object)->getStruct());
+                break;  // Planes can't be sampled so they are never lights
+            case ObjectType::Box:
+                handle.id = static_cast<int>(boxes.size());
+                boxes.push_back(static_cast<Box*>(object)->getStruct());
+                materialHandle = boxes.back().materialHandle;
+                break;
+            case ObjectType::Mesh: {
+                Mesh *mesh = static_cast<Mesh*>(object);
+                handle.id = static_cast<int>(meshes.size());
+                meshes.push_back({ mesh->getStruct(), mesh->getGeometry() });
+                materialHandle = meshes.back().mesh.materialHandle;
+            } break;
+            default: continue;
+        }
+
+        if (materialHandle >= 0 && materials[materialHandle].type == MaterialType::Emissive) {
+            const float area = object->getArea();
+            lights.push_back({ .objectId=static_cast<int>(objects.size()), .area=area, .pdfA=1.0f/area });
+            totalLightArea += area;
+        }
+        objects.push_back(handle);
+    }
+
+    scene.updateTlas();
+    tlasNodes = scene.getTlasNodes();
+    tlasObjectIds = scene.getTlasObjectIds();
+    tlasBoundedCount = scene.getTlasBoundedCount();
+}
+
+// ================ HELPERS ================
+static glm::vec3 transformPoint(const glm::mat4 &m, const glm::vec3 &p) {
+    return glm::vec3(m * glm::vec4(p, 1.0f));
+}
+
+static glm::vec3 transformDir(const glm::mat4 &m, const glm::vec3 &d) {
+    return glm::vec3(m * glm::vec4(d, 0.0f));
+}
+
+static glm::vec3 transformNormal(const glm::mat4 &invTransform, const glm::vec3 &n) {
+    return glm::normalize(glm::mat3(glm::transpose(invTransform)) * n);
+}
+
+static CpuHit makeHit(const Ray &ray, ObjectHandle object, float t, glm::vec3 normal) {
+    CpuHit hit;
+    hit.p = ray.origin + ray.dir * t;
+    hit.frontFace = true;
+    if (glm::dot(ray.dir, normal) > 0.0f) {
+        normal = -normal;
+        hit.frontFace = false;
+    }
+    hit.normal = normal;
+    hit.t = t;
+    hit.object = object;
+    return hit;
+}
+
+static glm::vec3 safeInverseDir(const glm::vec3 &dir) {
+    const glm::vec3 safeDir = glm::sign(dir) * glm::max(glm::abs(dir), glm::vec3(CPU_EPS));
+    return 1.0f / safeDir;
+}
+
+// ================ RAY INTERSECTION ================
+static CpuHit raySphereIntersection(const Ray &ray, ObjectHandle object, const GpuSphere &sphere) {
+    glm::vec3 p = sphere.center - ray.origin;
+    float dp = glm::dot(ray.dir, p);
+    float c = glm::dot(p, p) - sphere.radius*sphere.radius;
+    float delta = dp*dp - c;
+    if (delta < 0.0f) return CpuHit();
+
+    float t1 = dp - std::sqrt(delta);
+    if (t1 >= 0.0f) {
+        glm::vec3 hitP = ray.origin + ray.dir * t1;
+        return makeHit(ray, object, t1, glm::normalize(hitP - sphere.center));
+    }
+
+    float t2 = dp + std::sqrt(delta);
+    if (t2 >= 0.0f) {
+        glm::vec3 hitP = ray.origin + ray.dir * t2;
+        return makeHit(ray, object, t2, glm::normalize(hitP - sphere.center));
+    }
+    return CpuHit();
+}
+
+static CpuHit rayPlaneIntersection(const Ray &ray, ObjectHandle object, const GpuPlane &plane) {
+    float denom = glm::dot(plane.normal, ray.dir);
+    if (std::abs(denom) > CPU_EPS) {
+        float t = glm::dot(plane.point - ray.origin, plane.normal) / denom;
+        if (t >= CPU_EPS) return makeHit(ray, object, t, plane.normal);
+    }
+    return CpuHit();
+}
+
+static CpuHit rayAabbIntersection(const Ray &ray, const glm::vec3 &aabbMin, const glm::vec3 &aabbMax) {
+    glm::vec3 invDir = safeInverseDir(ray.dir);
+    glm::vec3 t0 = (aabbMin - ray.origin) * invDir;
+    glm::vec3 t1 = (aabbMax - ray.origin) * invDir;
+    glm::vec3 tmin = glm::min(t0, t1);
+    glm::vec3 tmax = glm::max(t0, t1);
+    float tNear = std::max(std::max(tmin.x, tmin.y), tmin.z);
+    float tFar = std::min(std::min(tmax.x, tmax.y), tmax.z);
+    if (tFar < std::max(tNear, CPU_EPS)) return CpuHit();
+
+    glm::vec3 normal;
+    if (tNear == tmin.x) normal = glm::vec3(glm::sign(ray.dir.x) < 0.0f ? 1.0f : -1.0f, 0.0f, 0.0f);
+    else if (tNear == tmin.y) normal = glm::vec3(0.0f, glm::sign(ray.dir.y) < 0.0f ? 1.0f : -1.0f, 0.0f);
+    else normal = glm::vec3(0.0f, 0.0f, glm::sign(ray.dir.z) < 0.0f ? 1.0f : -1.0f);
+    return makeHit(ray, { ObjectType::Aabb, -1 }, tNear, normal);
+}
+
+static CpuHit rayBoxIntersection(const Ray &ray, ObjectHandle object, const GpuBox &box) {
+    Ray localRay = { transformPoint(box.invTransform, ray.origin), transformDir(box.invTransform, ray.dir) };
+    CpuHit hit = rayAabbIntersection(localRay, glm::vec3(-1.0f), glm::vec3(1.0f));
+    if (!hit.found()) return hit;
+    return makeHit(ray, object, hit.t, transformNormal(box.invTransform, hit.normal));
+}
+
+static CpuHit makeMeshHit(const Ray &ray, ObjectHandle object, const CpuMesh &mesh, float t, uint32_t triangle) {
+    const std::vector<Vertex> &vertices = mesh.geometry->getVertices();
+    const std::vector<uint32_t> &indices = mesh.geometry->getIndices();
+    glm::vec3 v0 = vertices[indices[triangle * 3 + 0]].position;
+    glm::vec3 v1 = vertices[indices[triangle * 3 + 1]].position;
+    glm::vec3 v2 = vertices[indices[triangle * 3 + 2]].position;
+    return makeHit(ray, object, t, transformNormal(mesh.mesh.invTransform, glm::normalize(glm::cross(v1 - v0, v2 - v0))));
+}
+
+static CpuHit rayMeshIntersection(const Ray &ray, ObjectHandle object, const CpuMesh &mesh) {
+    if (mesh.mesh.bvhNodeCount == 0) return CpuHit();
+
+    Ray localRay = { transformPoint(mesh.mesh.invTransform, ray.origin), transformDir(mesh.mesh.invTransform, ray.dir) };
+    uint32_t triangle = 0;
+    float t = mesh.geometry->rayIntersectionLocal(localRay, std::numeric_limits<float>::infinity(), triangle);
+    if (t < 0.0f) return CpuHit();
+    return makeMeshHit(ray, object, mesh, t, triangle);
+}
+
+// The local directions aren't normalized, so the local distances are the world ones and `tClosest` is shared
+static void rayMeshPacketIntersection(const Ray *rays, uint32_t rayMask, ObjectHandle object, const CpuMesh &mesh, float *tClosest, CpuHit *hits) {
+    if (mesh.mesh.bvhNodeCount == 0) return;
+
+    BvhRay localRays[CPU_PACKET_SIZE];
+    for (uint32_t mask = rayMask; mask != 0; mask &= mask - 1) {
+        const uint32_t r = std::countr_zero(mask);
+        localRays[r] = makeBvhRay({ transformPoint(mesh.mesh.invTransform, rays[r].origin), transformDir(mesh.mesh.invTransform, rays[r].dir) });
+    }
+
+    uint32_t triangles[CPU_PACKET_SIZE];
+    const uint32_t hitMask = mesh.geometry->rayIntersectionPacketLocal(localRays, rayMask, tClosest, triangles);
+    for (uint32_t mask = hitMask; mask != 0; mask &= mask - 1) {
+        const uint32_t r = std::countr_zero(mask);
+        hits[r] = makeMeshHit(rays[r], object, mesh, tClosest[r], triangles[r]);
+    }
+}
+
+CpuHit CpuScene::rayObjectIntersection(const Ray &ray, ObjectHandle object) const {
+    switch (object.type) {
+        case ObjectType::Sphere: return raySphereIntersection(ray, object, spheres[object.id]);
+        case ObjectType::Plane:  return rayPlaneIntersection(ray, object, planes[object.id]);
+        case ObjectType::Box:    return rayBoxIntersection(ray, object, boxes[object.id]);
+        case ObjectType::Mesh:   return rayMeshIntersection(ray, object, meshes[object.id]);
+        default:                 return CpuHit();
+    }
+}
+
+// ================ OCCLUSION ================
+static bool raySphereOcclusion(const Ray &ray, const GpuSphere &sphere, float tMax) {
+    glm::vec3 p = sphere.center - ray.origin;
+    float dp = glm::dot(ray.dir, p);
+    float c = glm::dot(p, p) - sphere.radius*sphere.radius;
+    float delta = dp*dp - c;
+    if (delta < 0.0f) return false;
+
+    float sqrtDelta = std::sqrt(delta);
+    float t1 = dp - sqrtDelta;
+    float t2 = dp + sqrtDelta;
+    return (t1 >= CPU_EPS && t1 <= tMax) || (t1 < CPU_EPS && t2 >= CPU_EPS && t2 <= tMax);
+}
+
+static bool rayPlaneOcclusion(const Ray &ray, const GpuPlane &plane, float tMax) {
+    float denom = glm::dot(plane.normal, ray.dir);
+    if (std::abs(denom) <= CPU_EPS) return false;
+
+    float t = glm::dot(plane.point - ray.origin, plane.normal) / denom;
+    return t >= CPU_EPS && t <= tMax;
+}
+
+static bool rayBoxOcclusion(const Ray &ray, const GpuBox &box, float tMax) {
+    glm::vec3 localOrigin = transformPoint(box.invTransform, ray.origin);
+    glm::vec3 invDir = safeInverseDir(transformDir(box.invTransform, ray.dir));
+
+    glm::vec3 t0 = (glm::vec3(-1.0f) - localOrigin) * invDir;
+    glm::vec3 t1 = (glm::vec3( 1.0f) - localOrigin) * invDir;
+    glm::vec3 tmin = glm::min(t0, t1);
+    glm::vec3 tmax = glm::max(t0, t1);
+    float tNear = std::max(std::max(tmin.x, tmin.y), tmin.z);
+    float tFar = std::min(std::min(tmax.x, tmax.y), tmax.z);
+    if (tFar < tNear) return false;
+
+    return (tNear >= CPU_EPS && tNear <= tMax) || (tNear < CPU_EPS && tFar >= CPU_EPS && tFar <= tMax);
+}
+
+static bool rayMeshOcclusion(const Ray &ray, const CpuMesh &mesh, float tMax) {
+    if (mesh.mesh.bvhNodeCount == 0) return false;
+
+    Ray localRay = { transformPoint(mesh.mesh.invTransform, ray.origin), transformDir(mesh.mesh.invTransform, ray.dir) };
+    return mesh.geometry->occludedLocal(localRay, CPU_EPS, tMax);
+}
+
+bool CpuScene::rayObjectOcclusion(const Ray &ray, ObjectHandle object, float tMax) const {
+    switch (object.type) {
+        case ObjectType::Sphere: return raySphereOcclusion(ray, spheres[object.id], tMax);
+        case ObjectType::Plane:  return rayPlaneOcclusion(ray, planes[object.id], tMax);
+        case ObjectType::Box:    return rayBoxOcclusion(ray, boxes[object.id], tMax);
+        case ObjectType::Mesh:   return rayMeshOcclusion(ray, meshes[object.id], tMax);
+        default:                 return false;
+    }
+}
+
+// ================ SCENE ================
+CpuHit CpuScene::intersection(const Ray &ray) const {
+    CpuHit bestHit;
+
+    // Unbounded objects can't be part of the TLAS
+    for (size_t i = tlasBoundedCount; i < tlasObjectIds.size(); i++) {
+        CpuHit hit = rayObjectIntersection(ray, objects[tlasObjectIds[i]]);
+        if (hit.found() && hit.t < bestHit.t) bestHit = hit;
+    }
+    if (tlasNodes.empty()) return bestHit;
+
+    // The traversal accepts the same hits as the loop above, so the last one kept is the closest
+    uint32_t primitive;
+    traverseBvh(tlasNodes, ray, bestHit.t, [&](uint32_t i, float tClosest) {
+        CpuHit hit = rayObjectIntersection(ray, objects[tlasObjectIds[i]]);
+        if (!hit.found() || hit.t >= tClosest) return -1.0f;
+        bestHit = hit;
+        return hit.t;
+    }, primitive);
+    return bestHit;
+}
+
+// Primary rays of neighbouring pixels stay within a narrow cone, depth of field and bounced rays may not
+static bool isCoherentPacket(const Ray *rays, uint32_t count) {
+    glm::vec3 meanDir(0.0f);
+    for (uint32_t i = 0; i < count; i++) meanDir += rays[i].dir;
+    const float length = glm::length(meanDir);
+    if (length < CPU_EPS) return false;
+
+    meanDir /= length;
+    for (uint32_t i = 0; i < count; i++) {
+        if (glm::dot(rays[i].dir, meanDir) < CPU_PACKET_MIN_COHERENCE) return false;
+    }
+    return true;
+}
+
+void CpuScene::intersectionPacket(const Ray *rays, uint32_t count, CpuHit *hits) const {
+    count = std::min<uint32_t>(count, CPU_PACKET_SIZE);
+    if (count == 1 || !isCoherentPacket(rays, count)) {
+        for (uint32_t i = 0; i < count; i++) hits[i] = intersection(rays[i]);
+        return;
+    }
+
+    float tClosest[CPU_PACKET_SIZE];
+    BvhRay bvhRays[CPU_PACKET_SIZE];
+    for (uint32_t r = 0; r < count; r++) {
+        hits[r] = CpuHit();
+        for (size_t i = tlasBoundedCount; i < tlasObjectIds.size(); i++) {
+            CpuHit hit = rayObjectIntersection(rays[r], objects[tlasObjectIds[i]]);
+            if (hit.found() && hit.t < hits[r].t) hits[r] = hit;
+        }
+        tClosest[r] = hits[r].t;
+        bvhRays[r] = makeBvhRay(rays[r]);
+    }
+    if (tlasNodes.empty()) return;
+
+    // Same acceptance as the single ray traversal: only strictly closer hits replace the current one
+    traversePacketBvh(tlasNodes, bvhRays, (1u << count) - 1, tClosest, [&](uint32_t i, uint32_t leafMask) {
+        const ObjectHandle object = objects[tlasObjectIds[i]];
+        if (object.type == ObjectType::Mesh) {
+            rayMeshPacketIntersection(rays, leafMask, object, meshes[object.id], tClosest, hits);
+            return;
+        }
+        for (uint32_t mask = leafMask; mask != 0; mask &= mask - 1) {
+            const uint32_t r = std::countr_zero(mask);
+            CpuHit hit = rayObjectIntersection(rays[r], object);
+            if (!hit.found() || hit.t >= tClosest[r]) continue;
+            hits[r] = hit;
+            tClosest[r] = hit.t;
+        }
+    });
+}
+
+bool CpuScene::occluded(const Ray &ray, float tMax) const {
+    for (size_t i = tlasBoundedCount; i < tlasObjectIds.size(); i++) {
+        if (rayObjectOcclusion(ray, objects[tlasObjectIds[i]], tMax)) return true;
+    }
+    if (tlasNodes.empty()) return false;
+
+    return occludedBvh(tlasNodes, ray, tMax, [&](uint32_t i) {
+        return rayObjectOcclusion(ray, objects[tlasObjectIds[i]], tMax);
+    });
+}
+
+const Material& CpuScene::getMaterial(ObjectHandle object) const {
+    switch (object.type) {
+        case ObjectType::Sphere: return materials[spheres[object.id].materialHandle];
+        case ObjectType::Plane:  return materials[planes[object.id].materialHandle];
+        case ObjectType::Box:    return materials[boxes[object.id].materialHandle];
+        case ObjectType::Mesh:   return materials[meshes[object.id].mesh.materialHandle];
+        default:                 return DEFAULT_MATERIAL;
+    }
+}
+
+// ================ SURFACE SAMPLING ================
+static CpuSurfaceSample sampleSphereSurface(const GpuSphere &sphere, uint32_t &seed) {
+    glm::vec3 onLightDir = glm::normalize(randomInSphere(seed));
+    glm::vec3 p = sphere.center + onLightDir * sphere.radius;
+    return { p, (p - sphere.center) / sphere.radius };
+}
+
+static CpuSurfaceSample sampleBoxSurface(const GpuBox &box, float area, uint32_t &seed) {
+    glm::vec3 size = 2.0f * glm::vec3(glm::length(glm::vec3(box.transform[0])), glm::length(glm::vec3(box.transform[1])), glm::length(glm::vec3(box.transform[2])));
+    glm::vec3 pairArea = glm::vec3(size.y * size.z, size.z * size.x, size.x * size.y);
+
+    float r = randFloat(seed) * area;
+    float u = randFloat(seed);
+    float v = randFloat(seed);
+
+    int axis;
+    float side;
+    float range = 2.0f * pairArea.x;
+    if (r < range) {
+        axis = 0;
+        side = (r < pairArea.x) ? -1.0f : 1.0f;
+    } else {
+        r -= range;
+        range = 2.0f * pairArea.y;
+        if (r < range) {
+            axis = 1;
+            side = (r < pairArea.y) ? -1.0f : 1.0f;
+        } else {
+            r -= range;
+            axis = 2;
+            side = (r < pairArea.z) ? -1.0f : 1.0f;
+        }
+    }
+
+    // Two free coordinates in [-1, 1] and the face coordinate on the chosen axis
+    glm::vec3 p, normal(0.0f);
+    const float a = glm::mix(-1.0f, 1.0f, u);
+    const float b = glm::mix(-1.0f, 1.0f, v);
+    const float face = side < 0.0f ? -1.0f : 1.0f;
+    if (axis == 0)      p = glm::vec3(face, a, b);
+    else if (axis == 1) p = glm::vec3(a, face, b);
+    else                p = glm::vec3(a, b, face);
+    normal[axis] = side;
+
+    return { transformPoint(box.transform, p), transformNormal(box.invTransform, normal) };
+}
+
+static CpuSurfaceSample sampleMeshSurface(const CpuMesh &mesh, uint32_t &seed) {
+    const uint32_t triangleCount = mesh.mesh.triangleCount;
+    if (triangleCount == 0) return { glm::vec3(0.0f), glm::vec3(0.0f) };
+
+    uint32_t tri = static_cast<uint32_t>(randFloat(seed) * static_cast<float>(triangleCount));
+    if (tri >= triangleCount) tri = triangleCount - 1;
+    const std::vector<Vertex> &vertices = mesh.geometry->getVertices();
+    const std::vector<uint32_t> &indices = mesh.geometry->getIndices();
+    glm::vec3 v0 = vertices[indices[tri * 3 + 0]].position;
+    glm::vec3 v1 = vertices[indices[tri * 3 + 1]].position;
+    glm::vec3 v2 = vertices[indices[tri * 3 + 2]].position;
+
+    float r1 = std::sqrt(randFloat(seed));
+    float r2 = randFloat(seed);
+    glm::vec3 localP = v0 * (1.0f - r1) + v1 * (r1 * (1.0f - r2)) + v2 * (r1 * r2);
+    return {
+        transformPoint(mesh.mesh.transform, localP),
+        transformNormal(mesh.mesh.invTransform, glm::normalize(glm::cross(v1 - v0, v2 - v0))),
+    };
+}
+
+CpuSurfaceSample CpuScene::sampleSurface(ObjectHandle object, float area, uint32_t &seed) const {
+    switch (object.type) {
+        case ObjectType::Sphere: return sampleSphereSurface(spheres[object.id], seed);
+        case ObjectType::Box:    return sampleBoxSurface(boxes[object.id], area, seed);
+        case ObjectType::Mesh:   return sampleMeshSurface(meshes[object.id], seed);
+        default:                 return { glm::vec3(0.0f), glm::vec3(0.0f) };
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "../scene/scene.hpp"
+
+#define CPU_EPS 1e-3f     // `EPS` of `utils.glsl`
+#define CPU_PACKET_SIZE 16                  // Rays of a primary packet, 4x4 pixels
+#define CPU_PACKET_MIN_COHERENCE 0.95f      // Cosine between the mean direction and each ray below which a packet is traced ray by ray
+
+static_assert(CPU_PACKET_SIZE <= BVH_PACKET_MAX_SIZE, "A packet is traversed as a mask of rays");
+
+// Port of `Hit` in `utils.glsl`
+struct CpuHit {
+    glm::vec3 p = glm::vec3(0.0f);
+    glm::vec3 normal = glm::vec3(0.0f);
+    float t = std::numeric_limits<float>::infinity();
+    bool frontFace = true;
+    ObjectHandle object = { ObjectType::None, -1 };
+
+    bool found() const { return object.type != ObjectType::None; }
+};
+
+struct CpuSurfaceSample {
+    glm::vec3 p;
+    glm::vec3 normal;
+};
+
+// Mesh instance, the geometry is traversed in place instead of being copied in a global buffer
+struct CpuMesh {
+    GpuMesh mesh;
+    std::shared_ptr<MeshGeometry> geometry;
+};
+
+// Snapshot of a scene packed like `Scene::fillBuffers` does for the shader, with the object queries of
+// `objects.glsl`, `global.glsl` and the `intersection`/`occluded` functions of `raytracing.glsl`.
+// The snapshot doesn't change while it is rendered, so it can be read from any number of threads.
+class CpuScene {
+public:
+    void pack(Scene &scene);
+
+    CpuHit intersection(const Ray &ray) const;
+    // Same hits as `intersection` for up to CPU_PACKET_SIZE rays traversed together, incoherent packets fall back to single rays
+    void intersectionPacket(const Ray *rays, uint32_t count, CpuHit *hits) const;
+    bool occluded(const Ray &ray, float tMax) const;
+
+    CpuHit rayObjectIntersection(const Ray &ray, ObjectHandle object) const;
+    bool rayObjectOcclusion(const Ray &ray, ObjectHandle object, float tMax) const;
+    const Material& getMaterial(ObjectHandle object) const;
+    CpuSurfaceSample sampleSurface(ObjectHandle object, float area, uint32_t &seed) const;
+
+    const std::vector<ObjectHandle>& getObjects() const { return objects; }
+    const std::vector<GpuLight>& getLights() const { return lights; }
+    float getTotalLightArea() const { return totalLightArea; }
+    int getSelectedObjectId() const { return selectedObjectId; }
+
+private:
+    std::vector<ObjectHandle> objects;
+    std::vector<GpuSphere> spheres;
+    std::vector<GpuPlane> planes;
+    std::vector<GpuBox> boxes;
+    std::vector<CpuMesh> meshes;
+    std::vector<Material> materials;
+    std::vector<GpuLight> lights;
+    float totalLightArea = 0.0f;
+    int selectedObjectId = -1;
+
+    std::vector<GpuBvhNode> tlasNodes;
+    std::vector<uint32_t> tlasObjectIds;
+    uint32_t tlasBoundedCount = 0;
+};
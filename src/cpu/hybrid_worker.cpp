@@ -0,0 +1,51 @@
+#include "hybrid_worker.hpp"
+
+void HybridCpuWorker::start(Scene &scene, const CpuRenderParams &params, int threadCount) {
+    stop();
+
+    CpuRenderParams workerParams = params;
+    workerParams.seedOffset = HYBRID_SEED_OFFSET;
+    renderer.setThreadCount(threadCount);
+    renderer.setCancelFlag(&stopping);
+    renderer.setParams(workerParams);
+    renderer.setScene(scene);
+
+    pending.clear();
+    pendingSampleCount = 0;
+    stopping = false;
+    thread = std::thread(&HybridCpuWorker::run, this);
+}
+
+void HybridCpuWorker::stop() {
+    if (!thread.joinable()) return;
+    stopping = true;
+    thread.join();
+}
+
+bool HybridCpuWorker::takeSamples(std::vector<float> &colors, uint32_t &sampleCount) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (pendingSampleCount == 0) return false;
+    colors.swap(pending);
+    sampleCount = pendingSampleCount;
+    pendingSampleCount = 0;
+    return true;
+}
+
+void HybridCpuWorker::run() {
+    const uint32_t samplesPerFrame = static_cast<uint32_t>(renderer.getParams().samplesPerPixel);
+    while (!stopping) {
+        // One frame per batch, so a frame is never handed over twice
+        renderer.startBatch();
+        if (!renderer.renderFrame()) break;
+        const std::vector<float> &pixels = renderer.getPixels();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pendingSampleCount == 0) {
+            pending = pixels;
+        } else {
+            const float weight = static_cast<float>(samplesPerFrame) / static_cast<float>(pendingSampleCount + samplesPerFrame);
+            for (size_t i = 0; i < pending.size(); i++) pending[i] += (pixels[i] - pending[i]) * weight;
+        }
+        pendingSampleCount += samplesPerFrame;
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "cpu_renderer.hpp"
+
+// Frames of the CPU seeds start here, far above any GPU frame count so the two never draw the same sequences
+#define HYBRID_SEED_OFFSET 0x40000000u
+
+// Extra samples for the progressive GPU render, traced by the CPU on a background thread.
+// The worker renders frames back to back and hands over the mean of the ones finished since the last `takeSamples`,
+// which the caller merges by sample count. The scene is packed once, it must not change until `stop`.
+class HybridCpuWorker {
+public:
+    ~HybridCpuWorker() { stop(); }
+
+    // Packs the scene on the calling thread, then renders until `stop`
+    void start(Scene &scene, const CpuRenderParams &params, int threadCount);
+    // Cancels the frame in progress at its next tile and drops it
+    void stop();
+    bool isRunning() const { return thread.joinable(); }
+
+    // RGBA mean of the samples rendered since the last call, rows from top to bottom; false when none are ready
+    bool takeSamples(std::vector<float> &colors, uint32_t &sampleCount);
+
+private:
+    void run();
+
+    CpuRenderer renderer;
+    std::thread thread;
+    std::atomic<bool> stopping = false;
+
+    std::mutex mutex;
+    std::vector<float> pending;
+    uint32_t pendingSampleCount = 0;
+};
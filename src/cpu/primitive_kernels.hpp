@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+#include "primitive_soa.hpp"
+#include "../scene/object/object.hpp"
+
+// Closest-hit kernels testing one ray against V::WIDTH primitives at a time, `V` is Float4 or Float8 (AVX2 only).
+// They return the distance of the closest hit in [0, tMax) or -1, and write the index of the primitive hit.
+// Each kernel accepts the same hits as the scalar function it mirrors.
+
+// Running closest hit of every lane, reduced to a single hit at the end
+template<typename V>
+struct ClosestHitLanes {
+    V t;
+    V index;        // Float lanes, exact up to 2^24 primitives
+    V blockIndex;   // Indices of the primitives of the current block
+
+    explicit ClosestHitLanes(float tMax): t(V::splat(tMax)), index(V::splat(-1.0f)) {
+        alignas(32) float lanes[V::WIDTH];
+        for (int i = 0; i < V::WIDTH; i++) lanes[i] = static_cast<float>(i);
+        blockIndex = V::load(lanes);
+    }
+
+    // Keeps the lanes of `mask` closer than the current hit, then moves to the next block
+    void update(V mask, V tHit) {
+        mask = maskAnd(mask, cmpLess(tHit, t));
+        t = select(mask, tHit, t);
+        index = select(mask, blockIndex, index);
+        blockIndex = blockIndex + V::splat(static_cast<float>(V::WIDTH));
+    }
+
+    float reduce(uint32_t &hitIndex) const {
+        alignas(32) float tLanes[V::WIDTH], indexLanes[V::WIDTH];
+        t.store(tLanes);
+        index.store(indexLanes);
+        float tClosest = -1.0f;
+        for (int i = 0; i < V::WIDTH; i++) {
+            if (indexLanes[i] < 0.0f) continue;
+            // Ties go to the lowest index, like a scalar loop keeping the first hit
+            if (tClosest < 0.0f || tLanes[i] < tClosest || (tLanes[i] == tClosest && indexLanes[i] < hitIndex)) {
+                tClosest = tLanes[i];
+                hitIndex = static_cast<uint32_t>(indexLanes[i]);
+            }
+        }
+        return tClosest;
+    }
+};
+
+// Mirrors `Sphere::rayIntersection`
+template<typename V>
+float raySpheresIntersection(const SphereSoA &spheres, const Ray &ray, float tMax, uint32_t &hitIndex) {
+    const V ox = V::splat(ray.origin.x), oy = V::splat(ray.origin.y), oz = V::splat(ray.origin.z);
+    const V dx = V::splat(ray.dir.x), dy = V::splat(ray.dir.y), dz = V::splat(ray.dir.z);
+    const V zero = V::splat(0.0f);
+
+    ClosestHitLanes<V> closest(tMax);
+    for (size_t i = 0; i < spheres.paddedSize(); i += V::WIDTH) {
+        const V px = V::load(&spheres.centerX[i]) - ox;
+        const V py = V::load(&spheres.centerY[i]) - oy;
+        const V pz = V::load(&spheres.centerZ[i]) - oz;
+        const V r = V::load(&spheres.radius[i]);
+
+        const V dp = dx * px + dy * py + dz * pz;
+        const V c = px * px + py * py + pz * pz - r * r;
+        const V delta = dp * dp - c;
+        const V sqrtDelta = sqrt(max(delta, zero));
+        const V t1 = dp - sqrtDelta;
+        const V t2 = dp + sqrtDelta;
+        const V t = select(cmpGreaterEqual(t1, zero), t1, t2);
+
+        closest.update(maskAnd(cmpGreaterEqual(delta, zero), cmpGreaterEqual(t, zero)), t);
+    }
+    return closest.reduce(hitIndex);
+}
+
+// Mirrors `Box::rayIntersection`, directions almost parallel to a slab are clamped instead of special cased
+template<typename V>
+float rayBoxesIntersection(const BoxSoA &boxes, const Ray &ray, float tMax, uint32_t &hitIndex) {
+    const V ox = V::splat(ray.origin.x), oy = V::splat(ray.origin.y), oz = V::splat(ray.origin.z);
+    const V dx = V::splat(ray.dir.x), dy = V::splat(ray.dir.y), dz = V::splat(ray.dir.z);
+    const V zero = V::splat(0.0f), one = V::splat(1.0f), minusOne = V::splat(-1.0f);
+    const V eps = V::splat(1e-8f), minusEps = V::splat(-1e-8f);
+
+    ClosestHitLanes<V> closest(tMax);
+    for (size_t i = 0; i < boxes.paddedSize(); i += V::WIDTH) {
+        V tNear = V::splat(-std::numeric_limits<float>::infinity());
+        V tFar = V::splat(std::numeric_limits<float>::infinity());
+        for (int axis = 0; axis < 3; axis++) {
+            const V m0 = V::load(&boxes.inv[axis * 4 + 0][i]);
+            const V m1 = V::load(&boxes.inv[axis * 4 + 1][i]);
+            const V m2 = V::load(&boxes.inv[axis * 4 + 2][i]);
+            const V m3 = V::load(&boxes.inv[axis * 4 + 3][i]);
+            const V localOrigin = m0 * ox + m1 * oy + m2 * oz + m3;
+            const V localDir = m0 * dx + m1 * dy + m2 * dz;
+
+            const V safeDir = select(cmpLess(localDir, zero), min(localDir, minusEps), max(localDir, eps));
+            const V invDir = one / safeDir;
+            const V t0 = (minusOne - localOrigin) * invDir;
+            const V t1 = (one - localOrigin) * invDir;
+            tNear = max(tNear, min(t0, t1));
+            tFar = min(tFar, max(t0, t1));
+        }
+
+        const V t = select(cmpGreaterEqual(tNear, zero), tNear, tFar);
+        closest.update(maskAnd(cmpLessEqual(tNear, tFar), cmpGreaterEqual(tFar, zero)), t);
+    }
+    return closest.reduce(hitIndex);
+}
+
+// Mirrors `rayTriangleEdgeIntersection`
+template<typename V>
+float rayTrianglesIntersection(const TriangleSoA &triangles, const Ray &ray, float tMax, uint32_t &hitIndex) {
+    constexpr float TRI_EPS = 1e-6f;
+    const V ox = V::splat(ray.origin.x), oy = V::splat(ray.origin.y), oz = V::splat(ray.origin.z);
+    const V dx = V::splat(ray.dir.x), dy = V::splat(ray.dir.y), dz = V::splat(ray.dir.z);
+    const V zero = V::splat(0.0f), one = V::splat(1.0f);
+    const V eps = V::splat(TRI_EPS), minusEps = V::splat(-TRI_EPS), onePlusEps = V::splat(1.0f + TRI_EPS);
+
+    ClosestHitLanes<V> closest(tMax);
+    for (size_t i = 0; i < triangles.paddedSize(); i += V::WIDTH) {
+        const V e1x = V::load(&triangles.e1x[i]), e1y = V::load(&triangles.e1y[i]), e1z = V::load(&triangles.e1z[i]);
+        const V e2x = V::load(&triangles.e2x[i]), e2y = V::load(&triangles.e2y[i]), e2z = V::load(&triangles.e2z[i]);
+
+        const V px = dy * e2z - dz * e2y;
+        const V py = dz * e2x - dx * e2z;
+        const V pz = dx * e2y - dy * e2x;
+        const V det = e1x * px + e1y * py + e1z * pz;
+        const V invDet = one / det;
+
+        const V tx = ox - V::load(&triangles.v0x[i]);
+        const V ty = oy - V::load(&triangles.v0y[i]);
+        const V tz = oz - V::load(&triangles.v0z[i]);
+        const V u = (tx * px + ty * py + tz * pz) * invDet;
+
+        const V qx = ty * e1z - tz * e1y;
+        const V qy = tz * e1x - tx * e1z;
+        const V qz = tx * e1y - ty * e1x;
+        const V v = (dx * qx + dy * qy + dz * qz) * invDet;
+        const V t = (e2x * qx + e2y * qy + e2z * qz) * invDet;
+
+        V mask = cmpGreaterEqual(max(det, zero - det), eps);
+        mask = maskAnd(mask, maskAnd(cmpGreaterEqual(u, minusEps), cmpLessEqual(u, onePlusEps)));
+        mask = maskAnd(mask, maskAnd(cmpGreaterEqual(v, minusEps), cmpLessEqual(u + v, onePlusEps)));
+        mask = maskAnd(mask, cmpGreaterEqual(t, eps));
+        closest.update(mask, t);
+    }
+    return closest.reduce(hitIndex);
+}
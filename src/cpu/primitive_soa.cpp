@@ -0,0 +1,56 @@
+#include "primitive_soa.hpp"
+
+#include <initializer_list>
+#include <limits>
+
+// Makes room for one more primitive, growing every array by a block of NaN lanes when the last block is full
+static void growArrays(std::initializer_list<std::vector<float>*> arrays, uint32_t count) {
+    for (std::vector<float> *array : arrays) {
+        if (count == array->size()) array->resize(array->size() + SIMD_MAX_WIDTH, std::numeric_limits<float>::quiet_NaN());
+    }
+}
+
+void SphereSoA::clear() {
+    for (std::vector<float> *array : { &centerX, &centerY, &centerZ, &radius }) array->clear();
+    count = 0;
+}
+
+void SphereSoA::push(const glm::vec3 &center, float r) {
+    growArrays({ &centerX, &centerY, &centerZ, &radius }, count);
+    centerX[count] = center.x;
+    centerY[count] = center.y;
+    centerZ[count] = center.z;
+    radius[count] = r;
+    count++;
+}
+
+void BoxSoA::clear() {
+    for (std::vector<float> &array : inv) array.clear();
+    count = 0;
+}
+
+void BoxSoA::push(const glm::mat4 &invTransform) {
+    for (std::vector<float> &array : inv) growArrays({ &array }, count);
+    // glm matrices are column major, `invTransform[column][row]`
+    for (int row = 0; row < 3; row++) {
+        for (int column = 0; column < 4; column++) {
+            inv[row * 4 + column][count] = invTransform[column][row];
+        }
+    }
+    count++;
+}
+
+void TriangleSoA::clear() {
+    for (std::vector<float> *array : { &v0x, &v0y, &v0z, &e1x, &e1y, &e1z, &e2x, &e2y, &e2z }) array->clear();
+    count = 0;
+}
+
+void TriangleSoA::push(const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2) {
+    growArrays({ &v0x, &v0y, &v0z, &e1x, &e1y, &e1z, &e2x, &e2y, &e2z }, count);
+    const glm::vec3 e1 = v1 - v0;
+    const glm::vec3 e2 = v2 - v0;
+    v0x[count] = v0.x; v0y[count] = v0.y; v0z[count] = v0.z;
+    e1x[count] = e1.x; e1y[count] = e1.y; e1z[count] = e1.z;
+    e2x[count] = e2.x; e2y[count] = e2.y; e2z[count] = e2.z;
+    count++;
+}
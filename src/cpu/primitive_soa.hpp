@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "../utils/simd.hpp"
+
+// Structures of arrays of primitives for the SIMD kernels of `primitive_kernels.hpp`.
+// Arrays are padded to a multiple of SIMD_MAX_WIDTH with NaN, every comparison of the kernels fails on those lanes.
+
+struct SphereSoA {
+    std::vector<float> centerX, centerY, centerZ, radius;
+    uint32_t count = 0;
+
+    void clear();
+    void push(const glm::vec3 &center, float radius);
+    size_t paddedSize() const { return radius.size(); }
+};
+
+// Boxes are [-1, 1]^3 in local space, the rows of their inverse transform bring rays in
+struct BoxSoA {
+    std::vector<float> inv[12];     // Rows x, y, z of the inverse transform, 4 values each
+    uint32_t count = 0;
+
+    void clear();
+    void push(const glm::mat4 &invTransform);
+    size_t paddedSize() const { return inv[0].size(); }
+};
+
+// First vertex and edges, like `GpuTriangle`
+struct TriangleSoA {
+    std::vector<float> v0x, v0y, v0z;
+    std::vector<float> e1x, e1y, e1z;
+    std::vector<float> e2x, e2y, e2z;
+    uint32_t count = 0;
+
+    void clear();
+    void push(const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2);
+    size_t paddedSize() const { return v0x.size(); }
+};
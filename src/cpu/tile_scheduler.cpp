@@ -0,0 +1,228 @@
+#include "tile_scheduler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+
+#include "../utils/parallel.hpp"
+
+uint32_t TileSchedulerStats::getSteals() const {
+    uint32_t steals = 0;
+    for (const TileThreadStats &thread : threads) steals += thread.steals;
+    return steals;
+}
+
+double TileSchedulerStats::getUtilization() const {
+    if (threads.empty() || wallMs <= 0.0) return 0.0;
+    double busyMs = 0.0;
+    for (const TileThreadStats &thread : threads) busyMs += thread.busyMs;
+    return busyMs / (wallMs * static_cast<double>(threads.size()));
+}
+
+TileScheduler::~TileScheduler() {
+    resizePool(1);
+}
+
+// ================ Cost map ================
+
+// Largest power of two that still leaves TILE_MIN_PER_THREAD tiles per thread
+uint32_t TileScheduler::chooseRootSize(uint32_t width, uint32_t height, unsigned threads) const {
+    const double pixels = static_cast<double>(width) * height;
+    const double size = std::sqrt(pixels / (static_cast<double>(threads) * TILE_MIN_PER_THREAD));
+
+    uint32_t rootSize = TILE_MIN_SIZE;
+    while (rootSize * 2 <= TILE_MAX_SIZE && rootSize * 2 <= size) rootSize *= 2;
+    return rootSize;
+}
+
+// Mean cost of the cells under the tile, times its pixels
+double TileScheduler::estimateCost(const Tile &tile) const {
+    const uint32_t beginX = tile.x / TILE_COST_CELL_SIZE;
+    const uint32_t beginY = tile.y / TILE_COST_CELL_SIZE;
+    const uint32_t endX = (tile.x + tile.width + TILE_COST_CELL_SIZE - 1) / TILE_COST_CELL_SIZE;
+    const uint32_t endY = (tile.y + tile.height + TILE_COST_CELL_SIZE - 1) / TILE_COST_CELL_SIZE;
+
+    double cost = 0.0;
+    for (uint32_t y = beginY; y < endY; y++) {
+        for (uint32_t x = beginX; x < endX; x++) cost += costMap[static_cast<size_t>(y) * costWidth + x];
+    }
+    const double cells = static_cast<double>(endX - beginX) * (endY - beginY);
+    return cost / cells * static_cast<double>(tile.width) * tile.height;
+}
+
+// Quarters a `size` square at (x, y), cut at the image edges, until its pieces are cheap enough
+void TileScheduler::splitTile(uint32_t x, uint32_t y, uint32_t size, uint32_t width, uint32_t height, std::vector<Tile> &tiles) const {
+    if (x >= width || y >= height) return;
+    const Tile tile = { x, y, std::min(size, width - x), std::min(size, height - y) };
+    if (size / 2 < TILE_MIN_SIZE || estimateCost(tile) <= TILE_TARGET_MS) {
+        tiles.push_back(tile);
+        return;
+    }
+
+    const uint32_t half = size / 2;
+    splitTile(x, y, half, width, height, tiles);
+    splitTile(x + half, y, half, width, height, tiles);
+    splitTile(x, y + half, half, width, height, tiles);
+    splitTile(x + half, y + half, half, width, height, tiles);
+}
+
+// Tiles never overlap, so the threads write disjoint cells
+void TileScheduler::recordCost(const Tile &tile, double ms) {
+    const double cost = ms / (static_cast<double>(tile.width) * tile.height);
+    const uint32_t endX = (tile.x + tile.width + TILE_COST_CELL_SIZE - 1) / TILE_COST_CELL_SIZE;
+    const uint32_t endY = (tile.y + tile.height + TILE_COST_CELL_SIZE - 1) / TILE_COST_CELL_SIZE;
+    for (uint32_t y = tile.y / TILE_COST_CELL_SIZE; y < endY; y++) {
+        for (uint32_t x = tile.x / TILE_COST_CELL_SIZE; x < endX; x++) {
+            double &cell = costMap[static_cast<size_t>(y) * costWidth + x];
+            cell = cell > 0.0 ? 0.5 * (cell + cost) : cost;
+        }
+    }
+}
+
+// ================ Thread pool ================
+
+void TileScheduler::resizePool(unsigned threads) {
+    if (workers.size() + 1 == threads) return;
+
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        quitting = true;
+    }
+    poolWake.notify_all();
+    for (std::thread &worker : workers) worker.join();
+    workers.clear();
+    quitting = false;
+
+    workers.reserve(threads - 1);
+    for (unsigned i = 1; i < threads; i++) {
+        workers.emplace_back(&TileScheduler::poolLoop, this, i, jobGeneration);
+    }
+}
+
+// `generation` is the last job seen, the thread sleeps until a newer one is posted
+void TileScheduler::poolLoop(unsigned self, uint64_t generation) {
+    while (true) {
+        const std::function<void(unsigned)> *current;
+        {
+            std::unique_lock<std::mutex> lock(poolMutex);
+            poolWake.wait(lock, [&] { return quitting || jobGeneration != generation; });
+            if (quitting) return;
+            generation = jobGeneration;
+            current = job;
+        }
+        (*current)(self);
+        {
+            std::lock_guard<std::mutex> lock(poolMutex);
+            if (--jobsRunning == 0) poolDone.notify_one();
+        }
+    }
+}
+
+// ================ Run ================
+
+bool TileScheduler::run(uint32_t width, uint32_t height, const std::function<void(const Tile&, unsigned)> &fn) {
+    const unsigned threads = resolveThreadCount(threadCount);
+    const uint32_t rootSize = chooseRootSize(width, height, threads);
+
+    const uint32_t cellsX = (width + TILE_COST_CELL_SIZE - 1) / TILE_COST_CELL_SIZE;
+    const uint32_t cellsY = (height + TILE_COST_CELL_SIZE - 1) / TILE_COST_CELL_SIZE;
+    const bool measured = !costMap.empty() && costWidth == cellsX && costHeight == cellsY;
+    if (!measured) {
+        costMap.assign(static_cast<size_t>(cellsX) * cellsY, 0.0);
+        costWidth = cellsX;
+        costHeight = cellsY;
+    }
+
+    // Without a measure every tile has the default size, otherwise the cost map splits the root tiles
+    std::vector<Tile> tiles;
+    const uint32_t tileSize = measured ? rootSize : std::min<uint32_t>(rootSize, TILE_DEFAULT_SIZE);
+    for (uint32_t y = 0; y < height; y += tileSize) {
+        for (uint32_t x = 0; x < width; x += tileSize) {
+            if (measured) {
+                splitTile(x, y, tileSize, width, height, tiles);
+            } else {
+                tiles.push_back({ x, y, std::min(tileSize, width - x), std::min(tileSize, height - y) });
+            }
+        }
+    }
+
+    stats = {};
+    stats.tileCount = static_cast<uint32_t>(tiles.size());
+    stats.threads.assign(threads, TileThreadStats());
+    if (tiles.empty()) return true;
+    stats.minTileSize = TILE_MAX_SIZE;
+    for (const Tile &tile : tiles) {
+        const uint32_t size = std::max(tile.width, tile.height);
+        stats.minTileSize = std::min(stats.minTileSize, size);
+        stats.maxTileSize = std::max(stats.maxTileSize, size);
+    }
+
+    // Tiles are dealt round robin so the expensive regions of the image end up spread over all the deques
+    struct TileQueue {
+        std::mutex mutex;
+        std::deque<Tile> tiles;
+    };
+    std::vector<TileQueue> queues(threads);
+    for (size_t i = 0; i < tiles.size(); i++) {
+        queues[i % threads].tiles.push_back(tiles[i]);
+    }
+
+    auto popOwn = [&](unsigned self, Tile &tile) {
+        std::lock_guard<std::mutex> lock(queues[self].mutex);
+        if (queues[self].tiles.empty()) return false;
+        tile = queues[self].tiles.front();
+        queues[self].tiles.pop_front();
+        return true;
+    };
+    auto steal = [&](unsigned self, Tile &tile) {
+        for (unsigned offset = 1; offset < threads; offset++) {
+            TileQueue &victim = queues[(self + offset) % threads];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.tiles.empty()) continue;
+            tile = victim.tiles.back();
+            victim.tiles.pop_back();
+            return true;
+        }
+        return false;
+    };
+
+    // No tile is ever pushed after the start, so a thread finding every deque empty is done
+    const std::function<void(unsigned)> worker = [&](unsigned self) {
+        TileThreadStats &threadStats = stats.threads[self];
+        Tile tile;
+        while (!cancelFlag || !cancelFlag->load(std::memory_order_relaxed)) {
+            if (!popOwn(self, tile)) {
+                if (!steal(self, tile)) break;
+                threadStats.steals++;
+            }
+            auto start = std::chrono::steady_clock::now();
+            fn(tile, self);
+            const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            recordCost(tile, ms);
+            threadStats.busyMs += ms;
+            threadStats.tiles++;
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    resizePool(threads);
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        job = &worker;
+        jobsRunning = threads - 1;
+        jobGeneration++;
+    }
+    poolWake.notify_all();
+    worker(0);
+    {
+        std::unique_lock<std::mutex> lock(poolMutex);
+        poolDone.wait(lock, [&] { return jobsRunning == 0; });
+        job = nullptr;
+    }
+    stats.wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    uint32_t tilesDone = 0;
+    for (const TileThreadStats &thread : stats.threads) tilesDone += thread.tiles;
+    return tilesDone == stats.tileCount;
+}
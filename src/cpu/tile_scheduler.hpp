@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Tiles are sized so one takes about this long, small enough to balance and large enough to hide the locking
+#define TILE_TARGET_MS 1.0
+// Minimum number of tiles per thread, so the last tiles can still be shared
+#define TILE_MIN_PER_THREAD 8
+#define TILE_MIN_SIZE 4
+#define TILE_MAX_SIZE 128
+// Tile size of a run without a measured cost
+#define TILE_DEFAULT_SIZE 16
+// The cost map stores one cost per TILE_MIN_SIZE^2 pixels, every tile edge falls on a cell edge
+#define TILE_COST_CELL_SIZE TILE_MIN_SIZE
+
+struct Tile {
+    uint32_t x, y;
+    uint32_t width, height;
+};
+
+// Each thread only writes its own entry, aligned so they don't share a cache line
+struct alignas(64) TileThreadStats {
+    double busyMs = 0.0;        // Time spent in the tile function
+    uint32_t tiles = 0;
+    uint32_t steals = 0;        // Tiles taken from the deque of another thread
+};
+
+struct TileSchedulerStats {
+    double wallMs = 0.0;
+    uint32_t minTileSize = 0;
+    uint32_t maxTileSize = 0;
+    uint32_t tileCount = 0;
+    std::vector<TileThreadStats> threads;
+
+    uint32_t getSteals() const;
+    // Busy time of all threads over the time they were available, 1 when every core works until the last tile
+    double getUtilization() const;
+};
+
+// Runs a function over the tiles of an image on a persistent set of threads.
+// Every thread owns a deque of tiles, pops from its front and, once empty, steals from the back of the others.
+// The time of every tile is kept in a cost map of the image: the next run splits the tiles of the expensive regions
+// into quarters until they take about TILE_TARGET_MS, while cheap regions stay in large tiles.
+class TileScheduler {
+public:
+    TileScheduler() = default;
+    TileScheduler(const TileScheduler&) = delete;
+    TileScheduler& operator=(const TileScheduler&) = delete;
+    ~TileScheduler();
+
+    // 0 uses every core
+    void setThreadCount(int count) { threadCount = count; }
+    // Forgets the measured cost, e.g. when the scene changes
+    void reset() { costMap.clear(); }
+    // Checked before every tile, the run stops once it's set. Must outlive the runs
+    void setCancelFlag(const std::atomic<bool> *flag) { cancelFlag = flag; }
+
+    // `fn(tile, threadIndex)` is called once for every tile covering `width` x `height`.
+    // False when the run was cancelled before every tile was done
+    bool run(uint32_t width, uint32_t height, const std::function<void(const Tile&, unsigned)> &fn);
+
+    const TileSchedulerStats& getStats() const { return stats; }
+
+private:
+    int threadCount = 0;
+    const std::atomic<bool> *cancelFlag = nullptr;
+    TileSchedulerStats stats;
+
+    // Milliseconds per pixel of every cell, empty until a first run of this size has been measured
+    std::vector<double> costMap;
+    uint32_t costWidth = 0, costHeight = 0;     // Cells
+
+    // Threads 1 and up of the runs, waiting for the next job between them
+    std::vector<std::thread> workers;
+    std::mutex poolMutex;
+    std::condition_variable poolWake;
+    std::condition_variable poolDone;
+    const std::function<void(unsigned)> *job = nullptr;
+    uint64_t jobGeneration = 0;
+    unsigned jobsRunning = 0;
+    bool quitting = false;
+
+    uint32_t chooseRootSize(uint32_t width, uint32_t height, unsigned threads) const;
+    double estimateCost(const Tile &tile) const;
+    void splitTile(uint32_t x, uint32_t y, uint32_t size, uint32_t width, uint32_t height, std::vector<Tile> &tiles) const;
+    void recordCost(const Tile &tile, double ms);
+
+    void resizePool(unsigned threads);
+    void poolLoop(unsigned self, uint64_t generation);
+};
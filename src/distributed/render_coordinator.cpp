@@ -0,0 +1,233 @@
+#include "render_coordinator.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include <poll.h>
+
+#include "../scene/scene_serializer.hpp"
+
+#define COORDINATOR_POLL_MS 1000
+// Sends are small jobs or the scene, a worker not reading them for this long is gone
+#define COORDINATOR_SEND_TIMEOUT 30.0
+
+bool RenderCoordinator::start(Scene &scene, const CpuRenderParams &params, const RenderCoordinatorSettings &settings) {
+    this->params = params;
+    this->settings = settings;
+    this->settings.tileSize = std::max(settings.tileSize, 1u);
+    this->settings.framesPerJob = std::max(settings.framesPerJob, 1u);
+    this->settings.jobsPerWorker = std::max(settings.jobsPerWorker, 1u);
+
+    const std::vector<char> sceneData = serializeScene(scene);
+    sceneMessage.resize(sizeof(CpuRenderParams));
+    std::memcpy(sceneMessage.data(), &params, sizeof(CpuRenderParams));
+    sceneMessage.insert(sceneMessage.end(), sceneData.begin(), sceneData.end());
+
+    // Every tile of a range of frames before the next range, so an interrupted render is still even
+    jobs.clear();
+    const uint32_t tileSize = this->settings.tileSize;
+    for (uint32_t firstFrame = 1; firstFrame <= settings.frames; firstFrame += this->settings.framesPerJob) {
+        const uint32_t frameCount = std::min(this->settings.framesPerJob, settings.frames - firstFrame + 1);
+        for (uint32_t y = 0; y < params.height; y += tileSize) {
+            for (uint32_t x = 0; x < params.width; x += tileSize) {
+                jobs.push_back({
+                    .id=static_cast<uint32_t>(jobs.size()),
+                    .x=x, .y=y,
+                    .width=std::min(tileSize, params.width - x),
+                    .height=std::min(tileSize, params.height - y),
+                    .firstFrame=firstFrame,
+                    .frameCount=frameCount,
+                    .reserved=0
+                });
+            }
+        }
+    }
+    maxResultSize = sizeof(RenderJob);
+    for (const RenderJob &job : jobs) {
+        maxResultSize = std::max<uint64_t>(maxResultSize, sizeof(RenderJob) + static_cast<uint64_t>(job.width) * job.height * 4 * sizeof(float));
+    }
+    pendingJobs.clear();
+    for (const RenderJob &job : jobs) pendingJobs.push_back(job.id);
+    mergedJobs.assign(jobs.size(), false);
+    mergedJobCount = 0;
+
+    const size_t pixelCount = static_cast<size_t>(params.width) * params.height;
+    colorSums.assign(pixelCount * 3, 0.0);
+    sampleCounts.assign(pixelCount, 0);
+    stats = RenderCoordinatorStats();
+
+    if (!listener.listen(settings.address)) return false;
+    std::cout << "[INFO] Listening on " << settings.address << ", " << jobs.size() << " jobs, scene of "
+              << sceneData.size() / 1024 << " KiB" << std::endl;
+    return true;
+}
+
+bool RenderCoordinator::run() {
+    auto lastReport = std::chrono::steady_clock::now();
+    while (mergedJobCount < jobs.size()) {
+        std::vector<pollfd> fds = { { .fd=listener.getFd(), .events=POLLIN, .revents=0 } };
+        for (const Worker &worker : workers) fds.push_back({ .fd=worker.socket.getFd(), .events=POLLIN, .revents=0 });
+        if (poll(fds.data(), fds.size(), COORDINATOR_POLL_MS) < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "[ERROR] poll failed: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+
+        // Backwards so dropping a worker doesn't move the ones left to visit
+        for (size_t i = workers.size(); i-- > 0;) {
+            if (fds[i + 1].revents == 0) continue;
+            if (!receiveResults(workers[i])) dropWorker(i);
+        }
+        if (fds[0].revents & POLLIN) acceptWorker();
+        // Also hands over the jobs of the workers that left
+        for (size_t i = workers.size(); i-- > 0;) {
+            if (!assignJobs(workers[i])) dropWorker(i);
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        for (size_t i = workers.size(); i-- > 0;) {
+            if (workers[i].jobs.empty() || now - workers[i].lastProgress < std::chrono::duration<double>(settings.jobTimeout)) continue;
+            std::cerr << "[WARN] Worker " << workers[i].id << " sent nothing for " << settings.jobTimeout << " s" << std::endl;
+            stats.workersTimedOut++;
+            dropWorker(i);
+        }
+        if (now - lastReport >= std::chrono::seconds(1)) {
+            std::cout << "[INFO] " << mergedJobCount << "/" << jobs.size() << " jobs, " << workers.size() << " workers" << std::endl;
+            lastReport = now;
+        }
+    }
+
+    for (Worker &worker : workers) sendRenderMessage(worker.socket, RenderMessageType::Done);
+    workers.clear();
+    listener.close();
+    return true;
+}
+
+bool RenderCoordinator::acceptWorker() {
+    Socket socket = listener.accept();
+    if (!socket.isOpen()) return false;
+    socket.setSendTimeout(COORDINATOR_SEND_TIMEOUT);
+    if (!sendRenderMessage(socket, RenderMessageType::Scene, sceneMessage.data(), sceneMessage.size())) {
+        std::cerr << "[WARN] Failed to send the scene to a new worker" << std::endl;
+        return false;
+    }
+
+    workers.push_back({
+        .socket=std::move(socket),
+        .id=nextWorkerId++,
+        .jobs={},
+        .jobsDone=0,
+        .message=std::vector<char>(sizeof(RenderMessageHeader)),
+        .received=0,
+        .lastProgress=std::chrono::steady_clock::now()
+    });
+    stats.workersJoined++;
+    std::cout << "[INFO] Worker " << workers.back().id << " joined" << std::endl;
+    return true;
+}
+
+bool RenderCoordinator::assignJobs(Worker &worker) {
+    while (worker.jobs.size() < settings.jobsPerWorker && !pendingJobs.empty()) {
+        const uint32_t id = pendingJobs.front();
+        pendingJobs.pop_front();
+        if (mergedJobs[id]) continue;
+        // The clock of an idle worker starts with its first job
+        if (worker.jobs.empty()) worker.lastProgress = std::chrono::steady_clock::now();
+        worker.jobs.push_back(id);
+        if (!sendRenderMessage(worker.socket, RenderMessageType::Job, &jobs[id], sizeof(RenderJob))) return false;
+    }
+    return true;
+}
+
+// Reads whatever the socket holds into the message of the worker, handling every result it completes.
+// A worker stalled in the middle of a message leaves it partial until the next poll instead of blocking the loop
+bool RenderCoordinator::receiveResults(Worker &worker) {
+    while (true) {
+        size_t count;
+        if (!worker.socket.receiveSome(worker.message.data() + worker.received, worker.message.size() - worker.received, count)) return false;
+        if (count == 0) return true;
+        worker.received += count;
+        worker.lastProgress = std::chrono::steady_clock::now();
+        stats.bytesReceived += count;
+        if (worker.received < worker.message.size()) continue;
+
+        RenderMessageHeader header;
+        std::memcpy(&header, worker.message.data(), sizeof(header));
+        if (worker.message.size() == sizeof(header)) {
+            // Results are the only messages of the workers, no larger than the largest tile
+            if (!validRenderMessageHeader(header, maxResultSize)) return false;
+            if (header.type != static_cast<uint32_t>(RenderMessageType::Result) || header.size < sizeof(RenderJob)) {
+                std::cerr << "[WARN] Unexpected message from worker " << worker.id << std::endl;
+                return false;
+            }
+            worker.message.resize(sizeof(header) + header.size);
+            continue;
+        }
+
+        if (!handleResult(worker, worker.message.data() + sizeof(header), header.size)) return false;
+        worker.message.resize(sizeof(header));
+        worker.received = 0;
+    }
+}
+
+bool RenderCoordinator::handleResult(Worker &worker, const char *payload, size_t size) {
+    RenderJob job;
+    std::memcpy(&job, payload, sizeof(RenderJob));
+    auto sent = std::find(worker.jobs.begin(), worker.jobs.end(), job.id);
+    const size_t colorsSize = static_cast<size_t>(job.width) * job.height * 4 * sizeof(float);
+    if (sent == worker.jobs.end() || std::memcmp(&job, &jobs[job.id], sizeof(RenderJob)) != 0
+        || size != sizeof(RenderJob) + colorsSize) {
+        std::cerr << "[WARN] Invalid result from worker " << worker.id << std::endl;
+        return false;
+    }
+    worker.jobs.erase(sent);
+    worker.jobsDone++;
+
+    if (!mergedJobs[job.id]) {
+        std::vector<float> colors(static_cast<size_t>(job.width) * job.height * 4);
+        std::memcpy(colors.data(), payload + sizeof(RenderJob), colorsSize);
+        mergeResult(job, colors.data());
+        mergedJobs[job.id] = true;
+        mergedJobCount++;
+    }
+    return true;
+}
+
+void RenderCoordinator::dropWorker(size_t index) {
+    Worker &worker = workers[index];
+    for (uint32_t id : worker.jobs) {
+        if (mergedJobs[id]) continue;
+        pendingJobs.push_front(id);
+        stats.jobsRequeued++;
+    }
+    if (mergedJobCount < jobs.size()) stats.workersLeft++;
+    std::cout << "[INFO] Worker " << worker.id << " left after " << worker.jobsDone << " jobs, "
+              << worker.jobs.size() << " jobs requeued" << std::endl;
+    workers.erase(workers.begin() + index);
+}
+
+void RenderCoordinator::mergeResult(const RenderJob &job, const float *colors) {
+    const uint32_t samples = job.frameCount * static_cast<uint32_t>(params.samplesPerPixel);
+    for (uint32_t y = 0; y < job.height; y++) {
+        for (uint32_t x = 0; x < job.width; x++) {
+            const size_t pixel = static_cast<size_t>(job.y + y) * params.width + job.x + x;
+            const float *color = &colors[(static_cast<size_t>(y) * job.width + x) * 4];
+            for (int c = 0; c < 3; c++) colorSums[pixel * 3 + c] += static_cast<double>(color[c]) * samples;
+            sampleCounts[pixel] += samples;
+        }
+    }
+}
+
+std::vector<float> RenderCoordinator::getPixels() const {
+    std::vector<float> pixels(sampleCounts.size() * 4, 0.0f);
+    for (size_t i = 0; i < sampleCounts.size(); i++) {
+        if (sampleCounts[i] > 0) {
+            for (int c = 0; c < 3; c++) pixels[i * 4 + c] = static_cast<float>(colorSums[i * 3 + c] / sampleCounts[i]);
+        }
+        pixels[i * 4 + 3] = 1.0f;
+    }
+    return pixels;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "render_protocol.hpp"
+#include "../cpu/cpu_integrator.hpp"
+#include "../scene/scene.hpp"
+
+struct RenderCoordinatorSettings {
+    std::string address = "unix:/tmp/vkray_render.sock";
+    uint32_t frames = 64;           // Frames of `params.samplesPerPixel` samples per pixel
+    uint32_t tileSize = 64;
+    uint32_t framesPerJob = 4;
+    uint32_t jobsPerWorker = 2;     // Jobs queued on a worker, hides the round trips
+    double jobTimeout = 120.0;      // Seconds a worker holding jobs may go without sending a byte before it's dropped
+};
+
+struct RenderCoordinatorStats {
+    uint32_t workersJoined = 0;
+    uint32_t workersLeft = 0;       // Before the end of the render, their jobs went back to the queue
+    uint32_t jobsRequeued = 0;
+    uint32_t workersTimedOut = 0;   // Also counted in `workersLeft`
+    uint64_t bytesReceived = 0;
+};
+
+// Splits a render into jobs (a tile and a range of frames), hands them to the workers connected to its socket and
+// merges the returned means weighted by their sample counts. Workers can join or leave at any time: every new
+// worker receives the scene, the jobs of a worker that leaves are handed to the others.
+// The frames seed the random sequences, so the image doesn't depend on the workers and matches a local render.
+// Results are read without blocking, a worker that stalls or stops sending for `jobTimeout` is dropped like one that left.
+class RenderCoordinator {
+public:
+    // Serializes the scene and starts listening
+    bool start(Scene &scene, const CpuRenderParams &params, const RenderCoordinatorSettings &settings);
+    // Serves the workers until every job is merged
+    bool run();
+
+    // RGBA mean of every merged sample, rows from top to bottom
+    std::vector<float> getPixels() const;
+    const RenderCoordinatorStats& getStats() const { return stats; }
+
+private:
+    struct Worker {
+        Socket socket;
+        uint32_t id;
+        std::vector<uint32_t> jobs;     // Sent and not merged yet
+        uint32_t jobsDone = 0;
+        std::vector<char> message;      // Header then payload of the message being received
+        size_t received = 0;            // Bytes of `message` received so far
+        std::chrono::steady_clock::time_point lastProgress;     // Last byte received, or first job sent to an idle worker
+    };
+
+    bool acceptWorker();
+    bool assignJobs(Worker &worker);
+    bool receiveResults(Worker &worker);
+    bool handleResult(Worker &worker, const char *payload, size_t size);
+    void dropWorker(size_t index);
+    void mergeResult(const RenderJob &job, const float *colors);
+
+    CpuRenderParams params;
+    RenderCoordinatorSettings settings;
+    std::vector<char> sceneMessage;     // Parameters then the serialized scene
+    uint64_t maxResultSize = 0;         // Payload of the result of the largest tile
+
+    Socket listener;
+    std::vector<Worker> workers;
+    uint32_t nextWorkerId = 0;
+
+    std::vector<RenderJob> jobs;
+    std::deque<uint32_t> pendingJobs;
+    std::vector<bool> mergedJobs;
+    size_t mergedJobCount = 0;
+
+    std::vector<double> colorSums;      // Per pixel, RGB sums weighted by the sample counts
+    std::vector<uint32_t> sampleCounts;
+    RenderCoordinatorStats stats;
+};
@@ -0,0 +1,32 @@
+#include "render_protocol.hpp"
+
+#include <iostream>
+
+bool sendRenderMessage(Socket &socket, RenderMessageType type, const void *data, size_t size, const void *extraData, size_t extraSize) {
+    const RenderMessageHeader header = {
+        .magic=RENDER_PROTOCOL_MAGIC,
+        .version=RENDER_PROTOCOL_VERSION,
+        .type=static_cast<uint32_t>(type),
+        .reserved=0,
+        .size=size + extraSize
+    };
+    return socket.sendAll(&header, sizeof(header))
+        && (size == 0 || socket.sendAll(data, size))
+        && (extraSize == 0 || socket.sendAll(extraData, extraSize));
+}
+
+bool validRenderMessageHeader(const RenderMessageHeader &header, uint64_t maxSize) {
+    if (header.magic != RENDER_PROTOCOL_MAGIC || header.version != RENDER_PROTOCOL_VERSION || header.size > maxSize) {
+        std::cerr << "[ERROR] Invalid message, is the peer running another build?" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool receiveRenderMessage(Socket &socket, RenderMessageType &type, std::vector<char> &payload) {
+    RenderMessageHeader header;
+    if (!socket.receiveAll(&header, sizeof(header)) || !validRenderMessageHeader(header)) return false;
+    type = static_cast<RenderMessageType>(header.type);
+    payload.resize(header.size);
+    return header.size == 0 || socket.receiveAll(payload.data(), payload.size());
+}
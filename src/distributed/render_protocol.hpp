@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "../utils/socket.hpp"
+
+// Messages between the coordinator and the workers of a distributed render, each one a header and its payload.
+// The payloads are raw structs: every process must run the same build, RENDER_PROTOCOL_VERSION guards the rest.
+#define RENDER_PROTOCOL_MAGIC 0x4B52564Bu   // "KVRK"
+#define RENDER_PROTOCOL_VERSION 1
+#define RENDER_MESSAGE_MAX_SIZE (1ull << 34)
+
+enum class RenderMessageType : uint32_t {
+    Scene = 1,      // Coordinator to worker: CpuRenderParams then the serialized scene
+    Job,            // Coordinator to worker: RenderJob
+    Result,         // Worker to coordinator: RenderJob then the RGBA mean of the tile
+    Done,           // Coordinator to worker: every job is merged, no payload
+};
+
+struct RenderMessageHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t size;
+};
+
+// Frames [firstFrame, firstFrame + frameCount) of a tile. Frames seed the random sequences, so a job
+// renders the same samples whichever worker takes it
+struct RenderJob {
+    uint32_t id;
+    uint32_t x, y;
+    uint32_t width, height;
+    uint32_t firstFrame;
+    uint32_t frameCount;
+    uint32_t reserved;
+};
+
+// The payload is the concatenation of the parts, so large results are never copied into one buffer
+bool sendRenderMessage(Socket &socket, RenderMessageType type, const void *data = nullptr, size_t size = 0,
+                       const void *extraData = nullptr, size_t extraSize = 0);
+// False for another magic or version, or a payload larger than `maxSize`
+bool validRenderMessageHeader(const RenderMessageHeader &header, uint64_t maxSize = RENDER_MESSAGE_MAX_SIZE);
+bool receiveRenderMessage(Socket &socket, RenderMessageType &type, std::vector<char> &payload);
@@ -0,0 +1,84 @@
+#include "render_worker.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include "render_protocol.hpp"
+#include "../cpu/cpu_renderer.hpp"
+#include "../scene/scene_serializer.hpp"
+
+#define WORKER_RETRY_MS 100
+
+static bool connectWithRetry(Socket &socket, const RenderWorkerSettings &settings) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(settings.connectTimeout);
+    while (!socket.connect(settings.address)) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            std::cerr << "[ERROR] Failed to connect to " << settings.address << std::endl;
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(WORKER_RETRY_MS));
+    }
+    return true;
+}
+
+bool runRenderWorker(const RenderWorkerSettings &settings) {
+    Socket socket;
+    if (!connectWithRetry(socket, settings)) return false;
+
+    RenderMessageType type;
+    std::vector<char> payload;
+    if (!receiveRenderMessage(socket, type, payload) || type != RenderMessageType::Scene || payload.size() < sizeof(CpuRenderParams)) {
+        std::cerr << "[ERROR] Expected the scene from the coordinator" << std::endl;
+        return false;
+    }
+    CpuRenderParams params;
+    std::memcpy(static_cast<void*>(&params), payload.data(), sizeof(CpuRenderParams));
+
+    // The engine is never initialized, the scene is headless
+    VkSmol engine;
+    Scene scene;
+    scene.init(engine, true);
+    if (!deserializeScene(engine, scene, payload.data() + sizeof(CpuRenderParams), payload.size() - sizeof(CpuRenderParams))) {
+        scene.destroy(engine);
+        return false;
+    }
+
+    CpuRenderer renderer;
+    renderer.setThreadCount(settings.threadCount);
+    renderer.setParams(params);
+    renderer.setScene(scene);
+    std::cout << "[INFO] Connected to " << settings.address << ", " << scene.getObjects().size() << " objects, "
+              << params.width << "x" << params.height << std::endl;
+
+    int jobsDone = 0;
+    bool finished = false;
+    while (settings.maxJobs < 0 || jobsDone < settings.maxJobs) {
+        if (!receiveRenderMessage(socket, type, payload)) break;
+        if (type == RenderMessageType::Done) {
+            finished = true;
+            break;
+        }
+        if (type != RenderMessageType::Job || payload.size() != sizeof(RenderJob)) {
+            std::cerr << "[ERROR] Unexpected message from the coordinator" << std::endl;
+            break;
+        }
+        RenderJob job;
+        std::memcpy(&job, payload.data(), sizeof(RenderJob));
+
+        // The seed of frame i is the one of frame firstFrame + i - 1 of a local render
+        params.seedOffset = job.firstFrame - 1;
+        renderer.setParams(params);
+        renderer.setRegion({ job.x, job.y, job.width, job.height });
+        for (uint32_t frame = 0; frame < job.frameCount; frame++) renderer.renderFrame();
+
+        const std::vector<float> &pixels = renderer.getPixels();
+        if (!sendRenderMessage(socket, RenderMessageType::Result, &job, sizeof(RenderJob), pixels.data(), pixels.size() * sizeof(float))) break;
+        jobsDone++;
+    }
+
+    std::cout << "[INFO] Leaving after " << jobsDone << " jobs" << std::endl;
+    scene.destroy(engine);
+    return finished || settings.maxJobs >= 0;
+}
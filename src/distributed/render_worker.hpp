@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+
+struct RenderWorkerSettings {
+    std::string address = "unix:/tmp/vkray_render.sock";
+    int threadCount = 0;            // 0 uses every core
+    int maxJobs = -1;               // Leaves after this many jobs, e.g. to test workers leaving mid-render
+    double connectTimeout = 10.0;   // Seconds spent retrying while the coordinator starts
+};
+
+// Connects to a coordinator, receives its scene and renders jobs on the CPU until the coordinator is done.
+// Returns false if the coordinator couldn't be reached or went away before the end of the render
+bool runRenderWorker(const RenderWorkerSettings &settings);
@@ -0,0 +1,1135 @@
+#include "headless_renderer.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include "pipeline_cache.hpp"
+
+#define HEADLESS_COLOR_FORMAT VK_FORMAT_R32G32B32A32_SFLOAT
+#define HEADLESS_PIXEL_SIZE (4 * sizeof(float))
+#define COMPUTE_WORKGROUP_SIZE 8    // `local_size_x` and `local_size_y` of `raytracing_compute.glsl`
+
+// Must match `wavefront.glsl`
+#define WAVEFRONT_WORKGROUP_SIZE 64
+#define WAVEFRONT_QUEUE_COUNT 9             // Two ray queues, one per material type and the shadow rays
+#define WAVEFRONT_RAY_QUEUE 0
+#define WAVEFRONT_MATERIAL_QUEUE 2
+#define WAVEFRONT_SHADOW_QUEUE 8
+#define WAVEFRONT_MATERIAL_COUNT 6
+#define WAVEFRONT_EMISSIVE 3                // Ends its paths during the extension, never shaded
+#define WAVEFRONT_ANY_MATERIAL -1           // `MATERIAL_ANY` of `shade.glsl`, the single pass of the unsorted hits
+#define WAVEFRONT_STATS_OFFSET (WAVEFRONT_QUEUE_COUNT * 4 * sizeof(uint32_t))     // `shadeGroups` and `shadeBranches`
+#define WAVEFRONT_PATH_SIZE 96              // std430 size of `PathState`
+#define WAVEFRONT_SHADOW_RAY_SIZE 48        // std430 size of `ShadowRay`
+#define WAVEFRONT_BUFFER_COUNT 4            // Bindings 18 to 21, after the buffers of the other pipelines
+
+// Indices in `wavefrontPipelines`, the shading passes come last
+#define WAVEFRONT_RAYGEN 0
+#define WAVEFRONT_ARGS 1
+#define WAVEFRONT_EXTEND 2
+#define WAVEFRONT_SHADOW 3
+#define WAVEFRONT_ACCUMULATE 4
+#define WAVEFRONT_SHADE 5
+
+struct WavefrontConstants {
+    uint32_t pathCount;
+    uint32_t rayQueue;
+};
+
+#define VK_TRY(call, what) do {                                                                     \
+    VkResult result_ = (call);                                                                      \
+    if (result_ != VK_SUCCESS) {                                                                    \
+        std::cerr << "[ERROR] " << what << " failed (VkResult " << result_ << ")" << std::endl;     \
+        return false;                                                                               \
+    }                                                                                               \
+} while (0)
+
+// Two triangles covering the screen, the vertex shader passes the positions as `fragPos`
+static const glm::vec2 screenVertices[] = {
+    { 1.0f, 1.0f }, { 1.0f,-1.0f }, {-1.0f,-1.0f },
+    {-1.0f,-1.0f }, {-1.0f, 1.0f }, { 1.0f, 1.0f }
+};
+
+static bool hasLayer(const char *name) {
+    uint32_t count = 0;
+    vkEnumerateInstanceLayerProperties(&count, nullptr);
+    std::vector<VkLayerProperties> layers(count);
+    vkEnumerateInstanceLayerProperties(&count, layers.data());
+    for (const VkLayerProperties &layer : layers)
+        if (std::strcmp(layer.layerName, name) == 0) return true;
+    return false;
+}
+
+static bool hasInstanceExtension(const char *name) {
+    uint32_t count = 0;
+    vkEnumerateInstanceExtensionProperties(nullptr, &count, nullptr);
+    std::vector<VkExtensionProperties> extensions(count);
+    vkEnumerateInstanceExtensionProperties(nullptr, &count, extensions.data());
+    for (const VkExtensionProperties &extension : extensions)
+        if (std::strcmp(extension.extensionName, name) == 0) return true;
+    return false;
+}
+
+static bool hasDeviceExtension(VkPhysicalDevice physicalDevice, const char *name) {
+    uint32_t count = 0;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &count, nullptr);
+    std::vector<VkExtensionProperties> extensions(count);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &count, extensions.data());
+    for (const VkExtensionProperties &extension : extensions)
+        if (std::strcmp(extension.extensionName, name) == 0) return true;
+    return false;
+}
+
+// GLSL to SPIR-V with glslc ($GLSLC, then the Vulkan SDK, then the PATH), which resolves the `#include`s
+static bool compileShader(const std::string &path, const char *stage, std::vector<uint32_t> &spirv) {
+    std::string glslc = "glslc";
+    if (const char *env = std::getenv("GLSLC")) {
+        glslc = env;
+    } else if (const char *sdk = std::getenv("VULKAN_SDK")) {
+        const std::filesystem::path sdkGlslc = std::filesystem::path(sdk) / "bin" / "glslc";
+        if (std::filesystem::exists(sdkGlslc)) glslc = sdkGlslc.string();
+    }
+
+    const std::filesystem::path output = std::filesystem::temp_directory_path() /
+        ("vk_raytracing_" + std::filesystem::path(path).stem().string() + "." + stage + ".spv");
+    const std::string command = "\"" + glslc + "\" -fshader-stage=" + stage + " \"" + path + "\" -o \"" + output.string() + "\"";
+    if (std::system(command.c_str()) != 0) {
+        std::cerr << "[ERROR] Failed to compile shader [" << path << "] with " << glslc << std::endl;
+        return false;
+    }
+
+    std::ifstream file(output, std::ios::binary | std::ios::ate);
+    if (!file) {
+        std::cerr << "[ERROR] Failed to read " << output << std::endl;
+        return false;
+    }
+    const std::streamsize size = file.tellg();
+    spirv.resize(size / sizeof(uint32_t));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(spirv.data()), spirv.size() * sizeof(uint32_t));
+    std::filesystem::remove(output);
+    return !spirv.empty();
+}
+
+static bool createShaderModule(VkDevice device, const std::string &path, const char *stage, VkShaderModule &module) {
+    std::vector<uint32_t> spirv;
+    if (!compileShader(path, stage, spirv)) return false;
+    const VkShaderModuleCreateInfo createInfo = {
+        .sType=VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .codeSize=spirv.size() * sizeof(uint32_t),
+        .pCode=spirv.data()
+    };
+    VK_TRY(vkCreateShaderModule(device, &createInfo, nullptr, &module), "vkCreateShaderModule");
+    return true;
+}
+
+// ================ Setup ================
+
+bool HeadlessGpuRenderer::init(const HeadlessGpuOptions &options) {
+    this->options = options;
+    if (!createInstance(options.validation)) return false;
+    if (!pickDevice(options.deviceIndex)) return false;
+    if (options.usePipelineCache) pipelineCache = loadPipelineCache(physicalDevice, device);
+
+    const VkCommandPoolCreateInfo poolInfo = {
+        .sType=VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags=VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex=queueFamily
+    };
+    VK_TRY(vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool), "vkCreateCommandPool");
+
+    const VkCommandBufferAllocateInfo allocateInfo = {
+        .sType=VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool=commandPool,
+        .level=VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount=1
+    };
+    VK_TRY(vkAllocateCommandBuffers(device, &allocateInfo, &commandBuffer), "vkAllocateCommandBuffers");
+
+    const VkFenceCreateInfo fenceInfo = { .sType=VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+    VK_TRY(vkCreateFence(device, &fenceInfo, nullptr, &fence), "vkCreateFence");
+
+    if (timestampPeriod > 0.0f) {
+        const VkQueryPoolCreateInfo queryInfo = {
+            .sType=VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .queryType=VK_QUERY_TYPE_TIMESTAMP,
+            .queryCount=2
+        };
+        VK_TRY(vkCreateQueryPool(device, &queryInfo, nullptr, &queryPool), "vkCreateQueryPool");
+    }
+
+    const VkSamplerCreateInfo samplerInfo = {
+        .sType=VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+        .magFilter=VK_FILTER_NEAREST,
+        .minFilter=VK_FILTER_NEAREST,
+        .mipmapMode=VK_SAMPLER_MIPMAP_MODE_NEAREST,
+        .addressModeU=VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeV=VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeW=VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .maxLod=0.0f
+    };
+    VK_TRY(vkCreateSampler(device, &samplerInfo, nullptr, &sampler), "vkCreateSampler");
+
+    if (!createBuffer(sizeof(screenVertices), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertexBuffer)) return false;
+    std::memcpy(vertexBuffer.mapped, screenVertices, sizeof(screenVertices));
+    if (!createBuffer(sizeof(RaytracingUBO), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, uniformBuffer)) return false;
+    return true;
+}
+
+bool HeadlessGpuRenderer::createInstance(bool validation) {
+    std::vector<const char*> layers, extensions;
+    if (validation) {
+        if (hasLayer("VK_LAYER_KHRONOS_validation")) {
+            layers.push_back("VK_LAYER_KHRONOS_validation");
+            extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+        } else {
+            std::cerr << "[WARN] VK_LAYER_KHRONOS_validation is not installed, running without validation" << std::endl;
+        }
+    }
+    // MoltenVK is only listed with the portability enumeration
+    VkInstanceCreateFlags flags = 0;
+    if (hasInstanceExtension(VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME)) {
+        extensions.push_back(VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME);
+        flags |= VK_INSTANCE_CREATE_ENUMERATE_PORTABILITY_BIT_KHR;
+    }
+
+    const VkApplicationInfo appInfo = {
+        .sType=VK_STRUCTURE_TYPE_APPLICATION_INFO,
+        .pApplicationName="vk-raytracing headless",
+        .apiVersion=VK_API_VERSION_1_3
+    };
+    const VkInstanceCreateInfo createInfo = {
+        .sType=VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+        .flags=flags,
+        .pApplicationInfo=&appInfo,
+        .enabledLayerCount=static_cast<uint32_t>(layers.size()),
+        .ppEnabledLayerNames=layers.data(),
+        .enabledExtensionCount=static_cast<uint32_t>(extensions.size()),
+        .ppEnabledExtensionNames=extensions.data()
+    };
+    VK_TRY(vkCreateInstance(&createInfo, nullptr, &instance), "vkCreateInstance");
+
+    if (!layers.empty()) {
+        auto createMessenger = reinterpret_cast<PFN_vkCreateDebugUtilsMessengerEXT>(
+            vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT"));
+        const VkDebugUtilsMessengerCreateInfoEXT messengerInfo = {
+            .sType=VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
+            .messageSeverity=VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT,
+            .messageType=VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT
+                | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT,
+            .pfnUserCallback=debugCallback,
+            .pUserData=this
+        };
+        if (createMessenger) VK_TRY(createMessenger(instance, &messengerInfo, nullptr, &messenger), "vkCreateDebugUtilsMessengerEXT");
+    }
+    return true;
+}
+
+bool HeadlessGpuRenderer::pickDevice(int deviceIndex) {
+    uint32_t count = 0;
+    vkEnumeratePhysicalDevices(instance, &count, nullptr);
+    std::vector<VkPhysicalDevice> devices(count);
+    vkEnumeratePhysicalDevices(instance, &count, devices.data());
+    if (devices.empty()) {
+        std::cerr << "[ERROR] No Vulkan device, is a driver such as lavapipe installed?" << std::endl;
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(devices[i], &properties);
+        std::cout << "[INFO] Device " << i << ": " << properties.deviceName << std::endl;
+    }
+    if (deviceIndex >= static_cast<int>(count)) {
+        std::cerr << "[ERROR] No device " << deviceIndex << ", " << count << " available" << std::endl;
+        return false;
+    }
+    physicalDevice = devices[deviceIndex < 0 ? 0 : deviceIndex];
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    deviceName = properties.deviceName;
+    maxStorageBufferRange = properties.limits.maxStorageBufferRange;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+    bool foundFamily = false;
+    for (uint32_t i = 0; i < familyCount && !foundFamily; i++) {
+        if (families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+            queueFamily = i;
+            foundFamily = true;
+        }
+    }
+    if (!foundFamily) {
+        std::cerr << "[ERROR] " << deviceName << " has no graphics queue" << std::endl;
+        return false;
+    }
+    if (families[queueFamily].timestampValidBits > 0) timestampPeriod = properties.limits.timestampPeriod;
+
+    // Dynamic rendering is core in 1.3 and an extension before, e.g. with MoltenVK
+    const bool core13 = properties.apiVersion >= VK_API_VERSION_1_3;
+    std::vector<const char*> extensions;
+    if (!core13) {
+        if (!hasDeviceExtension(physicalDevice, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME)) {
+            std::cerr << "[ERROR] " << deviceName << " supports neither Vulkan 1.3 nor " << VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME << std::endl;
+            return false;
+        }
+        extensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+    }
+    if (hasDeviceExtension(physicalDevice, "VK_KHR_portability_subset")) extensions.push_back("VK_KHR_portability_subset");
+
+    const float priority = 1.0f;
+    const VkDeviceQueueCreateInfo queueInfo = {
+        .sType=VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+        .queueFamilyIndex=queueFamily,
+        .queueCount=1,
+        .pQueuePriorities=&priority
+    };
+    VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRendering = {
+        .sType=VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR,
+        .dynamicRendering=VK_TRUE
+    };
+    const VkDeviceCreateInfo createInfo = {
+        .sType=VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+        .pNext=&dynamicRendering,
+        .queueCreateInfoCount=1,
+        .pQueueCreateInfos=&queueInfo,
+        .enabledExtensionCount=static_cast<uint32_t>(extensions.size()),
+        .ppEnabledExtensionNames=extensions.data()
+    };
+    VK_TRY(vkCreateDevice(physicalDevice, &createInfo, nullptr, &device), "vkCreateDevice");
+    vkGetDeviceQueue(device, queueFamily, 0, &queue);
+
+    cmdBeginRendering = reinterpret_cast<PFN_vkCmdBeginRenderingKHR>(
+        vkGetDeviceProcAddr(device, core13 ? "vkCmdBeginRendering" : "vkCmdBeginRenderingKHR"));
+    cmdEndRendering = reinterpret_cast<PFN_vkCmdEndRenderingKHR>(
+        vkGetDeviceProcAddr(device, core13 ? "vkCmdEndRendering" : "vkCmdEndRenderingKHR"));
+    if (!cmdBeginRendering || !cmdEndRendering) {
+        std::cerr << "[ERROR] Failed to load the dynamic rendering functions" << std::endl;
+        return false;
+    }
+
+    std::cout << "[INFO] Rendering on " << deviceName << std::endl;
+    return true;
+}
+
+bool HeadlessGpuRenderer::createPipeline(uint32_t storageBufferCount) {
+    // Bindings of `inputs.glsl`: the UBO, the previous frame (the accumulation image when computing), the scene buffers
+    // and the CPU samples. Then the paths and queues of `wavefront.glsl`
+    if (options.pipeline == HeadlessPipeline::Wavefront) storageBufferCount += WAVEFRONT_BUFFER_COUNT;
+    const VkShaderStageFlags stage = usesStorageImage() ? VK_SHADER_STAGE_COMPUTE_BIT : VK_SHADER_STAGE_FRAGMENT_BIT;
+    const VkDescriptorType imageType = usesStorageImage() ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    std::vector<VkDescriptorSetLayoutBinding> bindings = {
+        { .binding=0, .descriptorType=VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, .descriptorCount=1, .stageFlags=stage },
+        { .binding=1, .descriptorType=imageType, .descriptorCount=1, .stageFlags=stage },
+    };
+    for (uint32_t i = 0; i < storageBufferCount; i++) {
+        bindings.push_back({ .binding=2 + i, .descriptorType=VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount=1, .stageFlags=stage });
+    }
+    const VkDescriptorSetLayoutCreateInfo setLayoutInfo = {
+        .sType=VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount=static_cast<uint32_t>(bindings.size()),
+        .pBindings=bindings.data()
+    };
+    VK_TRY(vkCreateDescriptorSetLayout(device, &setLayoutInfo, nullptr, &setLayout), "vkCreateDescriptorSetLayout");
+
+    const VkPushConstantRange pushConstants = {
+        .stageFlags=VK_SHADER_STAGE_COMPUTE_BIT, .offset=0, .size=sizeof(WavefrontConstants)
+    };
+    const bool wavefront = options.pipeline == HeadlessPipeline::Wavefront;
+    const VkPipelineLayoutCreateInfo layoutInfo = {
+        .sType=VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount=1,
+        .pSetLayouts=&setLayout,
+        .pushConstantRangeCount=wavefront ? 1u : 0u,
+        .pPushConstantRanges=wavefront ? &pushConstants : nullptr
+    };
+    VK_TRY(vkCreatePipelineLayout(device, &layoutInfo, nullptr, &pipelineLayout), "vkCreatePipelineLayout");
+
+    const VkDescriptorPoolSize poolSizes[] = {
+        { .type=VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, .descriptorCount=2 },
+        { .type=imageType, .descriptorCount=2 },
+        { .type=VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount=2 * storageBufferCount },
+    };
+    const VkDescriptorPoolCreateInfo poolInfo = {
+        .sType=VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets=2,
+        .poolSizeCount=3,
+        .pPoolSizes=poolSizes
+    };
+    VK_TRY(vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool), "vkCreateDescriptorPool");
+    const VkDescriptorSetLayout setLayouts[2] = { setLayout, setLayout };
+    const VkDescriptorSetAllocateInfo setInfo = {
+        .sType=VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool=descriptorPool,
+        .descriptorSetCount=2,
+        .pSetLayouts=setLayouts
+    };
+    VK_TRY(vkAllocateDescriptorSets(device, &setInfo, descriptorSets), "vkAllocateDescriptorSets");
+
+    switch (options.pipeline) {
+        case HeadlessPipeline::Compute:     return createComputePipeline();
+        case HeadlessPipeline::Wavefront:   return createWavefrontPipelines();
+        default:                            return createGraphicsPipeline();
+    }
+}
+
+bool HeadlessGpuRenderer::createGraphicsPipeline() {
+    VkShaderModule vertModule = VK_NULL_HANDLE, fragModule = VK_NULL_HANDLE;
+    if (!createShaderModule(device, options.vertShaderPath, "vert", vertModule)) return false;
+    if (!createShaderModule(device, options.fragShaderPath, "frag", fragModule)) {
+        vkDestroyShaderModule(device, vertModule, nullptr);
+        return false;
+    }
+
+    const VkPipelineShaderStageCreateInfo stages[] = {
+        { .sType=VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, .stage=VK_SHADER_STAGE_VERTEX_BIT, .module=vertModule, .pName="main" },
+        { .sType=VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, .stage=VK_SHADER_STAGE_FRAGMENT_BIT, .module=fragModule, .pName="main" },
+    };
+    const VkVertexInputBindingDescription vertexBinding = {
+        .binding=0, .stride=sizeof(glm::vec2), .inputRate=VK_VERTEX_INPUT_RATE_VERTEX
+    };
+    const VkVertexInputAttributeDescription vertexAttribute = {
+        .location=0, .binding=0, .format=VK_FORMAT_R32G32_SFLOAT, .offset=0
+    };
+    const VkPipelineVertexInputStateCreateInfo vertexInput = {
+        .sType=VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+        .vertexBindingDescriptionCount=1,
+        .pVertexBindingDescriptions=&vertexBinding,
+        .vertexAttributeDescriptionCount=1,
+        .pVertexAttributeDescriptions=&vertexAttribute
+    };
+    const VkPipelineInputAssemblyStateCreateInfo inputAssembly = {
+        .sType=VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+        .topology=VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST
+    };
+    const VkPipelineViewportStateCreateInfo viewport = {
+        .sType=VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+        .viewportCount=1,
+        .scissorCount=1
+    };
+    const VkPipelineRasterizationStateCreateInfo rasterization = {
+        .sType=VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+        .polygonMode=VK_POLYGON_MODE_FILL,
+        .cullMode=VK_CULL_MODE_NONE,
+        .frontFace=VK_FRONT_FACE_COUNTER_CLOCKWISE,
+        .lineWidth=1.0f
+    };
+    const VkPipelineMultisampleStateCreateInfo multisample = {
+        .sType=VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+        .rasterizationSamples=VK_SAMPLE_COUNT_1_BIT
+    };
+    const VkPipelineColorBlendAttachmentState blendAttachment = {
+        .blendEnable=VK_FALSE,
+        .colorWriteMask=VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT
+    };
+    const VkPipelineColorBlendStateCreateInfo blend = {
+        .sType=VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+        .attachmentCount=1,
+        .pAttachments=&blendAttachment
+    };
+    const VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+    const VkPipelineDynamicStateCreateInfo dynamic = {
+        .sType=VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+        .dynamicStateCount=2,
+        .pDynamicStates=dynamicStates
+    };
+    const VkFormat colorFormat = HEADLESS_COLOR_FORMAT;
+    const VkPipelineRenderingCreateInfoKHR rendering = {
+        .sType=VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR,
+        .colorAttachmentCount=1,
+        .pColorAttachmentFormats=&colorFormat
+    };
+    const VkGraphicsPipelineCreateInfo pipelineInfo = {
+        .sType=VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .pNext=&rendering,
+        .stageCount=2,
+        .pStages=stages,
+        .pVertexInputState=&vertexInput,
+        .pInputAssemblyState=&inputAssembly,
+        .pViewportState=&viewport,
+        .pRasterizationState=&rasterization,
+        .pMultisampleState=&multisample,
+        .pColorBlendState=&blend,
+        .pDynamicState=&dynamic,
+        .layout=pipelineLayout
+    };
+    const VkResult result = vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline);
+    vkDestroyShaderModule(device, vertModule, nullptr);
+    vkDestroyShaderModule(device, fragModule, nullptr);
+    VK_TRY(result, "vkCreateGraphicsPipelines");
+    return true;
+}
+
+bool HeadlessGpuRenderer::createComputePipeline() {
+    VkShaderModule compModule = VK_NULL_HANDLE;
+    if (!createShaderModule(device, options.compShaderPath, "comp", compModule)) return false;
+
+    const VkComputePipelineCreateInfo pipelineInfo = {
+        .sType=VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .stage={ .sType=VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, .stage=VK_SHADER_STAGE_COMPUTE_BIT, .module=compModule, .pName="main" },
+        .layout=pipelineLayout
+    };
+    const VkResult result = vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline);
+    vkDestroyShaderModule(device, compModule, nullptr);
+    VK_TRY(result, "vkCreateComputePipelines");
+    return true;
+}
+
+bool HeadlessGpuRenderer::createWavefrontPipelines() {
+    const char *passes[] = { "raygen", "args", "extend", "shadow", "accumulate", "shade" };
+    VkShaderModule modules[6] = {};
+    bool compiled = true;
+    for (size_t i = 0; i < 6 && compiled; i++) {
+        compiled = createShaderModule(device, options.wavefrontShaderDir + "/" + passes[i] + ".glsl", "comp", modules[i]);
+    }
+
+    // Specialization constant 0 is `SORT_HITS` for the extension and `MATERIAL_TYPE` for the shading passes: one per
+    // material type when sorting, otherwise a single one branching on the type of each hit
+    const uint32_t pipelineCount = WAVEFRONT_SHADE + (options.sortHits ? WAVEFRONT_MATERIAL_COUNT : 1);
+    wavefrontPipelines.assign(pipelineCount, VK_NULL_HANDLE);
+    int32_t constants[WAVEFRONT_SHADE + WAVEFRONT_MATERIAL_COUNT] = {};
+    VkSpecializationInfo specializations[WAVEFRONT_SHADE + WAVEFRONT_MATERIAL_COUNT] = {};
+    const VkSpecializationMapEntry constantEntry = { .constantID=0, .offset=0, .size=sizeof(int32_t) };
+    std::vector<VkComputePipelineCreateInfo> pipelineInfos;
+    std::vector<uint32_t> pipelineIndices;
+    for (uint32_t i = 0; i < pipelineCount && compiled; i++) {
+        const int32_t material = static_cast<int32_t>(i) - WAVEFRONT_SHADE;
+        if (options.sortHits && material == WAVEFRONT_EMISSIVE) continue;
+
+        VkPipelineShaderStageCreateInfo stage = {
+            .sType=VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage=VK_SHADER_STAGE_COMPUTE_BIT,
+            .module=modules[std::min<uint32_t>(i, WAVEFRONT_SHADE)],
+            .pName="main"
+        };
+        if (i == WAVEFRONT_EXTEND || i >= WAVEFRONT_SHADE) {
+            if (i == WAVEFRONT_EXTEND) constants[i] = options.sortHits ? VK_TRUE : VK_FALSE;
+            else constants[i] = options.sortHits ? material : WAVEFRONT_ANY_MATERIAL;
+            specializations[i] = {
+                .mapEntryCount=1, .pMapEntries=&constantEntry, .dataSize=sizeof(int32_t), .pData=&constants[i]
+            };
+            stage.pSpecializationInfo = &specializations[i];
+        }
+        pipelineInfos.push_back({ .sType=VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO, .stage=stage, .layout=pipelineLayout });
+        pipelineIndices.push_back(i);
+    }
+
+    VkResult result = VK_ERROR_INITIALIZATION_FAILED;
+    std::vector<VkPipeline> pipelines(pipelineInfos.size(), VK_NULL_HANDLE);
+    if (compiled) {
+        result = vkCreateComputePipelines(device, pipelineCache, static_cast<uint32_t>(pipelineInfos.size()),
+                                          pipelineInfos.data(), nullptr, pipelines.data());
+    }
+    for (VkShaderModule module : modules) {
+        if (module != VK_NULL_HANDLE) vkDestroyShaderModule(device, module, nullptr);
+    }
+    for (size_t i = 0; i < pipelines.size(); i++) wavefrontPipelines[pipelineIndices[i]] = pipelines[i];
+    if (!compiled) return false;
+    VK_TRY(result, "vkCreateComputePipelines");
+    return true;
+}
+
+bool HeadlessGpuRenderer::createTargets() {
+    // The compute pipelines read and write the same image
+    const uint32_t targetCount = usesStorageImage() ? 1 : 2;
+    const VkImageUsageFlags usage = usesStorageImage()
+        ? VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT
+        : VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    for (uint32_t i = 0; i < targetCount; i++) {
+        Target &target = targets[i];
+        const VkImageCreateInfo imageInfo = {
+            .sType=VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .imageType=VK_IMAGE_TYPE_2D,
+            .format=HEADLESS_COLOR_FORMAT,
+            .extent={ params.width, params.height, 1 },
+            .mipLevels=1,
+            .arrayLayers=1,
+            .samples=VK_SAMPLE_COUNT_1_BIT,
+            .tiling=VK_IMAGE_TILING_OPTIMAL,
+            .usage=usage,
+            .sharingMode=VK_SHARING_MODE_EXCLUSIVE,
+            .initialLayout=VK_IMAGE_LAYOUT_UNDEFINED
+        };
+        VK_TRY(vkCreateImage(device, &imageInfo, nullptr, &target.image), "vkCreateImage");
+
+        VkMemoryRequirements requirements;
+        vkGetImageMemoryRequirements(device, target.image, &requirements);
+        uint32_t typeIndex;
+        if (!findMemoryType(requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, typeIndex)
+            && !findMemoryType(requirements.memoryTypeBits, 0, typeIndex)) {
+            std::cerr << "[ERROR] No memory type for the render targets" << std::endl;
+            return false;
+        }
+        const VkMemoryAllocateInfo allocateInfo = {
+            .sType=VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .allocationSize=requirements.size,
+            .memoryTypeIndex=typeIndex
+        };
+        VK_TRY(vkAllocateMemory(device, &allocateInfo, nullptr, &target.memory), "vkAllocateMemory");
+        VK_TRY(vkBindImageMemory(device, target.image, target.memory, 0), "vkBindImageMemory");
+
+        const VkImageViewCreateInfo viewInfo = {
+            .sType=VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image=target.image,
+            .viewType=VK_IMAGE_VIEW_TYPE_2D,
+            .format=HEADLESS_COLOR_FORMAT,
+            .subresourceRange={ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
+        };
+        VK_TRY(vkCreateImageView(device, &viewInfo, nullptr, &target.view), "vkCreateImageView");
+        target.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    }
+    return createBuffer(static_cast<VkDeviceSize>(params.width) * params.height * HEADLESS_PIXEL_SIZE,
+                        VK_BUFFER_USAGE_TRANSFER_DST_BIT, readbackBuffer);
+}
+
+// Only touched by the GPU, so device local
+bool HeadlessGpuRenderer::createWavefrontBuffers() {
+    const VkDeviceSize pathBytes = static_cast<VkDeviceSize>(pathCount) * WAVEFRONT_PATH_SIZE;
+    const VkDeviceSize queueBytes = static_cast<VkDeviceSize>(pathCount) * WAVEFRONT_SHADOW_QUEUE * sizeof(uint32_t);
+    if (pathBytes > maxStorageBufferRange || queueBytes > maxStorageBufferRange) {
+        std::cerr << "[ERROR] " << pathCount << " paths don't fit in the storage buffers of " << deviceName
+                  << ", lower the resolution or the samples per pixel" << std::endl;
+        return false;
+    }
+
+    if (!createBuffer(pathBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, pathBuffer, false)) return false;
+    // The counts stay host visible, they are small and hold the shading statistics
+    if (!createBuffer(WAVEFRONT_STATS_OFFSET + 2 * sizeof(uint32_t),
+                      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                      queueCountBuffer)) return false;
+    if (!createBuffer(queueBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, queueBuffer, false)) return false;
+    return createBuffer(static_cast<VkDeviceSize>(pathCount) * WAVEFRONT_SHADOW_RAY_SIZE, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                        shadowBuffer, false);
+}
+
+bool HeadlessGpuRenderer::updateDescriptorSets() {
+    if (pipelineLayout == VK_NULL_HANDLE || targets[0].view == VK_NULL_HANDLE) {
+        std::cerr << "[ERROR] The scene and the parameters must be set before rendering" << std::endl;
+        return false;
+    }
+
+    // Set i renders into target i and reads the other one, both use the single target of the compute pipelines
+    const VkDescriptorType imageType = usesStorageImage() ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    for (uint32_t i = 0; i < 2; i++) {
+        const VkDescriptorBufferInfo uniformInfo = { uniformBuffer.buffer, 0, sizeof(RaytracingUBO) };
+        const VkDescriptorImageInfo imageInfo = usesStorageImage()
+            ? VkDescriptorImageInfo{ VK_NULL_HANDLE, targets[0].view, VK_IMAGE_LAYOUT_GENERAL }
+            : VkDescriptorImageInfo{ sampler, targets[1 - i].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+        std::vector<VkDescriptorBufferInfo> storageInfos;
+        for (const HostBuffer &buffer : storageBuffers) storageInfos.push_back({ buffer.buffer, 0, buffer.size });
+        if (options.pipeline == HeadlessPipeline::Wavefront) {
+            for (const HostBuffer *buffer : { &pathBuffer, &queueCountBuffer, &queueBuffer, &shadowBuffer }) {
+                storageInfos.push_back({ buffer->buffer, 0, buffer->size });
+            }
+        }
+
+        std::vector<VkWriteDescriptorSet> writes = {
+            { .sType=VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .dstSet=descriptorSets[i], .dstBinding=0, .descriptorCount=1,
+              .descriptorType=VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, .pBufferInfo=&uniformInfo },
+            { .sType=VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .dstSet=descriptorSets[i], .dstBinding=1, .descriptorCount=1,
+              .descriptorType=imageType, .pImageInfo=&imageInfo },
+        };
+        for (uint32_t j = 0; j < storageInfos.size(); j++) {
+            writes.push_back({ .sType=VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .dstSet=descriptorSets[i], .dstBinding=2 + j,
+                               .descriptorCount=1, .descriptorType=VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .pBufferInfo=&storageInfos[j] });
+        }
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+    descriptorsDirty = false;
+    return true;
+}
+
+bool HeadlessGpuRenderer::setScene(VkSmol &engine, Scene &scene) {
+    scene.fillBuffers(engine);
+    const std::vector<const std::vector<char>*> hostBuffers = scene.getHostBuffers();
+    // Plus the CPU samples of the hybrid render, never merged here
+    if (pipelineLayout == VK_NULL_HANDLE) {
+        // Shader compilation included, only the pipeline creation itself benefits from the cache
+        const auto pipelineStart = std::chrono::steady_clock::now();
+        if (!createPipeline(static_cast<uint32_t>(hostBuffers.size()) + 1)) return false;
+        pipelineMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pipelineStart).count();
+    }
+
+    vkDeviceWaitIdle(device);
+    for (HostBuffer &buffer : storageBuffers) destroyBuffer(buffer);
+    storageBuffers.assign(hostBuffers.size(), HostBuffer());
+    for (size_t i = 0; i < hostBuffers.size(); i++) {
+        if (hostBuffers[i]->empty()) {
+            std::cerr << "[ERROR] Buffer " << i << " of the scene is empty, is the scene headless?" << std::endl;
+            return false;
+        }
+        if (!createBuffer(hostBuffers[i]->size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, storageBuffers[i])) return false;
+        std::memcpy(storageBuffers[i].mapped, hostBuffers[i]->data(), hostBuffers[i]->size());
+    }
+    storageBuffers.push_back(HostBuffer());
+    if (!createBuffer(HEADLESS_PIXEL_SIZE, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, storageBuffers.back())) return false;
+
+    descriptorsDirty = true;
+    frameCount = 0;
+    frameTimings.clear();
+    shadeGroups = 0;
+    shadeBranches = 0;
+    return true;
+}
+
+bool HeadlessGpuRenderer::setParams(const CpuRenderParams &params) {
+    if (params.width == 0 || params.height == 0) {
+        std::cerr << "[ERROR] Empty render size" << std::endl;
+        return false;
+    }
+    const bool resized = !hasParams || params.width != this->params.width || params.height != this->params.height;
+    this->params = params;
+    hasParams = true;
+    if (resized) {
+        vkDeviceWaitIdle(device);
+        destroyTargets();
+        if (!createTargets()) return false;
+        descriptorsDirty = true;
+    }
+
+    // One path per sample of the frame
+    const uint32_t samplesPerPixel = static_cast<uint32_t>(std::max(params.samplesPerPixel, 1));
+    const uint32_t paths = params.width * params.height * samplesPerPixel;
+    if (options.pipeline == HeadlessPipeline::Wavefront && paths != pathCount) {
+        vkDeviceWaitIdle(device);
+        for (HostBuffer *buffer : { &pathBuffer, &queueCountBuffer, &queueBuffer, &shadowBuffer }) destroyBuffer(*buffer);
+        pathCount = paths;
+        if (!createWavefrontBuffers()) return false;
+        descriptorsDirty = true;
+    }
+
+    frameCount = 0;
+    frameIndex = 0;
+    frameTimings.clear();
+    shadeGroups = 0;
+    shadeBranches = 0;
+    return true;
+}
+
+// ================ Frames ================
+
+bool HeadlessGpuRenderer::renderFrame() {
+    if (descriptorsDirty && !updateDescriptorSets()) return false;
+
+    frameCount++;
+    const auto submitStart = std::chrono::steady_clock::now();
+    if (frameCount == 1) startTime = submitStart;
+
+    // Full resolution from the first frame, the low resolution preview is only useful while moving the camera
+    RaytracingUBO ubo = {};
+    ubo.cameraPos = params.cameraPos;
+    ubo.cameraDir = params.cameraDir;
+    ubo.tanHFov = params.tanHFov;
+    ubo.aperture = params.aperture;
+    ubo.focusDepth = params.focusDepth;
+    ubo.screenSize = { static_cast<float>(params.width), static_cast<float>(params.height) };
+    ubo.aspect = ubo.screenSize.x / ubo.screenSize.y;
+    ubo.lowResolutionScale = 1.0f;
+    ubo.frameCount = static_cast<int>(frameCount);
+    ubo.time = std::chrono::duration<float>(submitStart - startTime).count();
+    ubo.lightMode = params.lightMode;
+    ubo.maxBounces = params.maxBounces;
+    ubo.samplesPerPixel = params.samplesPerPixel;
+    ubo.importanceSampling = static_cast<int>(params.importanceSampling);
+    ubo.debugView = params.debugView;
+    std::memcpy(uniformBuffer.mapped, &ubo, sizeof(ubo));
+
+    const VkCommandBufferBeginInfo beginInfo = {
+        .sType=VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags=VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    };
+    VK_TRY(vkResetCommandBuffer(commandBuffer, 0), "vkResetCommandBuffer");
+    VK_TRY(vkBeginCommandBuffer(commandBuffer, &beginInfo), "vkBeginCommandBuffer");
+    if (queryPool != VK_NULL_HANDLE) vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2);
+
+    switch (options.pipeline) {
+        case HeadlessPipeline::Compute:     recordDispatch(targets[0]); break;
+        case HeadlessPipeline::Wavefront:   recordWavefront(targets[0]); break;
+        default:                            recordDraw(targets[1 - frameIndex], targets[frameIndex]); break;
+    }
+
+    VK_TRY(vkEndCommandBuffer(commandBuffer), "vkEndCommandBuffer");
+    if (!submitAndWait()) return false;
+
+    HeadlessFrameTiming timing = {
+        .wallMs=std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - submitStart).count(),
+        .gpuMs=-1.0
+    };
+    uint64_t timestamps[2];
+    if (queryPool != VK_NULL_HANDLE && vkGetQueryPoolResults(device, queryPool, 0, 2, sizeof(timestamps), timestamps,
+            sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) == VK_SUCCESS) {
+        timing.gpuMs = static_cast<double>(timestamps[1] - timestamps[0]) * timestampPeriod * 1e-6;
+    }
+    frameTimings.push_back(timing);
+
+    if (options.pipeline == HeadlessPipeline::Wavefront) {
+        uint32_t stats[2];
+        std::memcpy(stats, static_cast<const char*>(queueCountBuffer.mapped) + WAVEFRONT_STATS_OFFSET, sizeof(stats));
+        shadeGroups += stats[0];
+        shadeBranches += stats[1];
+    }
+
+    frameIndex = 1 - frameIndex;
+    return true;
+}
+
+void HeadlessGpuRenderer::recordDraw(Target &prev, Target &curr) {
+    // The previous image is undefined on the first frames, the shader ignores it until the third one
+    transition(prev, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0,
+               VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    curr.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    transition(curr, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+               VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+
+    if (queryPool != VK_NULL_HANDLE) vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+
+    const VkRenderingAttachmentInfoKHR colorAttachment = {
+        .sType=VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR,
+        .imageView=curr.view,
+        .imageLayout=VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        .loadOp=VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+        .storeOp=VK_ATTACHMENT_STORE_OP_STORE
+    };
+    const VkRenderingInfoKHR renderingInfo = {
+        .sType=VK_STRUCTURE_TYPE_RENDERING_INFO_KHR,
+        .renderArea={ { 0, 0 }, { params.width, params.height } },
+        .layerCount=1,
+        .colorAttachmentCount=1,
+        .pColorAttachments=&colorAttachment
+    };
+    cmdBeginRendering(commandBuffer, &renderingInfo);
+
+    const VkViewport viewport = { 0.0f, 0.0f, static_cast<float>(params.width), static_cast<float>(params.height), 0.0f, 1.0f };
+    const VkRect2D scissor = { { 0, 0 }, { params.width, params.height } };
+    const VkDeviceSize vertexOffset = 0;
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[frameIndex], 0, nullptr);
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer.buffer, &vertexOffset);
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    vkCmdDraw(commandBuffer, 6, 1, 0, 0);
+    cmdEndRendering(commandBuffer);
+
+    if (queryPool != VK_NULL_HANDLE) vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+
+    // Read by the next frame
+    transition(curr, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+               VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+}
+
+void HeadlessGpuRenderer::recordDispatch(Target &target) {
+    prepareStorageTarget(target);
+    if (queryPool != VK_NULL_HANDLE) vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[0], 0, nullptr);
+    vkCmdDispatch(commandBuffer, (params.width + COMPUTE_WORKGROUP_SIZE - 1) / COMPUTE_WORKGROUP_SIZE,
+                  (params.height + COMPUTE_WORKGROUP_SIZE - 1) / COMPUTE_WORKGROUP_SIZE, 1);
+
+    if (queryPool != VK_NULL_HANDLE) vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+}
+
+// Every bounce extends the paths of one ray queue, shades the hits queued per material type into the other ray queue
+// and traces the shadow rays of the shading. The queue sizes are only known on the GPU, so `args.glsl` turns them into
+// the workgroup counts of the indirect dispatches
+void HeadlessGpuRenderer::recordWavefront(Target &target) {
+    prepareStorageTarget(target);
+    if (queryPool != VK_NULL_HANDLE) vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+
+    const auto dispatch = [&](uint32_t index, uint32_t rayQueue, uint32_t groupCount) {
+        const WavefrontConstants constants = { .pathCount=pathCount, .rayQueue=rayQueue };
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, wavefrontPipelines[index]);
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+        vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+        computeBarrier();
+    };
+    // Workgroup counts written by `args.glsl` for the queue, empty queues dispatch nothing
+    const auto dispatchQueue = [&](uint32_t index, uint32_t rayQueue, uint32_t queue) {
+        const WavefrontConstants constants = { .pathCount=pathCount, .rayQueue=rayQueue };
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, wavefrontPipelines[index]);
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+        vkCmdDispatchIndirect(commandBuffer, queueCountBuffer.buffer, (WAVEFRONT_QUEUE_COUNT + 3 * queue) * sizeof(uint32_t));
+    };
+    const auto clearCounts = [&](uint32_t firstQueue, uint32_t queueCount) {
+        vkCmdFillBuffer(commandBuffer, queueCountBuffer.buffer, firstQueue * sizeof(uint32_t), queueCount * sizeof(uint32_t), 0);
+    };
+
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[0], 0, nullptr);
+    vkCmdFillBuffer(commandBuffer, queueCountBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+    computeBarrier();
+    dispatch(WAVEFRONT_RAYGEN, 0, (pathCount + WAVEFRONT_WORKGROUP_SIZE - 1) / WAVEFRONT_WORKGROUP_SIZE);
+    dispatch(WAVEFRONT_ARGS, 0, 1);
+
+    for (int bounce = 0; bounce < params.maxBounces; bounce++) {
+        const uint32_t rayQueue = WAVEFRONT_RAY_QUEUE + static_cast<uint32_t>(bounce % 2);
+        dispatchQueue(WAVEFRONT_EXTEND, rayQueue, rayQueue);
+        computeBarrier();
+        dispatch(WAVEFRONT_ARGS, rayQueue, 1);
+
+        // Without sorting every hit is in the first material queue
+        for (uint32_t material = 0; material < (options.sortHits ? WAVEFRONT_MATERIAL_COUNT : 1); material++) {
+            if (options.sortHits && material == WAVEFRONT_EMISSIVE) continue;
+            dispatchQueue(WAVEFRONT_SHADE + material, rayQueue, WAVEFRONT_MATERIAL_QUEUE + material);
+        }
+        computeBarrier();
+        dispatch(WAVEFRONT_ARGS, rayQueue, 1);
+        dispatchQueue(WAVEFRONT_SHADOW, rayQueue, WAVEFRONT_SHADOW_QUEUE);
+        computeBarrier();
+
+        // The queues read by this bounce are empty for the next one, the other ray queue now holds its paths
+        clearCounts(rayQueue, 1);
+        clearCounts(WAVEFRONT_MATERIAL_QUEUE, WAVEFRONT_QUEUE_COUNT - WAVEFRONT_MATERIAL_QUEUE);
+        computeBarrier();
+        dispatch(WAVEFRONT_ARGS, rayQueue, 1);
+    }
+
+    const uint32_t pixelCount = params.width * params.height;
+    dispatch(WAVEFRONT_ACCUMULATE, 0, (pixelCount + WAVEFRONT_WORKGROUP_SIZE - 1) / WAVEFRONT_WORKGROUP_SIZE);
+
+    const VkBufferMemoryBarrier hostBarrier = {
+        .sType=VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask=VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask=VK_ACCESS_HOST_READ_BIT,
+        .srcQueueFamilyIndex=VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex=VK_QUEUE_FAMILY_IGNORED,
+        .buffer=queueCountBuffer.buffer,
+        .size=VK_WHOLE_SIZE
+    };
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &hostBarrier, 0, nullptr);
+
+    if (queryPool != VK_NULL_HANDLE) vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+}
+
+// Undefined on the first frame, which the shaders don't read. Afterwards the writes of the previous frame must be
+// visible to this one even though the frames are submitted separately
+void HeadlessGpuRenderer::prepareStorageTarget(Target &target) {
+    if (target.layout == VK_IMAGE_LAYOUT_GENERAL) {
+        const VkMemoryBarrier barrier = {
+            .sType=VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask=VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask=VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+        };
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                             1, &barrier, 0, nullptr, 0, nullptr);
+    } else {
+        transition(target, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0,
+                   VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    }
+}
+
+// Between the wavefront passes: their buffers, the queue counts cleared by transfers and the indirect arguments
+void HeadlessGpuRenderer::computeBarrier() {
+    const VkMemoryBarrier barrier = {
+        .sType=VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask=VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask=VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT
+                       | VK_ACCESS_TRANSFER_WRITE_BIT
+    };
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+bool HeadlessGpuRenderer::readPixels(std::vector<float> &pixels) {
+    if (frameCount == 0) {
+        std::cerr << "[ERROR] Nothing rendered yet" << std::endl;
+        return false;
+    }
+    Target &last = usesStorageImage() ? targets[0] : targets[1 - frameIndex];
+    const VkImageLayout layout = last.layout;
+    const VkPipelineStageFlags shaderStage = usesStorageImage() ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+    const VkCommandBufferBeginInfo beginInfo = {
+        .sType=VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags=VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    };
+    VK_TRY(vkResetCommandBuffer(commandBuffer, 0), "vkResetCommandBuffer");
+    VK_TRY(vkBeginCommandBuffer(commandBuffer, &beginInfo), "vkBeginCommandBuffer");
+    transition(last, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, shaderStage, VK_ACCESS_SHADER_WRITE_BIT,
+               VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+    const VkBufferImageCopy region = {
+        .imageSubresource={ VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+        .imageExtent={ params.width, params.height, 1 }
+    };
+    vkCmdCopyImageToBuffer(commandBuffer, last.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer.buffer, 1, &region);
+    transition(last, layout, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, shaderStage, VK_ACCESS_SHADER_READ_BIT);
+    const VkBufferMemoryBarrier hostBarrier = {
+        .sType=VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask=VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask=VK_ACCESS_HOST_READ_BIT,
+        .srcQueueFamilyIndex=VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex=VK_QUEUE_FAMILY_IGNORED,
+        .buffer=readbackBuffer.buffer,
+        .size=VK_WHOLE_SIZE
+    };
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &hostBarrier, 0, nullptr);
+    VK_TRY(vkEndCommandBuffer(commandBuffer), "vkEndCommandBuffer");
+    if (!submitAndWait()) return false;
+
+    pixels.resize(static_cast<size_t>(params.width) * params.height * 4);
+    std::memcpy(pixels.data(), readbackBuffer.mapped, pixels.size() * sizeof(float));
+    return true;
+}
+
+bool HeadlessGpuRenderer::submitAndWait() {
+    const VkSubmitInfo submitInfo = {
+        .sType=VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount=1,
+        .pCommandBuffers=&commandBuffer
+    };
+    VK_TRY(vkResetFences(device, 1, &fence), "vkResetFences");
+    VK_TRY(vkQueueSubmit(queue, 1, &submitInfo, fence), "vkQueueSubmit");
+    VK_TRY(vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX), "vkWaitForFences");
+    return true;
+}
+
+void HeadlessGpuRenderer::transition(Target &target, VkImageLayout layout, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess,
+                                     VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+    if (target.layout == layout) return;
+    const VkImageMemoryBarrier barrier = {
+        .sType=VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask=srcAccess,
+        .dstAccessMask=dstAccess,
+        .oldLayout=target.layout,
+        .newLayout=layout,
+        .srcQueueFamilyIndex=VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex=VK_QUEUE_FAMILY_IGNORED,
+        .image=target.image,
+        .subresourceRange={ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
+    };
+    vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    target.layout = layout;
+}
+
+// ================ Resources ================
+
+bool HeadlessGpuRenderer::findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties, uint32_t &typeIndex) const {
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        if ((typeBits & (1u << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+            typeIndex = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Host visible and persistently mapped: the scene is uploaded once, which keeps the setup simple on any driver.
+// The buffers only the GPU touches prefer device local memory instead
+bool HeadlessGpuRenderer::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, HostBuffer &buffer, bool hostVisible) {
+    const VkBufferCreateInfo bufferInfo = {
+        .sType=VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size=size,
+        .usage=usage,
+        .sharingMode=VK_SHARING_MODE_EXCLUSIVE
+    };
+    VK_TRY(vkCreateBuffer(device, &bufferInfo, nullptr, &buffer.buffer), "vkCreateBuffer");
+    buffer.size = size;
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device, buffer.buffer, &requirements);
+    uint32_t typeIndex;
+    if (!hostVisible) {
+        if (!findMemoryType(requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, typeIndex)
+            && !findMemoryType(requirements.memoryTypeBits, 0, typeIndex)) {
+            std::cerr << "[ERROR] No memory for a buffer of " << size << " bytes" << std::endl;
+            return false;
+        }
+    } else if (!findMemoryType(requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, typeIndex)) {
+        std::cerr << "[ERROR] No host visible memory for a buffer of " << size << " bytes" << std::endl;
+        return false;
+    }
+    const VkMemoryAllocateInfo allocateInfo = {
+        .sType=VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize=requirements.size,
+        .memoryTypeIndex=typeIndex
+    };
+    VK_TRY(vkAllocateMemory(device, &allocateInfo, nullptr, &buffer.memory), "vkAllocateMemory");
+    VK_TRY(vkBindBufferMemory(device, buffer.buffer, buffer.memory, 0), "vkBindBufferMemory");
+    if (!hostVisible) return true;
+    VK_TRY(vkMapMemory(device, buffer.memory, 0, VK_WHOLE_SIZE, 0, &buffer.mapped), "vkMapMemory");
+    return true;
+}
+
+void HeadlessGpuRenderer::destroyBuffer(HostBuffer &buffer) {
+    if (buffer.buffer != VK_NULL_HANDLE) vkDestroyBuffer(device, buffer.buffer, nullptr);
+    if (buffer.memory != VK_NULL_HANDLE) vkFreeMemory(device, buffer.memory, nullptr);
+    buffer = HostBuffer();
+}
+
+void HeadlessGpuRenderer::destroyTargets() {
+    for (Target &target : targets) {
+        if (target.view != VK_NULL_HANDLE) vkDestroyImageView(device, target.view, nullptr);
+        if (target.image != VK_NULL_HANDLE) vkDestroyImage(device, target.image, nullptr);
+        if (target.memory != VK_NULL_HANDLE) vkFreeMemory(device, target.memory, nullptr);
+        target = Target();
+    }
+    destroyBuffer(readbackBuffer);
+}
+
+void HeadlessGpuRenderer::destroy() {
+    if (device != VK_NULL_HANDLE) {
+        vkDeviceWaitIdle(device);
+        destroyTargets();
+        for (HostBuffer &buffer : storageBuffers) destroyBuffer(buffer);
+        storageBuffers.clear();
+        destroyBuffer(vertexBuffer);
+        destroyBuffer(uniformBuffer);
+        for (HostBuffer *buffer : { &pathBuffer, &queueCountBuffer, &queueBuffer, &shadowBuffer }) destroyBuffer(*buffer);
+        pathCount = 0;
+
+        // Saved whenever it exists, the driver may have added pipelines to a loaded cache
+        closePipelineCache(physicalDevice, device, pipelineCache);
+        if (pipeline != VK_NULL_HANDLE) vkDestroyPipeline(device, pipeline, nullptr);
+        for (VkPipeline wavefrontPipeline : wavefrontPipelines) {
+            if (wavefrontPipeline != VK_NULL_HANDLE) vkDestroyPipeline(device, wavefrontPipeline, nullptr);
+        }
+        wavefrontPipelines.clear();
+        if (pipelineLayout != VK_NULL_HANDLE) vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+        if (descriptorPool != VK_NULL_HANDLE) vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+        if (setLayout != VK_NULL_HANDLE) vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+        if (sampler != VK_NULL_HANDLE) vkDestroySampler(device, sampler, nullptr);
+        if (queryPool != VK_NULL_HANDLE) vkDestroyQueryPool(device, queryPool, nullptr);
+        if (fence != VK_NULL_HANDLE) vkDestroyFence(device, fence, nullptr);
+        if (commandPool != VK_NULL_HANDLE) vkDestroyCommandPool(device, commandPool, nullptr);
+        vkDestroyDevice(device, nullptr);
+    }
+    if (messenger != VK_NULL_HANDLE) {
+        auto destroyMessenger = reinterpret_cast<PFN_vkDestroyDebugUtilsMessengerEXT>(
+            vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT"));
+        if (destroyMessenger) destroyMessenger(instance, messenger, nullptr);
+    }
+    if (instance != VK_NULL_HANDLE) vkDestroyInstance(instance, nullptr);
+
+    device = VK_NULL_HANDLE;
+    messenger = VK_NULL_HANDLE;
+    instance = VK_NULL_HANDLE;
+    pipeline = VK_NULL_HANDLE;
+    pipelineLayout = VK_NULL_HANDLE;
+    descriptorPool = VK_NULL_HANDLE;
+    setLayout = VK_NULL_HANDLE;
+    sampler = VK_NULL_HANDLE;
+    queryPool = VK_NULL_HANDLE;
+    fence = VK_NULL_HANDLE;
+    commandPool = VK_NULL_HANDLE;
+    hasParams = false;
+    descriptorsDirty = true;
+}
+
+VKAPI_ATTR VkBool32 VKAPI_CALL HeadlessGpuRenderer::debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+        VkDebugUtilsMessageTypeFlagsEXT, const VkDebugUtilsMessengerCallbackDataEXT *data, void *userData) {
+    if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) {
+        static_cast<HeadlessGpuRenderer*>(userData)->validationErrorCount++;
+        std::cerr << "[ERROR] " << data->pMessage << std::endl;
+    } else {
+        std::cerr << "[WARN] " << data->pMessage << std::endl;
+    }
+    return VK_FALSE;
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "../cpu/cpu_integrator.hpp"
+#include "../scene/scene.hpp"
+#include "raytracing_ubo.hpp"
+
+enum class HeadlessPipeline {
+    Fragment,   // `raytracing.glsl` over a full screen quad, like `Application`
+    Compute,    // `raytracing_compute.glsl`, accumulates in place in a storage image
+    Wavefront   // The passes of `wavefront/`, one dispatch per pass and bounce
+};
+
+struct HeadlessGpuOptions {
+    int deviceIndex = -1;       // -1 picks the first device, software drivers such as lavapipe included
+    bool validation = false;    // VK_LAYER_KHRONOS_validation, its errors are counted
+    std::string vertShaderPath = "./res/shader/vert.glsl";
+    std::string fragShaderPath = "./res/shader/raytracing/raytracing.glsl";
+    HeadlessPipeline pipeline = HeadlessPipeline::Fragment;
+    std::string compShaderPath = "./res/shader/raytracing/raytracing_compute.glsl";
+    std::string wavefrontShaderDir = "./res/shader/raytracing/wavefront";
+    bool sortHits = true;       // Wavefront: bins the hits by material type, one shading pass each
+    bool usePipelineCache = true;   // Loaded from and saved to PIPELINE_CACHE_DIR, see `pipeline_cache.hpp`
+};
+
+struct HeadlessFrameTiming {
+    double wallMs;      // From the submission to the fence
+    double gpuMs;       // Timestamps around the draw, negative when the queue has none
+};
+
+// Offscreen render of the `raytracing.glsl` pipeline, without a window, a surface or a swapchain.
+// The engine always opens a window, so this talks to Vulkan directly: the frames ping-pong between two float images
+// like in `Application` and each call to `renderFrame` waits for its frame, which makes the timings per frame.
+// The compute and wavefront pipelines accumulate into a single storage image instead.
+class HeadlessGpuRenderer {
+public:
+    ~HeadlessGpuRenderer() { destroy(); }
+
+    bool init(const HeadlessGpuOptions &options);
+    void destroy();
+
+    // The scene must be headless, its buffers are filled here and uploaded once
+    bool setScene(VkSmol &engine, Scene &scene);
+    // Same parameters as the CPU renderer so both can render the same image, resets the accumulation
+    bool setParams(const CpuRenderParams &params);
+
+    bool renderFrame();
+    // RGBA floats of the accumulated image, rows from top to bottom
+    bool readPixels(std::vector<float> &pixels);
+
+    const std::string& getDeviceName() const { return deviceName; }
+    uint32_t getFrameCount() const { return frameCount; }
+    const std::vector<HeadlessFrameTiming>& getFrameTimings() const { return frameTimings; }
+    uint32_t getValidationErrorCount() const { return validationErrorCount; }
+    // Shader compilation and pipeline creation of the first `setScene`
+    double getPipelineMs() const { return pipelineMs; }
+    // Material types shaded per workgroup by the wavefront pipeline since the last reset, 1 when none of them
+    // diverges. Negative with the other pipelines
+    double getShadeBranchesPerGroup() const {
+        return shadeGroups > 0 ? static_cast<double>(shadeBranches) / static_cast<double>(shadeGroups) : -1.0;
+    }
+
+private:
+    struct HostBuffer {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        void *mapped = nullptr;     // Null for the device local buffers
+        VkDeviceSize size = 0;
+    };
+
+    struct Target {
+        VkImage image = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    };
+
+    bool createInstance(bool validation);
+    bool pickDevice(int deviceIndex);
+    bool createPipeline(uint32_t storageBufferCount);
+    bool createGraphicsPipeline();
+    bool createComputePipeline();
+    bool createWavefrontPipelines();
+    bool createWavefrontBuffers();
+    bool createTargets();
+    bool updateDescriptorSets();
+
+    bool createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, HostBuffer &buffer, bool hostVisible = true);
+    void destroyBuffer(HostBuffer &buffer);
+    void destroyTargets();
+    bool findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties, uint32_t &typeIndex) const;
+    void transition(Target &target, VkImageLayout layout, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess,
+                    VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+    bool submitAndWait();
+    void recordDraw(Target &prev, Target &curr);
+    void recordDispatch(Target &target);
+    void recordWavefront(Target &target);
+    void prepareStorageTarget(Target &target);
+    void computeBarrier();
+    bool usesStorageImage() const { return options.pipeline != HeadlessPipeline::Fragment; }
+
+    static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+        VkDebugUtilsMessageTypeFlagsEXT type, const VkDebugUtilsMessengerCallbackDataEXT *data, void *userData);
+
+    HeadlessGpuOptions options;
+
+    VkInstance instance = VK_NULL_HANDLE;
+    VkDebugUtilsMessengerEXT messenger = VK_NULL_HANDLE;
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties memoryProperties = {};
+    VkDevice device = VK_NULL_HANDLE;
+    uint32_t queueFamily = 0;
+    VkQueue queue = VK_NULL_HANDLE;
+    PFN_vkCmdBeginRenderingKHR cmdBeginRendering = nullptr;
+    PFN_vkCmdEndRenderingKHR cmdEndRendering = nullptr;
+    std::string deviceName;
+
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    VkQueryPool queryPool = VK_NULL_HANDLE;
+    float timestampPeriod = 0.0f;
+    VkDeviceSize maxStorageBufferRange = 0;
+
+    VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+    double pipelineMs = 0.0;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSet descriptorSets[2] = {};
+    VkSampler sampler = VK_NULL_HANDLE;
+
+    HostBuffer vertexBuffer;
+    HostBuffer uniformBuffer;
+    HostBuffer readbackBuffer;
+    std::vector<HostBuffer> storageBuffers;
+    Target targets[2];      // Only the first one with the compute and wavefront pipelines
+
+    // Wavefront state, see `wavefront.glsl`: one path per sample and the queues the passes exchange them through
+    std::vector<VkPipeline> wavefrontPipelines;
+    HostBuffer pathBuffer;
+    HostBuffer queueCountBuffer;
+    HostBuffer queueBuffer;
+    HostBuffer shadowBuffer;
+    uint32_t pathCount = 0;
+    uint64_t shadeGroups = 0;
+    uint64_t shadeBranches = 0;
+
+    CpuRenderParams params;
+    bool hasParams = false;
+    bool descriptorsDirty = true;
+    uint32_t frameCount = 0;
+    uint32_t frameIndex = 0;        // Target written by the next frame
+    std::chrono::steady_clock::time_point startTime;
+    std::vector<HeadlessFrameTiming> frameTimings;
+    uint32_t validationErrorCount = 0;
+};
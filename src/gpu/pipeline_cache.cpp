@@ -0,0 +1,135 @@
+#include "pipeline_cache.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "../utils/hash.hpp"
+#include "../utils/mapped_file.hpp"
+
+constexpr char PIPELINE_CACHE_MAGIC[8] = { 'V', 'K', 'R', 'P', 'I', 'P', 'E', '\0' };
+
+// Header of the data the current device and driver would write
+static PipelineCacheHeader deviceHeader(VkPhysicalDevice physicalDevice) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    PipelineCacheHeader header = {};
+    std::memcpy(header.magic, PIPELINE_CACHE_MAGIC, sizeof(header.magic));
+    header.version = PIPELINE_CACHE_VERSION;
+    header.vendorId = properties.vendorID;
+    header.deviceId = properties.deviceID;
+    header.driverVersion = properties.driverVersion;
+    std::memcpy(header.pipelineCacheUuid, properties.pipelineCacheUUID, VK_UUID_SIZE);
+    if (properties.apiVersion >= VK_API_VERSION_1_1) {
+        VkPhysicalDeviceIDProperties idProperties = { .sType=VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES };
+        VkPhysicalDeviceProperties2 properties2 = { .sType=VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, .pNext=&idProperties };
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+        std::memcpy(header.deviceUuid, idProperties.deviceUUID, VK_UUID_SIZE);
+    }
+    return header;
+}
+
+std::string pipelineCachePath(VkPhysicalDevice physicalDevice) {
+    const PipelineCacheHeader header = deviceHeader(physicalDevice);
+    char name[32];
+    std::snprintf(name, sizeof(name), "%04x_%04x.bin", header.vendorId, header.deviceId);
+    return std::string(PIPELINE_CACHE_DIR) + "/" + name;
+}
+
+VkPipelineCache loadPipelineCache(VkPhysicalDevice physicalDevice, VkDevice device) {
+    const PipelineCacheHeader expected = deviceHeader(physicalDevice);
+    const std::string path = pipelineCachePath(physicalDevice);
+
+    // A missing file is the first run on this device, anything else is reported
+    MappedFile file;
+    const unsigned char *data = nullptr;
+    size_t dataSize = 0;
+    if (std::filesystem::exists(path) && file.open(path)) {
+        PipelineCacheHeader header = {};
+        if (file.getSize() >= sizeof(header)) std::memcpy(&header, file.getData(), sizeof(header));
+
+        // The size is compared against what the file holds, `sizeof(header) + header.dataSize` could wrap
+        if (file.getSize() < sizeof(header)
+            || std::memcmp(header.magic, PIPELINE_CACHE_MAGIC, sizeof(header.magic)) != 0
+            || header.version != PIPELINE_CACHE_VERSION
+            || header.dataSize != file.getSize() - sizeof(header)
+            || header.dataHash != hashBytes(file.getData() + sizeof(header), header.dataSize, PIPELINE_CACHE_VERSION)) {
+            std::cerr << "[WARN] Ignoring invalid pipeline cache " << path << std::endl;
+        } else if (header.vendorId != expected.vendorId || header.deviceId != expected.deviceId
+                   || header.driverVersion != expected.driverVersion
+                   || std::memcmp(header.deviceUuid, expected.deviceUuid, VK_UUID_SIZE) != 0
+                   || std::memcmp(header.pipelineCacheUuid, expected.pipelineCacheUuid, VK_UUID_SIZE) != 0) {
+            std::cout << "[INFO] Ignoring the pipeline cache " << path << " of another device or driver version" << std::endl;
+        } else {
+            data = file.getData() + sizeof(header);
+            dataSize = header.dataSize;
+        }
+    }
+
+    const VkPipelineCacheCreateInfo cacheInfo = {
+        .sType=VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .initialDataSize=dataSize,
+        .pInitialData=data
+    };
+    VkPipelineCache cache = VK_NULL_HANDLE;
+    if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &cache) != VK_SUCCESS) {
+        std::cerr << "[WARN] Failed to create the pipeline cache, pipelines are compiled from scratch" << std::endl;
+        return VK_NULL_HANDLE;
+    }
+    if (dataSize > 0) std::cout << "[INFO] Loaded " << dataSize << " bytes of pipeline cache from " << path << std::endl;
+    return cache;
+}
+
+void closePipelineCache(VkPhysicalDevice physicalDevice, VkDevice device, VkPipelineCache &cache) {
+    if (cache == VK_NULL_HANDLE) return;
+    savePipelineCache(physicalDevice, device, cache);
+    vkDestroyPipelineCache(device, cache, nullptr);
+    cache = VK_NULL_HANDLE;
+}
+
+// Written to a temporary file first so a crash never leaves a truncated cache behind
+bool savePipelineCache(VkPhysicalDevice physicalDevice, VkDevice device, VkPipelineCache cache) {
+    if (cache == VK_NULL_HANDLE) return false;
+
+    size_t dataSize = 0;
+    if (vkGetPipelineCacheData(device, cache, &dataSize, nullptr) != VK_SUCCESS) return false;
+    std::vector<unsigned char> data(dataSize);
+    if (dataSize > 0 && vkGetPipelineCacheData(device, cache, &dataSize, data.data()) != VK_SUCCESS) return false;
+    data.resize(dataSize);
+
+    std::error_code error;
+    std::filesystem::create_directories(PIPELINE_CACHE_DIR, error);
+    if (error) {
+        std::cerr << "[WARN] Failed to create " << PIPELINE_CACHE_DIR << ": " << error.message() << std::endl;
+        return false;
+    }
+
+    PipelineCacheHeader header = deviceHeader(physicalDevice);
+    header.dataSize = data.size();
+    header.dataHash = hashBytes(data.data(), data.size(), PIPELINE_CACHE_VERSION);
+
+    const std::string path = pipelineCachePath(physicalDevice);
+    const std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(data.data()), data.size());
+        if (!out) {
+            std::cerr << "[WARN] Failed to write pipeline cache " << tmpPath << std::endl;
+            std::filesystem::remove(tmpPath, error);
+            return false;
+        }
+    }
+
+    std::filesystem::rename(tmpPath, path, error);
+    if (error) {
+        std::cerr << "[WARN] Failed to write pipeline cache " << path << ": " << error.message() << std::endl;
+        std::filesystem::remove(tmpPath, error);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <vulkan/vulkan.h>
+
+// Pipeline cache stored on disk so the driver reuses the pipelines compiled by previous runs.
+// A file holds a PipelineCacheHeader followed by the data of `vkGetPipelineCacheData`. The header ties the data to one
+// device and driver version: drivers are only required to reject data from another driver, not data they misread,
+// so anything that doesn't match exactly is discarded before it reaches them.
+#define PIPELINE_CACHE_VERSION 1
+#define PIPELINE_CACHE_DIR "cache/pipeline"
+
+struct PipelineCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t vendorId;
+    uint32_t deviceId;
+    uint32_t driverVersion;
+    uint8_t deviceUuid[VK_UUID_SIZE];           // Zero on devices older than Vulkan 1.1
+    uint8_t pipelineCacheUuid[VK_UUID_SIZE];
+    uint64_t dataSize;
+    uint64_t dataHash;
+};
+
+// One file per device
+std::string pipelineCachePath(VkPhysicalDevice physicalDevice);
+
+// Starts empty when there is no valid file, VK_NULL_HANDLE only if the cache can't be created
+VkPipelineCache loadPipelineCache(VkPhysicalDevice physicalDevice, VkDevice device);
+bool savePipelineCache(VkPhysicalDevice physicalDevice, VkDevice device, VkPipelineCache cache);
+// Saves then destroys the cache and resets the handle, nothing when it is VK_NULL_HANDLE
+void closePipelineCache(VkPhysicalDevice physicalDevice, VkDevice device, VkPipelineCache &cache);
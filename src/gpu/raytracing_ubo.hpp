@@ -0,0 +1,36 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "../scene/scene.hpp"
+
+// Uniforms of `raytracing.glsl`, std140 layout of `inputs.glsl`
+struct RaytracingUBO {
+    alignas(16) glm::vec3 cameraPos;
+    alignas(16) glm::vec3 cameraDir;
+    float tanHFov;
+    float aperture;
+    float focusDepth;
+
+    alignas(8) glm::vec2 screenSize;
+    float aspect;
+    float lowResolutionScale;
+    
+    int frameCount;
+    float time;
+
+    LightMode lightMode;
+
+    int maxBounces;
+    int samplesPerPixel;
+    int importanceSampling;
+    int debugView;
+    int cpuSampleCount;
+};
+
+enum class DebugView : int {
+    None = 0,
+    Bounces,
+    Normal,
+    SelectionMask
+};
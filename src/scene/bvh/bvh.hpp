@@ -0,0 +1,462 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "../object/object.hpp"
+#include "../../utils/simd.hpp"
+
+// Must match `BVH_STACK_SIZE` and `BVH4_STACK_SIZE` in `res/shader/raytracing/utils.glsl`
+#define BVH_STACK_SIZE 32
+// A wide node is at most as deep as the binary node it comes from, and each level keeps up to 3 of its children
+#define BVH4_STACK_SIZE (3 * (BVH_STACK_SIZE - 1) + 1)
+#define BVH4_INVALID 0xFFFFFFFFu
+
+// Node layout uploaded for a mesh, must match the `bvh_` values in `utils.glsl`
+enum class BvhLayout : uint32_t {
+    Binary = 0,
+    Wide4,
+    Quantized16,    // Binary BVH stored with `BvhNodeFormat::Quantized16`, selected per scene (see `bvh_quantized.hpp`)
+    Quantized8,
+};
+
+struct GpuBvhNode {
+    alignas(16) glm::vec3 aabbMin;
+    alignas(16) glm::vec3 aabbMax;
+    uint32_t data0; // left or first triangle
+    uint32_t data1; // right or triangle count
+    uint32_t isLeaf;
+};
+
+#define BVH_childLeft(node)   (node.data0)
+#define BVH_childRight(node)  (node.data1)
+#define BVH_firstTriangle(node) (node.data0)
+#define BVH_triangleCount(node) (node.data1)
+
+// 4-wide node, the bounds of the children are stored SoA so they are tested at once.
+// Each axis keeps its min and max next to each other so AVX2 can load both in a single register.
+// Inner children have `count == 0`, leaves store their first triangle in `child`,
+// unused slots are at the end with `child == BVH4_INVALID`.
+struct GpuBvhNode4 {
+    alignas(16) float minX[4];
+    float maxX[4];
+    float minY[4];
+    float maxY[4];
+    float minZ[4];
+    float maxZ[4];
+    uint32_t child[4];
+    uint32_t count[4];
+};
+
+// Counters filled by the CPU traversal (used for benchmarks and debugging)
+struct BvhTraversalStats {
+    uint64_t nodeVisits = 0;
+    uint64_t primitiveTests = 0;
+};
+
+// Ray with a precomputed inverse direction, the same clamping as `rayAabbDistance` in the shader is used
+struct BvhRay {
+    glm::vec3 origin;
+    glm::vec3 dir;
+    glm::vec3 invDir;
+};
+
+inline BvhRay makeBvhRay(const Ray &ray) {
+    constexpr float eps = 1e-3f;
+    glm::vec3 safeDir;
+    for (int i = 0; i < 3; i++) {
+        const float s = ray.dir[i] < 0.0f ? -1.0f : 1.0f;
+        safeDir[i] = s * std::max(std::abs(ray.dir[i]), eps);
+    }
+    return BvhRay{ ray.origin, ray.dir, 1.0f / safeDir };
+}
+
+// Returns the entry distance of the ray in the box, or infinity if the box is missed or further than `tMax`
+inline float rayAabbDistance(const BvhRay &ray, const glm::vec3 &aabbMin, const glm::vec3 &aabbMax, float tMax) {
+    const glm::vec3 t0 = (aabbMin - ray.origin) * ray.invDir;
+    const glm::vec3 t1 = (aabbMax - ray.origin) * ray.invDir;
+    const glm::vec3 tmin = glm::min(t0, t1);
+    const glm::vec3 tmax = glm::max(t0, t1);
+    const float tNear = std::max(std::max(tmin.x, tmin.y), std::max(tmin.z, 0.0f));
+    const float tFar = std::min(std::min(tmax.x, tmax.y), std::min(tmax.z, tMax));
+    return tNear <= tFar ? tNear : std::numeric_limits<float>::infinity();
+}
+
+// Closest-hit traversal of a binary BVH (CPU port of `rayMeshIntersection` in `objects.glsl`).
+// `intersect(primitive, tClosest)` must return the hit distance or a negative value on a miss.
+// Returns the closest distance in [0, tMax) and writes the primitive in `hitPrimitive`, or -1 if nothing was hit.
+template<typename IntersectFn>
+float traverseBvh(
+    const std::vector<GpuBvhNode> &nodes,
+    const Ray &ray,
+    float tMax,
+    IntersectFn &&intersect,
+    uint32_t &hitPrimitive,
+    BvhTraversalStats *stats = nullptr
+) {
+    if (nodes.empty()) return -1.0f;
+
+    const BvhRay bvhRay = makeBvhRay(ray);
+    float tClosest = tMax;
+    bool found = false;
+
+    if (rayAabbDistance(bvhRay, nodes[0].aabbMin, nodes[0].aabbMax, tClosest) == std::numeric_limits<float>::infinity())
+        return -1.0f;
+
+    struct StackEntry {
+        uint32_t node;
+        float tNear;
+    };
+    StackEntry stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    uint32_t nodeIndex = 0;
+    while (true) {
+        const GpuBvhNode &node = nodes[nodeIndex];
+        if (stats) stats->nodeVisits++;
+
+        if (node.isLeaf != 0) {
+            for (uint32_t i = 0; i < BVH_triangleCount(node); i++) {
+                const uint32_t primitive = BVH_firstTriangle(node) + i;
+                if (stats) stats->primitiveTests++;
+                float t = intersect(primitive, tClosest);
+                if (t >= 0.0f && t < tClosest) {
+                    tClosest = t;
+                    hitPrimitive = primitive;
+                    found = true;
+                }
+            }
+        } else {
+            const uint32_t left = BVH_childLeft(node);
+            const uint32_t right = BVH_childRight(node);
+            const float tLeft = rayAabbDistance(bvhRay, nodes[left].aabbMin, nodes[left].aabbMax, tClosest);
+            const float tRight = rayAabbDistance(bvhRay, nodes[right].aabbMin, nodes[right].aabbMax, tClosest);
+            const bool hitLeft = tLeft != std::numeric_limits<float>::infinity();
+            const bool hitRight = tRight != std::numeric_limits<float>::infinity();
+
+            if (hitLeft && hitRight) {
+                // Visit the near child first, the far one is pruned when popped if a closer hit was found
+                const bool leftFirst = tLeft <= tRight;
+                if (stackSize < BVH_STACK_SIZE)
+                    stack[stackSize++] = leftFirst ? StackEntry{ right, tRight } : StackEntry{ left, tLeft };
+                nodeIndex = leftFirst ? left : right;
+                continue;
+            }
+            if (hitLeft) { nodeIndex = left; continue; }
+            if (hitRight) { nodeIndex = right; continue; }
+        }
+
+        // Pop the next node that can still contain a closer hit
+        bool next = false;
+        while (stackSize > 0) {
+            const StackEntry entry = stack[--stackSize];
+            if (entry.tNear < tClosest) {
+                nodeIndex = entry.node;
+                next = true;
+                break;
+            }
+        }
+        if (!next) break;
+    }
+
+    return found ? tClosest : -1.0f;
+}
+
+// Any-hit traversal (CPU port of `rayMeshOcclusion` in `objects.glsl`).
+// `occludes(primitive)` must return true if the primitive blocks the ray before `tMax`.
+template<typename OccludeFn>
+bool occludedBvh(
+    const std::vector<GpuBvhNode> &nodes,
+    const Ray &ray,
+    float tMax,
+    OccludeFn &&occludes,
+    BvhTraversalStats *stats = nullptr
+) {
+    if (nodes.empty()) return false;
+
+    const BvhRay bvhRay = makeBvhRay(ray);
+    uint32_t stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0) {
+        const GpuBvhNode &node = nodes[stack[--stackSize]];
+        if (stats) stats->nodeVisits++;
+        if (rayAabbDistance(bvhRay, node.aabbMin, node.aabbMax, tMax) == std::numeric_limits<float>::infinity()) continue;
+
+        if (node.isLeaf != 0) {
+            for (uint32_t i = 0; i < BVH_triangleCount(node); i++) {
+                if (stats) stats->primitiveTests++;
+                if (occludes(BVH_firstTriangle(node) + i)) return true;
+            }
+        } else if (stackSize + 2 <= BVH_STACK_SIZE) {
+            stack[stackSize++] = BVH_childRight(node);
+            stack[stackSize++] = BVH_childLeft(node);
+        }
+    }
+    return false;
+}
+
+// Tests the ray against the four children of a wide node, returns a mask of the children hit before `tMax`
+inline int rayAabbDistance4(const BvhRay &ray, const GpuBvhNode4 &node, float tMax, float tNear[4]) {
+#if defined(SIMD_AVX2)
+    const Float8 tx = (Float8::load(node.minX) - Float8::splat(ray.origin.x)) * Float8::splat(ray.invDir.x);
+    const Float8 ty = (Float8::load(node.minY) - Float8::splat(ray.origin.y)) * Float8::splat(ray.invDir.y);
+    const Float8 tz = (Float8::load(node.minZ) - Float8::splat(ray.origin.z)) * Float8::splat(ray.invDir.z);
+    const Float4 t0x = tx.low(), t1x = tx.high();
+    const Float4 t0y = ty.low(), t1y = ty.high();
+    const Float4 t0z = tz.low(), t1z = tz.high();
+#else
+    const Float4 ox = Float4::splat(ray.origin.x), oy = Float4::splat(ray.origin.y), oz = Float4::splat(ray.origin.z);
+    const Float4 ix = Float4::splat(ray.invDir.x), iy = Float4::splat(ray.invDir.y), iz = Float4::splat(ray.invDir.z);
+    const Float4 t0x = (Float4::load(node.minX) - ox) * ix, t1x = (Float4::load(node.maxX) - ox) * ix;
+    const Float4 t0y = (Float4::load(node.minY) - oy) * iy, t1y = (Float4::load(node.maxY) - oy) * iy;
+    const Float4 t0z = (Float4::load(node.minZ) - oz) * iz, t1z = (Float4::load(node.maxZ) - oz) * iz;
+#endif
+    const Float4 nearT = max(max(min(t0x, t1x), min(t0y, t1y)), max(min(t0z, t1z), Float4::splat(0.0f)));
+    const Float4 farT = min(min(max(t0x, t1x), max(t0y, t1y)), min(max(t0z, t1z), Float4::splat(tMax)));
+    nearT.store(tNear);
+
+    int mask = lessEqualMask(nearT, farT);
+    for (int i = 0; i < 4; i++) {
+        if (node.child[i] == BVH4_INVALID) mask &= ~(1 << i);
+    }
+    return mask;
+}
+
+// Closest-hit traversal of a 4-wide BVH (CPU port of `rayMeshIntersection4` in `objects.glsl`), same contract as `traverseBvh`
+template<typename IntersectFn>
+float traverseBvh4(
+    const std::vector<GpuBvhNode4> &nodes,
+    const Ray &ray,
+    float tMax,
+    IntersectFn &&intersect,
+    uint32_t &hitPrimitive,
+    BvhTraversalStats *stats = nullptr
+) {
+    if (nodes.empty()) return -1.0f;
+
+    const BvhRay bvhRay = makeBvhRay(ray);
+    float tClosest = tMax;
+    bool found = false;
+
+    struct StackEntry {
+        uint32_t node;
+        float tNear;
+    };
+    StackEntry stack[BVH4_STACK_SIZE];
+    int stackSize = 0;
+    uint32_t nodeIndex = 0;
+    while (true) {
+        const GpuBvhNode4 &node = nodes[nodeIndex];
+        if (stats) stats->nodeVisits++;
+
+        float tNear[4];
+        const int mask = rayAabbDistance4(bvhRay, node, tClosest, tNear);
+
+        // Leaves are intersected right away, inner children are sorted by distance
+        StackEntry inner[4];
+        int innerCount = 0;
+        for (int i = 0; i < 4; i++) {
+            if ((mask & (1 << i)) == 0) continue;
+            if (node.count[i] == 0) {
+                inner[innerCount++] = { node.child[i], tNear[i] };
+                continue;
+            }
+            if (tNear[i] >= tClosest) continue;
+            for (uint32_t j = 0; j < node.count[i]; j++) {
+                const uint32_t primitive = node.child[i] + j;
+                if (stats) stats->primitiveTests++;
+                float t = intersect(primitive, tClosest);
+                if (t >= 0.0f && t < tClosest) {
+                    tClosest = t;
+                    hitPrimitive = primitive;
+                    found = true;
+                }
+            }
+        }
+        std::sort(inner, inner + innerCount, [](const StackEntry &a, const StackEntry &b) { return a.tNear > b.tNear; });
+
+        // Push the far children, continue with the nearest one
+        bool next = false;
+        for (int i = 0; i < innerCount; i++) {
+            if (inner[i].tNear >= tClosest) continue;
+            if (i == innerCount - 1) {
+                nodeIndex = inner[i].node;
+                next = true;
+            } else if (stackSize < BVH4_STACK_SIZE) {
+                stack[stackSize++] = inner[i];
+            }
+        }
+        if (next) continue;
+
+        while (stackSize > 0) {
+            const StackEntry entry = stack[--stackSize];
+            if (entry.tNear < tClosest) {
+                nodeIndex = entry.node;
+                next = true;
+                break;
+            }
+        }
+        if (!next) break;
+    }
+
+    return found ? tClosest : -1.0f;
+}
+
+// Any-hit traversal of a 4-wide BVH (CPU port of `rayMeshOcclusion4` in `objects.glsl`), same contract as `occludedBvh`
+template<typename OccludeFn>
+bool occludedBvh4(
+    const std::vector<GpuBvhNode4> &nodes,
+    const Ray &ray,
+    float tMax,
+    OccludeFn &&occludes,
+    BvhTraversalStats *stats = nullptr
+) {
+    if (nodes.empty()) return false;
+
+    const BvhRay bvhRay = makeBvhRay(ray);
+    uint32_t stack[BVH4_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0) {
+        const GpuBvhNode4 &node = nodes[stack[--stackSize]];
+        if (stats) stats->nodeVisits++;
+
+        float tNear[4];
+        const int mask = rayAabbDistance4(bvhRay, node, tMax, tNear);
+        for (int i = 0; i < 4; i++) {
+            if ((mask & (1 << i)) == 0) continue;
+            if (node.count[i] == 0) {
+                if (stackSize < BVH4_STACK_SIZE) stack[stackSize++] = node.child[i];
+                continue;
+            }
+            for (uint32_t j = 0; j < node.count[i]; j++) {
+                if (stats) stats->primitiveTests++;
+                if (occludes(node.child[i] + j)) return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Packets are `uint32_t` masks of active rays
+#define BVH_PACKET_MAX_SIZE 32
+
+// Bounds of the origins and inverse directions of a packet, used to cull a node for every ray at once.
+// Only the axes along which all the rays go the same way are used, the others can't bound the slab distances.
+struct BvhPacketInterval {
+    glm::vec3 originMin, originMax;
+    glm::vec3 invDirMin, invDirMax;
+    bool positive[3];
+    bool valid[3];
+};
+
+inline BvhPacketInterval makeBvhPacketInterval(const BvhRay *rays, uint32_t rayMask) {
+    BvhPacketInterval interval;
+    const BvhRay &first = rays[std::countr_zero(rayMask)];
+    interval.originMin = interval.originMax = first.origin;
+    interval.invDirMin = interval.invDirMax = first.invDir;
+    for (uint32_t mask = rayMask; mask != 0; mask &= mask - 1) {
+        const BvhRay &ray = rays[std::countr_zero(mask)];
+        interval.originMin = glm::min(interval.originMin, ray.origin);
+        interval.originMax = glm::max(interval.originMax, ray.origin);
+        interval.invDirMin = glm::min(interval.invDirMin, ray.invDir);
+        interval.invDirMax = glm::max(interval.invDirMax, ray.invDir);
+    }
+    for (int axis = 0; axis < 3; axis++) {
+        interval.positive[axis] = interval.invDirMin[axis] > 0.0f;
+        interval.valid[axis] = interval.positive[axis] || interval.invDirMax[axis] < 0.0f;
+    }
+    return interval;
+}
+
+// True if no ray of the packet enters the box before `tMax`, the largest closest distance of the packet.
+// `(plane - origin) * invDir` is monotonic in both terms, rounding included, so the distances of every ray
+// lie between the products of the extreme values and the test never culls a box that one of the rays enters.
+inline bool packetMissesAabb(const BvhPacketInterval &interval, const glm::vec3 &aabbMin, const glm::vec3 &aabbMax, float tMax) {
+    float tNear = 0.0f;
+    float tFar = tMax;
+    for (int axis = 0; axis < 3; axis++) {
+        if (!interval.valid[axis]) continue;
+        const float nearPlane = interval.positive[axis] ? aabbMin[axis] : aabbMax[axis];
+        const float farPlane = interval.positive[axis] ? aabbMax[axis] : aabbMin[axis];
+        const float invMin = interval.invDirMin[axis], invMax = interval.invDirMax[axis];
+
+        const float n0 = (nearPlane - interval.originMax[axis]), n1 = (nearPlane - interval.originMin[axis]);
+        tNear = std::max(tNear, std::min(std::min(n0 * invMin, n0 * invMax), std::min(n1 * invMin, n1 * invMax)));
+        const float f0 = (farPlane - interval.originMax[axis]), f1 = (farPlane - interval.originMin[axis]);
+        tFar = std::min(tFar, std::max(std::max(f0 * invMin, f0 * invMax), std::max(f1 * invMin, f1 * invMax)));
+    }
+    return tNear > tFar;
+}
+
+// Closest-hit traversal of a packet of coherent rays, every node is visited once for all the rays of `rayMask`.
+// A node is first culled for the whole packet by interval arithmetic, then its box is tested ray by ray until one
+// enters it: the rays before that one miss the box and are dropped for the subtree, the others are kept untested.
+// `intersect(primitive, leafMask)` tests a primitive against the rays of `leafMask` (those entering the leaf box)
+// and must lower `tClosest` of the rays it hits, which is read again before each node.
+template<typename IntersectFn>
+void traversePacketBvh(
+    const std::vector<GpuBvhNode> &nodes,
+    const BvhRay *rays,
+    uint32_t rayMask,
+    const float *tClosest,
+    IntersectFn &&intersect,
+    BvhTraversalStats *stats = nullptr
+) {
+    if (nodes.empty() || rayMask == 0) return;
+    const BvhPacketInterval interval = makeBvhPacketInterval(rays, rayMask);
+    constexpr float miss = std::numeric_limits<float>::infinity();
+
+    struct StackEntry {
+        uint32_t node;
+        uint32_t rayMask;
+    };
+    StackEntry stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = { 0, rayMask };
+    while (stackSize > 0) {
+        const StackEntry entry = stack[--stackSize];
+        const GpuBvhNode &node = nodes[entry.node];
+        if (stats) stats->nodeVisits++;
+
+        float tMax = 0.0f;
+        for (uint32_t mask = entry.rayMask; mask != 0; mask &= mask - 1)
+            tMax = std::max(tMax, tClosest[std::countr_zero(mask)]);
+        if (packetMissesAabb(interval, node.aabbMin, node.aabbMax, tMax)) continue;
+
+        uint32_t active = entry.rayMask;
+        while (active != 0) {
+            const uint32_t r = std::countr_zero(active);
+            if (rayAabbDistance(rays[r], node.aabbMin, node.aabbMax, tClosest[r]) != miss) break;
+            active &= active - 1;
+        }
+        if (active == 0) continue;
+
+        if (node.isLeaf != 0) {
+            // Primitives cost more than a box, so only the rays entering the leaf are tested
+            uint32_t leafMask = active & (~active + 1);
+            for (uint32_t mask = active & (active - 1); mask != 0; mask &= mask - 1) {
+                const uint32_t r = std::countr_zero(mask);
+                if (rayAabbDistance(rays[r], node.aabbMin, node.aabbMax, tClosest[r]) != miss) leafMask |= 1u << r;
+            }
+            for (uint32_t i = 0; i < BVH_triangleCount(node); i++) {
+                if (stats) stats->primitiveTests += std::popcount(leafMask);
+                intersect(BVH_firstTriangle(node) + i, leafMask);
+            }
+        } else if (stackSize + 2 <= BVH_STACK_SIZE) {
+            // Near child first, ordered along the direction of the first ray still in the packet
+            const uint32_t left = BVH_childLeft(node);
+            const uint32_t right = BVH_childRight(node);
+            const glm::vec3 centerDelta = (nodes[right].aabbMin + nodes[right].aabbMax) - (nodes[left].aabbMin + nodes[left].aabbMax);
+            const bool leftFirst = glm::dot(centerDelta, rays[std::countr_zero(active)].dir) >= 0.0f;
+            stack[stackSize++] = { leftFirst ? right : left, active };
+            stack[stackSize++] = { leftFirst ? left : right, active };
+        }
+    }
+}
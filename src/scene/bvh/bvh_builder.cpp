@@ -0,0 +1,488 @@
+#include "bvh_builder.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <sstream>
+#include <thread>
+
+#include "bvh_quantized.hpp"
+#include "../../utils/parallel.hpp"
+
+struct Aabb {
+    glm::vec3 min = glm::vec3(std::numeric_limits<float>::infinity());
+    glm::vec3 max = glm::vec3(-std::numeric_limits<float>::infinity());
+
+    void grow(const glm::vec3 &p) {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+    void grow(const Aabb &other) {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+    float area() const {
+        glm::vec3 e = max - min;
+        if (e.x < 0.0f || e.y < 0.0f || e.z < 0.0f) return 0.0f;
+        return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+};
+
+// Nodes with fewer primitives are always processed by a single thread
+constexpr uint32_t PARALLEL_REDUCE_THRESHOLD = 1 << 15;
+constexpr uint32_t PARALLEL_TASK_THRESHOLD = 1 << 12;
+
+// Levels `quantizeBvh` adds below a leaf of MAX_LEAF_SIZE triangles, by halving it until it fits in a child word
+constexpr uint32_t QUANTIZED_LEAF_LEVELS = std::bit_width((MAX_LEAF_SIZE + QBVH_MAX_LEAF_SIZE - 1u) / QBVH_MAX_LEAF_SIZE - 1u);
+
+// Deepest level of a leaf, the traversal stack holds at most one node per level, quantized leaf splits included
+constexpr uint32_t BVH_MAX_DEPTH = BVH_STACK_SIZE - 1 - QUANTIZED_LEAF_LEVELS;
+
+// Most primitives a node at `depth` can hold and still end in leaves of at most MAX_LEAF_SIZE with median splits
+static uint64_t depthCapacity(uint32_t depth) {
+    return static_cast<uint64_t>(MAX_LEAF_SIZE) << (BVH_MAX_DEPTH - depth);
+}
+
+struct SahBins {
+    Aabb box[3][MAX_SAH_BIN_COUNT];
+    uint32_t count[3][MAX_SAH_BIN_COUNT] = {};
+};
+
+class BvhBuilder {
+public:
+    BvhBuilder(const std::vector<BvhPrimitiveBounds> &bounds, const BvhBuildSettings &settings, std::vector<GpuBvhNode> &nodes, std::vector<uint32_t> &order, unsigned threads):
+        bounds(bounds), settings(settings), nodes(nodes), order(order), threads(threads) {
+    }
+
+    uint32_t buildNode(uint32_t start, uint32_t count, uint32_t depth);
+
+private:
+    const std::vector<BvhPrimitiveBounds> &bounds;
+    const BvhBuildSettings &settings;
+    std::vector<GpuBvhNode> &nodes;
+    std::vector<uint32_t> &order;   // Shared between the tasks, each one only touches its own range
+    unsigned threads;               // Threads this builder may use for its subtree
+
+    unsigned rangeThreads(uint32_t count) const { return count >= PARALLEL_REDUCE_THRESHOLD ? threads : 1; }
+
+    void computeBounds(uint32_t start, uint32_t count, Aabb &box, Aabb &centroidBox);
+    uint32_t makeLeaf(uint32_t nodeIndex, const Aabb &box, uint32_t start, uint32_t count);
+    uint32_t splitMedian(uint32_t start, uint32_t count, const Aabb &centroidBox);
+    bool splitSah(uint32_t start, uint32_t count, const Aabb &box, const Aabb &centroidBox, uint32_t &mid);
+    uint32_t partition(uint32_t start, uint32_t count, const std::function<bool(uint32_t)> &goesLeft);
+    uint32_t appendSubtree(const std::vector<GpuBvhNode> &subtree);
+};
+
+void BvhBuilder::computeBounds(uint32_t start, uint32_t count, Aabb &box, Aabb &centroidBox) {
+    const unsigned rThreads = rangeThreads(count);
+    const size_t chunks = parallelChunkCount(count, PARALLEL_REDUCE_THRESHOLD / 4, rThreads);
+    std::vector<Aabb> chunkBoxes(chunks), chunkCentroids(chunks);
+    parallelFor(start, start + count, PARALLEL_REDUCE_THRESHOLD / 4, rThreads, [&](size_t begin, size_t end, size_t chunk) {
+        Aabb b, c;
+        for (size_t i = begin; i < end; i++) {
+            const BvhPrimitiveBounds &pb = bounds[order[i]];
+            b.grow(pb.min);
+            b.grow(pb.max);
+            c.grow(pb.centroid);
+        }
+        chunkBoxes[chunk] = b;
+        chunkCentroids[chunk] = c;
+    });
+
+    // min/max are exact so the result doesn't depend on the chunking
+    for (size_t i = 0; i < chunks; i++) {
+        box.grow(chunkBoxes[i]);
+        centroidBox.grow(chunkCentroids[i]);
+    }
+}
+
+uint32_t BvhBuilder::makeLeaf(uint32_t nodeIndex, const Aabb &box, uint32_t start, uint32_t count) {
+    nodes[nodeIndex] = {
+        .aabbMin = box.min,
+        .aabbMax = box.max,
+        .data0 = start,
+        .data1 = count,
+        .isLeaf = 1,
+    };
+    return nodeIndex;
+}
+
+uint32_t BvhBuilder::splitMedian(uint32_t start, uint32_t count, const Aabb &centroidBox) {
+    glm::vec3 extent = centroidBox.max - centroidBox.min;
+    int axis = 0;
+    if (extent.y > extent.x && extent.y >= extent.z) axis = 1;
+    else if (extent.z > extent.x) axis = 2;
+
+    uint32_t mid = start + count / 2;
+    std::nth_element(
+        order.begin() + start,
+        order.begin() + mid,
+        order.begin() + start + count,
+        [&](uint32_t a, uint32_t b) {
+            return bounds[a].centroid[axis] < bounds[b].centroid[axis];
+        }
+    );
+    return mid;
+}
+
+// Stable partition, so the result is the same whatever the number of threads
+uint32_t BvhBuilder::partition(uint32_t start, uint32_t count, const std::function<bool(uint32_t)> &goesLeft) {
+    const unsigned rThreads = rangeThreads(count);
+    if (rThreads <= 1) {
+        auto it = std::stable_partition(order.begin() + start, order.begin() + start + count, goesLeft);
+        return static_cast<uint32_t>(it - order.begin());
+    }
+
+    const size_t grain = PARALLEL_REDUCE_THRESHOLD / 4;
+    const size_t chunks = parallelChunkCount(count, grain, rThreads);
+    std::vector<uint32_t> source(order.begin() + start, order.begin() + start + count);
+    std::vector<uint8_t> flags(count);
+    std::vector<uint32_t> leftCounts(chunks, 0);
+    parallelFor(0, count, grain, rThreads, [&](size_t begin, size_t end, size_t chunk) {
+        uint32_t leftCount = 0;
+        for (size_t i = begin; i < end; i++) {
+            flags[i] = goesLeft(source[i]) ? 1 : 0;
+            leftCount += flags[i];
+        }
+        leftCounts[chunk] = leftCount;
+    });
+
+    std::vector<uint32_t> leftOffsets(chunks), rightOffsets(chunks);
+    uint32_t totalLeft = 0;
+    for (size_t i = 0; i < chunks; i++) totalLeft += leftCounts[i];
+    uint32_t leftAcc = 0, rightAcc = totalLeft;
+    for (size_t i = 0; i < chunks; i++) {
+        leftOffsets[i] = leftAcc;
+        rightOffsets[i] = rightAcc;
+        leftAcc += leftCounts[i];
+        rightAcc += static_cast<uint32_t>(count * (i + 1) / chunks - count * i / chunks) - leftCounts[i];
+    }
+
+    parallelFor(0, count, grain, rThreads, [&](size_t begin, size_t end, size_t chunk) {
+        uint32_t left = leftOffsets[chunk];
+        uint32_t right = rightOffsets[chunk];
+        for (size_t i = begin; i < end; i++) {
+            order[start + (flags[i] ? left++ : right++)] = source[i];
+        }
+    });
+    return start + totalLeft;
+}
+
+// Returns false if making a leaf is cheaper than the best split
+bool BvhBuilder::splitSah(uint32_t start, uint32_t count, const Aabb &box, const Aabb &centroidBox, uint32_t &mid) {
+    const int binCount = std::clamp(settings.binCount, 2, MAX_SAH_BIN_COUNT);
+    const float rootArea = std::max(box.area(), std::numeric_limits<float>::min());
+
+    glm::vec3 binScale;
+    for (int axis = 0; axis < 3; axis++) {
+        const float extent = centroidBox.max[axis] - centroidBox.min[axis];
+        binScale[axis] = extent > 0.0f ? static_cast<float>(binCount) / extent : 0.0f;
+    }
+    auto binOf = [&](const glm::vec3 &centroid, int axis) {
+        return std::min(binCount - 1, static_cast<int>((centroid[axis] - centroidBox.min[axis]) * binScale[axis]));
+    };
+
+    // Bin the primitives along the three axes at once, per chunk for the large nodes
+    const unsigned rThreads = rangeThreads(count);
+    const size_t chunks = parallelChunkCount(count, PARALLEL_REDUCE_THRESHOLD / 4, rThreads);
+    std::vector<SahBins> chunkBins(chunks);
+    parallelFor(start, start + count, PARALLEL_REDUCE_THRESHOLD / 4, rThreads, [&](size_t begin, size_t end, size_t chunk) {
+        SahBins &bins = chunkBins[chunk];
+        for (size_t i = begin; i < end; i++) {
+            const BvhPrimitiveBounds &b = bounds[order[i]];
+            for (int axis = 0; axis < 3; axis++) {
+                int bin = binOf(b.centroid, axis);
+                bins.count[axis][bin]++;
+                bins.box[axis][bin].grow(b.min);
+                bins.box[axis][bin].grow(b.max);
+            }
+        }
+    });
+    SahBins &bins = chunkBins[0];
+    for (size_t c = 1; c < chunks; c++) {
+        for (int axis = 0; axis < 3; axis++) {
+            for (int i = 0; i < binCount; i++) {
+                bins.count[axis][i] += chunkBins[c].count[axis][i];
+                bins.box[axis][i].grow(chunkBins[c].box[axis][i]);
+            }
+        }
+    }
+
+    float bestCost = std::numeric_limits<float>::infinity();
+    int bestAxis = -1;
+    int bestSplit = 0;
+
+    for (int axis = 0; axis < 3; axis++) {
+        if (binScale[axis] == 0.0f) continue;
+
+        // Sweep from the right to get the cost of the right side of every split plane
+        float rightArea[MAX_SAH_BIN_COUNT];
+        uint32_t rightCount[MAX_SAH_BIN_COUNT];
+        Aabb acc;
+        uint32_t accCount = 0;
+        for (int i = binCount - 1; i > 0; i--) {
+            acc.grow(bins.box[axis][i]);
+            accCount += bins.count[axis][i];
+            rightArea[i] = acc.area();
+            rightCount[i] = accCount;
+        }
+
+        acc = Aabb();
+        accCount = 0;
+        for (int i = 0; i < binCount - 1; i++) {
+            acc.grow(bins.box[axis][i]);
+            accCount += bins.count[axis][i];
+            if (accCount == 0 || rightCount[i + 1] == 0) continue;
+
+            const float cost = settings.traversalCost + settings.intersectionCost *
+                (acc.area() * accCount + rightArea[i + 1] * rightCount[i + 1]) / rootArea;
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = i;
+            }
+        }
+    }
+
+    const float leafCost = settings.intersectionCost * count;
+    const uint32_t maxLeafSize = std::clamp(settings.maxLeafSize, 1, MAX_LEAF_SIZE);
+    if (bestAxis < 0) {
+        // Every centroid is at the same position, no plane can separate them
+        if (count <= maxLeafSize) return false;
+        mid = start + count / 2;
+        return true;
+    }
+    if (bestCost >= leafCost && count <= maxLeafSize) return false;
+
+    mid = partition(start, count, [&](uint32_t p) {
+        return binOf(bounds[p].centroid, bestAxis) <= bestSplit;
+    });
+    return true;
+}
+
+// Appends the nodes of a subtree built by another task, returns the index of its root
+uint32_t BvhBuilder::appendSubtree(const std::vector<GpuBvhNode> &subtree) {
+    const uint32_t base = static_cast<uint32_t>(nodes.size());
+    for (GpuBvhNode node : subtree) {
+        if (node.isLeaf == 0) {
+            node.data0 += base;
+            node.data1 += base;
+        }
+        nodes.push_back(node);
+    }
+    return base;
+}
+
+uint32_t BvhBuilder::buildNode(uint32_t start, uint32_t count, uint32_t depth) {
+    uint32_t nodeIndex = nodes.size();
+    nodes.push_back({});
+
+    Aabb box, centroidBox;
+    computeBounds(start, count, box, centroidBox);
+
+    // Nodes always fit in `depthCapacity(depth)`, so a node at the depth limit is a valid leaf
+    if (count == 1 || depth >= BVH_MAX_DEPTH)
+        return makeLeaf(nodeIndex, box, start, count);
+
+    uint32_t mid;
+    if (settings.builder == BvhBuilderType::BinnedSah) {
+        if (!splitSah(start, count, box, centroidBox, mid))
+            return makeLeaf(nodeIndex, box, start, count);
+    } else {
+        if (count <= LEAF_SIZE)
+            return makeLeaf(nodeIndex, box, start, count);
+        mid = splitMedian(start, count, centroidBox);
+    }
+
+    uint32_t leftCount = mid - start;
+    uint32_t rightCount = count - leftCount;
+    if (leftCount == 0 || rightCount == 0) {
+        mid = start + count / 2;
+        leftCount = mid - start;
+        rightCount = count - leftCount;
+    }
+    if (std::max(leftCount, rightCount) > depthCapacity(depth + 1)) {
+        // Too unbalanced for the levels left, the object median halves the node so both sides fit
+        mid = splitMedian(start, count, centroidBox);
+        leftCount = mid - start;
+        rightCount = count - leftCount;
+    }
+
+    uint32_t left, right;
+    if (threads > 1 && count >= PARALLEL_TASK_THRESHOLD) {
+        // Build both subtrees in separate arrays, then splice them in the same order as the serial build
+        const unsigned leftThreads = (threads + 1) / 2;
+        const unsigned rightThreads = threads - leftThreads;
+        std::vector<GpuBvhNode> leftNodes, rightNodes;
+
+        std::thread leftTask([&]() {
+            BvhBuilder builder(bounds, settings, leftNodes, order, leftThreads);
+            builder.buildNode(start, leftCount, depth + 1);
+        });
+        BvhBuilder builder(bounds, settings, rightNodes, order, rightThreads);
+        builder.buildNode(mid, rightCount, depth + 1);
+        leftTask.join();
+
+        left = appendSubtree(leftNodes);
+        right = appendSubtree(rightNodes);
+    } else {
+        left = buildNode(start, leftCount, depth + 1);
+        right = buildNode(mid, rightCount, depth + 1);
+    }
+
+    nodes[nodeIndex] = {
+        .aabbMin = box.min,
+        .aabbMax = box.max,
+        .data0 = left,
+        .data1 = right,
+        .isLeaf = 0,
+    };
+    return nodeIndex;
+}
+
+void buildBvh(const std::vector<BvhPrimitiveBounds> &bounds, const BvhBuildSettings &settings, std::vector<GpuBvhNode> &nodes, std::vector<uint32_t> &primitiveOrder) {
+    nodes.clear();
+    primitiveOrder.resize(bounds.size());
+    const unsigned threads = resolveThreadCount(settings.threadCount);
+    parallelFor(0, bounds.size(), PARALLEL_REDUCE_THRESHOLD, threads, [&](size_t begin, size_t end, size_t) {
+        std::iota(primitiveOrder.begin() + begin, primitiveOrder.begin() + end, static_cast<uint32_t>(begin));
+    });
+    if (bounds.empty()) return;
+
+    nodes.reserve(2 * bounds.size());
+    BvhBuilder builder(bounds, settings, nodes, primitiveOrder, threads);
+    builder.buildNode(0, static_cast<uint32_t>(bounds.size()), 0);
+}
+
+
+static float nodeArea(const GpuBvhNode &node) {
+    Aabb box{ node.aabbMin, node.aabbMax };
+    return box.area();
+}
+
+static uint32_t collapseNode(const std::vector<GpuBvhNode> &nodes, uint32_t index, std::vector<GpuBvhNode4> &wideNodes) {
+    uint32_t children[4];
+    int childCount = 0;
+    if (nodes[index].isLeaf != 0) {
+        children[childCount++] = index;
+    } else {
+        children[childCount++] = BVH_childLeft(nodes[index]);
+        children[childCount++] = BVH_childRight(nodes[index]);
+    }
+
+    // Replace the largest inner child by its two children, in place to keep the left to right order
+    while (childCount < 4) {
+        int largest = -1;
+        float largestArea = -1.0f;
+        for (int i = 0; i < childCount; i++) {
+            if (nodes[children[i]].isLeaf != 0) continue;
+            const float area = nodeArea(nodes[children[i]]);
+            if (area > largestArea) {
+                largestArea = area;
+                largest = i;
+            }
+        }
+        if (largest < 0) break;
+
+        const GpuBvhNode &opened = nodes[children[largest]];
+        for (int i = childCount; i > largest + 1; i--) {
+            children[i] = children[i - 1];
+        }
+        children[largest] = BVH_childLeft(opened);
+        children[largest + 1] = BVH_childRight(opened);
+        childCount++;
+    }
+
+    const uint32_t wideIndex = static_cast<uint32_t>(wideNodes.size());
+    wideNodes.push_back({});
+
+    GpuBvhNode4 wide = {};
+    for (int i = 0; i < 4; i++) {
+        if (i >= childCount) {
+            wide.child[i] = BVH4_INVALID;
+            continue;
+        }
+
+        const GpuBvhNode &child = nodes[children[i]];
+        wide.minX[i] = child.aabbMin.x;
+        wide.minY[i] = child.aabbMin.y;
+        wide.minZ[i] = child.aabbMin.z;
+        wide.maxX[i] = child.aabbMax.x;
+        wide.maxY[i] = child.aabbMax.y;
+        wide.maxZ[i] = child.aabbMax.z;
+        if (child.isLeaf != 0) {
+            wide.child[i] = BVH_firstTriangle(child);
+            wide.count[i] = BVH_triangleCount(child);
+        } else {
+            wide.child[i] = collapseNode(nodes, children[i], wideNodes);
+            wide.count[i] = 0;
+        }
+    }
+    wideNodes[wideIndex] = wide;
+    return wideIndex;
+}
+
+void collapseBvh4(const std::vector<GpuBvhNode> &nodes, std::vector<GpuBvhNode4> &wideNodes) {
+    wideNodes.clear();
+    if (nodes.empty()) return;
+
+    wideNodes.reserve(nodes.size() / 2 + 1);
+    collapseNode(nodes, 0, wideNodes);
+}
+
+BvhReport computeBvhReport(const std::vector<GpuBvhNode> &nodes, const BvhBuildSettings &settings) {
+    BvhReport report;
+    if (nodes.empty()) return report;
+
+    const float rootArea = std::max(nodeArea(nodes[0]), std::numeric_limits<float>::min());
+    report.nodeCount = static_cast<uint32_t>(nodes.size());
+
+    uint32_t primitiveCount = 0;
+    std::vector<std::pair<uint32_t, uint32_t> > stack = { { 0, 1 } };
+    while (!stack.empty()) {
+        auto [index, depth] = stack.back();
+        stack.pop_back();
+
+        const GpuBvhNode &node = nodes[index];
+        const float relativeArea = nodeArea(node) / rootArea;
+        report.maxDepth = std::max(report.maxDepth, depth);
+
+        if (node.isLeaf != 0) {
+            const uint32_t count = BVH_triangleCount(node);
+            report.sahCost += relativeArea * settings.intersectionCost * count;
+            report.leafCount++;
+            primitiveCount += count;
+            if (report.leafSizeHistogram.size() <= count)
+                report.leafSizeHistogram.resize(count + 1, 0);
+            report.leafSizeHistogram[count]++;
+        } else {
+            report.sahCost += relativeArea * settings.traversalCost;
+            stack.push_back({ BVH_childLeft(node), depth + 1 });
+            stack.push_back({ BVH_childRight(node), depth + 1 });
+        }
+    }
+    report.averageLeafSize = report.leafCount > 0 ? static_cast<float>(primitiveCount) / report.leafCount : 0.0f;
+    return report;
+}
+
+std::string formatBvhReport(const BvhReport &report) {
+    std::ostringstream out;
+    out.precision(3);
+    out << "SAH cost " << report.sahCost
+        << ", " << report.nodeCount << " nodes"
+        << ", " << report.leafCount << " leaves"
+        << ", depth " << report.maxDepth
+        << ", leaf size avg " << report.averageLeafSize
+        << ", histogram [";
+    bool first = true;
+    for (size_t i = 1; i < report.leafSizeHistogram.size(); i++) {
+        if (report.leafSizeHistogram[i] == 0) continue;
+        if (!first) out << " ";
+        out << i << ":" << report.leafSizeHistogram[i];
+        first = false;
+    }
+    out << "]";
+    return out.str();
+}
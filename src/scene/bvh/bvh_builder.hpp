@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bvh.hpp"
+
+#define LEAF_SIZE 4             // Leaf size of the median builder
+#define MAX_LEAF_SIZE 16        // Upper bound of any leaf, whatever the builder
+#define MAX_SAH_BIN_COUNT 64
+
+enum class BvhBuilderType : int {
+    Median = 0,
+    BinnedSah,
+};
+
+struct BvhBuildSettings {
+    BvhBuilderType builder = BvhBuilderType::Median;
+    int binCount = 16;              // Binned SAH only
+    int maxLeafSize = 8;            // Binned SAH only, leaves are created earlier if they are cheaper than any split
+    float traversalCost = 1.0f;     // Cost of a node visit relative to a primitive test
+    float intersectionCost = 1.0f;
+    int threadCount = 0;            // 0 uses every hardware thread, the resulting BVH doesn't depend on it
+    BvhLayout layout = BvhLayout::Binary;   // Layout traversed by the shader and the CPU, the binary tree is always built first
+};
+
+struct BvhPrimitiveBounds {
+    glm::vec3 min;
+    glm::vec3 max;
+    glm::vec3 centroid;
+};
+
+struct BvhReport {
+    float sahCost = 0.0f;
+    uint32_t nodeCount = 0;
+    uint32_t leafCount = 0;
+    uint32_t maxDepth = 0;
+    float averageLeafSize = 0.0f;
+    std::vector<uint32_t> leafSizeHistogram;   // leafSizeHistogram[n] is the number of leaves holding n primitives
+};
+
+// Builds a BVH over the given primitives.
+// `primitiveOrder[i]` is the original primitive stored at the position i referenced by the leaves.
+void buildBvh(
+    const std::vector<BvhPrimitiveBounds> &bounds,
+    const BvhBuildSettings &settings,
+    std::vector<GpuBvhNode> &nodes,
+    std::vector<uint32_t> &primitiveOrder
+);
+
+// Collapses a binary BVH into a 4-wide one, by repeatedly opening the largest inner child of each node.
+// Leaves are kept as they are, so the triangle order of the binary BVH is still valid.
+void collapseBvh4(const std::vector<GpuBvhNode> &nodes, std::vector<GpuBvhNode4> &wideNodes);
+
+BvhReport computeBvhReport(const std::vector<GpuBvhNode> &nodes, const BvhBuildSettings &settings);
+std::string formatBvhReport(const BvhReport &report);
@@ -0,0 +1,143 @@
+#include "bvh_quantized.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+class BvhQuantizer {
+public:
+    BvhQuantizer(const std::vector<GpuBvhNode> &nodes, BvhNodeFormat format, std::vector<uint32_t> &words):
+        nodes(nodes), words(words),
+        bits(quantizedBits(format)), qMax(quantizedMax(format)), invMax(quantizedInvMax(format)), nodeWords(quantizedNodeWords(format)) {
+    }
+
+    uint32_t encodeChild(uint32_t index, const glm::vec3 &boxMin, const glm::vec3 &boxMax);
+
+private:
+    const std::vector<GpuBvhNode> &nodes;
+    std::vector<uint32_t> &words;
+    uint32_t bits, qMax;
+    float invMax;
+    uint32_t nodeWords;
+    uint32_t nodeCount = 0;
+
+    uint32_t quantizeMin(float value, float parentMin, float parentMax) const;
+    uint32_t quantizeMax(float value, float parentMin, float parentMax) const;
+    uint32_t encodeLeaf(uint32_t first, uint32_t count, const glm::vec3 &boxMin, const glm::vec3 &boxMax);
+    uint32_t pushNode();
+    void writeChildBox(uint32_t node, uint32_t child, const glm::vec3 &parentMin, const glm::vec3 &parentMax,
+                       const glm::vec3 &childMin, const glm::vec3 &childMax, glm::vec3 &decodedMin, glm::vec3 &decodedMax);
+};
+
+// Largest value whose decoded bound is still below `value`, so the decoded box always contains the original one
+uint32_t BvhQuantizer::quantizeMin(float value, float parentMin, float parentMax) const {
+    const float extent = parentMax - parentMin;
+    if (!(extent > 0.0f)) return 0;
+    float q = std::floor((value - parentMin) / extent * static_cast<float>(qMax));
+    uint32_t result = static_cast<uint32_t>(std::clamp(q, 0.0f, static_cast<float>(qMax)));
+    while (result > 0 && dequantize(result, qMax, invMax, parentMin, parentMax) > value) result--;
+    return result;
+}
+
+// Smallest value whose decoded bound is still above `value`
+uint32_t BvhQuantizer::quantizeMax(float value, float parentMin, float parentMax) const {
+    const float extent = parentMax - parentMin;
+    if (!(extent > 0.0f)) return qMax;
+    float q = std::ceil((value - parentMin) / extent * static_cast<float>(qMax));
+    uint32_t result = static_cast<uint32_t>(std::clamp(q, 0.0f, static_cast<float>(qMax)));
+    while (result < qMax && dequantize(result, qMax, invMax, parentMin, parentMax) < value) result++;
+    return result;
+}
+
+uint32_t BvhQuantizer::pushNode() {
+    words.resize(words.size() + nodeWords, 0);
+    return nodeCount++;
+}
+
+void BvhQuantizer::writeChildBox(uint32_t node, uint32_t child, const glm::vec3 &parentMin, const glm::vec3 &parentMax,
+                                 const glm::vec3 &childMin, const glm::vec3 &childMax, glm::vec3 &decodedMin, glm::vec3 &decodedMax) {
+    const uint32_t perWord = 32 / bits;
+    uint32_t *data = &words[QBVH_HEADER_WORDS + node * nodeWords];
+    for (uint32_t axis = 0; axis < 3; axis++) {
+        const uint32_t qLow = quantizeMin(childMin[axis], parentMin[axis], parentMax[axis]);
+        const uint32_t qHigh = std::max(qLow, quantizeMax(childMax[axis], parentMin[axis], parentMax[axis]));
+        const uint32_t iMin = child * 6 + axis;
+        const uint32_t iMax = child * 6 + 3 + axis;
+        data[iMin / perWord] |= qLow << ((iMin % perWord) * bits);
+        data[iMax / perWord] |= qHigh << ((iMax % perWord) * bits);
+
+        // The children of this child are quantized relative to what the traversal decodes, not to the exact box
+        decodedMin[axis] = dequantize(qLow, qMax, invMax, parentMin[axis], parentMax[axis]);
+        decodedMax[axis] = dequantize(qHigh, qMax, invMax, parentMin[axis], parentMax[axis]);
+    }
+}
+
+// Leaves that don't fit in a child word are split in halves below nodes sharing their box.
+// The builder keeps the levels this adds below its deepest leaves free (`QUANTIZED_LEAF_LEVELS` in `bvh_builder.cpp`).
+uint32_t BvhQuantizer::encodeLeaf(uint32_t first, uint32_t count, const glm::vec3 &boxMin, const glm::vec3 &boxMax) {
+    if (count <= QBVH_MAX_LEAF_SIZE)
+        return QBVH_LEAF_BIT | ((count - 1) << QBVH_COUNT_SHIFT) | (first & QBVH_FIRST_MASK);
+
+    const uint32_t node = pushNode();
+    const uint32_t leftCount = count / 2;
+    glm::vec3 decodedMin, decodedMax;
+
+    writeChildBox(node, 0, boxMin, boxMax, boxMin, boxMax, decodedMin, decodedMax);
+    const uint32_t left = encodeLeaf(first, leftCount, decodedMin, decodedMax);
+    words[QBVH_HEADER_WORDS + node * nodeWords + nodeWords - 2] = left;
+
+    writeChildBox(node, 1, boxMin, boxMax, boxMin, boxMax, decodedMin, decodedMax);
+    const uint32_t right = encodeLeaf(first + leftCount, count - leftCount, decodedMin, decodedMax);
+    words[QBVH_HEADER_WORDS + node * nodeWords + nodeWords - 1] = right;
+    return node;
+}
+
+// `boxMin/boxMax` is the box of the node as decoded by the traversal
+uint32_t BvhQuantizer::encodeChild(uint32_t index, const glm::vec3 &boxMin, const glm::vec3 &boxMax) {
+    const GpuBvhNode &source = nodes[index];
+    if (source.isLeaf != 0)
+        return encodeLeaf(BVH_firstTriangle(source), BVH_triangleCount(source), boxMin, boxMax);
+
+    const uint32_t node = pushNode();
+    const uint32_t children[2] = { BVH_childLeft(source), BVH_childRight(source) };
+    for (uint32_t c = 0; c < 2; c++) {
+        glm::vec3 decodedMin, decodedMax;
+        writeChildBox(node, c, boxMin, boxMax, nodes[children[c]].aabbMin, nodes[children[c]].aabbMax, decodedMin, decodedMax);
+        // `words` may grow in `encodeChild`, so the child word is written through its index afterwards
+        const uint32_t word = encodeChild(children[c], decodedMin, decodedMax);
+        words[QBVH_HEADER_WORDS + node * nodeWords + nodeWords - 2 + c] = word;
+    }
+    return node;
+}
+
+void quantizeBvh(const std::vector<GpuBvhNode> &nodes, BvhNodeFormat format, std::vector<uint32_t> &words) {
+    words.clear();
+    if (nodes.empty() || format == BvhNodeFormat::Full) return;
+
+    const GpuBvhNode &root = nodes[0];
+    words.resize(QBVH_HEADER_WORDS, 0);
+    for (int axis = 0; axis < 3; axis++) {
+        words[axis] = std::bit_cast<uint32_t>(root.aabbMin[axis]);
+        words[3 + axis] = std::bit_cast<uint32_t>(root.aabbMax[axis]);
+    }
+    words.reserve(QBVH_HEADER_WORDS + nodes.size() / 2 * quantizedNodeWords(format));
+
+    BvhQuantizer quantizer(nodes, format, words);
+    words[6] = quantizer.encodeChild(0, root.aabbMin, root.aabbMax);
+}
+
+
+void addBvhMemoryReport(BvhMemoryReport &report, uint32_t triangleCount, size_t fullBytes, size_t quantizedBytes) {
+    report.triangleCount += triangleCount;
+    report.fullBytes += fullBytes;
+    report.quantizedBytes += quantizedBytes;
+}
+
+std::string formatBvhMemoryReport(const BvhMemoryReport &report) {
+    const double triangles = std::max<uint32_t>(report.triangleCount, 1);
+    std::ostringstream out;
+    out.precision(3);
+    out << report.fullBytes / 1024.0 << " KiB (" << report.fullBytes / triangles << " B/tri)"
+        << " -> " << report.quantizedBytes / 1024.0 << " KiB (" << report.quantizedBytes / triangles << " B/tri)";
+    return out.str();
+}
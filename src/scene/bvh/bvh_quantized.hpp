@@ -0,0 +1,223 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bvh.hpp"
+
+// Binary BVH with the bounds of both children quantized relative to their parent box.
+// The data of a mesh is a block of 32-bit words:
+//   - the root box as 6 floats and the root child word (QBVH_HEADER_WORDS)
+//   - one node per inner node: the 12 quantized bounds packed in 32-bit words, then the 2 child words
+// A child word is an inner node index, or QBVH_LEAF_BIT | (count - 1) << QBVH_COUNT_SHIFT | first triangle.
+// Must match the `QBVH_` definitions in `res/shader/raytracing/utils.glsl`
+#define QBVH_HEADER_WORDS 7
+#define QBVH_LEAF_BIT 0x80000000u
+#define QBVH_COUNT_SHIFT 27
+#define QBVH_FIRST_MASK 0x07FFFFFFu
+#define QBVH_MAX_LEAF_SIZE 16
+#define QBVH_INV_MAX8 0x3B808081u     // Bits of 1/255, given as bits so both sides use the same rounding
+#define QBVH_INV_MAX16 0x37800080u    // Bits of 1/65535
+
+// Node format used by the binary meshes of a scene
+enum class BvhNodeFormat : uint32_t {
+    Full = 0,
+    Quantized16,
+    Quantized8,
+};
+
+inline uint32_t quantizedBits(BvhNodeFormat format) { return format == BvhNodeFormat::Quantized8 ? 8 : 16; }
+inline uint32_t quantizedMax(BvhNodeFormat format) { return (1u << quantizedBits(format)) - 1; }
+inline uint32_t quantizedNodeWords(BvhNodeFormat format) { return 12 / (32 / quantizedBits(format)) + 2; }
+inline float quantizedInvMax(BvhNodeFormat format) {
+    return std::bit_cast<float>(format == BvhNodeFormat::Quantized8 ? QBVH_INV_MAX8 : QBVH_INV_MAX16);
+}
+
+// Bound `q` of an axis going from `parentMin` to `parentMax`, both ends are decoded exactly.
+// The product and the sum are separate statements so they are never fused, the shader uses `precise` for the same reason.
+inline float dequantize(uint32_t q, uint32_t qMax, float invMax, float parentMin, float parentMax) {
+    if (q == qMax) return parentMax;
+    const float scale = (parentMax - parentMin) * invMax;
+    const float offset = static_cast<float>(q) * scale;
+    return parentMin + offset;
+}
+
+// Root box stored as floats in the first words
+inline void decodeQuantizedRoot(const std::vector<uint32_t> &words, glm::vec3 &rootMin, glm::vec3 &rootMax) {
+    for (int axis = 0; axis < 3; axis++) {
+        rootMin[axis] = std::bit_cast<float>(words[axis]);
+        rootMax[axis] = std::bit_cast<float>(words[3 + axis]);
+    }
+}
+
+// Decodes the boxes of the two children of the node starting at `node`
+inline void decodeQuantizedNode(
+    const uint32_t *node,
+    BvhNodeFormat format,
+    const glm::vec3 &parentMin,
+    const glm::vec3 &parentMax,
+    glm::vec3 childMin[2],
+    glm::vec3 childMax[2]
+) {
+    const uint32_t bits = quantizedBits(format);
+    const uint32_t perWord = 32 / bits;
+    const uint32_t qMax = quantizedMax(format);
+    const float invMax = quantizedInvMax(format);
+    for (uint32_t c = 0; c < 2; c++) {
+        for (uint32_t axis = 0; axis < 3; axis++) {
+            const uint32_t iMin = c * 6 + axis;
+            const uint32_t iMax = c * 6 + 3 + axis;
+            const uint32_t qLow = (node[iMin / perWord] >> ((iMin % perWord) * bits)) & qMax;
+            const uint32_t qHigh = (node[iMax / perWord] >> ((iMax % perWord) * bits)) & qMax;
+            childMin[c][axis] = dequantize(qLow, qMax, invMax, parentMin[axis], parentMax[axis]);
+            childMax[c][axis] = dequantize(qHigh, qMax, invMax, parentMin[axis], parentMax[axis]);
+        }
+    }
+}
+
+// Encodes a binary BVH, leaves larger than QBVH_MAX_LEAF_SIZE are split under extra nodes
+void quantizeBvh(const std::vector<GpuBvhNode> &nodes, BvhNodeFormat format, std::vector<uint32_t> &words);
+
+struct BvhMemoryReport {
+    uint32_t triangleCount = 0;
+    size_t fullBytes = 0;           // `GpuBvhNode` array
+    size_t quantizedBytes = 0;      // Selected format, equal to fullBytes for `BvhNodeFormat::Full`
+};
+
+void addBvhMemoryReport(BvhMemoryReport &report, uint32_t triangleCount, size_t fullBytes, size_t quantizedBytes);
+std::string formatBvhMemoryReport(const BvhMemoryReport &report);
+
+// Closest-hit traversal of a quantized BVH (CPU port of `rayMeshIntersectionQuantized` in `objects.glsl`), same contract as `traverseBvh`
+template<typename IntersectFn>
+float traverseQuantizedBvh(
+    const std::vector<uint32_t> &words,
+    BvhNodeFormat format,
+    const Ray &ray,
+    float tMax,
+    IntersectFn &&intersect,
+    uint32_t &hitPrimitive,
+    BvhTraversalStats *stats = nullptr
+) {
+    if (words.size() < QBVH_HEADER_WORDS) return -1.0f;
+
+    const BvhRay bvhRay = makeBvhRay(ray);
+    float tClosest = tMax;
+    bool found = false;
+
+    struct StackEntry {
+        uint32_t child;
+        float tNear;
+        glm::vec3 aabbMin, aabbMax;
+    };
+    StackEntry current;
+    decodeQuantizedRoot(words, current.aabbMin, current.aabbMax);
+    current.child = words[6];
+    if (rayAabbDistance(bvhRay, current.aabbMin, current.aabbMax, tClosest) == std::numeric_limits<float>::infinity())
+        return -1.0f;
+
+    const uint32_t nodeWords = quantizedNodeWords(format);
+    StackEntry stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    while (true) {
+        if (stats) stats->nodeVisits++;
+
+        if ((current.child & QBVH_LEAF_BIT) != 0) {
+            const uint32_t first = current.child & QBVH_FIRST_MASK;
+            const uint32_t count = ((current.child & ~QBVH_LEAF_BIT) >> QBVH_COUNT_SHIFT) + 1;
+            for (uint32_t primitive = first; primitive < first + count; primitive++) {
+                if (stats) stats->primitiveTests++;
+                float t = intersect(primitive, tClosest);
+                if (t >= 0.0f && t < tClosest) {
+                    tClosest = t;
+                    hitPrimitive = primitive;
+                    found = true;
+                }
+            }
+        } else {
+            const uint32_t *node = &words[QBVH_HEADER_WORDS + current.child * nodeWords];
+            glm::vec3 childMin[2], childMax[2];
+            decodeQuantizedNode(node, format, current.aabbMin, current.aabbMax, childMin, childMax);
+
+            const float tLeft = rayAabbDistance(bvhRay, childMin[0], childMax[0], tClosest);
+            const float tRight = rayAabbDistance(bvhRay, childMin[1], childMax[1], tClosest);
+            const bool hitLeft = tLeft != std::numeric_limits<float>::infinity();
+            const bool hitRight = tRight != std::numeric_limits<float>::infinity();
+            const StackEntry left = { node[nodeWords - 2], tLeft, childMin[0], childMax[0] };
+            const StackEntry right = { node[nodeWords - 1], tRight, childMin[1], childMax[1] };
+
+            if (hitLeft && hitRight) {
+                const bool leftFirst = tLeft <= tRight;
+                if (stackSize < BVH_STACK_SIZE)
+                    stack[stackSize++] = leftFirst ? right : left;
+                current = leftFirst ? left : right;
+                continue;
+            }
+            if (hitLeft) { current = left; continue; }
+            if (hitRight) { current = right; continue; }
+        }
+
+        bool next = false;
+        while (stackSize > 0) {
+            const StackEntry &entry = stack[--stackSize];
+            if (entry.tNear < tClosest) {
+                current = entry;
+                next = true;
+                break;
+            }
+        }
+        if (!next) break;
+    }
+
+    return found ? tClosest : -1.0f;
+}
+
+// Any-hit traversal of a quantized BVH (CPU port of `rayMeshOcclusionQuantized` in `objects.glsl`), same contract as `occludedBvh`
+template<typename OccludeFn>
+bool occludedQuantizedBvh(
+    const std::vector<uint32_t> &words,
+    BvhNodeFormat format,
+    const Ray &ray,
+    float tMax,
+    OccludeFn &&occludes,
+    BvhTraversalStats *stats = nullptr
+) {
+    if (words.size() < QBVH_HEADER_WORDS) return false;
+
+    const BvhRay bvhRay = makeBvhRay(ray);
+    struct StackEntry {
+        uint32_t child;
+        glm::vec3 aabbMin, aabbMax;
+    };
+    StackEntry stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    decodeQuantizedRoot(words, stack[0].aabbMin, stack[0].aabbMax);
+    stack[0].child = words[6];
+    stackSize++;
+
+    const uint32_t nodeWords = quantizedNodeWords(format);
+    while (stackSize > 0) {
+        const StackEntry entry = stack[--stackSize];
+        if (stats) stats->nodeVisits++;
+        if (rayAabbDistance(bvhRay, entry.aabbMin, entry.aabbMax, tMax) == std::numeric_limits<float>::infinity()) continue;
+
+        if ((entry.child & QBVH_LEAF_BIT) != 0) {
+            const uint32_t first = entry.child & QBVH_FIRST_MASK;
+            const uint32_t count = ((entry.child & ~QBVH_LEAF_BIT) >> QBVH_COUNT_SHIFT) + 1;
+            for (uint32_t primitive = first; primitive < first + count; primitive++) {
+                if (stats) stats->primitiveTests++;
+                if (occludes(primitive)) return true;
+            }
+        } else if (stackSize + 2 <= BVH_STACK_SIZE) {
+            const uint32_t *node = &words[QBVH_HEADER_WORDS + entry.child * nodeWords];
+            glm::vec3 childMin[2], childMax[2];
+            decodeQuantizedNode(node, format, entry.aabbMin, entry.aabbMax, childMin, childMax);
+            stack[stackSize++] = { node[nodeWords - 1], childMin[1], childMax[1] };
+            stack[stackSize++] = { node[nodeWords - 2], childMin[0], childMax[0] };
+        }
+    }
+    return false;
+}
@@ -137,6 +137,11 @@ float Box::getArea() {
     return 2.0f * (wx * wy + wy * wz + wx * wz);
 }
 
+bool Box::getBounds(glm::vec3 &aabbMin, glm::vec3 &aabbMax) {
+    transformBounds(transform, glm::vec3(-1.0f), glm::vec3(1.0f), aabbMin, aabbMax);
+    return true;
+}
+
 GpuBox Box::getStruct() {
     box.transform = transform;
     box.invTransform = glm::inverse(transform);
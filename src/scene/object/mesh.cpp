@@ -1,13 +1,10 @@
 #include "mesh.hpp"
 
 #include <algorithm>
-#include <cmath>
 #include <limits>
-#include <numeric>
 
-Mesh::Mesh(std::string name, std::vector<Vertex> vertices, std::vector<unsigned int> indices, glm::mat4 transform, MaterialHandle materialHandle):
-    Object(name), vertices(vertices), indices(indices), transform(transform), materialHandle(materialHandle) {
-    buildBvh();
+Mesh::Mesh(std::string name, std::shared_ptr<MeshGeometry> geometry, glm::mat4 transform, MaterialHandle materialHandle):
+    Object(name), geometry(std::move(geometry)), transform(transform), materialHandle(materialHandle) {
 }
 
 
@@ -17,41 +14,10 @@ float Mesh::rayIntersection(const Ray &ray) {
     glm::vec3 localDir = glm::vec3(invTransform * glm::vec4(ray.dir, 0.0f));
     Ray localRay{ localOrigin, localDir };
 
-    float tClosest = std::numeric_limits<float>::infinity();
-    bool hit = false;
-    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
-        const glm::vec3 v0 = glm::vec3(vertices[indices[i + 0]].position);
-        const glm::vec3 v1 = glm::vec3(vertices[indices[i + 1]].position);
-        const glm::vec3 v2 = glm::vec3(vertices[indices[i + 2]].position);
-
-        glm::vec3 edge1 = v1 - v0;
-        glm::vec3 edge2 = v2 - v0;
-        glm::vec3 pvec = glm::cross(localRay.dir, edge2);
-        float det = glm::dot(edge1, pvec);
-        if (std::fabs(det) < 1e-6f)
-            continue;
-
-        float invDet = 1.0f / det;
-        glm::vec3 tvec = localRay.origin - v0;
-        float u = glm::dot(tvec, pvec) * invDet;
-        if (u < 0.0f || u > 1.0f)
-            continue;
-
-        glm::vec3 qvec = glm::cross(tvec, edge1);
-        float v = glm::dot(localRay.dir, qvec) * invDet;
-        if (v < 0.0f || (u + v) > 1.0f)
-            continue;
-
-        float t = glm::dot(edge2, qvec) * invDet;
-        if (t >= 0.0f && t < tClosest) {
-            tClosest = t;
-            hit = true;
-        }
-    }
-    return hit ? tClosest : -1.0f;
+    uint32_t triangle;
+    return rayIntersectionLocal(localRay, std::numeric_limits<float>::infinity(), triangle);
 }
 
-
 bool Mesh::drawGuizmo(const glm::mat4 &view, const glm::mat4 &proj) {
     glm::vec3 currentPos, currentRot, currentScale;
     ImGuizmo::DecomposeMatrixToComponents(
@@ -138,121 +104,98 @@ bool Mesh::drawUI(std::vector<Material> &materials) {
     }
 
     updated |= drawMaterialUI(materials[materialHandle]);
+    updated |= drawBvhUI();
     return updated;
 }
 
-float Mesh::getArea() {
-    float area = 0.0f;
-    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
-        const glm::vec3 v0 = glm::vec3(vertices[indices[i + 0]].position);
-        const glm::vec3 v1 = glm::vec3(vertices[indices[i + 1]].position);
-        const glm::vec3 v2 = glm::vec3(vertices[indices[i + 2]].position);
-        area += 0.5f * glm::length(glm::cross(v1 - v0, v2 - v0));
-    }
-    return area;
-}
+// Changing the settings builds a new geometry for this instance only, the other instances keep the shared one
+bool Mesh::drawBvhUI() {
+    BvhBuildSettings bvhSettings = geometry->getBvhSettings();
+    bool rebuild = false;
 
-GpuMesh Mesh::getStruct() {
-    mesh.transform = transform;
-    mesh.invTransform = glm::inverse(transform);
-    mesh.indexOffset = -1;  // Computed by the scene
-    mesh.triangleCount = indices.size() / 3;
-    mesh.bvhOffset = 0;     // Computed by the scene
-    mesh.bvhNodeCount = static_cast<uint32_t>(bvhNodes.size());
-    mesh.materialHandle = materialHandle;
-    return mesh;
-}
-
-
-size_t Mesh::buildBvhNode(std::vector<TriBounds> &triBounds, std::vector<uint32_t> &triIndices, uint32_t start, uint32_t count) {
-    uint32_t nodeIndex = bvhNodes.size();
-    bvhNodes.push_back({});
-
-    glm::vec3 nodeMin(std::numeric_limits<float>::infinity());
-    glm::vec3 nodeMax(-std::numeric_limits<float>::infinity());
-    glm::vec3 centroidMin(std::numeric_limits<float>::infinity());
-    glm::vec3 centroidMax(-std::numeric_limits<float>::infinity());
-    for (size_t i = 0; i < count; i++) {
-        const TriBounds &tb = triBounds[triIndices[start + i]];
-        nodeMin = glm::min(nodeMin, tb.min);
-        nodeMax = glm::max(nodeMax, tb.max);
-        centroidMin = glm::min(centroidMin, tb.centroid);
-        centroidMax = glm::max(centroidMax, tb.centroid);
+    ImGui::SeparatorText("BVH");
+    const char *builders[] = { "Median", "Binned SAH" };
+    int currentBuilder = static_cast<int>(bvhSettings.builder);
+    const char *layouts[] = { "Binary", "4-wide" };
+    int currentLayout = static_cast<int>(bvhSettings.layout);
+    ImGui::PushItemWidth(-FLT_MIN);
+    if (ImGui::Combo("##Bvh Layout", &currentLayout, layouts, IM_ARRAYSIZE(layouts))) {
+        bvhSettings.layout = static_cast<BvhLayout>(currentLayout);
+        rebuild = true;
     }
-
-    if (count <= LEAF_SIZE) {
-        bvhNodes[nodeIndex] = {
-            .aabbMin = nodeMin,
-            .aabbMax = nodeMax,
-            .data0 = start,
-            .data1 = count,
-            .isLeaf = 1,
-        };
-        return nodeIndex;
+    if (ImGui::Combo("##Bvh Builder", &currentBuilder, builders, IM_ARRAYSIZE(builders))) {
+        bvhSettings.builder = static_cast<BvhBuilderType>(currentBuilder);
+        rebuild = true;
     }
+    if (bvhSettings.builder == BvhBuilderType::BinnedSah) {
+        if (ImGui::DragInt("##Bvh Bins", &bvhSettings.binCount, 1, 2, MAX_SAH_BIN_COUNT, "Bins: %d"))
+            rebuild = true;
+        if (ImGui::DragInt("##Bvh Max Leaf", &bvhSettings.maxLeafSize, 1, 1, MAX_LEAF_SIZE, "Max leaf size: %d"))
+            rebuild = true;
+    }
+    ImGui::PopItemWidth();
 
-    glm::vec3 extent = centroidMax - centroidMin;
-    int axis = 0;
-    if (extent.y > extent.x && extent.y >= extent.z) axis = 1;
-    else if (extent.z > extent.x) axis = 2;
-
-    uint32_t mid = start + count / 2;
-    std::nth_element(
-        triIndices.begin() + start,
-        triIndices.begin() + mid,
-        triIndices.begin() + start + count,
-        [&](uint32_t a, uint32_t b) {
-            return triBounds[a].centroid[axis] < triBounds[b].centroid[axis];
-        }
-    );
+    if (rebuild) {
+        auto rebuilt = std::make_shared<MeshGeometry>(geometry->getVertices(), geometry->getIndices(), bvhSettings);
+        rebuilt = MeshGeometry::withBvhNodeFormat(std::move(rebuilt), geometry->getBvhNodeFormat());
+        geometry = MeshGeometry::withTriangleRecords(std::move(rebuilt), geometry->hasTriangleRecords());
+    }
 
-    uint32_t leftCount = mid - start;
-    uint32_t rightCount = count - leftCount;
-    if (leftCount == 0 || rightCount == 0) {
-        mid = start + count / 2;
-        leftCount = mid - start;
-        rightCount = count - leftCount;
+    const BvhReport &bvhReport = geometry->getBvhReport();
+    if (geometry.use_count() > 1)
+        ImGui::Text("Shared by %ld instances", geometry.use_count());
+    ImGui::Text("SAH cost: %.2f", bvhReport.sahCost);
+    ImGui::Text("Nodes: %u (%u leaves)", bvhReport.nodeCount, bvhReport.leafCount);
+    ImGui::Text("Depth: %u", bvhReport.maxDepth);
+    if (bvhSettings.layout == BvhLayout::Wide4)
+        ImGui::Text("4-wide nodes: %zu", geometry->getBvh4Nodes().size());
+    const float triangles = static_cast<float>(std::max<uint32_t>(geometry->getTriangleCount(), 1));
+    ImGui::Text("Memory: %.1f B/tri (%.1f B/tri full)", geometry->getGpuBvhBytes() / triangles, geometry->getBvhNodes().size() * sizeof(GpuBvhNode) / triangles);
+
+    // Shared with the other instances, only the layout of the triangles changes. The scene swaps the copy into them
+    bool triangleRecords = geometry->hasTriangleRecords();
+    const bool recordsToggled = ImGui::Checkbox("Triangle records", &triangleRecords);
+    if (recordsToggled) {
+        replacedGeometry = geometry;
+        geometry = MeshGeometry::withTriangleRecords(geometry, triangleRecords);
     }
+    ImGui::SameLine();
+    ImGui::TextDisabled("%.1f KiB (%zu B/tri)", geometry->getTriangleRecordBytes() / 1024.0f, sizeof(GpuTriangle));
 
-    uint32_t left = buildBvhNode(triBounds, triIndices ,start, leftCount);
-    uint32_t right = buildBvhNode(triBounds, triIndices ,mid, rightCount);
+    ImGui::Text("Leaf sizes:");
+    for (size_t i = 1; i < bvhReport.leafSizeHistogram.size(); i++) {
+        if (bvhReport.leafSizeHistogram[i] == 0) continue;
+        ImGui::Text(" %2zu: %u", i, bvhReport.leafSizeHistogram[i]);
+    }
 
-    bvhNodes[nodeIndex] = {
-        .aabbMin = nodeMin,
-        .aabbMax = nodeMax,
-        .data0 = left,
-        .data1 = right,
-        .isLeaf = 0,
-    };
-    return nodeIndex;
+    return rebuild || recordsToggled;
 }
 
-void Mesh::buildBvh() {
-    bvhNodes.clear();
-    const size_t triCount = indices.size() / 3;
-    if (triCount == 0) return;
-
-    std::vector<TriBounds> triBounds(triCount);
-    for (size_t i = 0; i < triCount; i++) {
-        const glm::vec3 v0 = vertices[indices[i * 3 + 0]].position;
-        const glm::vec3 v1 = vertices[indices[i * 3 + 1]].position;
-        const glm::vec3 v2 = vertices[indices[i * 3 + 2]].position;
-        glm::vec3 mn = glm::min(v0, glm::min(v1, v2));
-        glm::vec3 mx = glm::max(v0, glm::max(v1, v2));
-        triBounds[i] = { mn, mx, (mn + mx) * 0.5f };
-    }
-
-    std::vector<uint32_t> triIndices(triCount);
-    std::iota(triIndices.begin(), triIndices.end(), 0u);
+float Mesh::getArea() {
+    return geometry->getArea();
+}
 
-    buildBvhNode(triBounds, triIndices, 0, triCount);
+bool Mesh::getBounds(glm::vec3 &aabbMin, glm::vec3 &aabbMax) {
+    const std::vector<GpuBvhNode> &bvhNodes = geometry->getBvhNodes();
+    if (bvhNodes.empty()) return false;
+    transformBounds(transform, bvhNodes[0].aabbMin, bvhNodes[0].aabbMax, aabbMin, aabbMax);
+    return true;
+}
 
-    std::vector<unsigned int> reordered(indices.size());
-    for (size_t newTri = 0; newTri < triCount; newTri++) {
-        const size_t oldTri = triIndices[newTri];
-        reordered[newTri * 3 + 0] = indices[oldTri * 3 + 0];
-        reordered[newTri * 3 + 1] = indices[oldTri * 3 + 1];
-        reordered[newTri * 3 + 2] = indices[oldTri * 3 + 2];
+GpuMesh Mesh::getStruct() {
+    mesh.transform = transform;
+    mesh.invTransform = glm::inverse(transform);
+    mesh.indexOffset = -1;  // Computed by the scene
+    mesh.triangleCount = geometry->getTriangleCount();
+    mesh.bvhOffset = 0;     // Computed by the scene
+    mesh.bvhLayout = geometry->getGpuBvhLayout();
+    switch (mesh.bvhLayout) {
+        case BvhLayout::Wide4: mesh.bvhNodeCount = static_cast<uint32_t>(geometry->getBvh4Nodes().size()); break;
+        case BvhLayout::Quantized16:
+        case BvhLayout::Quantized8: mesh.bvhNodeCount = static_cast<uint32_t>(geometry->getQuantizedBvh().size()); break;   // In words
+        default: mesh.bvhNodeCount = static_cast<uint32_t>(geometry->getBvhNodes().size()); break;
     }
-    indices.swap(reordered);
+    mesh.triangleRecordOffset = NO_TRIANGLE_RECORDS;    // Computed by the scene
+    mesh.materialHandle = materialHandle;
+    return mesh;
 }
@@ -1,28 +1,17 @@
 #pragma once
 
+#include <memory>
+
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include "object.hpp"
 #include "material.hpp"
+#include "mesh_geometry.hpp"
 #include "imgui/imgui.h"
 #include "imgui/ImGuizmo.h"
 
-#define LEAF_SIZE 4
-
-struct GpuBvhNode {
-    alignas(16) glm::vec3 aabbMin;
-    alignas(16) glm::vec3 aabbMax;
-    uint32_t data0; // left or first triangle
-    uint32_t data1; // right or triangle count
-    uint32_t isLeaf;
-};
-
-#define BVH_childLeft(node)   (node.data0)
-#define BVH_childRight(node)  (node.data1)
-#define BVH_firstTriangle(node) (node.data0)
-#define BVH_triangleCount(node) (node.data1)
-
+// Per-instance record, the offsets point into the data of the shared geometry
 struct GpuMesh {
     alignas(16) glm::mat4 transform;
     alignas(16) glm::mat4 invTransform;
@@ -30,43 +19,42 @@ struct GpuMesh {
     uint32_t triangleCount;
     uint32_t bvhOffset;
     uint32_t bvhNodeCount;
+    BvhLayout bvhLayout;    // Selects the node buffer `bvhOffset` points into
+    uint32_t triangleRecordOffset;
     MaterialHandle materialHandle;
 };
 
-struct Vertex {
-    alignas(16) glm::vec3 position;
-};
-
+// Instance of a shared geometry with its own transform and material
 class Mesh: public Object {
 public:
-    Mesh(std::string name, std::vector<Vertex> vertices, std::vector<uint32_t> indices, glm::mat4 transform, MaterialHandle materialHandle);
+    Mesh(std::string name, std::shared_ptr<MeshGeometry> geometry, glm::mat4 transform, MaterialHandle materialHandle);
     float rayIntersection(const Ray &ray) override;
+    float rayIntersectionLocal(const Ray &localRay, float tMax, uint32_t &triangle, BvhTraversalStats *stats = nullptr) const {
+        return geometry->rayIntersectionLocal(localRay, tMax, triangle, stats);
+    }
+    bool occludedLocal(const Ray &localRay, float tMin, float tMax, BvhTraversalStats *stats = nullptr) const {
+        return geometry->occludedLocal(localRay, tMin, tMax, stats);
+    }
     bool drawGuizmo(const glm::mat4 &view, const glm::mat4 &proj) override;
     bool drawUI(std::vector<Material> &materials) override;
     
     float getArea() override;
+    bool getBounds(glm::vec3 &aabbMin, glm::vec3 &aabbMax) override;
     GpuMesh getStruct();
-    const std::vector<Vertex>& getVertices() const { return vertices; }
-    const std::vector<uint32_t>& getIndices() const { return indices; }
-    const std::vector<GpuBvhNode>& getBvhNodes() const { return bvhNodes; }
+    const std::shared_ptr<MeshGeometry>& getGeometry() const { return geometry; }
+    void setGeometry(std::shared_ptr<MeshGeometry> geometry_) { geometry = std::move(geometry_); }
+    // Geometry the UI replaced by an updated copy that the other instances should use too, reset once taken
+    std::shared_ptr<MeshGeometry> takeReplacedGeometry() { return std::move(replacedGeometry); }
     const glm::mat4 getTransform() const { return transform; }
     ObjectType getType() override { return ObjectType::Mesh; };
 
 private:
     GpuMesh mesh;
 
-    std::vector<Vertex> vertices;
-    std::vector<uint32_t> indices;
-    std::vector<GpuBvhNode> bvhNodes;
+    std::shared_ptr<MeshGeometry> geometry;
+    std::shared_ptr<MeshGeometry> replacedGeometry;
     glm::mat4 transform;
     MaterialHandle materialHandle;
 
-    struct TriBounds {
-        glm::vec3 min;
-        glm::vec3 max;
-        glm::vec3 centroid;
-    };
-    
-    size_t buildBvhNode(std::vector<TriBounds> &triBounds, std::vector<uint32_t> &triIndices, uint32_t start, uint32_t count);
-    void buildBvh();
+    bool drawBvhUI();
 };
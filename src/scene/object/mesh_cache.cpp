@@ -0,0 +1,157 @@
+#include "mesh_cache.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include "../../utils/hash.hpp"
+#include "../../utils/mapped_file.hpp"
+
+constexpr char MESH_CACHE_MAGIC[8] = { 'V', 'K', 'R', 'M', 'E', 'S', 'H', '\0' };
+
+uint64_t meshCacheKey(const std::string &sourcePath, const BvhBuildSettings &settings) {
+    MappedFile source;
+    if (!source.open(sourcePath)) return 0;
+
+    uint64_t key = hashBytes(source.getData(), source.getSize(), MESH_CACHE_VERSION);
+    // Field by field, the padding of the struct is not initialized. The thread count doesn't change the output,
+    // and the layout is derived from the stored binary nodes when loading, so one entry serves every layout.
+    key = hashValue(key, settings.builder);
+    key = hashValue(key, settings.binCount);
+    key = hashValue(key, settings.maxLeafSize);
+    key = hashValue(key, settings.traversalCost);
+    key = hashValue(key, settings.intersectionCost);
+    return key != 0 ? key : 1;
+}
+
+// Checks every reference a traversal follows, so a corrupted entry is rejected instead of read out of bounds.
+// The builder always stores the children after their parent, which also rules out cycles.
+static bool validMeshCacheData(const std::vector<uint32_t> &indices, size_t vertexCount, const std::vector<GpuBvhNode> &nodes) {
+    for (uint32_t index : indices) {
+        if (index >= vertexCount) return false;
+    }
+    if (nodes.empty() != indices.empty()) return false;
+
+    const size_t triangleCount = indices.size() / 3;
+    std::vector<uint32_t> depths(nodes.size(), 0);
+    for (size_t i = 0; i < nodes.size(); i++) {
+        const GpuBvhNode &node = nodes[i];
+        if (node.isLeaf != 0) {
+            const uint64_t count = BVH_triangleCount(node);
+            if (count == 0 || count > MAX_LEAF_SIZE || BVH_firstTriangle(node) + count > triangleCount) return false;
+            continue;
+        }
+        for (uint32_t child : { BVH_childLeft(node), BVH_childRight(node) }) {
+            if (child <= i || child >= nodes.size()) return false;
+            depths[child] = depths[i] + 1;
+            if (depths[child] >= BVH_STACK_SIZE) return false;
+        }
+    }
+    return true;
+}
+
+std::string meshCachePath(uint64_t key) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+    return std::string(MESH_CACHE_DIR) + "/" + name;
+}
+
+// The file is mapped so the arrays are copied straight from the page cache
+std::shared_ptr<MeshGeometry> loadMeshCache(uint64_t key, const BvhBuildSettings &settings) {
+    if (key == 0) return nullptr;
+
+    const std::string path = meshCachePath(key);
+    MappedFile file;
+    if (!file.open(path)) return nullptr;
+
+    MeshCacheHeader header;
+    if (file.getSize() < sizeof(header)) return nullptr;
+    std::memcpy(&header, file.getData(), sizeof(header));
+
+    // Every count is bounded by the file size before being multiplied, so the expected size can't wrap around
+    const size_t payloadSize = file.getSize() - sizeof(header);
+    const bool countsFit = header.vertexCount <= payloadSize / sizeof(Vertex)
+        && header.indexCount <= payloadSize / sizeof(uint32_t)
+        && header.nodeCount <= payloadSize / sizeof(GpuBvhNode);
+    if (std::memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0
+        || header.version != MESH_CACHE_VERSION
+        || header.vertexSize != sizeof(Vertex)
+        || header.nodeSize != sizeof(GpuBvhNode)
+        || header.key != key
+        || header.indexCount % 3 != 0
+        || !countsFit
+        || payloadSize != header.vertexCount * sizeof(Vertex) + header.indexCount * sizeof(uint32_t) + header.nodeCount * sizeof(GpuBvhNode)) {
+        std::cerr << "[WARN] Ignoring invalid mesh cache " << path << std::endl;
+        return nullptr;
+    }
+
+    const unsigned char *data = file.getData() + sizeof(header);
+    std::vector<Vertex> vertices(header.vertexCount);
+    std::memcpy(static_cast<void*>(vertices.data()), data, vertices.size() * sizeof(Vertex));
+    data += vertices.size() * sizeof(Vertex);
+
+    std::vector<uint32_t> indices(header.indexCount);
+    std::memcpy(indices.data(), data, indices.size() * sizeof(uint32_t));
+    data += indices.size() * sizeof(uint32_t);
+
+    std::vector<GpuBvhNode> nodes(header.nodeCount);
+    std::memcpy(static_cast<void*>(nodes.data()), data, nodes.size() * sizeof(GpuBvhNode));
+
+    if (!validMeshCacheData(indices, vertices.size(), nodes)) {
+        std::cerr << "[WARN] Ignoring invalid mesh cache " << path << std::endl;
+        return nullptr;
+    }
+
+    return std::make_shared<MeshGeometry>(std::move(vertices), std::move(indices), std::move(nodes), settings);
+}
+
+// Written to a temporary file first so a crash never leaves a truncated entry behind
+bool saveMeshCache(uint64_t key, const MeshGeometry &geometry) {
+    if (key == 0) return false;
+
+    std::error_code error;
+    std::filesystem::create_directories(MESH_CACHE_DIR, error);
+    if (error) {
+        std::cerr << "[WARN] Failed to create " << MESH_CACHE_DIR << ": " << error.message() << std::endl;
+        return false;
+    }
+
+    const std::vector<Vertex> &vertices = geometry.getVertices();
+    const std::vector<uint32_t> &indices = geometry.getIndices();
+    const std::vector<GpuBvhNode> &nodes = geometry.getBvhNodes();
+
+    MeshCacheHeader header = {};
+    std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+    header.version = MESH_CACHE_VERSION;
+    header.vertexSize = sizeof(Vertex);
+    header.nodeSize = sizeof(GpuBvhNode);
+    header.key = key;
+    header.vertexCount = vertices.size();
+    header.indexCount = indices.size();
+    header.nodeCount = nodes.size();
+
+    const std::string path = meshCachePath(key);
+    const std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(vertices.data()), vertices.size() * sizeof(Vertex));
+        out.write(reinterpret_cast<const char*>(indices.data()), indices.size() * sizeof(uint32_t));
+        out.write(reinterpret_cast<const char*>(nodes.data()), nodes.size() * sizeof(GpuBvhNode));
+        if (!out) {
+            std::cerr << "[WARN] Failed to write mesh cache " << tmpPath << std::endl;
+            std::filesystem::remove(tmpPath, error);
+            return false;
+        }
+    }
+
+    std::filesystem::rename(tmpPath, path, error);
+    if (error) {
+        std::cerr << "[WARN] Failed to write mesh cache " << path << ": " << error.message() << std::endl;
+        std::filesystem::remove(tmpPath, error);
+        return false;
+    }
+    return true;
+}
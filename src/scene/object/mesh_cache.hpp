@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "mesh_geometry.hpp"
+
+// Built meshes stored on disk so loading a model skips both the OBJ parsing and the BVH build.
+// A file holds a MeshCacheHeader followed by the vertices, the indices in leaf order and the binary BVH nodes.
+// The key covers the content of the source file, the builder settings (not the layout, applied on load) and the format version:
+// bump MESH_CACHE_VERSION whenever the builder output or the stored structs change.
+#define MESH_CACHE_VERSION 2
+#define MESH_CACHE_DIR "cache/mesh"
+
+struct MeshCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t vertexSize;    // sizeof(Vertex) and sizeof(GpuBvhNode) of the writer
+    uint32_t nodeSize;
+    uint32_t reserved;
+    uint64_t key;
+    uint64_t vertexCount;
+    uint64_t indexCount;
+    uint64_t nodeCount;
+};
+
+// 0 if the source file can't be read
+uint64_t meshCacheKey(const std::string &sourcePath, const BvhBuildSettings &settings);
+std::string meshCachePath(uint64_t key);
+
+// Null when there is no valid entry for this key
+std::shared_ptr<MeshGeometry> loadMeshCache(uint64_t key, const BvhBuildSettings &settings);
+bool saveMeshCache(uint64_t key, const MeshGeometry &geometry);
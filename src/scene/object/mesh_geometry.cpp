@@ -0,0 +1,254 @@
+#include "mesh_geometry.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <numeric>
+
+#include "../../utils/parallel.hpp"
+
+MeshGeometry::MeshGeometry(std::vector<Vertex> vertices, std::vector<uint32_t> indices, BvhBuildSettings bvhSettings):
+    vertices(std::move(vertices)), indices(std::move(indices)), bvhSettings(bvhSettings) {
+    buildBvh();
+    area = computeArea();
+}
+
+MeshGeometry::MeshGeometry(std::vector<Vertex> vertices, std::vector<uint32_t> indices, std::vector<GpuBvhNode> bvhNodes, BvhBuildSettings bvhSettings):
+    vertices(std::move(vertices)), indices(std::move(indices)), bvhNodes(std::move(bvhNodes)), bvhSettings(bvhSettings) {
+    bvhReport = computeBvhReport(this->bvhNodes, bvhSettings);
+    encodeBvh();
+    area = computeArea();
+}
+
+
+float rayTriangleIntersection(const Ray &ray, const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2) {
+    return rayTriangleEdgeIntersection(ray, v0, v1 - v0, v2 - v0);
+}
+
+// Same tolerances as `rayTriangleEdgeIntersection` in `objects.glsl` so the CPU renderer finds the same hits
+float rayTriangleEdgeIntersection(const Ray &ray, const glm::vec3 &v0, const glm::vec3 &edge1, const glm::vec3 &edge2) {
+    constexpr float TRI_EPS = 1e-6f;
+    glm::vec3 pvec = glm::cross(ray.dir, edge2);
+    float det = glm::dot(edge1, pvec);
+    if (std::fabs(det) < TRI_EPS)
+        return -1.0f;
+
+    float invDet = 1.0f / det;
+    glm::vec3 tvec = ray.origin - v0;
+    float u = glm::dot(tvec, pvec) * invDet;
+    if (u < -TRI_EPS || u > 1.0f + TRI_EPS)
+        return -1.0f;
+
+    glm::vec3 qvec = glm::cross(tvec, edge1);
+    float v = glm::dot(ray.dir, qvec) * invDet;
+    if (v < -TRI_EPS || (u + v) > 1.0f + TRI_EPS)
+        return -1.0f;
+
+    float t = glm::dot(edge2, qvec) * invDet;
+    return t >= TRI_EPS ? t : -1.0f;
+}
+
+float MeshGeometry::rayIntersectionLocal(const Ray &localRay, float tMax, uint32_t &triangle, BvhTraversalStats *stats) const {
+    auto intersect = [&](uint32_t tri, float) {
+        if (!triangleRecords.empty()) {
+            const GpuTriangle &record = triangleRecords[tri];
+            return rayTriangleEdgeIntersection(localRay, record.v0, record.e1, record.e2);
+        }
+        const glm::vec3 v0 = vertices[indices[tri * 3 + 0]].position;
+        const glm::vec3 v1 = vertices[indices[tri * 3 + 1]].position;
+        const glm::vec3 v2 = vertices[indices[tri * 3 + 2]].position;
+        return rayTriangleIntersection(localRay, v0, v1, v2);
+    };
+
+    switch (getGpuBvhLayout()) {
+        case BvhLayout::Wide4:
+            return traverseBvh4(bvh4Nodes, localRay, tMax, intersect, triangle, stats);
+        case BvhLayout::Quantized16:
+        case BvhLayout::Quantized8:
+            return traverseQuantizedBvh(quantizedBvh, bvhNodeFormat, localRay, tMax, intersect, triangle, stats);
+        default: break;
+    }
+    return traverseBvh(bvhNodes, localRay, tMax, intersect, triangle, stats);
+}
+
+uint32_t MeshGeometry::rayIntersectionPacketLocal(const BvhRay *localRays, uint32_t rayMask, float *tClosest, uint32_t *triangles, BvhTraversalStats *stats) const {
+    uint32_t hitMask = 0;
+    traversePacketBvh(bvhNodes, localRays, rayMask, tClosest, [&](uint32_t tri, uint32_t leafMask) {
+        for (uint32_t mask = leafMask; mask != 0; mask &= mask - 1) {
+            const uint32_t r = std::countr_zero(mask);
+            const Ray localRay = { localRays[r].origin, localRays[r].dir };
+            float t;
+            if (!triangleRecords.empty()) {
+                const GpuTriangle &record = triangleRecords[tri];
+                t = rayTriangleEdgeIntersection(localRay, record.v0, record.e1, record.e2);
+            } else {
+                const glm::vec3 v0 = vertices[indices[tri * 3 + 0]].position;
+                const glm::vec3 v1 = vertices[indices[tri * 3 + 1]].position;
+                const glm::vec3 v2 = vertices[indices[tri * 3 + 2]].position;
+                t = rayTriangleIntersection(localRay, v0, v1, v2);
+            }
+            if (t >= 0.0f && t < tClosest[r]) {
+                tClosest[r] = t;
+                triangles[r] = tri;
+                hitMask |= 1u << r;
+            }
+        }
+    }, stats);
+    return hitMask;
+}
+
+bool MeshGeometry::occludedLocal(const Ray &localRay, float tMin, float tMax, BvhTraversalStats *stats) const {
+    auto occludes = [&](uint32_t tri) {
+        float t;
+        if (!triangleRecords.empty()) {
+            const GpuTriangle &record = triangleRecords[tri];
+            t = rayTriangleEdgeIntersection(localRay, record.v0, record.e1, record.e2);
+        } else {
+            const glm::vec3 v0 = vertices[indices[tri * 3 + 0]].position;
+            const glm::vec3 v1 = vertices[indices[tri * 3 + 1]].position;
+            const glm::vec3 v2 = vertices[indices[tri * 3 + 2]].position;
+            t = rayTriangleIntersection(localRay, v0, v1, v2);
+        }
+        return t >= tMin && t <= tMax;
+    };
+
+    switch (getGpuBvhLayout()) {
+        case BvhLayout::Wide4:
+            return occludedBvh4(bvh4Nodes, localRay, tMax, occludes, stats);
+        case BvhLayout::Quantized16:
+        case BvhLayout::Quantized8:
+            return occludedQuantizedBvh(quantizedBvh, bvhNodeFormat, localRay, tMax, occludes, stats);
+        default: break;
+    }
+    return occludedBvh(bvhNodes, localRay, tMax, occludes, stats);
+}
+
+float MeshGeometry::computeArea() const {
+    float area = 0.0f;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        const glm::vec3 v0 = glm::vec3(vertices[indices[i + 0]].position);
+        const glm::vec3 v1 = glm::vec3(vertices[indices[i + 1]].position);
+        const glm::vec3 v2 = glm::vec3(vertices[indices[i + 2]].position);
+        area += 0.5f * glm::length(glm::cross(v1 - v0, v2 - v0));
+    }
+    return area;
+}
+
+void MeshGeometry::buildBvh() {
+    bvhNodes.clear();
+    bvh4Nodes.clear();
+    quantizedBvh.clear();
+    const size_t triCount = indices.size() / 3;
+    if (triCount == 0) {
+        bvhReport = BvhReport();
+        return;
+    }
+
+    const unsigned threads = resolveThreadCount(bvhSettings.threadCount);
+    const size_t grain = 1 << 14;
+
+    std::vector<BvhPrimitiveBounds> triBounds(triCount);
+    parallelFor(0, triCount, grain, threads, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; i++) {
+            const glm::vec3 v0 = vertices[indices[i * 3 + 0]].position;
+            const glm::vec3 v1 = vertices[indices[i * 3 + 1]].position;
+            const glm::vec3 v2 = vertices[indices[i * 3 + 2]].position;
+            glm::vec3 mn = glm::min(v0, glm::min(v1, v2));
+            glm::vec3 mx = glm::max(v0, glm::max(v1, v2));
+            triBounds[i] = { mn, mx, (mn + mx) * 0.5f };
+        }
+    });
+
+    std::vector<uint32_t> triIndices;
+    ::buildBvh(triBounds, bvhSettings, bvhNodes, triIndices);
+    bvhReport = computeBvhReport(bvhNodes, bvhSettings);
+
+    std::vector<unsigned int> reordered(indices.size());
+    parallelFor(0, triCount, grain, threads, [&](size_t begin, size_t end, size_t) {
+        for (size_t newTri = begin; newTri < end; newTri++) {
+            const size_t oldTri = triIndices[newTri];
+            reordered[newTri * 3 + 0] = indices[oldTri * 3 + 0];
+            reordered[newTri * 3 + 1] = indices[oldTri * 3 + 1];
+            reordered[newTri * 3 + 2] = indices[oldTri * 3 + 2];
+        }
+    });
+    indices.swap(reordered);
+    encodeBvh();
+}
+
+// Layout traversed on top of the binary tree
+void MeshGeometry::encodeBvh() {
+    bvh4Nodes.clear();
+    quantizedBvh.clear();
+    if (bvhNodes.empty()) return;
+    if (bvhSettings.layout == BvhLayout::Wide4)
+        collapseBvh4(bvhNodes, bvh4Nodes);
+    else
+        quantizeBvh(bvhNodes, bvhNodeFormat, quantizedBvh);
+}
+
+BvhLayout MeshGeometry::getGpuBvhLayout() const {
+    if (bvhSettings.layout == BvhLayout::Wide4) return BvhLayout::Wide4;
+    switch (bvhNodeFormat) {
+        case BvhNodeFormat::Quantized16: return BvhLayout::Quantized16;
+        case BvhNodeFormat::Quantized8: return BvhLayout::Quantized8;
+        default: return BvhLayout::Binary;
+    }
+}
+
+size_t MeshGeometry::getGpuBvhBytes() const {
+    switch (getGpuBvhLayout()) {
+        case BvhLayout::Wide4: return bvh4Nodes.size() * sizeof(GpuBvhNode4);
+        case BvhLayout::Quantized16:
+        case BvhLayout::Quantized8: return quantizedBvh.size() * sizeof(uint32_t);
+        default: return bvhNodes.size() * sizeof(GpuBvhNode);
+    }
+}
+
+std::shared_ptr<MeshGeometry> MeshGeometry::withBvhNodeFormat(std::shared_ptr<MeshGeometry> geometry, BvhNodeFormat format) {
+    // A quantized leaf stores its first triangle in QBVH_FIRST_MASK, larger meshes keep the full nodes
+    if (format != BvhNodeFormat::Full && geometry->getTriangleCount() > static_cast<size_t>(QBVH_FIRST_MASK) + 1) {
+        std::cerr << "[WARN] Mesh with " << geometry->getTriangleCount() << " triangles is too large for quantized BVH nodes, keeping full nodes" << std::endl;
+        format = BvhNodeFormat::Full;
+    }
+    if (geometry->bvhNodeFormat == format) return geometry;
+    if (geometry.use_count() > 1) geometry = std::make_shared<MeshGeometry>(*geometry);
+    geometry->setBvhNodeFormat(format);
+    return geometry;
+}
+
+std::shared_ptr<MeshGeometry> MeshGeometry::withTriangleRecords(std::shared_ptr<MeshGeometry> geometry, bool enabled) {
+    if (geometry->hasTriangleRecords() == enabled) return geometry;
+    if (geometry.use_count() > 1) geometry = std::make_shared<MeshGeometry>(*geometry);
+    geometry->setTriangleRecords(enabled);
+    return geometry;
+}
+
+void MeshGeometry::setBvhNodeFormat(BvhNodeFormat format) {
+    if (format == bvhNodeFormat) return;
+    bvhNodeFormat = format;
+    quantizedBvh.clear();
+    if (bvhSettings.layout != BvhLayout::Wide4)
+        quantizeBvh(bvhNodes, bvhNodeFormat, quantizedBvh);
+}
+
+// The indices are already in leaf order after `buildBvh`
+void MeshGeometry::setTriangleRecords(bool enabled) {
+    if (enabled == hasTriangleRecords()) return;
+    triangleRecords.clear();
+    triangleRecords.shrink_to_fit();
+    if (!enabled) return;
+
+    const size_t triCount = getTriangleCount();
+    triangleRecords.resize(triCount);
+    parallelFor(0, triCount, 1 << 14, resolveThreadCount(bvhSettings.threadCount), [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; i++) {
+            const glm::vec3 v0 = vertices[indices[i * 3 + 0]].position;
+            const glm::vec3 v1 = vertices[indices[i * 3 + 1]].position;
+            const glm::vec3 v2 = vertices[indices[i * 3 + 2]].position;
+            triangleRecords[i] = { v0, v1 - v0, v2 - v0 };
+        }
+    });
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "object.hpp"
+#include "../bvh/bvh.hpp"
+#include "../bvh/bvh_builder.hpp"
+#include "../bvh/bvh_quantized.hpp"
+
+struct Vertex {
+    alignas(16) glm::vec3 position;
+};
+
+// First vertex and edges of a triangle, written in BVH leaf order so a leaf is one contiguous read.
+// Must match `TriangleRecord` in `res/shader/raytracing/utils.glsl`
+#define NO_TRIANGLE_RECORDS 0xFFFFFFFFu
+struct GpuTriangle {
+    alignas(16) glm::vec3 v0;
+    alignas(16) glm::vec3 e1;
+    alignas(16) glm::vec3 e2;
+};
+
+float rayTriangleIntersection(const Ray &ray, const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2);
+float rayTriangleEdgeIntersection(const Ray &ray, const glm::vec3 &v0, const glm::vec3 &e1, const glm::vec3 &e2);
+
+// Triangles of a mesh and their BVH, shared by every instance of the mesh.
+// A geometry never changes once shared, so a renderer holding it (e.g. the hybrid CPU worker) can read it at any time:
+// changing the BVH settings builds a new geometry, and the node encoding picked by the scene or the optional
+// triangle records are changed on a copy (`withBvhNodeFormat`, `withTriangleRecords`) that replaces it in the instances.
+class MeshGeometry {
+public:
+    MeshGeometry(std::vector<Vertex> vertices, std::vector<uint32_t> indices, BvhBuildSettings bvhSettings = {});
+    // Already built geometry (e.g. from the mesh cache), the indices must be in the leaf order of `bvhNodes`
+    MeshGeometry(std::vector<Vertex> vertices, std::vector<uint32_t> indices, std::vector<GpuBvhNode> bvhNodes, BvhBuildSettings bvhSettings);
+
+    // Closest hit of a ray expressed in the mesh local space, `triangle` is an index in the BVH order
+    float rayIntersectionLocal(const Ray &localRay, float tMax, uint32_t &triangle, BvhTraversalStats *stats = nullptr) const;
+    // Closest hits of the rays of `rayMask` traversed together through the binary tree, whatever the GPU layout.
+    // Only hits closer than `tClosest` are kept, the rays hit get their distance in `tClosest` and their triangle in `triangles`.
+    // Returns the mask of the rays hit
+    uint32_t rayIntersectionPacketLocal(const BvhRay *localRays, uint32_t rayMask, float *tClosest, uint32_t *triangles, BvhTraversalStats *stats = nullptr) const;
+    // True if any triangle is hit in [tMin, tMax] by a ray expressed in the mesh local space
+    bool occludedLocal(const Ray &localRay, float tMin, float tMax, BvhTraversalStats *stats = nullptr) const;
+
+    const std::vector<Vertex>& getVertices() const { return vertices; }
+    const std::vector<uint32_t>& getIndices() const { return indices; }
+    uint32_t getTriangleCount() const { return static_cast<uint32_t>(indices.size() / 3); }
+    float getArea() const { return area; }     // In the local space
+    const std::vector<GpuBvhNode>& getBvhNodes() const { return bvhNodes; }
+    const std::vector<GpuBvhNode4>& getBvh4Nodes() const { return bvh4Nodes; }   // Empty unless the layout is `Wide4`
+    const std::vector<uint32_t>& getQuantizedBvh() const { return quantizedBvh; }  // Empty unless a quantized format is used
+    const BvhBuildSettings& getBvhSettings() const { return bvhSettings; }
+    const BvhReport& getBvhReport() const { return bvhReport; }
+    BvhNodeFormat getBvhNodeFormat() const { return bvhNodeFormat; }
+    const std::vector<GpuTriangle>& getTriangleRecords() const { return triangleRecords; }
+    bool hasTriangleRecords() const { return !triangleRecords.empty(); }
+    size_t getTriangleRecordBytes() const { return getTriangleCount() * sizeof(GpuTriangle); }     // Also an estimate when disabled
+    BvhLayout getGpuBvhLayout() const;
+    size_t getGpuBvhBytes() const;
+
+    // Copy-on-write updates, `geometry` itself is updated only when the caller holds the last reference to it
+    static std::shared_ptr<MeshGeometry> withBvhNodeFormat(std::shared_ptr<MeshGeometry> geometry, BvhNodeFormat format);
+    static std::shared_ptr<MeshGeometry> withTriangleRecords(std::shared_ptr<MeshGeometry> geometry, bool enabled);
+
+private:
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    float area = 0.0f;
+    std::vector<GpuBvhNode> bvhNodes;
+    std::vector<GpuBvhNode4> bvh4Nodes;
+    std::vector<uint32_t> quantizedBvh;
+    BvhNodeFormat bvhNodeFormat = BvhNodeFormat::Full;  // Set by the scene, only used by the binary layout
+    std::vector<GpuTriangle> triangleRecords;          // Empty unless enabled, same order as the indices
+    BvhBuildSettings bvhSettings;
+    BvhReport bvhReport;
+
+    void buildBvh();
+    void encodeBvh();
+    void setBvhNodeFormat(BvhNodeFormat format);
+    void setTriangleRecords(bool enabled);
+    float computeArea() const;
+};
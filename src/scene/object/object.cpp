@@ -21,6 +21,19 @@ Ray getRay(const glm::vec2 &mousePos, const glm::vec2 &screenSize, const Camera
     return Ray{ camera.getPosition(), dir };
 }
 
+void transformBounds(const glm::mat4 &transform, const glm::vec3 &localMin, const glm::vec3 &localMax, glm::vec3 &aabbMin, glm::vec3 &aabbMax) {
+    const glm::vec3 center = glm::vec3(transform * glm::vec4((localMin + localMax) * 0.5f, 1.0f));
+    const glm::vec3 halfExtent = (localMax - localMin) * 0.5f;
+
+    // Extent of the transformed box along each world axis
+    glm::vec3 worldHalfExtent(0.0f);
+    for (int axis = 0; axis < 3; axis++) {
+        worldHalfExtent += glm::abs(glm::vec3(transform[axis])) * halfExtent[axis];
+    }
+    aabbMin = center - worldHalfExtent;
+    aabbMax = center + worldHalfExtent;
+}
+
 bool isInvalid(glm::mat4 mat) {
     bool invalid = false;
     for (size_t i = 0; i < 4; i++) {
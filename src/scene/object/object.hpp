@@ -73,6 +73,8 @@ public:
     virtual bool drawUI(std::vector<Material> &materials) = 0;
     
     virtual float getArea() = 0;
+    // World space bounding box, returns false if the object is unbounded
+    virtual bool getBounds(glm::vec3 &aabbMin, glm::vec3 &aabbMax) = 0;
     void getStruct(void) {};
     std::string getName() { return name; }
     void setName(std::string newName) { name = newName; }
@@ -83,3 +85,4 @@ protected:
 };
 
 bool isInvalid(glm::mat4 mat);
+void transformBounds(const glm::mat4 &transform, const glm::vec3 &localMin, const glm::vec3 &localMax, glm::vec3 &aabbMin, glm::vec3 &aabbMax);
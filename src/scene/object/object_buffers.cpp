@@ -1,22 +1,25 @@
 #include "object_buffers.hpp"
 
 
-void ObjectBuffers::init(VkSmol &engine, size_t _objectSize, size_t _baseSize) {
+void ObjectBuffers::init(VkSmol &engine, size_t _objectSize, size_t _baseSize, bool _headless) {
     count = 0;
     capacity = 2;
     objectSize = _objectSize;
     baseSize = _baseSize;
+    headless = _headless;
 
+    if (headless) return;
     bufferList = engine.initBufferList(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, baseSize + objectSize * capacity);
 }
 
 void ObjectBuffers::destroy(VkSmol &engine) {
+    if (headless) return;
     engine.destroyBufferList(bufferList);
 }
 
 void ObjectBuffers::clear(VkSmol &engine) {
-    engine.destroyBufferList(bufferList);
-    init(engine, objectSize, baseSize);
+    if (!headless) engine.destroyBufferList(bufferList);
+    init(engine, objectSize, baseSize, headless);
 }
 
 bool ObjectBuffers::addElement(VkSmol &engine) {
@@ -48,6 +51,10 @@ void ObjectBuffers::removeElement() {
 }
 
 void ObjectBuffers::resize(VkSmol &engine, size_t newCapacity) {
+    if (headless) {
+        capacity = newCapacity;
+        return;
+    }
     engine.waitIdle();
     engine.destroyBufferList(bufferList);
     capacity = newCapacity;
@@ -55,5 +62,10 @@ void ObjectBuffers::resize(VkSmol &engine, size_t newCapacity) {
 }
 
 void ObjectBuffers::fill(VkSmol &engine, void *data) {
+    if (headless) {
+        const char *bytes = static_cast<const char*>(data);
+        hostData.assign(bytes, bytes + baseSize + objectSize * capacity);
+        return;
+    }
     engine.fillBuffer(engine.getBuffer(bufferList), data);
 }
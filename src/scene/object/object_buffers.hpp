@@ -1,10 +1,14 @@
 #pragma once
 
+#include <vector>
+
 #include "../../engine/engine.hpp"
 
+// Storage buffer of a type of element, grown by powers of two.
+// Headless buffers never touch the engine, they keep the last filled data on the host instead (e.g. for an offscreen renderer).
 class ObjectBuffers {
 public:
-    void init(VkSmol &engine, size_t objectSize, size_t baseSize = 0);
+    void init(VkSmol &engine, size_t objectSize, size_t baseSize = 0, bool headless = false);
     void destroy(VkSmol &engine);
     void clear(VkSmol &engine);
 
@@ -17,6 +21,8 @@ public:
     size_t getCapacity() { return capacity; }
     size_t getCount() { return count; }
     bufferList_t getBufferList() { return bufferList; }
+    // Header and `capacity` elements, empty until the first `fill` of a headless buffer
+    const std::vector<char>& getHostData() const { return hostData; }
 
 private:
     bufferList_t bufferList;
@@ -25,4 +31,6 @@ private:
 
     size_t objectSize;
     size_t baseSize;
+    bool headless = false;
+    std::vector<char> hostData;
 };
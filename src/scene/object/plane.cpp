@@ -72,6 +72,10 @@ float Plane::getArea() {
     return 0.0;
 }
 
+bool Plane::getBounds(glm::vec3 &aabbMin, glm::vec3 &aabbMax) {
+    return false;
+}
+
 GpuPlane Plane::getStruct() {
     plane.point = point;
     plane.normal = normal;
@@ -73,6 +73,12 @@ float Sphere::getArea() {
     return 4.0 * glm::pi<float>() * radius * radius;
 }
 
+bool Sphere::getBounds(glm::vec3 &aabbMin, glm::vec3 &aabbMax) {
+    aabbMin = center - glm::vec3(radius);
+    aabbMax = center + glm::vec3(radius);
+    return true;
+}
+
 GpuSphere Sphere::getStruct() {
     sphere.center = center;
     sphere.radius = radius;
@@ -22,6 +22,7 @@ public:
     bool drawUI(std::vector<Material> &materials) override;
     
     float getArea() override;
+    bool getBounds(glm::vec3 &aabbMin, glm::vec3 &aabbMax) override;
     GpuSphere getStruct();
     ObjectType getType() override { return ObjectType::Sphere; };
 
@@ -2,29 +2,48 @@
 // 001000000
 
 #include "scene.hpp"
+#include "object/mesh_cache.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <cstring>
+#include <unordered_map>
+#include <unordered_set>
 #include <glm/gtc/matrix_transform.hpp>
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
 
 constexpr size_t OBJECT_HEADER_SIZE = sizeof(unsigned int) + sizeof(int);
-constexpr size_t LIGHT_HEADER_SIZE = sizeof(float);
-
-void Scene::init(VkSmol &engine) {
-    sphereBuffers.init(engine, sizeof(GpuSphere));
-    planeBuffers.init(engine, sizeof(GpuPlane));
-    boxBuffers.init(engine, sizeof(GpuBox));
-    vertexBuffers.init(engine, sizeof(Vertex));
-    indexBuffers.init(engine, sizeof(unsigned int));
-    bvhBuffers.init(engine, sizeof(GpuBvhNode));
-    meshBuffers.init(engine, sizeof(GpuMesh));
-
-    materialBuffers.init(engine, sizeof(Material));
-    objectBuffers.init(engine, sizeof(ObjectHandle), OBJECT_HEADER_SIZE);
-    lightBuffers.init(engine, sizeof(GpuLight), LIGHT_HEADER_SIZE);
+constexpr size_t LIGHT_HEADER_SIZE = sizeof(float) + sizeof(int);
+constexpr size_t TLAS_INDEX_HEADER_SIZE = 3 * sizeof(uint32_t);
+
+// At most a few objects per leaf, more only when the depth cap forces a median split, so the box of a leaf
+// stays close to the world boxes of its objects and is tested before the objects themselves
+const BvhBuildSettings TLAS_BUILD_SETTINGS = {
+    .builder = BvhBuilderType::BinnedSah,
+    .binCount = 16,
+    .maxLeafSize = 1,
+};
+
+void Scene::init(VkSmol &engine, bool headless_) {
+    headless = headless_;
+    sphereBuffers.init(engine, sizeof(GpuSphere), 0, headless);
+    planeBuffers.init(engine, sizeof(GpuPlane), 0, headless);
+    boxBuffers.init(engine, sizeof(GpuBox), 0, headless);
+    vertexBuffers.init(engine, sizeof(Vertex), 0, headless);
+    indexBuffers.init(engine, sizeof(unsigned int), 0, headless);
+    bvhBuffers.init(engine, sizeof(GpuBvhNode), 0, headless);
+    meshBuffers.init(engine, sizeof(GpuMesh), 0, headless);
+
+    materialBuffers.init(engine, sizeof(Material), 0, headless);
+    objectBuffers.init(engine, sizeof(ObjectHandle), OBJECT_HEADER_SIZE, headless);
+    lightBuffers.init(engine, sizeof(GpuLight), LIGHT_HEADER_SIZE, headless);
+    tlasBuffers.init(engine, sizeof(GpuBvhNode), 0, headless);
+    tlasIndexBuffers.init(engine, sizeof(uint32_t), TLAS_INDEX_HEADER_SIZE, headless);
+    bvh4Buffers.init(engine, sizeof(GpuBvhNode4), 0, headless);
+    quantizedBvhBuffers.init(engine, sizeof(uint32_t), 0, headless);
+    triangleBuffers.init(engine, sizeof(GpuTriangle), 0, headless);
 }
 
 void Scene::destroy(VkSmol &engine) {
@@ -39,10 +58,15 @@ void Scene::destroy(VkSmol &engine) {
     materialBuffers.destroy(engine);
     objectBuffers.destroy(engine);
     lightBuffers.destroy(engine);
+    tlasBuffers.destroy(engine);
+    tlasIndexBuffers.destroy(engine);
+    bvh4Buffers.destroy(engine);
+    quantizedBvhBuffers.destroy(engine);
+    triangleBuffers.destroy(engine);
 }
 
 void Scene::clear(VkSmol &engine) {
-    engine.waitIdle();
+    if (!headless) engine.waitIdle();
     
     sphereBuffers.clear(engine);
     planeBuffers.clear(engine);
@@ -55,6 +79,11 @@ void Scene::clear(VkSmol &engine) {
     materialBuffers.clear(engine);
     objectBuffers.clear(engine);
     lightBuffers.clear(engine);
+    tlasBuffers.clear(engine);
+    tlasIndexBuffers.clear(engine);
+    bvh4Buffers.clear(engine);
+    quantizedBvhBuffers.clear(engine);
+    triangleBuffers.clear(engine);
 
     objects.clear();
     materials.clear();
@@ -98,16 +127,40 @@ void Scene::pushBoxTransform(VkSmol &engine, std::string name, const glm::mat4 &
     materials.push_back(mat);
 }
 
-void Scene::pushMesh(VkSmol &engine, std::string name, std::vector<Vertex> vertices, std::vector<unsigned int> indices, glm::mat4 transform, Material mat) {
+std::shared_ptr<MeshGeometry> Scene::buildMeshGeometry(const std::string &name, std::vector<Vertex> vertices, std::vector<unsigned int> indices, const BvhBuildSettings &bvhSettings) {
+    auto geometry = std::make_shared<MeshGeometry>(std::move(vertices), std::move(indices), bvhSettings);
+
+    if (verbose) {
+        std::string report = "BVH of " + name + ": " + formatBvhReport(geometry->getBvhReport());
+        std::cout << "[INFO] " << report << std::endl;
+        if (messageCallback) messageCallback(NotificationType::Info, report);
+    }
+    return geometry;
+}
+
+void Scene::pushMesh(VkSmol &engine, std::string name, std::vector<Vertex> vertices, std::vector<unsigned int> indices, glm::mat4 transform, Material mat, const BvhBuildSettings &bvhSettings) {
+    pushMeshInstance(engine, name, buildMeshGeometry(name, std::move(vertices), std::move(indices), bvhSettings), transform, mat);
+}
+
+// The geometry is uploaded once whatever the number of instances using it
+void Scene::pushMeshInstance(VkSmol &engine, std::string name, std::shared_ptr<MeshGeometry> geometry, glm::mat4 transform, Material mat) {
     bufferUpdated |= meshBuffers.addElement(engine);
     bufferUpdated |= materialBuffers.addElement(engine);
     bufferUpdated |= objectBuffers.addElement(engine);
 
-    objects.push_back(new Mesh(name, std::move(vertices), std::move(indices), transform, static_cast<int>(materials.size())));
+    geometry = MeshGeometry::withBvhNodeFormat(std::move(geometry), bvhNodeFormat);
+    objects.push_back(new Mesh(name, std::move(geometry), transform, static_cast<int>(materials.size())));
     materials.push_back(mat);
 }
 
-bool Scene::pushMeshFromObj(VkSmol &engine, const std::string &name, const std::string &path, Material mat, const glm::mat4 &transform) {
+bool Scene::pushMeshFromObj(VkSmol &engine, const std::string &name, const std::string &path, Material mat, const glm::mat4 &transform, const BvhBuildSettings &bvhSettings) {
+    const uint64_t cacheKey = meshCacheEnabled ? meshCacheKey(path, bvhSettings) : 0;
+    if (std::shared_ptr<MeshGeometry> cached = loadMeshCache(cacheKey, bvhSettings)) {
+        std::cout << "[INFO] Loaded " << path << " from " << meshCachePath(cacheKey) << std::endl;
+        pushMeshInstance(engine, name, std::move(cached), transform, mat);
+        return true;
+    }
+
     std::string baseDir = "./";
     size_t slash = path.find_last_of("/\\");
     if (slash != std::string::npos) {
@@ -158,7 +211,9 @@ bool Scene::pushMeshFromObj(VkSmol &engine, const std::string &name, const std::
         }
     }
 
-    pushMesh(engine, name, std::move(meshVertices), std::move(meshIndices), transform, mat);
+    std::shared_ptr<MeshGeometry> geometry = buildMeshGeometry(name, std::move(meshVertices), std::move(meshIndices), bvhSettings);
+    if (cacheKey != 0) saveMeshCache(cacheKey, *geometry);
+    pushMeshInstance(engine, name, std::move(geometry), transform, mat);
     return true;
 }
 
@@ -175,23 +230,71 @@ inline void addLight(const Material &mat, const float &area, const int &objectId
     }
 };
 
+void Scene::buildTlas(const std::vector<Object*> &orderedObjects) {
+    std::vector<BvhPrimitiveBounds> bounds;
+    std::vector<uint32_t> boundedIds, unboundedIds;
+    bounds.reserve(orderedObjects.size());
+    for (size_t i = 0; i < orderedObjects.size(); i++) {
+        glm::vec3 aabbMin, aabbMax;
+        if (orderedObjects[i]->getBounds(aabbMin, aabbMax)) {
+            bounds.push_back({ aabbMin, aabbMax, (aabbMin + aabbMax) * 0.5f });
+            boundedIds.push_back(static_cast<uint32_t>(i));
+        } else {
+            unboundedIds.push_back(static_cast<uint32_t>(i));
+        }
+    }
+
+    // The BVH only depends on the bounds, it is kept as long as no object moved, appeared or disappeared
+    auto sameBounds = [](const BvhPrimitiveBounds &a, const BvhPrimitiveBounds &b) {
+        return a.min == b.min && a.max == b.max;
+    };
+    if (boundedIds != tlasBoundedIds || !std::equal(bounds.begin(), bounds.end(), tlasBounds.begin(), tlasBounds.end(), sameBounds)) {
+        buildBvh(bounds, TLAS_BUILD_SETTINGS, tlasNodes, tlasOrder);
+        tlasBounds = std::move(bounds);
+        tlasBoundedIds = boundedIds;
+    }
+
+    tlasObjectIds.clear();
+    tlasObjectIds.reserve(orderedObjects.size());
+    for (uint32_t primitive : tlasOrder) {
+        tlasObjectIds.push_back(boundedIds[primitive]);
+    }
+    tlasObjectIds.insert(tlasObjectIds.end(), unboundedIds.begin(), unboundedIds.end());
+    tlasBoundedCount = static_cast<uint32_t>(boundedIds.size());
+}
+
 // TODO: Only refill them after an update (not every frame)
 void Scene::fillBuffers(VkSmol &engine) {
     size_t totalVertices = 0;
     size_t totalIndices = 0;
     size_t totalBvhNodes = 0;
+    size_t totalBvh4Nodes = 0;
+    size_t totalQuantizedWords = 0;
+    size_t totalTriangleRecords = 0;
+    // Instances sharing a geometry upload it once
+    std::unordered_set<const MeshGeometry*> uniqueGeometries;
     for (Object *object : objects) {
         if (object->getType() == ObjectType::Mesh) {
-            Mesh *mesh = static_cast<Mesh*>(object);
-            totalVertices += mesh->getVertices().size();
-            totalIndices += mesh->getIndices().size();
-            totalBvhNodes += mesh->getBvhNodes().size();
+            const MeshGeometry *geometry = static_cast<Mesh*>(object)->getGeometry().get();
+            if (!uniqueGeometries.insert(geometry).second) continue;
+            totalVertices += geometry->getVertices().size();
+            totalIndices += geometry->getIndices().size();
+            totalTriangleRecords += geometry->getTriangleRecords().size();
+            switch (geometry->getGpuBvhLayout()) {
+                case BvhLayout::Wide4: totalBvh4Nodes += geometry->getBvh4Nodes().size(); break;
+                case BvhLayout::Quantized16:
+                case BvhLayout::Quantized8: totalQuantizedWords += geometry->getQuantizedBvh().size(); break;
+                default: totalBvhNodes += geometry->getBvhNodes().size(); break;
+            }
         }
     }
 
     bufferUpdated |= vertexBuffers.setElementCount(engine, totalVertices);
     bufferUpdated |= indexBuffers.setElementCount(engine, totalIndices);
     bufferUpdated |= bvhBuffers.setElementCount(engine, totalBvhNodes);
+    bufferUpdated |= bvh4Buffers.setElementCount(engine, totalBvh4Nodes);
+    bufferUpdated |= quantizedBvhBuffers.setElementCount(engine, totalQuantizedWords);
+    bufferUpdated |= triangleBuffers.setElementCount(engine, totalTriangleRecords);
 
     std::vector<GpuSphere> spheres(sphereBuffers.getCapacity());
     std::vector<GpuPlane> planes(planeBuffers.getCapacity());
@@ -199,6 +302,9 @@ void Scene::fillBuffers(VkSmol &engine) {
     std::vector<Vertex> vertices(vertexBuffers.getCapacity());
     std::vector<uint32_t> indices(indexBuffers.getCapacity());
     std::vector<GpuBvhNode> bvhNodes(bvhBuffers.getCapacity());
+    std::vector<GpuBvhNode4> bvh4Nodes(bvh4Buffers.getCapacity());
+    std::vector<uint32_t> quantizedWords(quantizedBvhBuffers.getCapacity());
+    std::vector<GpuTriangle> triangleRecords(triangleBuffers.getCapacity());
     std::vector<GpuMesh> meshes(meshBuffers.getCapacity());
     std::vector<Material> materialData(materialBuffers.getCapacity());
     std::vector<ObjectHandle> objectHandles(objectBuffers.getCapacity());
@@ -214,6 +320,11 @@ void Scene::fillBuffers(VkSmol &engine) {
     uint32_t vertexOffset = 0;
     uint32_t indexOffset = 0;
     uint32_t bvhOffset = 0;
+    uint32_t bvh4Offset = 0;
+    uint32_t quantizedOffset = 0;
+    uint32_t triangleRecordOffset = 0;
+    struct GeometryOffsets { uint32_t indexOffset, bvhOffset, triangleRecordOffset; };
+    std::unordered_map<const MeshGeometry*, GeometryOffsets> geometryOffsets;
     
     for (Object *object : objects) {
         switch(object->getType()) {
@@ -240,38 +351,76 @@ void Scene::fillBuffers(VkSmol &engine) {
             } break;
             case ObjectType::Mesh: {
                 Mesh *mesh = static_cast<Mesh*>(object);
-                const std::vector<Vertex> &meshVerts = mesh->getVertices();
-                const std::vector<uint32_t> &meshIndices = mesh->getIndices();
-                const std::vector<GpuBvhNode> &meshBvhNodes = mesh->getBvhNodes();
+                const MeshGeometry *geometry = mesh->getGeometry().get();
+                GpuMesh meshStruct = mesh->getStruct();
 
-                for (size_t i = 0; i < meshVerts.size(); i++) {
-                    vertices[vertexOffset + i] = meshVerts[i];
-                }
-                for (size_t i = 0; i < meshIndices.size(); i++) {
-                    indices[indexOffset + i] = meshIndices[i] + vertexOffset;
-                }
-                for (size_t i = 0; i < meshBvhNodes.size(); i++) {
-                    GpuBvhNode node = meshBvhNodes[i];
-                    if (node.isLeaf != 0) {
-                        node.data0 = static_cast<size_t>(node.data0 + (indexOffset / 3));
+                auto uploaded = geometryOffsets.find(geometry);
+                if (uploaded == geometryOffsets.end()) {
+                    const std::vector<Vertex> &meshVerts = geometry->getVertices();
+                    const std::vector<uint32_t> &meshIndices = geometry->getIndices();
+                    const BvhLayout layout = geometry->getGpuBvhLayout();
+                    GeometryOffsets offsets = { indexOffset, 0, NO_TRIANGLE_RECORDS };
+
+                    for (size_t i = 0; i < meshVerts.size(); i++) {
+                        vertices[vertexOffset + i] = meshVerts[i];
+                    }
+                    for (size_t i = 0; i < meshIndices.size(); i++) {
+                        indices[indexOffset + i] = meshIndices[i] + vertexOffset;
+                    }
+
+                    if (layout == BvhLayout::Quantized16 || layout == BvhLayout::Quantized8) {
+                        // Node and triangle indices are relative to the mesh, the shader adds the offsets
+                        const std::vector<uint32_t> &meshWords = geometry->getQuantizedBvh();
+                        std::copy(meshWords.begin(), meshWords.end(), quantizedWords.begin() + quantizedOffset);
+                        offsets.bvhOffset = quantizedOffset;
+                        quantizedOffset += static_cast<uint32_t>(meshWords.size());
+                    } else if (layout == BvhLayout::Wide4) {
+                        const std::vector<GpuBvhNode4> &meshBvhNodes = geometry->getBvh4Nodes();
+                        for (size_t i = 0; i < meshBvhNodes.size(); i++) {
+                            GpuBvhNode4 node = meshBvhNodes[i];
+                            for (int c = 0; c < 4; c++) {
+                                if (node.child[c] == BVH4_INVALID) continue;
+                                node.child[c] += node.count[c] != 0 ? indexOffset / 3 : bvh4Offset;
+                            }
+                            bvh4Nodes[bvh4Offset + i] = node;
+                        }
+                        offsets.bvhOffset = bvh4Offset;
+                        bvh4Offset += static_cast<uint32_t>(meshBvhNodes.size());
                     } else {
-                        node.data0 = static_cast<size_t>(node.data0 + bvhOffset);
-                        node.data1 = static_cast<size_t>(node.data1 + bvhOffset);
+                        const std::vector<GpuBvhNode> &meshBvhNodes = geometry->getBvhNodes();
+                        for (size_t i = 0; i < meshBvhNodes.size(); i++) {
+                            GpuBvhNode node = meshBvhNodes[i];
+                            if (node.isLeaf != 0) {
+                                node.data0 = static_cast<size_t>(node.data0 + indexOffset / 3);
+                            } else {
+                                node.data0 = static_cast<size_t>(node.data0 + bvhOffset);
+                                node.data1 = static_cast<size_t>(node.data1 + bvhOffset);
+                            }
+                            bvhNodes[bvhOffset + i] = node;
+                        }
+                        offsets.bvhOffset = bvhOffset;
+                        bvhOffset += static_cast<uint32_t>(meshBvhNodes.size());
+                    }
+
+                    if (geometry->hasTriangleRecords()) {
+                        const std::vector<GpuTriangle> &meshTriangles = geometry->getTriangleRecords();
+                        std::copy(meshTriangles.begin(), meshTriangles.end(), triangleRecords.begin() + triangleRecordOffset);
+                        offsets.triangleRecordOffset = triangleRecordOffset;
+                        triangleRecordOffset += static_cast<uint32_t>(meshTriangles.size());
                     }
-                    bvhNodes[bvhOffset + i] = node;
+
+                    vertexOffset += static_cast<uint32_t>(meshVerts.size());
+                    indexOffset += static_cast<uint32_t>(meshIndices.size());
+                    uploaded = geometryOffsets.emplace(geometry, offsets).first;
                 }
 
-                GpuMesh meshStruct = mesh->getStruct();
-                meshStruct.indexOffset = indexOffset;
-                meshStruct.bvhOffset = bvhOffset;
+                meshStruct.indexOffset = uploaded->second.indexOffset;
+                meshStruct.bvhOffset = uploaded->second.bvhOffset;
+                meshStruct.triangleRecordOffset = uploaded->second.triangleRecordOffset;
                 meshes[meshId] = meshStruct;
 
                 addLight(materials[meshStruct.materialHandle], object->getArea(), objectCount, lightCount, lights, totalLightArea);
                 objectHandles[objectCount] = { .type=ObjectType::Mesh, .id=meshId };
-
-                vertexOffset += static_cast<uint32_t>(meshVerts.size());
-                indexOffset += static_cast<uint32_t>(meshIndices.size());
-                bvhOffset += static_cast<uint32_t>(meshBvhNodes.size());
                 meshId++;
                 objectCount++;
             } break;
@@ -280,6 +429,10 @@ void Scene::fillBuffers(VkSmol &engine) {
     }
     bufferUpdated |= lightBuffers.setElementCount(engine, lightCount);
 
+    buildTlas(objects);
+    bufferUpdated |= tlasBuffers.setElementCount(engine, tlasNodes.size());
+    bufferUpdated |= tlasIndexBuffers.setElementCount(engine, tlasObjectIds.size());
+
     for (size_t i = 0; i < materials.size() && i < materialData.size(); i++) {
         materialData[i] = materials[i];
     }
@@ -295,6 +448,9 @@ void Scene::fillBuffers(VkSmol &engine) {
     indexBuffers.fill(engine, indices.data());
     meshBuffers.fill(engine, meshes.data());
     bvhBuffers.fill(engine, bvhNodes.data());
+    bvh4Buffers.fill(engine, bvh4Nodes.data());
+    quantizedBvhBuffers.fill(engine, quantizedWords.data());
+    triangleBuffers.fill(engine, triangleRecords.data());
 
     size_t offset;
     
@@ -313,12 +469,65 @@ void Scene::fillBuffers(VkSmol &engine) {
     offset = 0;
     memcpy(lightData.data() + offset, &totalLightArea, sizeof(totalLightArea));
     offset += sizeof(totalLightArea);
+    memcpy(lightData.data() + offset, &lightCount, sizeof(lightCount));
+    offset += sizeof(lightCount);
     memcpy(lightData.data() + offset, lights.data(), lights.size() * sizeof(GpuLight));
         
     lightBuffers.fill(engine, lightData.data());
+
+    std::vector<GpuBvhNode> tlasData(tlasBuffers.getCapacity());
+    std::copy(tlasNodes.begin(), tlasNodes.end(), tlasData.begin());
+    tlasBuffers.fill(engine, tlasData.data());
+
+    std::vector<char> tlasIndexData(TLAS_INDEX_HEADER_SIZE + sizeof(uint32_t) * tlasIndexBuffers.getCapacity(), 0);
+    uint32_t tlasHeader[3] = {
+        static_cast<uint32_t>(tlasNodes.size()),
+        tlasBoundedCount,
+        static_cast<uint32_t>(tlasObjectIds.size()) - tlasBoundedCount,
+    };
+    memcpy(tlasIndexData.data(), tlasHeader, sizeof(tlasHeader));
+    memcpy(tlasIndexData.data() + TLAS_INDEX_HEADER_SIZE, tlasObjectIds.data(), tlasObjectIds.size() * sizeof(uint32_t));
+    tlasIndexBuffers.fill(engine, tlasIndexData.data());
 }
 
 
+void Scene::setBvhNodeFormat(BvhNodeFormat format) {
+    if (format == bvhNodeFormat) return;
+    bvhNodeFormat = format;
+    // Instances sharing a geometry keep sharing its updated copy
+    std::unordered_map<const MeshGeometry*, std::shared_ptr<MeshGeometry>> updatedGeometries;
+    for (Object *object : objects) {
+        if (object->getType() != ObjectType::Mesh) continue;
+        Mesh *mesh = static_cast<Mesh*>(object);
+        std::shared_ptr<MeshGeometry> &updatedGeometry = updatedGeometries[mesh->getGeometry().get()];
+        if (!updatedGeometry) updatedGeometry = MeshGeometry::withBvhNodeFormat(mesh->getGeometry(), format);
+        mesh->setGeometry(updatedGeometry);
+    }
+    updated = true;
+
+    std::string report = "BVH memory: " + formatBvhMemoryReport(getBvhMemoryReport());
+    std::cout << "[INFO] " << report << std::endl;
+    if (messageCallback) messageCallback(NotificationType::Info, report);
+}
+
+// Full binary nodes against what is actually uploaded for every geometry
+BvhMemoryReport Scene::getBvhMemoryReport() {
+    BvhMemoryReport report;
+    std::unordered_set<const MeshGeometry*> counted;
+    for (Object *object : objects) {
+        if (object->getType() != ObjectType::Mesh) continue;
+        const MeshGeometry *geometry = static_cast<Mesh*>(object)->getGeometry().get();
+        if (!counted.insert(geometry).second) continue;
+        addBvhMemoryReport(
+            report,
+            geometry->getTriangleCount(),
+            geometry->getBvhNodes().size() * sizeof(GpuBvhNode),
+            geometry->getGpuBvhBytes()
+        );
+    }
+    return report;
+}
+
 void Scene::drawGuizmo(const glm::mat4 &view, const glm::mat4 &proj) {
     if (selectedObjectId < 0) return;
     ImGuizmo::PushID(selectedObjectId); // To isolate the state of the gizmo
@@ -327,6 +536,15 @@ void Scene::drawGuizmo(const glm::mat4 &view, const glm::mat4 &proj) {
 }
 
 void Scene::drawUI(VkSmol &engine) {
+    const char *bvhFormats[] = { "BVH nodes: full", "BVH nodes: 16-bit", "BVH nodes: 8-bit" };
+    int currentBvhFormat = static_cast<int>(bvhNodeFormat);
+    ImGui::PushItemWidth(-FLT_MIN);
+    if (ImGui::Combo("##Bvh Format", &currentBvhFormat, bvhFormats, IM_ARRAYSIZE(bvhFormats)))
+        setBvhNodeFormat(static_cast<BvhNodeFormat>(currentBvhFormat));
+    ImGui::PopItemWidth();
+    if (bvhNodeFormat != BvhNodeFormat::Full)
+        ImGui::TextDisabled("%s", formatBvhMemoryReport(getBvhMemoryReport()).c_str());
+
     if (ImGui::Button("Add object", { -FLT_MIN, 0 }) && !ImGui::IsPopupOpen("New Object")) {
         ImGui::OpenPopup("New Object");
     }
@@ -440,6 +658,15 @@ void Scene::drawSelectedUI(VkSmol &engine) {
         objects[selectedObjectId]->setName(std::string(buff));
         
         updated |= objects[selectedObjectId]->drawUI(materials);
+        if (objects[selectedObjectId]->getType() == ObjectType::Mesh) {
+            Mesh *mesh = static_cast<Mesh*>(objects[selectedObjectId]);
+            if (std::shared_ptr<MeshGeometry> replaced = mesh->takeReplacedGeometry()) {
+                for (Object *object : objects) {
+                    if (object->getType() == ObjectType::Mesh && static_cast<Mesh*>(object)->getGeometry() == replaced)
+                        static_cast<Mesh*>(object)->setGeometry(mesh->getGeometry());
+                }
+            }
+        }
         
         ImGui::Separator();
         if (ImGui::Button("Clone", { -FLT_MIN, 0 })) {
@@ -475,11 +702,10 @@ void Scene::drawSelectedUI(VkSmol &engine) {
                 } break;
                 case ObjectType::Mesh: {
                     Mesh *mesh = static_cast<Mesh*>(objects[selectedObjectId]);
-                    pushMesh(
+                    pushMeshInstance(
                         engine,
                         mesh->getName() + "-copy",
-                        mesh->getVertices(),
-                        mesh->getIndices(),
+                        mesh->getGeometry(),
                         mesh->getTransform(),
                         materials[mesh->getStruct().materialHandle]
                     );
@@ -547,12 +773,37 @@ std::vector<bufferList_t> Scene::getBufferLists() {
         materialBuffers.getBufferList(),
         objectBuffers.getBufferList(),
         lightBuffers.getBufferList(),
+        tlasBuffers.getBufferList(),
+        tlasIndexBuffers.getBufferList(),
+        bvh4Buffers.getBufferList(),
+        quantizedBvhBuffers.getBufferList(),
+        triangleBuffers.getBufferList(),
     };
 
 
     return bufferLists;
 }
 
+std::vector<const std::vector<char>*> Scene::getHostBuffers() const {
+    return {
+        &sphereBuffers.getHostData(),
+        &planeBuffers.getHostData(),
+        &boxBuffers.getHostData(),
+        &vertexBuffers.getHostData(),
+        &indexBuffers.getHostData(),
+        &bvhBuffers.getHostData(),
+        &meshBuffers.getHostData(),
+        &materialBuffers.getHostData(),
+        &objectBuffers.getHostData(),
+        &lightBuffers.getHostData(),
+        &tlasBuffers.getHostData(),
+        &tlasIndexBuffers.getHostData(),
+        &bvh4Buffers.getHostData(),
+        &quantizedBvhBuffers.getHostData(),
+        &triangleBuffers.getHostData(),
+    };
+}
+
 bool Scene::checkUpdate() {
     if (updated) {
         updated = false;
@@ -28,7 +28,8 @@ enum LightMode : int {
 
 class Scene {
 public:
-    void init(VkSmol &engine);
+    // A headless scene never touches the engine, e.g. for the CPU renderer
+    void init(VkSmol &engine, bool headless = false);
     void destroy(VkSmol &engine);
     void clear(VkSmol &engine);
 
@@ -41,10 +42,21 @@ public:
     void pushPlane(VkSmol &engine, std::string name, glm::vec3 point, glm::vec3 normal, Material mat);
     void pushBox(VkSmol &engine, std::string name, glm::vec3 cornerMin, glm::vec3 cornerMax, Material mat);
     void pushBoxTransform(VkSmol &engine, std::string name, const glm::mat4 &transform, Material mat);
-    void pushMesh(VkSmol &engine, std::string name, std::vector<Vertex> vertices, std::vector<unsigned int> indices, glm::mat4 transform, Material mat);
-    bool pushMeshFromObj(VkSmol &engine, const std::string &name, const std::string &path, Material mat, const glm::mat4 &transform = glm::mat4(1.0f));
+    void pushMesh(VkSmol &engine, std::string name, std::vector<Vertex> vertices, std::vector<unsigned int> indices, glm::mat4 transform, Material mat, const BvhBuildSettings &bvhSettings = BvhBuildSettings());
+    void pushMeshInstance(VkSmol &engine, std::string name, std::shared_ptr<MeshGeometry> geometry, glm::mat4 transform, Material mat);
+    bool pushMeshFromObj(VkSmol &engine, const std::string &name, const std::string &path, Material mat, const glm::mat4 &transform = glm::mat4(1.0f), const BvhBuildSettings &bvhSettings = BvhBuildSettings());
+
+    // OBJ files go through the on-disk cache of `mesh_cache.hpp`
+    void setMeshCacheEnabled(bool enabled) { meshCacheEnabled = enabled; }
+    // Reports the BVH of every new mesh
+    void setVerbose(bool verbose_) { verbose = verbose_; }
 
     void fillBuffers(VkSmol &engine);
+
+    // Node format of the meshes using the binary BVH layout
+    void setBvhNodeFormat(BvhNodeFormat format);
+    BvhNodeFormat getBvhNodeFormat() const { return bvhNodeFormat; }
+    BvhMemoryReport getBvhMemoryReport();
     
     void drawGuizmo(const glm::mat4 &view, const glm::mat4 &proj);
     void drawUI(VkSmol &engine);   // The engine is needed in case we have to resize a buffer
@@ -55,6 +67,18 @@ public:
     bool raycast(const glm::vec2 &screenPos, const glm::vec2 &screenSize, const Camera &camera, float &dist, glm::vec3 &p, bool select = false);
 
     std::vector<bufferList_t> getBufferLists();
+    // Data of a headless scene after `fillBuffers`, one per binding in the order of `getBufferLists`
+    std::vector<const std::vector<char>*> getHostBuffers() const;
+
+    // Read by the CPU renderer, in the order used by the object buffer
+    const std::vector<Object*>& getObjects() const { return objects; }
+    const std::vector<Material>& getMaterials() const { return materials; }
+    int getSelectedObjectId() const { return selectedObjectId; }
+    // Top-level BVH, rebuilt by `fillBuffers` or `updateTlas`
+    void updateTlas() { buildTlas(objects); }
+    const std::vector<GpuBvhNode>& getTlasNodes() const { return tlasNodes; }
+    const std::vector<uint32_t>& getTlasObjectIds() const { return tlasObjectIds; }
+    uint32_t getTlasBoundedCount() const { return tlasBoundedCount; }
 
     // Returns true if the scene have been updated since the last call of this function
     bool checkUpdate();
@@ -63,12 +87,30 @@ public:
 private:
     ObjectBuffers sphereBuffers, planeBuffers, boxBuffers, vertexBuffers, indexBuffers, bvhBuffers, meshBuffers;
     ObjectBuffers materialBuffers, objectBuffers, lightBuffers;
+    ObjectBuffers tlasBuffers, tlasIndexBuffers;
+    ObjectBuffers bvh4Buffers, quantizedBvhBuffers, triangleBuffers;
     
     int selectedObjectId = -1;
     int objectId = 0;   // Used for unique object naming
     std::vector<Object*> objects;
     std::vector<Material> materials;
 
+    // Top-level acceleration structure over the bounded objects, rebuilt by `fillBuffers` when the bounds changed
+    std::vector<GpuBvhNode> tlasNodes;
+    std::vector<uint32_t> tlasObjectIds;   // Bounded objects in leaf order followed by the unbounded ones
+    uint32_t tlasBoundedCount = 0;
+    // Input of the last build, compared on every call to skip the unchanged frames
+    std::vector<BvhPrimitiveBounds> tlasBounds;
+    std::vector<uint32_t> tlasBoundedIds;
+    std::vector<uint32_t> tlasOrder;
+    void buildTlas(const std::vector<Object*> &orderedObjects);
+
+    BvhNodeFormat bvhNodeFormat = BvhNodeFormat::Full;
+    bool headless = false;
+    bool meshCacheEnabled = true;
+    bool verbose = false;
+    std::shared_ptr<MeshGeometry> buildMeshGeometry(const std::string &name, std::vector<Vertex> vertices, std::vector<unsigned int> indices, const BvhBuildSettings &bvhSettings);
+
     bool updated = false;
     bool bufferUpdated = false;
 
@@ -140,8 +140,8 @@ void initCornellBox(VkSmol &engine, Scene &scene, LightMode &lightMode) {
 }
 
 #define RAND_FLOAT static_cast<float>(rand() % 100000) / 100000.0f
-void initRandomSpheres(VkSmol &engine, Scene &scene, LightMode &lightMode) {
-    srand(time(nullptr));
+void initRandomSpheres(VkSmol &engine, Scene &scene, LightMode &lightMode, unsigned int seed) {
+    srand(seed != 0 ? seed : time(nullptr));
 
     scene.clear(engine);
 
@@ -5,4 +5,5 @@
 
 void initEmpty(VkSmol &engine, Scene &scene, LightMode &lightMode);
 void initCornellBox(VkSmol &engine, Scene &scene, LightMode &lightMode);
-void initRandomSpheres(VkSmol &engine, Scene &scene, LightMode &lightMode);
+// A `seed` of 0 gives a different layout on every call
+void initRandomSpheres(VkSmol &engine, Scene &scene, LightMode &lightMode, unsigned int seed = 0);
@@ -0,0 +1,245 @@
+#include "scene_serializer.hpp"
+
+#include <cstring>
+#include <iostream>
+#include <map>
+
+constexpr char SCENE_MAGIC[8] = { 'V', 'K', 'R', 'S', 'C', 'E', 'N', 'E' };
+
+class ByteWriter {
+public:
+    template <typename T>
+    void write(const T &value) { writeBytes(&value, sizeof(T)); }
+    void writeBytes(const void *data, size_t size) {
+        const char *bytes = static_cast<const char*>(data);
+        buffer.insert(buffer.end(), bytes, bytes + size);
+    }
+    void writeString(const std::string &text) {
+        write(static_cast<uint32_t>(text.size()));
+        writeBytes(text.data(), text.size());
+    }
+    template <typename T>
+    void writeVector(const std::vector<T> &values) {
+        write(static_cast<uint64_t>(values.size()));
+        writeBytes(values.data(), values.size() * sizeof(T));
+    }
+
+    std::vector<char> buffer;
+};
+
+// Every read checks the remaining size, `ok` stays false after the first failure
+class ByteReader {
+public:
+    ByteReader(const char *data, size_t size): data(data), size(size) {}
+
+    template <typename T>
+    T read() {
+        T value = {};
+        readBytes(&value, sizeof(T));
+        return value;
+    }
+    void readBytes(void *out, size_t count) {
+        if (!ok || count > size - offset) {
+            ok = false;
+            return;
+        }
+        std::memcpy(out, data + offset, count);
+        offset += count;
+    }
+    std::string readString() {
+        const uint32_t length = read<uint32_t>();
+        if (!ok || length > size - offset) {
+            ok = false;
+            return {};
+        }
+        std::string text(data + offset, length);
+        offset += length;
+        return text;
+    }
+    template <typename T>
+    std::vector<T> readVector() {
+        const uint64_t count = read<uint64_t>();
+        if (!ok || count > (size - offset) / sizeof(T)) {
+            ok = false;
+            return {};
+        }
+        std::vector<T> values(count);
+        readBytes(static_cast<void*>(values.data()), count * sizeof(T));
+        return values;
+    }
+
+    bool ok = true;
+
+private:
+    const char *data;
+    size_t size;
+    size_t offset = 0;
+};
+
+// Field by field, the padding of the structs is not initialized
+static void writeMaterial(ByteWriter &writer, const Material &material) {
+    writer.write(static_cast<int32_t>(material.type));
+    writer.write(material.albedo);
+    writer.write(material.payload[0]);
+    writer.write(material.payload[1]);
+}
+
+static Material readMaterial(ByteReader &reader) {
+    Material material = {};
+    material.type = static_cast<MaterialType>(reader.read<int32_t>());
+    material.albedo = reader.read<glm::vec3>();
+    material.payload[0] = reader.read<float>();
+    material.payload[1] = reader.read<float>();
+    return material;
+}
+
+static void writeBvhSettings(ByteWriter &writer, const BvhBuildSettings &settings) {
+    writer.write(static_cast<int32_t>(settings.builder));
+    writer.write(static_cast<int32_t>(settings.binCount));
+    writer.write(static_cast<int32_t>(settings.maxLeafSize));
+    writer.write(settings.traversalCost);
+    writer.write(settings.intersectionCost);
+    writer.write(static_cast<int32_t>(settings.layout));
+}
+
+static BvhBuildSettings readBvhSettings(ByteReader &reader) {
+    BvhBuildSettings settings;
+    settings.builder = static_cast<BvhBuilderType>(reader.read<int32_t>());
+    settings.binCount = reader.read<int32_t>();
+    settings.maxLeafSize = reader.read<int32_t>();
+    settings.traversalCost = reader.read<float>();
+    settings.intersectionCost = reader.read<float>();
+    settings.layout = static_cast<BvhLayout>(reader.read<int32_t>());
+    return settings;
+}
+
+std::vector<char> serializeScene(Scene &scene) {
+    ByteWriter writer;
+    writer.writeBytes(SCENE_MAGIC, sizeof(SCENE_MAGIC));
+    writer.write(static_cast<uint32_t>(SCENE_SERIALIZER_VERSION));
+    writer.write(static_cast<uint32_t>(sizeof(Vertex)));
+    writer.write(static_cast<uint32_t>(sizeof(GpuBvhNode)));
+
+    // Geometries first, the mesh instances refer to them by index
+    std::map<const MeshGeometry*, uint32_t> geometryIds;
+    std::vector<const MeshGeometry*> geometries;
+    for (Object *object : scene.getObjects()) {
+        if (object->getType() != ObjectType::Mesh) continue;
+        const MeshGeometry *geometry = static_cast<Mesh*>(object)->getGeometry().get();
+        if (geometryIds.emplace(geometry, static_cast<uint32_t>(geometries.size())).second) geometries.push_back(geometry);
+    }
+    writer.write(static_cast<uint32_t>(geometries.size()));
+    for (const MeshGeometry *geometry : geometries) {
+        writeBvhSettings(writer, geometry->getBvhSettings());
+        writer.writeVector(geometry->getVertices());
+        writer.writeVector(geometry->getIndices());
+        writer.writeVector(geometry->getBvhNodes());
+    }
+
+    const std::vector<Material> &materials = scene.getMaterials();
+    writer.write(static_cast<uint32_t>(scene.getObjects().size()));
+    for (Object *object : scene.getObjects()) {
+        writer.write(static_cast<int32_t>(object->getType()));
+        writer.writeString(object->getName());
+        switch (object->getType()) {
+            case ObjectType::Sphere: {
+                const GpuSphere sphere = static_cast<Sphere*>(object)->getStruct();
+                writeMaterial(writer, materials[sphere.materialHandle]);
+                writer.write(sphere.center);
+                writer.write(sphere.radius);
+                break;
+            }
+            case ObjectType::Plane: {
+                const GpuPlane plane = static_cast<Plane*>(object)->getStruct();
+                writeMaterial(writer, materials[plane.materialHandle]);
+                writer.write(plane.point);
+                writer.write(plane.normal);
+                break;
+            }
+            case ObjectType::Box: {
+                const GpuBox box = static_cast<Box*>(object)->getStruct();
+                writeMaterial(writer, materials[box.materialHandle]);
+                writer.write(box.transform);
+                break;
+            }
+            case ObjectType::Mesh: {
+                Mesh *mesh = static_cast<Mesh*>(object);
+                writeMaterial(writer, materials[mesh->getStruct().materialHandle]);
+                writer.write(mesh->getTransform());
+                writer.write(geometryIds[mesh->getGeometry().get()]);
+                break;
+            }
+            default: break;
+        }
+    }
+    return std::move(writer.buffer);
+}
+
+bool deserializeScene(VkSmol &engine, Scene &scene, const char *data, size_t size) {
+    ByteReader reader(data, size);
+    char magic[sizeof(SCENE_MAGIC)];
+    reader.readBytes(magic, sizeof(magic));
+    const uint32_t version = reader.read<uint32_t>();
+    const uint32_t vertexSize = reader.read<uint32_t>();
+    const uint32_t nodeSize = reader.read<uint32_t>();
+    if (!reader.ok || std::memcmp(magic, SCENE_MAGIC, sizeof(magic)) != 0 || version != SCENE_SERIALIZER_VERSION
+        || vertexSize != sizeof(Vertex) || nodeSize != sizeof(GpuBvhNode)) {
+        std::cerr << "[ERROR] Serialized scene of another version" << std::endl;
+        return false;
+    }
+
+    std::vector<std::shared_ptr<MeshGeometry>> geometries(reader.read<uint32_t>());
+    for (std::shared_ptr<MeshGeometry> &geometry : geometries) {
+        const BvhBuildSettings settings = readBvhSettings(reader);
+        std::vector<Vertex> vertices = reader.readVector<Vertex>();
+        std::vector<uint32_t> indices = reader.readVector<uint32_t>();
+        std::vector<GpuBvhNode> nodes = reader.readVector<GpuBvhNode>();
+        if (!reader.ok || indices.size() % 3 != 0) {
+            std::cerr << "[ERROR] Truncated serialized scene" << std::endl;
+            return false;
+        }
+        geometry = std::make_shared<MeshGeometry>(std::move(vertices), std::move(indices), std::move(nodes), settings);
+    }
+
+    const uint32_t objectCount = reader.read<uint32_t>();
+    for (uint32_t i = 0; i < objectCount && reader.ok; i++) {
+        const ObjectType type = static_cast<ObjectType>(reader.read<int32_t>());
+        const std::string name = reader.readString();
+        const Material material = readMaterial(reader);
+        switch (type) {
+            case ObjectType::Sphere: {
+                const glm::vec3 center = reader.read<glm::vec3>();
+                const float radius = reader.read<float>();
+                if (reader.ok) scene.pushSphere(engine, name, center, radius, material);
+                break;
+            }
+            case ObjectType::Plane: {
+                const glm::vec3 point = reader.read<glm::vec3>();
+                const glm::vec3 normal = reader.read<glm::vec3>();
+                if (reader.ok) scene.pushPlane(engine, name, point, normal, material);
+                break;
+            }
+            case ObjectType::Box: {
+                const glm::mat4 transform = reader.read<glm::mat4>();
+                if (reader.ok) scene.pushBoxTransform(engine, name, transform, material);
+                break;
+            }
+            case ObjectType::Mesh: {
+                const glm::mat4 transform = reader.read<glm::mat4>();
+                const uint32_t geometryId = reader.read<uint32_t>();
+                if (reader.ok && geometryId >= geometries.size()) reader.ok = false;
+                if (reader.ok) scene.pushMeshInstance(engine, name, geometries[geometryId], transform, material);
+                break;
+            }
+            default:
+                reader.ok = false;
+                break;
+        }
+    }
+
+    if (!reader.ok) {
+        std::cerr << "[ERROR] Truncated serialized scene" << std::endl;
+        return false;
+    }
+    return true;
+}
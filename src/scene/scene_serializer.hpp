@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "scene.hpp"
+
+// Snapshot of the objects and materials of a scene, e.g. to send it to the workers of a distributed render.
+// Meshes keep their built binary BVH, shared geometries are stored once. Bump SCENE_SERIALIZER_VERSION whenever
+// the stored fields change: readers and writers must be the same build, the structs are copied as they are.
+#define SCENE_SERIALIZER_VERSION 1
+
+std::vector<char> serializeScene(Scene &scene);
+// Appends the objects to `scene`, returns false if the data is truncated or from another version
+bool deserializeScene(VkSmol &engine, Scene &scene, const char *data, size_t size);
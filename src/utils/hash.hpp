@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Fast non-cryptographic 64-bit hash, used to key on-disk caches.
+// Four independent lanes of 8 bytes so large files are hashed at memory speed.
+inline uint64_t hashMix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+inline uint64_t hashBytes(const void *data, size_t size, uint64_t seed = 0) {
+    const uint64_t prime = 0x100000001b3ull;
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+    uint64_t lanes[4] = { seed ^ 0xcbf29ce484222325ull, seed + 1, seed + 2, seed + 3 };
+
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        for (int lane = 0; lane < 4; lane++) {
+            uint64_t word;
+            std::memcpy(&word, bytes + i + lane * 8, sizeof(word));
+            lanes[lane] = (lanes[lane] ^ word) * prime;
+            lanes[lane] ^= lanes[lane] >> 29;
+        }
+    }
+
+    uint64_t h = hashMix(lanes[0]) ^ hashMix(lanes[1] + 1) ^ hashMix(lanes[2] + 2) ^ hashMix(lanes[3] + 3);
+    for (; i < size; i++) {
+        h = (h ^ bytes[i]) * prime;
+    }
+    return hashMix(h ^ size);
+}
+
+template<typename T>
+inline uint64_t hashValue(uint64_t h, const T &value) {
+    return hashBytes(&value, sizeof(value), h);
+}
@@ -0,0 +1,26 @@
+#include "image.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+bool writePngFromFloats(const std::string &path, uint32_t width, uint32_t height, const float *pixels) {
+    const size_t floatCount = static_cast<size_t>(width) * height * 4;
+    std::vector<uint8_t> bytes(floatCount);
+    auto toByte = [](float v) -> uint8_t {
+        v = std::clamp(v, 0.0f, 1.0f);
+        v = std::pow(v, 1.0f / 2.2f);
+        return static_cast<uint8_t>(v * 255.0f + 0.5f);
+    };
+    for (size_t i = 0; i < floatCount; i += 4) {
+        bytes[i + 0] = toByte(pixels[i + 0]);
+        bytes[i + 1] = toByte(pixels[i + 1]);
+        bytes[i + 2] = toByte(pixels[i + 2]);
+        bytes[i + 3] = 255;
+    }
+
+    return stbi_write_png(path.c_str(), static_cast<int>(width), static_cast<int>(height), 4, bytes.data(), static_cast<int>(width) * 4) != 0;
+}
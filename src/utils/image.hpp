@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Writes linear RGBA floats as an 8-bit PNG (clamped, gamma 2.2, opaque), returns false on failure
+bool writePngFromFloats(const std::string &path, uint32_t width, uint32_t height, const float *pixels);
@@ -0,0 +1,45 @@
+#include "mapped_file.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string &path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    size = static_cast<size_t>(info.st_size);
+    if (size > 0) {
+        void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            ::close(fd);
+            size = 0;
+            return false;
+        }
+        data = mapping;
+    }
+    // The mapping stays valid after the descriptor is closed
+    ::close(fd);
+    opened = true;
+    return true;
+}
+
+void MappedFile::close() {
+    if (data != nullptr) munmap(data, size);
+    data = nullptr;
+    size = 0;
+    opened = false;
+}
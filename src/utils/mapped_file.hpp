@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file, unmapped on destruction
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string &path);
+    void close();
+
+    bool isOpen() const { return opened; }
+    const unsigned char *getData() const { return static_cast<const unsigned char*>(data); }
+    size_t getSize() const { return size; }
+
+private:
+    void *data = nullptr;
+    size_t size = 0;
+    bool opened = false;    // Empty files are open without a mapping
+};
@@ -0,0 +1,39 @@
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+unsigned resolveThreadCount(int requested) {
+    if (requested > 0) return static_cast<unsigned>(requested);
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+size_t parallelChunkCount(size_t count, size_t grain, unsigned threadCount) {
+    if (count == 0) return 0;
+    grain = std::max<size_t>(grain, 1);
+    size_t chunks = (count + grain - 1) / grain;
+    return std::max<size_t>(1, std::min<size_t>(chunks, threadCount));
+}
+
+void parallelFor(size_t begin, size_t end, size_t grain, unsigned threadCount, const std::function<void(size_t, size_t, size_t)> &fn) {
+    const size_t count = end > begin ? end - begin : 0;
+    const size_t chunks = parallelChunkCount(count, grain, threadCount);
+    if (chunks == 0) return;
+    if (chunks == 1) {
+        fn(begin, end, 0);
+        return;
+    }
+
+    auto chunkBegin = [&](size_t i) { return begin + count * i / chunks; };
+
+    std::vector<std::thread> threads;
+    threads.reserve(chunks - 1);
+    for (size_t i = 1; i < chunks; i++) {
+        threads.emplace_back(fn, chunkBegin(i), chunkBegin(i + 1), i);
+    }
+    fn(chunkBegin(0), chunkBegin(1), 0);
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+}
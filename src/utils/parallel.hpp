@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+// Number of threads to use when a setting asks for "all of them" (0)
+unsigned resolveThreadCount(int requested);
+
+// Number of chunks `parallelFor` splits `count` elements into.
+// It only depends on its arguments so per-chunk results can be merged deterministically.
+size_t parallelChunkCount(size_t count, size_t grain, unsigned threadCount);
+
+// Runs `fn(chunkBegin, chunkEnd, chunkIndex)` on contiguous chunks of [begin, end), one thread per chunk.
+// The calling thread processes the first chunk.
+void parallelFor(
+    size_t begin,
+    size_t end,
+    size_t grain,
+    unsigned threadCount,
+    const std::function<void(size_t, size_t, size_t)> &fn
+);
@@ -0,0 +1,194 @@
+#pragma once
+
+// Minimal 4-wide float vector, the instruction set is selected at compile time:
+// AVX2 (with -mavx2), SSE (any x86-64 target), NEON (arm64) or a scalar fallback.
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__AVX2__)
+    #define SIMD_AVX2 1
+    #define SIMD_SSE 1
+    #include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+    #define SIMD_SSE 1
+    #include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #define SIMD_NEON 1
+    #include <arm_neon.h>
+#endif
+
+// Lanes of the widest vector type available
+#if defined(SIMD_AVX2)
+    #define SIMD_MAX_WIDTH 8
+#else
+    #define SIMD_MAX_WIDTH 4
+#endif
+
+inline const char *simdInstructionSet() {
+#if defined(SIMD_AVX2)
+    return "AVX2";
+#elif defined(SIMD_SSE)
+    return "SSE";
+#elif defined(SIMD_NEON)
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
+
+struct Float4 {
+    static constexpr int WIDTH = 4;
+
+#if defined(SIMD_SSE)
+    __m128 v;
+#elif defined(SIMD_NEON)
+    float32x4_t v;
+#else
+    float v[4];
+#endif
+
+    static Float4 load(const float *p) {
+#if defined(SIMD_SSE)
+        return { _mm_loadu_ps(p) };
+#elif defined(SIMD_NEON)
+        return { vld1q_f32(p) };
+#else
+        return { { p[0], p[1], p[2], p[3] } };
+#endif
+    }
+
+    static Float4 splat(float s) {
+#if defined(SIMD_SSE)
+        return { _mm_set1_ps(s) };
+#elif defined(SIMD_NEON)
+        return { vdupq_n_f32(s) };
+#else
+        return { { s, s, s, s } };
+#endif
+    }
+
+    void store(float *p) const {
+#if defined(SIMD_SSE)
+        _mm_storeu_ps(p, v);
+#elif defined(SIMD_NEON)
+        vst1q_f32(p, v);
+#else
+        std::copy(v, v + 4, p);
+#endif
+    }
+};
+
+#if defined(SIMD_SSE)
+inline Float4 operator+(Float4 a, Float4 b) { return { _mm_add_ps(a.v, b.v) }; }
+inline Float4 operator-(Float4 a, Float4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+inline Float4 operator*(Float4 a, Float4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+inline Float4 min(Float4 a, Float4 b) { return { _mm_min_ps(a.v, b.v) }; }
+inline Float4 max(Float4 a, Float4 b) { return { _mm_max_ps(a.v, b.v) }; }
+// Bit i is set if a[i] <= b[i]
+inline int lessEqualMask(Float4 a, Float4 b) { return _mm_movemask_ps(_mm_cmple_ps(a.v, b.v)); }
+inline Float4 operator/(Float4 a, Float4 b) { return { _mm_div_ps(a.v, b.v) }; }
+inline Float4 sqrt(Float4 a) { return { _mm_sqrt_ps(a.v) }; }
+// Lane masks have every bit set where the comparison holds, comparisons with NaN never hold
+inline Float4 cmpLess(Float4 a, Float4 b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+inline Float4 cmpLessEqual(Float4 a, Float4 b) { return { _mm_cmple_ps(a.v, b.v) }; }
+inline Float4 cmpGreaterEqual(Float4 a, Float4 b) { return { _mm_cmpge_ps(a.v, b.v) }; }
+inline Float4 maskAnd(Float4 a, Float4 b) { return { _mm_and_ps(a.v, b.v) }; }
+inline Float4 maskOr(Float4 a, Float4 b) { return { _mm_or_ps(a.v, b.v) }; }
+// a where the mask is set, b elsewhere
+inline Float4 select(Float4 mask, Float4 a, Float4 b) { return { _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)) }; }
+inline int moveMask(Float4 mask) { return _mm_movemask_ps(mask.v); }
+#elif defined(SIMD_NEON)
+inline Float4 operator+(Float4 a, Float4 b) { return { vaddq_f32(a.v, b.v) }; }
+inline Float4 operator-(Float4 a, Float4 b) { return { vsubq_f32(a.v, b.v) }; }
+inline Float4 operator*(Float4 a, Float4 b) { return { vmulq_f32(a.v, b.v) }; }
+inline Float4 min(Float4 a, Float4 b) { return { vminq_f32(a.v, b.v) }; }
+inline Float4 max(Float4 a, Float4 b) { return { vmaxq_f32(a.v, b.v) }; }
+inline int lessEqualMask(Float4 a, Float4 b) {
+    const uint32x4_t bits = { 1, 2, 4, 8 };
+    return static_cast<int>(vaddvq_u32(vandq_u32(vcleq_f32(a.v, b.v), bits)));
+}
+inline Float4 operator/(Float4 a, Float4 b) { return { vdivq_f32(a.v, b.v) }; }
+inline Float4 sqrt(Float4 a) { return { vsqrtq_f32(a.v) }; }
+inline Float4 cmpLess(Float4 a, Float4 b) { return { vreinterpretq_f32_u32(vcltq_f32(a.v, b.v)) }; }
+inline Float4 cmpLessEqual(Float4 a, Float4 b) { return { vreinterpretq_f32_u32(vcleq_f32(a.v, b.v)) }; }
+inline Float4 cmpGreaterEqual(Float4 a, Float4 b) { return { vreinterpretq_f32_u32(vcgeq_f32(a.v, b.v)) }; }
+inline Float4 maskAnd(Float4 a, Float4 b) { return { vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a.v), vreinterpretq_u32_f32(b.v))) }; }
+inline Float4 maskOr(Float4 a, Float4 b) { return { vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(a.v), vreinterpretq_u32_f32(b.v))) }; }
+inline Float4 select(Float4 mask, Float4 a, Float4 b) { return { vbslq_f32(vreinterpretq_u32_f32(mask.v), a.v, b.v) }; }
+inline int moveMask(Float4 mask) {
+    const uint32x4_t bits = { 1, 2, 4, 8 };
+    return static_cast<int>(vaddvq_u32(vandq_u32(vreinterpretq_u32_f32(mask.v), bits)));
+}
+#else
+inline Float4 operator+(Float4 a, Float4 b) { return { { a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3] } }; }
+inline Float4 operator-(Float4 a, Float4 b) { return { { a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3] } }; }
+inline Float4 operator*(Float4 a, Float4 b) { return { { a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3] } }; }
+inline Float4 min(Float4 a, Float4 b) { return { { std::min(a.v[0], b.v[0]), std::min(a.v[1], b.v[1]), std::min(a.v[2], b.v[2]), std::min(a.v[3], b.v[3]) } }; }
+inline Float4 max(Float4 a, Float4 b) { return { { std::max(a.v[0], b.v[0]), std::max(a.v[1], b.v[1]), std::max(a.v[2], b.v[2]), std::max(a.v[3], b.v[3]) } }; }
+inline int lessEqualMask(Float4 a, Float4 b) {
+    int mask = 0;
+    for (int i = 0; i < 4; i++) mask |= (a.v[i] <= b.v[i] ? 1 : 0) << i;
+    return mask;
+}
+inline Float4 operator/(Float4 a, Float4 b) { return { { a.v[0] / b.v[0], a.v[1] / b.v[1], a.v[2] / b.v[2], a.v[3] / b.v[3] } }; }
+inline Float4 sqrt(Float4 a) { return { { std::sqrt(a.v[0]), std::sqrt(a.v[1]), std::sqrt(a.v[2]), std::sqrt(a.v[3]) } }; }
+inline float laneMask(bool set) { return std::bit_cast<float>(set ? 0xFFFFFFFFu : 0u); }
+inline bool laneSet(float mask) { return std::bit_cast<uint32_t>(mask) != 0; }
+inline Float4 cmpLess(Float4 a, Float4 b) { return { { laneMask(a.v[0] < b.v[0]), laneMask(a.v[1] < b.v[1]), laneMask(a.v[2] < b.v[2]), laneMask(a.v[3] < b.v[3]) } }; }
+inline Float4 cmpLessEqual(Float4 a, Float4 b) { return { { laneMask(a.v[0] <= b.v[0]), laneMask(a.v[1] <= b.v[1]), laneMask(a.v[2] <= b.v[2]), laneMask(a.v[3] <= b.v[3]) } }; }
+inline Float4 cmpGreaterEqual(Float4 a, Float4 b) { return { { laneMask(a.v[0] >= b.v[0]), laneMask(a.v[1] >= b.v[1]), laneMask(a.v[2] >= b.v[2]), laneMask(a.v[3] >= b.v[3]) } }; }
+inline Float4 maskAnd(Float4 a, Float4 b) {
+    Float4 r;
+    for (int i = 0; i < 4; i++) r.v[i] = laneMask(laneSet(a.v[i]) && laneSet(b.v[i]));
+    return r;
+}
+inline Float4 maskOr(Float4 a, Float4 b) {
+    Float4 r;
+    for (int i = 0; i < 4; i++) r.v[i] = laneMask(laneSet(a.v[i]) || laneSet(b.v[i]));
+    return r;
+}
+inline Float4 select(Float4 mask, Float4 a, Float4 b) {
+    Float4 r;
+    for (int i = 0; i < 4; i++) r.v[i] = laneSet(mask.v[i]) ? a.v[i] : b.v[i];
+    return r;
+}
+inline int moveMask(Float4 mask) {
+    int bits = 0;
+    for (int i = 0; i < 4; i++) bits |= (laneSet(mask.v[i]) ? 1 : 0) << i;
+    return bits;
+}
+#endif
+
+#if defined(SIMD_AVX2)
+// Two Float4 processed at once, e.g. to compute the slabs of both bounds of an axis in one instruction.
+// Has the same operations as Float4 so width-generic code can use either.
+struct Float8 {
+    static constexpr int WIDTH = 8;
+
+    __m256 v;
+
+    static Float8 load(const float *p) { return { _mm256_loadu_ps(p) }; }
+    static Float8 splat(float s) { return { _mm256_set1_ps(s) }; }
+    void store(float *p) const { _mm256_storeu_ps(p, v); }
+    Float4 low() const { return { _mm256_castps256_ps128(v) }; }
+    Float4 high() const { return { _mm256_extractf128_ps(v, 1) }; }
+};
+
+inline Float8 operator+(Float8 a, Float8 b) { return { _mm256_add_ps(a.v, b.v) }; }
+inline Float8 operator-(Float8 a, Float8 b) { return { _mm256_sub_ps(a.v, b.v) }; }
+inline Float8 operator*(Float8 a, Float8 b) { return { _mm256_mul_ps(a.v, b.v) }; }
+inline Float8 operator/(Float8 a, Float8 b) { return { _mm256_div_ps(a.v, b.v) }; }
+inline Float8 min(Float8 a, Float8 b) { return { _mm256_min_ps(a.v, b.v) }; }
+inline Float8 max(Float8 a, Float8 b) { return { _mm256_max_ps(a.v, b.v) }; }
+inline Float8 sqrt(Float8 a) { return { _mm256_sqrt_ps(a.v) }; }
+inline Float8 cmpLess(Float8 a, Float8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+inline Float8 cmpLessEqual(Float8 a, Float8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) }; }
+inline Float8 cmpGreaterEqual(Float8 a, Float8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; }
+inline Float8 maskAnd(Float8 a, Float8 b) { return { _mm256_and_ps(a.v, b.v) }; }
+inline Float8 maskOr(Float8 a, Float8 b) { return { _mm256_or_ps(a.v, b.v) }; }
+inline Float8 select(Float8 mask, Float8 a, Float8 b) { return { _mm256_blendv_ps(b.v, a.v, mask.v) }; }
+inline int moveMask(Float8 mask) { return _mm256_movemask_ps(mask.v); }
+#endif
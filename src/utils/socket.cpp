@@ -0,0 +1,211 @@
+#include "socket.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifdef MSG_NOSIGNAL
+#define SOCKET_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SOCKET_SEND_FLAGS 0
+#endif
+
+#define UNIX_PREFIX "unix:"
+
+// A peer leaving must show up as a failed send, not kill the process with SIGPIPE
+static void configureSocket(int fd, bool tcp) {
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+    if (tcp) {
+        int noDelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    }
+}
+
+static bool isUnixAddress(const std::string &address) {
+    return address.rfind(UNIX_PREFIX, 0) == 0;
+}
+
+static bool makeUnixAddress(const std::string &address, sockaddr_un &unixAddress) {
+    const std::string path = address.substr(std::strlen(UNIX_PREFIX));
+    unixAddress = {};
+    unixAddress.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(unixAddress.sun_path)) {
+        std::cerr << "[ERROR] Invalid Unix socket path " << path << std::endl;
+        return false;
+    }
+    std::memcpy(unixAddress.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+static addrinfo* resolveTcpAddress(const std::string &address, bool passive) {
+    const size_t colon = address.rfind(':');
+    if (colon == std::string::npos) {
+        std::cerr << "[ERROR] Expected host:port, :port or unix:/path, got " << address << std::endl;
+        return nullptr;
+    }
+    const std::string host = address.substr(0, colon);
+    const std::string port = address.substr(colon + 1);
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    addrinfo *result = nullptr;
+    const int error = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result);
+    if (error != 0) {
+        std::cerr << "[ERROR] Failed to resolve " << address << ": " << gai_strerror(error) << std::endl;
+        return nullptr;
+    }
+    return result;
+}
+
+Socket::~Socket() {
+    close();
+}
+
+Socket::Socket(Socket &&other) noexcept: fd(other.fd), unixPath(std::move(other.unixPath)) {
+    other.fd = -1;
+    other.unixPath.clear();
+}
+
+Socket& Socket::operator=(Socket &&other) noexcept {
+    if (this != &other) {
+        close();
+        fd = other.fd;
+        unixPath = std::move(other.unixPath);
+        other.fd = -1;
+        other.unixPath.clear();
+    }
+    return *this;
+}
+
+void Socket::close() {
+    if (fd >= 0) ::close(fd);
+    if (!unixPath.empty()) unlink(unixPath.c_str());
+    fd = -1;
+    unixPath.clear();
+}
+
+bool Socket::listen(const std::string &address) {
+    close();
+    if (isUnixAddress(address)) {
+        sockaddr_un unixAddress;
+        if (!makeUnixAddress(address, unixAddress)) return false;
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return false;
+        configureSocket(fd, false);
+        unlink(unixAddress.sun_path);   // Left behind by a previous run that crashed
+        if (bind(fd, reinterpret_cast<sockaddr*>(&unixAddress), sizeof(unixAddress)) != 0 || ::listen(fd, SOMAXCONN) != 0) {
+            std::cerr << "[ERROR] Failed to listen on " << address << ": " << std::strerror(errno) << std::endl;
+            close();
+            return false;
+        }
+        unixPath = unixAddress.sun_path;
+        return true;
+    }
+
+    addrinfo *addresses = resolveTcpAddress(address, true);
+    for (addrinfo *info = addresses; info != nullptr && fd < 0; info = info->ai_next) {
+        fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+        if (fd < 0) continue;
+        int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        configureSocket(fd, true);
+        if (bind(fd, info->ai_addr, info->ai_addrlen) != 0 || ::listen(fd, SOMAXCONN) != 0) close();
+    }
+    if (addresses) freeaddrinfo(addresses);
+    if (fd < 0) {
+        std::cerr << "[ERROR] Failed to listen on " << address << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Socket::connect(const std::string &address) {
+    close();
+    if (isUnixAddress(address)) {
+        sockaddr_un unixAddress;
+        if (!makeUnixAddress(address, unixAddress)) return false;
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return false;
+        configureSocket(fd, false);
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&unixAddress), sizeof(unixAddress)) != 0) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    addrinfo *addresses = resolveTcpAddress(address, false);
+    for (addrinfo *info = addresses; info != nullptr && fd < 0; info = info->ai_next) {
+        fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+        if (fd < 0) continue;
+        configureSocket(fd, true);
+        if (::connect(fd, info->ai_addr, info->ai_addrlen) != 0) close();
+    }
+    if (addresses) freeaddrinfo(addresses);
+    return fd >= 0;
+}
+
+Socket Socket::accept() {
+    sockaddr_storage peer;
+    socklen_t peerSize = sizeof(peer);
+    const int client = ::accept(fd, reinterpret_cast<sockaddr*>(&peer), &peerSize);
+    if (client < 0) return Socket();
+    configureSocket(client, peer.ss_family != AF_UNIX);
+    return Socket(client);
+}
+
+bool Socket::sendAll(const void *data, size_t size) {
+    const char *bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        const ssize_t sent = send(fd, bytes, size, SOCKET_SEND_FLAGS);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        bytes += sent;
+        size -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+bool Socket::receiveSome(void *data, size_t size, size_t &received) {
+    received = 0;
+    while (true) {
+        const ssize_t count = recv(fd, data, size, MSG_DONTWAIT);
+        if (count < 0 && errno == EINTR) continue;
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+        if (count <= 0) return false;
+        received = static_cast<size_t>(count);
+        return true;
+    }
+}
+
+bool Socket::setSendTimeout(double seconds) {
+    timeval timeout = {};
+    timeout.tv_sec = static_cast<time_t>(seconds);
+    timeout.tv_usec = static_cast<suseconds_t>((seconds - static_cast<double>(timeout.tv_sec)) * 1e6);
+    return setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) == 0;
+}
+
+bool Socket::receiveAll(void *data, size_t size) {
+    char *bytes = static_cast<char*>(data);
+    while (size > 0) {
+        const ssize_t received = recv(fd, bytes, size, 0);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) return false;
+        bytes += received;
+        size -= static_cast<size_t>(received);
+    }
+    return true;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Blocking stream socket over TCP or a Unix domain socket, closed on destruction. `receiveSome` is the only call
+// that never blocks.
+// Addresses are "unix:/path/to/socket", "host:port" or ":port" (every interface when listening)
+class Socket {
+public:
+    Socket() = default;
+    explicit Socket(int fd): fd(fd) {}
+    ~Socket();
+    Socket(const Socket&) = delete;
+    Socket& operator=(const Socket&) = delete;
+    Socket(Socket &&other) noexcept;
+    Socket& operator=(Socket &&other) noexcept;
+
+    bool listen(const std::string &address);
+    bool connect(const std::string &address);
+    // Invalid socket on failure
+    Socket accept();
+    void close();
+
+    // Both loop until every byte is transferred, false once the peer is gone
+    bool sendAll(const void *data, size_t size);
+    bool receiveAll(void *data, size_t size);
+    // Reads what is already there without blocking, `received` is 0 when nothing is. False once the peer is gone
+    bool receiveSome(void *data, size_t size, size_t &received);
+    // Sends to a peer that stopped reading fail after this long instead of blocking forever
+    bool setSendTimeout(double seconds);
+
+    bool isOpen() const { return fd >= 0; }
+    int getFd() const { return fd; }
+
+private:
+    int fd = -1;
+    std::string unixPath;   // Removed when a listening Unix socket closes
+};
@@ -0,0 +1,246 @@
+// Deterministic checks of the CPU integrator: a fixed seed render of a preset against stored values,
+// the edge cases of `scatter` and `getLightId`, and the tolerances of the triangle test used by the picking.
+// usage: cpu_integrator_test, from the repository root so the presets find their models
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "../src/cpu/cpu_integrator.hpp"
+#include "../src/cpu/cpu_random.hpp"
+#include "../src/scene/scene_preset.hpp"
+
+static int failures = 0;
+
+static void check(bool condition, const char *name) {
+    if (!condition) {
+        std::cerr << "[ERROR] " << name << std::endl;
+        failures++;
+    }
+}
+
+static bool near(float a, float b, float tolerance) {
+    return std::fabs(a - b) <= tolerance;
+}
+
+static bool near(const glm::vec3 &a, const glm::vec3 &b, float tolerance) {
+    return near(a.x, b.x, tolerance) && near(a.y, b.y, tolerance) && near(a.z, b.z, tolerance);
+}
+
+// Seed whose first `randFloat` is exactly 0
+#define ZERO_DRAW_SEED 449710063u
+
+// ================ RENDER ================
+#define RENDER_WIDTH 16
+#define RENDER_HEIGHT 12
+#define RENDER_SPP 8
+
+// Same pixel centers and seeds as `CpuRenderer`, frame 0
+static std::vector<glm::vec3> renderImage(const CpuScene &scene, const CpuRenderParams &params) {
+    std::vector<glm::vec3> image(params.width * params.height);
+    for (uint32_t y = 0; y < params.height; y++) {
+        for (uint32_t x = 0; x < params.width; x++) {
+            const glm::vec2 fragPos = (glm::vec2(x, y) + 0.5f) / glm::vec2(params.width, params.height) * 2.0f - 1.0f;
+            uint32_t seed = initSeed(x, y, 0);
+            image[y * params.width + x] = computeFragmentColor(scene, params, fragPos, seed);
+        }
+    }
+    return image;
+}
+
+static void checkCornellRender(const CpuScene &scene, LightMode lightMode) {
+    CpuRenderParams params;
+    params.width = RENDER_WIDTH;
+    params.height = RENDER_HEIGHT;
+    params.samplesPerPixel = RENDER_SPP;
+    params.lightMode = lightMode;
+
+    const std::vector<glm::vec3> image = renderImage(scene, params);
+    const std::vector<glm::vec3> again = renderImage(scene, params);
+    check(image == again, "render: the same seeds give the same image");
+
+    // Mean of each quadrant, the light, the walls and the floor end up in different ones
+    glm::vec3 quadrants[4] = {};
+    for (uint32_t y = 0; y < RENDER_HEIGHT; y++) {
+        for (uint32_t x = 0; x < RENDER_WIDTH; x++) {
+            quadrants[(y * 2 / RENDER_HEIGHT) * 2 + x * 2 / RENDER_WIDTH] += image[y * RENDER_WIDTH + x] / (RENDER_WIDTH * RENDER_HEIGHT / 4.0f);
+        }
+    }
+
+    // Stored from a run of this test. The tolerance covers the floating point differences between compilers,
+    // a changed sampling, bounce or intersection code moves the means well beyond it
+    const glm::vec3 expected[4] = {
+        glm::vec3(0.042335f, 0.020823f, 0.015695f), glm::vec3(0.019034f, 0.021406f, 0.009648f),
+        glm::vec3(0.011377f, 0.001536f, 0.001024f), glm::vec3(0.001499f, 0.004841f, 0.000729f),
+    };
+    for (int i = 0; i < 4; i++) {
+        const float scale = std::max(expected[i].x, std::max(expected[i].y, expected[i].z));
+        check(near(quadrants[i], expected[i], 0.02f * scale), "render: quadrant means of the cornell box");
+    }
+
+    // The packet path promises the colors of the single ray path, bit for bit
+    glm::vec2 fragPos[CPU_PACKET_SIZE];
+    uint32_t seeds[CPU_PACKET_SIZE];
+    glm::vec3 colors[CPU_PACKET_SIZE];
+    for (uint32_t i = 0; i < CPU_PACKET_SIZE; i++) {
+        const uint32_t x = 6 + i % 4, y = 4 + i / 4;
+        fragPos[i] = (glm::vec2(x, y) + 0.5f) / glm::vec2(params.width, params.height) * 2.0f - 1.0f;
+        seeds[i] = initSeed(x, y, 0);
+    }
+    computePacketColors(scene, params, fragPos, seeds, CPU_PACKET_SIZE, colors);
+    bool samePacket = true;
+    for (uint32_t i = 0; i < CPU_PACKET_SIZE; i++) {
+        samePacket &= colors[i] == image[(4 + i / 4) * RENDER_WIDTH + 6 + i % 4];
+    }
+    check(samePacket, "render: packets give the colors of single rays");
+}
+
+// ================ SCATTER ================
+static CpuHit makeHit(const glm::vec3 &normal, bool frontFace) {
+    CpuHit hit;
+    hit.p = glm::vec3(0.0f);
+    hit.normal = normal;
+    hit.t = 1.0f;
+    hit.frontFace = frontFace;
+    hit.object = { ObjectType::Sphere, 0 };
+    return hit;
+}
+
+static void checkScatter() {
+    const glm::vec3 up(0.0f, 1.0f, 0.0f);
+    const Ray down = { glm::vec3(0.0f, 1.0f, 0.0f), glm::normalize(glm::vec3(1.0f, -1.0f, 0.0f)) };
+    ScatterResult result;
+
+    // Diffuse bounces stay above the surface whatever the draw, the origin is pushed out of it
+    const Material white = { .type=MaterialType::Lambertian, .albedo={ 1.0f, 1.0f, 1.0f }, .payload={ 0.0f, 0.0f } };
+    bool aboveSurface = true;
+    for (uint32_t seed = 1; seed < 1000; seed++) {
+        uint32_t state = seed;
+        scatter(white, down, makeHit(up, true), result, state);
+        aboveSurface &= glm::dot(result.scattered.dir, up) >= 0.0f && near(glm::length(result.scattered.dir), 1.0f, 1e-5f);
+    }
+    check(aboveSurface, "scatter: lambertian bounces leave the surface");
+    check(result.isScattered && result.isDiffuse, "scatter: lambertian is diffuse");
+    check(result.scattered.origin.y > 0.0f, "scatter: lambertian origin is offset along the normal");
+
+    // A zero fuzz mirror ignores the draw
+    const Material mirror = { .type=MaterialType::Metal, .albedo={ 0.5f, 0.5f, 0.5f }, .payload={ 0.0f, 0.0f } };
+    uint32_t seed = ZERO_DRAW_SEED;
+    scatter(mirror, down, makeHit(up, true), result, seed);
+    check(near(result.scattered.dir, glm::reflect(down.dir, up), 1e-6f), "scatter: metal without fuzz reflects");
+    check(!result.isDiffuse, "scatter: metal is not diffuse");
+
+    // Leaving glass at a grazing angle is always a total internal reflection
+    const Material glass = { .type=MaterialType::Dielectric, .albedo={ 1.0f, 1.0f, 1.0f }, .payload={ 1.5f, 0.0f } };
+    const Ray grazing = { glm::vec3(0.0f, 1.0f, 0.0f), glm::normalize(glm::vec3(1.0f, -0.2f, 0.0f)) };
+    bool reflected = true;
+    for (uint32_t s = 1; s < 100; s++) {
+        uint32_t state = s;
+        scatter(glass, grazing, makeHit(up, false), result, state);
+        reflected &= near(result.scattered.dir, glm::reflect(grazing.dir, up), 1e-6f) && result.scattered.origin.y > 0.0f;
+    }
+    check(reflected, "scatter: total internal reflection in glass");
+
+    // Lights end the path with their radiance
+    const Material light = { .type=MaterialType::Emissive, .albedo={ 1.0f, 0.5f, 0.25f }, .payload={ 4.0f, 0.0f } };
+    scatter(light, down, makeHit(up, true), result, seed);
+    check(!result.isScattered && near(result.attenuation, glm::vec3(4.0f, 2.0f, 1.0f), 0.0f), "scatter: emissive stops the path");
+
+    // Unknown materials are flagged in magenta
+    Material unknown = white;
+    unknown.type = static_cast<MaterialType>(255);
+    scatter(unknown, down, makeHit(up, true), result, seed);
+    check(result.attenuation.y == 0.0f && result.attenuation.x > 0.0f, "scatter: unknown material is magenta");
+}
+
+// ================ LIGHTS ================
+static void checkLightIds(VkSmol &engine) {
+    Scene scene;
+    scene.init(engine, true);
+    CpuScene packed;
+
+    scene.pushSphere(engine, "Ball", glm::vec3(0.0f), 1.0f, { .type=MaterialType::Lambertian, .albedo={ 1.0f, 1.0f, 1.0f }, .payload={ 0.0f, 0.0f } });
+    packed.pack(scene);
+    uint32_t seed = 1;
+    check(getLightId(packed, seed) == -1, "getLightId: -1 without lights");
+
+    // Areas of 4 pi and 16 pi
+    const Material light = { .type=MaterialType::Emissive, .albedo={ 1.0f, 1.0f, 1.0f }, .payload={ 1.0f, 0.0f } };
+    scene.pushSphere(engine, "Small", glm::vec3(5.0f, 0.0f, 0.0f), 1.0f, light);
+    packed.pack(scene);
+    seed = ZERO_DRAW_SEED;
+    check(getLightId(packed, seed) == 0, "getLightId: a draw of 0 picks the first light");
+
+    scene.pushSphere(engine, "Large", glm::vec3(-5.0f, 0.0f, 0.0f), 2.0f, light);
+    packed.pack(scene);
+    check(packed.getLights().size() == 2, "getLightId: one light per emissive object");
+
+    const int draws = 20000;
+    int picked[2] = {};
+    bool inRange = true;
+    seed = 1;
+    for (int i = 0; i < draws; i++) {
+        const int id = getLightId(packed, seed);
+        inRange &= id == 0 || id == 1;
+        if (inRange) picked[id]++;
+    }
+    check(inRange, "getLightId: every draw picks a light");
+    check(near(static_cast<float>(picked[0]) / draws, 0.2f, 0.01f), "getLightId: picked in proportion to the area");
+
+    scene.destroy(engine);
+}
+
+// ================ TRIANGLES ================
+static void checkTriangles() {
+    const glm::vec3 v0(0.0f, 0.0f, 0.0f), v1(1.0f, 0.0f, 0.0f), v2(0.0f, 1.0f, 0.0f);
+    const glm::vec3 forward(0.0f, 0.0f, 1.0f);
+
+    check(near(rayTriangleIntersection({ glm::vec3(0.25f, 0.25f, -1.0f), forward }, v0, v1, v2), 1.0f, 1e-6f), "triangle: inside hit");
+    // Edges and vertices are inside, so the rays between two triangles hit one of them
+    check(rayTriangleIntersection({ glm::vec3(0.5f, 0.5f, -1.0f), forward }, v0, v1, v2) > 0.0f, "triangle: hit on the long edge");
+    check(rayTriangleIntersection({ glm::vec3(0.0f, 0.0f, -1.0f), forward }, v0, v1, v2) > 0.0f, "triangle: hit on a vertex");
+    check(rayTriangleIntersection({ glm::vec3(-1e-3f, 0.5f, -1.0f), forward }, v0, v1, v2) < 0.0f, "triangle: miss outside an edge");
+    check(rayTriangleIntersection({ glm::vec3(0.25f, 0.25f, -1.0f), glm::vec3(1.0f, 0.0f, 0.0f) }, v0, v1, v2) < 0.0f, "triangle: parallel ray");
+    check(rayTriangleIntersection({ glm::vec3(0.25f, 0.25f, 1.0f), forward }, v0, v1, v2) < 0.0f, "triangle: hit behind the origin");
+    check(rayTriangleIntersection({ glm::vec3(0.25f, 0.25f, -1e-7f), forward }, v0, v1, v2) < 0.0f, "triangle: hit closer than TRI_EPS");
+
+    // Picking goes through `Mesh::rayIntersection`: a quad clicked on its diagonal is never missed
+    std::vector<Vertex> vertices = { { glm::vec3(-1, -1, 0) }, { glm::vec3(1, -1, 0) }, { glm::vec3(1, 1, 0) }, { glm::vec3(-1, 1, 0) } };
+    std::vector<uint32_t> indices = { 0, 1, 2, 0, 2, 3 };
+    Mesh quad("Quad", std::make_shared<MeshGeometry>(vertices, indices), glm::mat4(1.0f), 0);
+    bool diagonalHit = true;
+    for (int i = -9; i <= 9; i++) {
+        const float d = i / 10.0f;
+        diagonalHit &= near(quad.rayIntersection({ glm::vec3(d, d, -2.0f), forward }), 2.0f, 1e-5f);
+    }
+    check(diagonalHit, "picking: the diagonal of a quad is hit");
+}
+
+int main() {
+    VkSmol engine;
+
+    Scene scene;
+    scene.init(engine, true);
+    scene.setMeshCacheEnabled(false);
+    LightMode lightMode;
+    initCornellBox(engine, scene, lightMode);
+    CpuScene packed;
+    packed.pack(scene);
+
+    checkCornellRender(packed, lightMode);
+    checkScatter();
+    checkLightIds(engine);
+    checkTriangles();
+    scene.destroy(engine);
+
+    if (failures > 0) {
+        std::cerr << "[ERROR] " << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "[INFO] Every check passed" << std::endl;
+    return 0;
+}
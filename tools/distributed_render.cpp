@@ -0,0 +1,220 @@
+// Render of a scene split across worker processes, on one machine or many
+// usage: distributed_render coordinator [options] | distributed_render worker [options], see `printUsage`
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <glm/glm.hpp>
+
+#include "tool_utils.hpp"
+#include "../src/distributed/render_coordinator.hpp"
+#include "../src/distributed/render_worker.hpp"
+#include "../src/utils/image.hpp"
+#include "../src/utils/parallel.hpp"
+
+struct CoordinatorOptions {
+    std::string scene = "cornell";
+    std::string objPath;
+    std::string output = "distributed_render.png";
+    glm::vec3 cameraPos = glm::vec3(0.0f, 0.0f, -10.0f);
+    glm::vec3 cameraTarget = glm::vec3(0.0f);
+    float fov = 80.0f;
+    float aperture = 0.0f;
+    float focusDepth = 10.0f;
+    uint32_t width = 1280;
+    uint32_t height = 720;
+    int maxBounces = 8;
+    std::string lightMode;
+    int localWorkers = 0;
+    RenderCoordinatorSettings settings;
+};
+
+static void printUsage(const char *program) {
+    std::cout << "usage: " << program << " coordinator [options]\n"
+              << "  --scene empty|cornell|spheres   preset to load (cornell)\n"
+              << "  --obj PATH                      mesh added to the preset, white Lambertian\n"
+              << "  --camera X,Y,Z                  camera position (0,0,-10)\n"
+              << "  --target X,Y,Z                  point looked at (0,0,0)\n"
+              << "  --fov DEGREES                   vertical field of view (80)\n"
+              << "  --aperture A --focus DEPTH      depth of field (0, 10)\n"
+              << "  --size WxH                      resolution (1280x720)\n"
+              << "  --spp N                         samples per pixel (64)\n"
+              << "  --bounces N                     maximum bounces (8)\n"
+              << "  --light day|sunset|night|empty  sky, defaults to the one of the preset\n"
+              << "  --listen ADDRESS                unix:/path, host:port or :port (unix:/tmp/vkray_render.sock)\n"
+              << "  --tile N                        tile size in pixels (64)\n"
+              << "  --frames-per-job N              samples per pixel of a job (4)\n"
+              << "  --job-timeout SECONDS           silence of a worker holding jobs before they are requeued (120)\n"
+              << "  --local-workers N               worker processes started on this machine (0)\n"
+              << "  --output PATH                   PNG written at the end (distributed_render.png)\n"
+              << "usage: " << program << " worker [options]\n"
+              << "  --connect ADDRESS               address of the coordinator (unix:/tmp/vkray_render.sock)\n"
+              << "  --threads N                     0 uses every core (0)\n"
+              << "  --max-jobs N                    leave after N jobs, to test workers leaving mid-render\n"
+              << "  --timeout SECONDS               time spent waiting for the coordinator (10)" << std::endl;
+}
+
+static bool parseCoordinatorOptions(int argc, char **argv, CoordinatorOptions &options) {
+    for (int i = 2; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h" || i + 1 >= argc) {
+            if (i + 1 >= argc) std::cerr << "[ERROR] Missing value for " << arg << std::endl;
+            return false;
+        }
+        const char *value = argv[++i];
+        bool valid = true;
+        if (arg == "--scene")                   options.scene = value;
+        else if (arg == "--obj")                options.objPath = value;
+        else if (arg == "--output")             options.output = value;
+        else if (arg == "--camera")             valid = parseVec3(value, options.cameraPos);
+        else if (arg == "--target")             valid = parseVec3(value, options.cameraTarget);
+        else if (arg == "--fov")                valid = parseFloat(value, options.fov);
+        else if (arg == "--aperture")           valid = parseFloat(value, options.aperture);
+        else if (arg == "--focus")              valid = parseFloat(value, options.focusDepth);
+        else if (arg == "--size")               valid = parseSize(value, options.width, options.height);
+        else if (arg == "--spp")                valid = parseUint(value, options.settings.frames);
+        else if (arg == "--bounces")            valid = parseInt(value, options.maxBounces);
+        else if (arg == "--light")              options.lightMode = value;
+        else if (arg == "--listen")             options.settings.address = value;
+        else if (arg == "--tile")               valid = parseUint(value, options.settings.tileSize);
+        else if (arg == "--frames-per-job")     valid = parseUint(value, options.settings.framesPerJob);
+        else if (arg == "--job-timeout")        valid = parseDouble(value, options.settings.jobTimeout);
+        else if (arg == "--local-workers")      valid = parseInt(value, options.localWorkers);
+        else {
+            std::cerr << "[ERROR] Unknown option " << arg << std::endl;
+            return false;
+        }
+
+        if (!valid) {
+            std::cerr << "[ERROR] Invalid value for " << arg << ": " << value << std::endl;
+            return false;
+        }
+    }
+
+    if (options.width == 0 || options.height == 0 || options.settings.frames == 0 || options.maxBounces <= 0
+        || options.settings.tileSize == 0 || options.settings.framesPerJob == 0 || options.settings.jobTimeout <= 0.0
+        || options.localWorkers < 0) {
+        std::cerr << "[ERROR] The size, samples per pixel, bounce count, tile size, frames per job and job timeout must be positive" << std::endl;
+        return false;
+    }
+    return checkCameraTarget(options.cameraPos, options.cameraTarget);
+}
+
+static bool parseWorkerOptions(int argc, char **argv, RenderWorkerSettings &settings) {
+    for (int i = 2; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h" || i + 1 >= argc) {
+            if (i + 1 >= argc) std::cerr << "[ERROR] Missing value for " << arg << std::endl;
+            return false;
+        }
+        const char *value = argv[++i];
+        bool valid = true;
+        if (arg == "--connect")         settings.address = value;
+        else if (arg == "--threads")    valid = parseInt(value, settings.threadCount);
+        else if (arg == "--max-jobs")   valid = parseInt(value, settings.maxJobs);
+        else if (arg == "--timeout")    valid = parseDouble(value, settings.connectTimeout);
+        else {
+            std::cerr << "[ERROR] Unknown option " << arg << std::endl;
+            return false;
+        }
+
+        if (!valid) {
+            std::cerr << "[ERROR] Invalid value for " << arg << ": " << value << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Workers started from this executable, sharing the cores of the machine
+static std::vector<pid_t> spawnLocalWorkers(const char *program, const CoordinatorOptions &options) {
+    std::vector<pid_t> children;
+    if (options.localWorkers == 0) return children;
+    const unsigned threads = std::max(resolveThreadCount(0) / static_cast<unsigned>(options.localWorkers), 1u);
+    const std::string threadArg = std::to_string(threads);
+    for (int i = 0; i < options.localWorkers; i++) {
+        const pid_t pid = fork();
+        if (pid == 0) {
+            execl(program, program, "worker", "--connect", options.settings.address.c_str(), "--threads", threadArg.c_str(),
+                  static_cast<char*>(nullptr));
+            std::cerr << "[ERROR] Failed to start a worker from " << program << std::endl;
+            _exit(1);
+        }
+        if (pid > 0) children.push_back(pid);
+    }
+    return children;
+}
+
+static int runCoordinator(int argc, char **argv) {
+    CoordinatorOptions options;
+    if (!parseCoordinatorOptions(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // The engine is never initialized, the scene is headless
+    VkSmol engine;
+    Scene scene;
+    scene.init(engine, true);
+    LightMode lightMode = LightMode::Empty;
+    if (!loadScene(engine, scene, options.scene, options.objPath, options.lightMode, lightMode)) return 1;
+
+    CpuRenderParams params;
+    params.cameraPos = options.cameraPos;
+    params.cameraDir = glm::normalize(options.cameraTarget - options.cameraPos);
+    params.tanHFov = glm::tan(glm::radians(options.fov) * 0.5f);
+    params.aperture = options.aperture;
+    params.focusDepth = options.focusDepth;
+    params.width = options.width;
+    params.height = options.height;
+    params.lightMode = lightMode;
+    params.maxBounces = options.maxBounces;
+    params.samplesPerPixel = 1;
+
+    RenderCoordinator coordinator;
+    if (!coordinator.start(scene, params, options.settings)) return 1;
+    const std::vector<pid_t> children = spawnLocalWorkers(argv[0], options);
+
+    const auto start = std::chrono::steady_clock::now();
+    const bool rendered = coordinator.run();
+    const double renderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    for (pid_t child : children) waitpid(child, nullptr, 0);
+    scene.destroy(engine);
+    if (!rendered) return 1;
+
+    if (!writePngFromFloats(options.output, options.width, options.height, coordinator.getPixels().data())) {
+        std::cerr << "[ERROR] Failed to write " << options.output << std::endl;
+        return 1;
+    }
+    const RenderCoordinatorStats &stats = coordinator.getStats();
+    const double samples = static_cast<double>(options.width) * options.height * options.settings.frames;
+    std::printf("[INFO] %ux%u, %u spp, %d bounces\n", options.width, options.height, options.settings.frames, options.maxBounces);
+    std::printf("[INFO] render %10.1f ms (%.2f Msamples/s)\n", renderMs, samples / (renderMs * 1e3));
+    std::printf("[INFO] %u workers joined, %u left early (%u timed out), %u jobs requeued, %.1f MiB received\n", stats.workersJoined,
+                stats.workersLeft, stats.workersTimedOut, stats.jobsRequeued, stats.bytesReceived / (1024.0 * 1024.0));
+    std::printf("[INFO] Saved %s\n", options.output.c_str());
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const std::string mode = argc > 1 ? argv[1] : "";
+    if (mode == "coordinator") return runCoordinator(argc, argv);
+    if (mode == "worker") {
+        RenderWorkerSettings settings;
+        if (!parseWorkerOptions(argc, argv, settings)) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        return runRenderWorker(settings) ? 0 : 1;
+    }
+    printUsage(argv[0]);
+    return 1;
+}
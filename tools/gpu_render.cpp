@@ -0,0 +1,309 @@
+// Offscreen render of a scene with the `raytracing.glsl` pipeline (`raytracing_compute.glsl` or the `wavefront/` passes
+// with --pipeline), without a window: works on a software driver such as lavapipe. Writes the accumulated image, the
+// frame timings and optionally compares against the CPU renderer.
+// usage: gpu_render [options], see `printUsage`
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <glm/glm.hpp>
+
+#include "tool_utils.hpp"
+#include "../src/cpu/cpu_renderer.hpp"
+#include "../src/gpu/headless_renderer.hpp"
+#include "../src/utils/image.hpp"
+
+struct GpuRenderOptions {
+    std::string scene = "cornell";
+    std::string objPath;
+    std::string output = "gpu_render.png";
+    std::string timingsOutput = "gpu_render.json";
+    std::string referenceOutput;    // CPU image, only written when given
+    glm::vec3 cameraPos = glm::vec3(0.0f, 0.0f, -10.0f);
+    glm::vec3 cameraTarget = glm::vec3(0.0f);
+    float fov = 80.0f;
+    float aperture = 0.0f;
+    float focusDepth = 10.0f;
+    uint32_t width = 640;
+    uint32_t height = 360;
+    int frames = 64;
+    int maxBounces = 8;
+    std::string lightMode;
+    int deviceIndex = -1;
+    bool validation = false;
+    HeadlessPipeline pipeline = HeadlessPipeline::Fragment;
+    int samplesPerPixel = 1;        // Per frame, the wavefront pipeline traces them all in the same passes
+    bool sortHits = true;           // Wavefront only, off to measure the divergence the sorting removes
+    bool pipelineCache = true;
+    bool reference = false;
+    float maxError = -1.0f;         // Fails above this RMSE against the reference, negative only reports it
+};
+
+static void printUsage(const char *program) {
+    std::cout << "usage: " << program << " [options]\n"
+              << "  --scene empty|cornell|spheres   preset to load (cornell)\n"
+              << "  --obj PATH                      mesh added to the preset, white Lambertian\n"
+              << "  --camera X,Y,Z                  camera position (0,0,-10)\n"
+              << "  --target X,Y,Z                  point looked at (0,0,0)\n"
+              << "  --fov DEGREES                   vertical field of view (80)\n"
+              << "  --aperture A --focus DEPTH      depth of field (0, 10)\n"
+              << "  --size WxH                      resolution (640x360)\n"
+              << "  --frames N                      accumulated frames, one sample each (64)\n"
+              << "  --bounces N                     maximum bounces (8)\n"
+              << "  --light day|sunset|night|empty  sky, defaults to the one of the preset\n"
+              << "  --device N                      physical device, listed at startup (first)\n"
+              << "  --validation                    enable the validation layer, fails on its errors\n"
+              << "  --no-pipeline-cache             create the pipelines without the cache of previous runs\n"
+              << "  --pipeline fragment|compute|wavefront  shaders rendering the frames (fragment)\n"
+              << "  --spp N                         samples per pixel of a frame (1)\n"
+              << "  --no-sort                       wavefront: shade the hits in one pass instead of one per material\n"
+              << "  --reference                     also render on the CPU and compare the images\n"
+              << "  --reference-output PATH         PNG of the CPU image\n"
+              << "  --max-error E                   fails when the RMSE against the reference is above E\n"
+              << "  --timings PATH                  JSON of the frame timings (gpu_render.json)\n"
+              << "  --output PATH                   PNG of the GPU image (gpu_render.png)" << std::endl;
+}
+
+static bool parseOptions(int argc, char **argv, GpuRenderOptions &options) {
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") return false;
+        if (arg == "--validation") {
+            options.validation = true;
+            continue;
+        }
+        if (arg == "--no-pipeline-cache") {
+            options.pipelineCache = false;
+            continue;
+        }
+        if (arg == "--no-sort") {
+            options.sortHits = false;
+            continue;
+        }
+        if (arg == "--reference") {
+            options.reference = true;
+            continue;
+        }
+
+        if (i + 1 >= argc) {
+            std::cerr << "[ERROR] Missing value for " << arg << std::endl;
+            return false;
+        }
+        const char *value = argv[++i];
+        bool valid = true;
+        if (arg == "--scene")                   options.scene = value;
+        else if (arg == "--obj")                options.objPath = value;
+        else if (arg == "--output")             options.output = value;
+        else if (arg == "--timings")            options.timingsOutput = value;
+        else if (arg == "--reference-output") {
+            options.referenceOutput = value;
+            options.reference = true;
+        }
+        else if (arg == "--camera")             valid = parseVec3(value, options.cameraPos);
+        else if (arg == "--target")             valid = parseVec3(value, options.cameraTarget);
+        else if (arg == "--fov")                valid = parseFloat(value, options.fov);
+        else if (arg == "--aperture")           valid = parseFloat(value, options.aperture);
+        else if (arg == "--focus")              valid = parseFloat(value, options.focusDepth);
+        else if (arg == "--size")               valid = parseSize(value, options.width, options.height);
+        else if (arg == "--frames")             valid = parseInt(value, options.frames);
+        else if (arg == "--bounces")            valid = parseInt(value, options.maxBounces);
+        else if (arg == "--light")              options.lightMode = value;
+        else if (arg == "--device")             valid = parseInt(value, options.deviceIndex);
+        else if (arg == "--spp")                valid = parseInt(value, options.samplesPerPixel);
+        else if (arg == "--pipeline") {
+            const std::string pipeline = value;
+            if (pipeline == "fragment")         options.pipeline = HeadlessPipeline::Fragment;
+            else if (pipeline == "compute")     options.pipeline = HeadlessPipeline::Compute;
+            else if (pipeline == "wavefront")   options.pipeline = HeadlessPipeline::Wavefront;
+            else valid = false;
+        }
+        else if (arg == "--max-error") {
+            valid = parseFloat(value, options.maxError);
+            options.reference = true;
+        }
+        else {
+            std::cerr << "[ERROR] Unknown option " << arg << std::endl;
+            return false;
+        }
+
+        if (!valid) {
+            std::cerr << "[ERROR] Invalid value for " << arg << ": " << value << std::endl;
+            return false;
+        }
+    }
+
+    if (options.width == 0 || options.height == 0 || options.frames <= 0 || options.maxBounces <= 0 || options.samplesPerPixel <= 0) {
+        std::cerr << "[ERROR] The size, frame, bounce and sample counts must be positive" << std::endl;
+        return false;
+    }
+    return checkCameraTarget(options.cameraPos, options.cameraTarget);
+}
+
+static double percentile(std::vector<double> values, double p) {
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    const size_t index = static_cast<size_t>(std::round(p * (values.size() - 1)));
+    return values[std::min(index, values.size() - 1)];
+}
+
+static const char* pipelineName(HeadlessPipeline pipeline) {
+    switch (pipeline) {
+        case HeadlessPipeline::Compute:     return "compute";
+        case HeadlessPipeline::Wavefront:   return "wavefront";
+        default:                            return "fragment";
+    }
+}
+
+static std::string toJson(const GpuRenderOptions &options, const HeadlessGpuRenderer &renderer) {
+    std::vector<double> wallMs, gpuMs;
+    for (const HeadlessFrameTiming &timing : renderer.getFrameTimings()) {
+        wallMs.push_back(timing.wallMs);
+        if (timing.gpuMs >= 0.0) gpuMs.push_back(timing.gpuMs);
+    }
+    double totalMs = 0.0;
+    for (double ms : wallMs) totalMs += ms;
+    const double samples = static_cast<double>(options.width) * options.height * options.samplesPerPixel * wallMs.size();
+
+    std::ostringstream out;
+    out.precision(6);
+    out << "{\n"
+        << "  \"device\": \"" << renderer.getDeviceName() << "\",\n"
+        << "  \"pipeline\": \"" << pipelineName(options.pipeline) << "\",\n"
+        << "  \"scene\": \"" << options.scene << "\",\n"
+        << "  \"width\": " << options.width << ",\n"
+        << "  \"height\": " << options.height << ",\n"
+        << "  \"frames\": " << wallMs.size() << ",\n"
+        << "  \"samplesPerPixel\": " << options.samplesPerPixel << ",\n"
+        << "  \"sortHits\": " << (options.sortHits ? "true" : "false") << ",\n"
+        << "  \"shadeBranchesPerGroup\": " << renderer.getShadeBranchesPerGroup() << ",\n"
+        << "  \"maxBounces\": " << options.maxBounces << ",\n"
+        << "  \"pipelineCache\": " << (options.pipelineCache ? "true" : "false") << ",\n"
+        << "  \"pipelineMs\": " << renderer.getPipelineMs() << ",\n"
+        << "  \"samplesPerSecond\": " << (totalMs > 0.0 ? samples / (totalMs * 1e-3) : 0.0) << ",\n"
+        << "  \"p50Ms\": " << percentile(wallMs, 0.5) << ",\n"
+        << "  \"p99Ms\": " << percentile(wallMs, 0.99) << ",\n"
+        << "  \"gpuP50Ms\": " << (gpuMs.empty() ? -1.0 : percentile(gpuMs, 0.5)) << ",\n"
+        << "  \"frameMs\": [";
+    for (size_t i = 0; i < wallMs.size(); i++) out << (i == 0 ? "" : ", ") << wallMs[i];
+    out << "],\n  \"gpuFrameMs\": [";
+    for (size_t i = 0; i < gpuMs.size(); i++) out << (i == 0 ? "" : ", ") << gpuMs[i];
+    out << "]\n}\n";
+    return out.str();
+}
+
+int main(int argc, char **argv) {
+    GpuRenderOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // The engine is never initialized, the scene is headless and keeps its buffers on the host
+    VkSmol engine;
+    Scene scene;
+    scene.init(engine, true);
+    LightMode lightMode = LightMode::Empty;
+    if (!loadScene(engine, scene, options.scene, options.objPath, options.lightMode, lightMode)) return 1;
+
+    CpuRenderParams params;
+    params.cameraPos = options.cameraPos;
+    params.cameraDir = glm::normalize(options.cameraTarget - options.cameraPos);
+    params.tanHFov = glm::tan(glm::radians(options.fov) * 0.5f);
+    params.aperture = options.aperture;
+    params.focusDepth = options.focusDepth;
+    params.width = options.width;
+    params.height = options.height;
+    params.lightMode = lightMode;
+    params.maxBounces = options.maxBounces;
+    params.samplesPerPixel = options.samplesPerPixel;
+
+    HeadlessGpuRenderer renderer;
+    const HeadlessGpuOptions gpuOptions = { .deviceIndex=options.deviceIndex, .validation=options.validation, .pipeline=options.pipeline,
+                                           .sortHits=options.sortHits, .usePipelineCache=options.pipelineCache };
+    if (!renderer.init(gpuOptions) || !renderer.setScene(engine, scene) || !renderer.setParams(params)) return 1;
+
+    const auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < options.frames; frame++) {
+        if (!renderer.renderFrame()) return 1;
+    }
+    const double renderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<float> pixels;
+    if (!renderer.readPixels(pixels)) return 1;
+    if (!writePngFromFloats(options.output, options.width, options.height, pixels.data())) {
+        std::cerr << "[ERROR] Failed to write " << options.output << std::endl;
+        return 1;
+    }
+    std::ofstream file(options.timingsOutput);
+    file << toJson(options, renderer);
+    if (!file) {
+        std::cerr << "[ERROR] Failed to write " << options.timingsOutput << std::endl;
+        return 1;
+    }
+
+    const double samples = static_cast<double>(options.width) * options.height * options.samplesPerPixel * options.frames;
+    std::printf("[INFO] %s, %s pipeline, %ux%u, %d frames of %d spp, %d bounces\n", renderer.getDeviceName().c_str(),
+                pipelineName(options.pipeline), options.width, options.height, options.frames, options.samplesPerPixel,
+                options.maxBounces);
+    std::printf("[INFO] pipelines %7.1f ms (%s)\n", renderer.getPipelineMs(), options.pipelineCache ? "cached" : "no cache");
+    std::printf("[INFO] render %10.1f ms (%.2f Msamples/s)\n", renderMs, samples / (renderMs * 1e3));
+    if (options.pipeline == HeadlessPipeline::Wavefront) {
+        std::printf("[INFO] hits %s, %.2f material branches per shading workgroup\n", options.sortHits ? "sorted" : "unsorted",
+                    renderer.getShadeBranchesPerGroup());
+    }
+    std::printf("[INFO] Saved %s and %s\n", options.output.c_str(), options.timingsOutput.c_str());
+
+    int status = 0;
+    if (options.validation && renderer.getValidationErrorCount() > 0) {
+        std::cerr << "[ERROR] " << renderer.getValidationErrorCount() << " validation errors" << std::endl;
+        status = 1;
+    }
+
+    // Both integrators are noisy, the errors shrink with the frame count unless the shader and its port disagree.
+    // The shader also drops its first frame (the low resolution preview), so the images are never bit identical
+    if (options.reference) {
+        CpuRenderer cpuRenderer;
+        cpuRenderer.setParams(params);
+        cpuRenderer.setScene(scene);
+        for (int frame = 0; frame < options.frames; frame++) cpuRenderer.renderFrame();
+        const std::vector<float> &reference = cpuRenderer.getPixels();
+
+        double absError = 0.0, squaredError = 0.0, gpuMean = 0.0, cpuMean = 0.0;
+        size_t count = 0;
+        for (size_t i = 0; i < pixels.size(); i += 4) {
+            for (size_t c = 0; c < 3; c++) {
+                const double difference = static_cast<double>(pixels[i + c]) - reference[i + c];
+                absError += std::abs(difference);
+                squaredError += difference * difference;
+                gpuMean += pixels[i + c];
+                cpuMean += reference[i + c];
+                count++;
+            }
+        }
+        const double rmse = std::sqrt(squaredError / count);
+        std::printf("[INFO] Against the CPU: mean abs error %.5f, RMSE %.5f, mean %.5f (GPU) / %.5f (CPU)\n",
+                    absError / count, rmse, gpuMean / count, cpuMean / count);
+
+        if (!options.referenceOutput.empty()) {
+            if (!writePngFromFloats(options.referenceOutput, options.width, options.height, reference.data())) {
+                std::cerr << "[ERROR] Failed to write " << options.referenceOutput << std::endl;
+                return 1;
+            }
+            std::printf("[INFO] Saved %s\n", options.referenceOutput.c_str());
+        }
+        if (options.maxError >= 0.0f && rmse > options.maxError) {
+            std::cerr << "[ERROR] RMSE " << rmse << " above " << options.maxError << std::endl;
+            status = 1;
+        }
+    }
+
+    scene.destroy(engine);
+    return status;
+}
@@ -0,0 +1,189 @@
+// Offline render of a scene to a PNG on the CPU, without a window or a GPU
+// usage: render [options], see `printUsage`
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <glm/glm.hpp>
+
+#include "tool_utils.hpp"
+#include "../src/cpu/cpu_renderer.hpp"
+#include "../src/utils/image.hpp"
+#include "../src/utils/parallel.hpp"
+
+struct RenderOptions {
+    std::string scene = "cornell";
+    std::string objPath;
+    std::string output = "render.png";
+    glm::vec3 cameraPos = glm::vec3(0.0f, 0.0f, -10.0f);
+    glm::vec3 cameraTarget = glm::vec3(0.0f);
+    float fov = 80.0f;
+    float aperture = 0.0f;
+    float focusDepth = 10.0f;
+    uint32_t width = 1280;
+    uint32_t height = 720;
+    int samplesPerPixel = 256;
+    int maxBounces = 8;
+    int threadCount = 0;
+    std::string lightMode;      // Empty keeps the one of the preset
+    bool meshCache = true;
+    bool rayPackets = true;
+    bool verbose = false;
+};
+
+static void printUsage(const char *program) {
+    std::cout << "usage: " << program << " [options]\n"
+              << "  --scene empty|cornell|spheres   preset to load (cornell)\n"
+              << "  --obj PATH                      mesh added to the preset, white Lambertian\n"
+              << "  --camera X,Y,Z                  camera position (0,0,-10)\n"
+              << "  --target X,Y,Z                  point looked at (0,0,0)\n"
+              << "  --fov DEGREES                   vertical field of view (80)\n"
+              << "  --aperture A --focus DEPTH      depth of field (0, 10)\n"
+              << "  --size WxH                      resolution (1280x720)\n"
+              << "  --spp N                         samples per pixel (256)\n"
+              << "  --bounces N                     maximum bounces (8)\n"
+              << "  --light day|sunset|night|empty  sky, defaults to the one of the preset\n"
+              << "  --threads N                     0 uses every core (0)\n"
+              << "  --no-mesh-cache                 always rebuild the mesh BVHs\n"
+              << "  --no-packets                    trace the primary rays one by one\n"
+              << "  --verbose                       report the BVH of every mesh\n"
+              << "  --output PATH                   PNG written at the end (render.png)" << std::endl;
+}
+
+static bool parseOptions(int argc, char **argv, RenderOptions &options) {
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") return false;
+        if (arg == "--no-mesh-cache") {
+            options.meshCache = false;
+            continue;
+        }
+        if (arg == "--no-packets") {
+            options.rayPackets = false;
+            continue;
+        }
+        if (arg == "--verbose") {
+            options.verbose = true;
+            continue;
+        }
+
+        if (i + 1 >= argc) {
+            std::cerr << "[ERROR] Missing value for " << arg << std::endl;
+            return false;
+        }
+        const char *value = argv[++i];
+        bool valid = true;
+        if (arg == "--scene")           options.scene = value;
+        else if (arg == "--obj")        options.objPath = value;
+        else if (arg == "--output")     options.output = value;
+        else if (arg == "--camera")     valid = parseVec3(value, options.cameraPos);
+        else if (arg == "--target")     valid = parseVec3(value, options.cameraTarget);
+        else if (arg == "--fov")        valid = parseFloat(value, options.fov);
+        else if (arg == "--aperture")   valid = parseFloat(value, options.aperture);
+        else if (arg == "--focus")      valid = parseFloat(value, options.focusDepth);
+        else if (arg == "--size")       valid = parseSize(value, options.width, options.height);
+        else if (arg == "--spp")        valid = parseInt(value, options.samplesPerPixel);
+        else if (arg == "--bounces")    valid = parseInt(value, options.maxBounces);
+        else if (arg == "--threads")    valid = parseInt(value, options.threadCount);
+        else if (arg == "--light")      options.lightMode = value;
+        else {
+            std::cerr << "[ERROR] Unknown option " << arg << std::endl;
+            return false;
+        }
+
+        if (!valid) {
+            std::cerr << "[ERROR] Invalid value for " << arg << ": " << value << std::endl;
+            return false;
+        }
+    }
+
+    if (options.width == 0 || options.height == 0 || options.samplesPerPixel <= 0 || options.maxBounces <= 0) {
+        std::cerr << "[ERROR] The size, samples per pixel and bounce count must be positive" << std::endl;
+        return false;
+    }
+    return checkCameraTarget(options.cameraPos, options.cameraTarget);
+}
+
+static double elapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv) {
+    RenderOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // The engine is never initialized, the scene is headless
+    VkSmol engine;
+    Scene scene;
+    scene.init(engine, true);
+    scene.setMeshCacheEnabled(options.meshCache);
+    scene.setVerbose(options.verbose);
+
+    auto start = std::chrono::steady_clock::now();
+    LightMode lightMode = LightMode::Empty;
+    if (!loadScene(engine, scene, options.scene, options.objPath, options.lightMode, lightMode)) return 1;
+    const double loadMs = elapsedMs(start);
+
+    start = std::chrono::steady_clock::now();
+    CpuRenderParams params;
+    params.cameraPos = options.cameraPos;
+    params.cameraDir = glm::normalize(options.cameraTarget - options.cameraPos);
+    params.tanHFov = glm::tan(glm::radians(options.fov) * 0.5f);
+    params.aperture = options.aperture;
+    params.focusDepth = options.focusDepth;
+    params.width = options.width;
+    params.height = options.height;
+    params.lightMode = lightMode;
+    params.maxBounces = options.maxBounces;
+    params.samplesPerPixel = 1;     // One sample per frame, like the render mode of the window
+    params.rayPackets = options.rayPackets;
+
+    CpuRenderer renderer;
+    renderer.setThreadCount(options.threadCount);
+    renderer.setParams(params);
+    renderer.setScene(scene);
+    const double packMs = elapsedMs(start);
+
+    // Load balance summed over the frames
+    double busyMs = 0.0, availableMs = 0.0;
+    uint64_t steals = 0, tiles = 0;
+    start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < options.samplesPerPixel; frame++) {
+        renderer.renderFrame();
+        const TileSchedulerStats &stats = renderer.getSchedulerStats();
+        busyMs += stats.getUtilization() * stats.wallMs * stats.threads.size();
+        availableMs += stats.wallMs * stats.threads.size();
+        steals += stats.getSteals();
+        tiles += stats.tileCount;
+    }
+    const double renderMs = elapsedMs(start);
+
+    start = std::chrono::steady_clock::now();
+    if (!writePngFromFloats(options.output, options.width, options.height, renderer.getPixels().data())) {
+        std::cerr << "[ERROR] Failed to write " << options.output << std::endl;
+        return 1;
+    }
+    const double writeMs = elapsedMs(start);
+
+    const double samples = static_cast<double>(options.width) * options.height * options.samplesPerPixel;
+    std::printf("[INFO] %ux%u, %d spp, %d bounces, %u threads\n",
+                options.width, options.height, options.samplesPerPixel, options.maxBounces, resolveThreadCount(options.threadCount));
+    std::printf("[INFO] load   %10.1f ms\n", loadMs);
+    std::printf("[INFO] pack   %10.1f ms\n", packMs);
+    std::printf("[INFO] render %10.1f ms (%.2f Msamples/s)\n", renderMs, samples / (renderMs * 1e3));
+    std::printf("[INFO] write  %10.1f ms\n", writeMs);
+    std::printf("[INFO] %.1f%% utilization, %llu/%llu tiles stolen, last tile sizes %u-%u\n",
+                availableMs > 0.0 ? 100.0 * busyMs / availableMs : 0.0, static_cast<unsigned long long>(steals),
+                static_cast<unsigned long long>(tiles),
+                renderer.getSchedulerStats().minTileSize, renderer.getSchedulerStats().maxTileSize);
+    std::printf("[INFO] Saved %s\n", options.output.c_str());
+
+    scene.destroy(engine);
+    return 0;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+
+#include <glm/glm.hpp>
+
+#include "../src/scene/scene_preset.hpp"
+
+// Helpers shared by the command line tools
+
+// The parsers only accept the whole argument, trailing characters and out of range values are rejected
+static inline bool parseVec3(const char *text, glm::vec3 &value) {
+    int length = 0;
+    glm::vec3 parsed;
+    if (std::sscanf(text, "%f,%f,%f%n", &parsed.x, &parsed.y, &parsed.z, &length) != 3 || text[length] != '\0') return false;
+    if (!std::isfinite(parsed.x) || !std::isfinite(parsed.y) || !std::isfinite(parsed.z)) return false;
+    value = parsed;
+    return true;
+}
+
+static inline bool parseDouble(const char *text, double &value) {
+    char *end = nullptr;
+    errno = 0;
+    const double parsed = std::strtod(text, &end);
+    if (end == text || *end != '\0' || errno == ERANGE || !std::isfinite(parsed)) return false;
+    value = parsed;
+    return true;
+}
+
+static inline bool parseFloat(const char *text, float &value) {
+    double parsed;
+    if (!parseDouble(text, parsed) || std::fabs(parsed) > std::numeric_limits<float>::max()) return false;
+    value = static_cast<float>(parsed);
+    return true;
+}
+
+static inline bool parseInt(const char *text, int &value) {
+    char *end = nullptr;
+    errno = 0;
+    const long parsed = std::strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE
+        || parsed < std::numeric_limits<int>::min() || parsed > std::numeric_limits<int>::max()) return false;
+    value = static_cast<int>(parsed);
+    return true;
+}
+
+// `strtoul` silently wraps negative values around, so they are rejected first
+static inline bool parseUint(const char *text, uint32_t &value) {
+    int parsed;
+    if (!parseInt(text, parsed) || parsed < 0) return false;
+    value = static_cast<uint32_t>(parsed);
+    return true;
+}
+
+// WxH, e.g. 1280x720
+static inline bool parseSize(const char *text, uint32_t &width, uint32_t &height) {
+    const char *separator = std::strchr(text, 'x');
+    if (!separator) return false;
+    const std::string widthText(text, separator);
+    uint32_t parsedWidth, parsedHeight;
+    if (!parseUint(widthText.c_str(), parsedWidth) || !parseUint(separator + 1, parsedHeight)) return false;
+    width = parsedWidth;
+    height = parsedHeight;
+    return true;
+}
+
+// The view direction is normalized, a target on the camera would give NaN everywhere
+static inline bool checkCameraTarget(const glm::vec3 &cameraPos, const glm::vec3 &cameraTarget) {
+    if (glm::length(cameraTarget - cameraPos) > 1e-6f) return true;
+    std::cerr << "[ERROR] The camera target must differ from the camera position" << std::endl;
+    return false;
+}
+
+static inline bool parseLightMode(const std::string &name, LightMode &lightMode) {
+    if (name == "day")         lightMode = LightMode::Day;
+    else if (name == "sunset") lightMode = LightMode::Sunset;
+    else if (name == "night")  lightMode = LightMode::Night;
+    else if (name == "empty")  lightMode = LightMode::Empty;
+    else return false;
+    return true;
+}
+
+// Preset, optional OBJ as a white Lambertian mesh and optional light mode overriding the one of the preset
+static inline bool loadScene(VkSmol &engine, Scene &scene, const std::string &preset, const std::string &objPath,
+                             const std::string &lightName, LightMode &lightMode) {
+    if (preset == "empty")        initEmpty(engine, scene, lightMode);
+    else if (preset == "cornell") initCornellBox(engine, scene, lightMode);
+    else if (preset == "spheres") initRandomSpheres(engine, scene, lightMode);
+    else {
+        std::cerr << "[ERROR] Unknown scene " << preset << std::endl;
+        return false;
+    }
+
+    if (!objPath.empty()) {
+        const Material material = { .type=MaterialType::Lambertian, .albedo={ 1.0f, 1.0f, 1.0f }, .payload={ 0.0f, 0.0f } };
+        if (!scene.pushMeshFromObj(engine, objPath, objPath, material)) {
+            std::cerr << "[ERROR] Failed to load " << objPath << std::endl;
+            return false;
+        }
+    }
+
+    if (!lightName.empty() && !parseLightMode(lightName, lightMode)) {
+        std::cerr << "[ERROR] Unknown light mode " << lightName << std::endl;
+        return false;
+    }
+    return true;
+}